@@ -26,6 +26,16 @@ extern "C" {
 */
 typedef bool (*papuga_ClassMethod)( void* self, papuga_CallResult* retval, size_t argc, const papuga_ValueVariant* argv);
 /*
+* @brief Batched class method function type, executing a sequence of calls of the same method on the same object with one invocation
+* @param[in] self pointer to data object
+* @param[out] retvalar array of call result structures, one per call
+* @param[in] nofcalls number of calls
+* @param[in] argcar array with the number of arguments passed per call
+* @param[in] argvar array with the pointers to the arrays of arguments passed per call
+* @return the number of calls executed successfully in order, a value smaller than nofcalls reports the failure of the call with this index, with the error in its call result
+*/
+typedef size_t (*papuga_ClassMethodBatch)( void* self, papuga_CallResult* retvalar, size_t nofcalls, const size_t* argcar, const papuga_ValueVariant* const* argvar);
+/*
 * @brief Class constructor function type
 * @param[out] errbuf buffer for error messages
 * @param[in] argc number of arguments passed
@@ -38,6 +48,21 @@ typedef void* (*papuga_ClassConstructor)( papuga_ErrorBuffer* errbuf, size_t arg
 * @param[in] self pointer to data object to destroy
 */
 typedef void (*papuga_ClassDestructor)( void* self);
+/*
+* @brief Class serialize function type, writing the state of an object needed to recreate it with the deserialize function of the class
+* @param[in] self pointer to data object
+* @param[out] dest serialization to append the state of the object to
+* @param[out] errcode error code in case of error
+* @return true on success, false on error
+*/
+typedef bool (*papuga_ClassSerialize)( const void* self, papuga_Serialization* dest, papuga_ErrorCode* errcode);
+/*
+* @brief Class deserialize function type, recreating an object from its state written by the serialize function of the class
+* @param[out] errbuf buffer for error messages
+* @param[in] src serialization of the state of the object
+* @return pointer to data of object created, to be destroyed with the destructor of the class
+*/
+typedef void* (*papuga_ClassDeserialize)( papuga_ErrorBuffer* errbuf, const papuga_Serialization* src);
 
 /*
 * @brief Structure defining a class
@@ -50,9 +75,12 @@ typedef struct papuga_ClassDef
 	const papuga_ClassMethod* methodtable;			/*< method table of the class */
 	const char** methodnames;				/*< method names of the class, array parallel to 'methodtable' */
 	int methodtablesize;					/*< number of functions defined in the method table and the array of method names of the class */
+	const papuga_ClassMethodBatch* batchmethodtable;	/*< optional batched methods of the class, array parallel to 'methodtable' with NULL for methods without, NULL if the class has no batched methods */
+	papuga_ClassSerialize serialize;			/*< optional function writing the state of an object of the class for a snapshot of contexts, NULL if not supported */
+	papuga_ClassDeserialize deserialize;			/*< optional function recreating an object of the class from a snapshot of contexts, NULL if not supported */
 } papuga_ClassDef;
 
-#define papuga_ClassDef_NULL	{0,0,0,0,0,0}
+#define papuga_ClassDef_NULL	{0,0,0,0,0,0,0,0,0}
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _PAPUGA_FILE_CONTENT_H_INCLUDED
+#define _PAPUGA_FILE_CONTENT_H_INCLUDED
+/*
+* @brief Read only access to the content of a file for passing it to the parsers without copying it
+* @file fileContent.h
+*/
+#include "papuga/typedefs.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* @brief Content of a file, mapped into memory or read into a buffer if the file cannot be mapped (pipe, character device)
+* @note The content is always null terminated, so it can be passed to the parsers in borrowed buffer mode
+*/
+typedef struct papuga_FileContent
+{
+	const char* ptr;			/*< pointer to the content */
+	size_t size;				/*< size of the content in bytes (without the null termination) */
+	void* mapbase;				/*< base address of the mapping, NULL if the content was read into buf */
+	size_t mapsize;				/*< size of the mapping in bytes */
+	char* buf;				/*< buffer allocated for content read, NULL if the content is mapped */
+} papuga_FileContent;
+
+/*
+* @brief Map or read the content of a file
+* @param[out] self pointer to structure initialized
+* @param[in] path path of the file
+* @param[out] errcode error code in case of error (papuga_FileReadError with errno set, or papuga_NoMemError)
+* @return true on success, false on error
+*/
+bool papuga_init_FileContent( papuga_FileContent* self, const char* path, papuga_ErrorCode* errcode);
+
+/*
+* @brief Release the content of a file
+* @param[in] self pointer to structure
+*/
+void papuga_destroy_FileContent( papuga_FileContent* self);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
@@ -300,6 +300,74 @@ bool papuga_RequestAutomaton_has_exclusive_access( const papuga_RequestAutomaton
  */
 bool papuga_RequestAutomaton_done( papuga_RequestAutomaton* self);
 
+/*
+ * @brief Evaluate if the calls of requests of an automaton can be executed while the request is fed (see papuga_create_RequestIterator_streaming)
+ * @param[in] self automaton completed with papuga_RequestAutomaton_done
+ * @return true, if all calls belong to one group, no call is prioritized, no argument or structure member is resolved as inherited, no result refers to a call result and no context is inherited
+ */
+bool papuga_RequestAutomaton_is_streamable( const papuga_RequestAutomaton* self);
+
+/*
+ * @brief Get the binary image of an automaton for loading it with papuga_load_RequestAutomaton, e.g. at process startup without interpreting its schema description
+ * @param[in] self automaton completed with papuga_RequestAutomaton_done
+ * @param[out] imagesize size of the image in bytes
+ * @param[out] errcode error code in case of an error (papuga_ExecutionOrder if the automaton is not completed)
+ * @return pointer to the image owned by the automaton or NULL in case of an error
+ * @note The image is a log of the calls building the automaton, built when the automaton is completed
+ * @note The image does not contain pointers, it can be written to a file and loaded from any address (e.g. a memory mapped file), it is not portable between versions of this library
+ */
+const void* papuga_RequestAutomaton_save( const papuga_RequestAutomaton* self, size_t* imagesize, papuga_ErrorCode* errcode);
+
+/*
+ * @brief Create a completed automaton from an image got with papuga_RequestAutomaton_save
+ * @param[in] classdefs class definitions referred to in host object references (the same as of the automaton saved)
+ * @param[in] structdefs structure definitions (the same as of the automaton saved)
+ * @param[in] image pointer to the image
+ * @param[in] imagesize size of the image in bytes
+ * @param[out] errcode error code in case of an error (papuga_SyntaxError if the image is corrupt)
+ * @return the automaton, completed and not referring to the image, or NULL in case of an error
+ * @remark Loading replays the calls recorded in the image on a new automaton and compiles the select expressions again, it only spares the interpretation of the schema description
+ */
+papuga_RequestAutomaton* papuga_load_RequestAutomaton(
+		const papuga_ClassDef* classdefs,
+		const papuga_StructInterfaceDescription* structdefs,
+		const void* image,
+		size_t imagesize,
+		papuga_ErrorCode* errcode);
+
+/*
+ * @brief Node of the dependency graph of the calls of an automaton
+ * @remark Calls are executed ordered by group and in document order within a group
+ */
+typedef struct papuga_RequestCallNode
+{
+	papuga_RequestMethodId methodid;		/*< method called, classid 0 for a variable assignment, functionid 0 for a constructor */
+	const char* selfvarname;			/*< name of the variable with the object called or NULL */
+	const char* resultvarname;			/*< name of the variable assigned with the result or NULL */
+	int groupid;					/*< group of the call, groups with a lower id are executed first */
+	int nofproducers;				/*< number of calls this call depends on */
+	const int* producers;				/*< indices of the calls of the same or an earlier group assigning a variable this call may read */
+	int nofconsumers;				/*< number of calls depending on this call */
+	const int* consumers;				/*< indices of the calls depending on this call */
+	bool resultunused;				/*< true if the result is assigned to a local variable (starting with '_') not read by any call or result, the call is dead if the method has no side effects */
+} papuga_RequestCallNode;
+
+/*
+ * @brief Get the number of calls defined in an automaton
+ * @param[in] self automaton
+ * @return the number of calls, 0 if the automaton is not completed with papuga_RequestAutomaton_done
+ */
+int papuga_RequestAutomaton_nof_calls( const papuga_RequestAutomaton* self);
+
+/*
+ * @brief Get the node of a call in the dependency graph of the calls, computed by papuga_RequestAutomaton_done
+ * @param[in] self automaton
+ * @param[in] callidx index of the call in the order of definition starting with 0
+ * @return pointer to the node or NULL if callidx is out of range or the automaton not completed
+ * @note Variables of structures are counted as read by every call with an argument resolved from the content
+ */
+const papuga_RequestCallNode* papuga_RequestAutomaton_get_call_node( const papuga_RequestAutomaton* self, int callidx);
+
 
 /*
  * @brief Create a request structure to feed with content to get a translated request
@@ -436,16 +504,26 @@ typedef struct papuga_RequestError
 */
 void papuga_init_RequestError( papuga_RequestError* self);
 
+/*
+ * @brief Arguments of one method call provided by the request
+ */
+typedef struct papuga_RequestMethodArgs
+{
+	size_t argc;					/*< number of arguments passed to call */
+	papuga_ValueVariant* argv;			/*< argument list, allocated by the iterator for the maximum number of arguments of the calls in the automaton */
+} papuga_RequestMethodArgs;
+
 /*
  * @brief Describes one method call provided by the request
+ * @note The structure and the arguments referenced are valid until the next call of the iterator
  */
 typedef struct papuga_RequestMethodCall
 {
 	const char* selfvarname;			/*< variable referencing the object for the method call */
 	const char* resultvarname;			/*< variable where to write the result to */
 	papuga_RequestMethodId methodid;		/*< method identifier if defined */
-	papuga_CallArgs args;				/*< arguments of the call */
-	char membuf[ 4096];				/*< local memory buffer for allocator */
+	papuga_RequestMethodArgs args;			/*< arguments of the call */
+	int callidx;					/*< index of the call in the request, for declaring its result with papuga_RequestIterator_push_call_result_at */
 } papuga_RequestMethodCall;
 
 /*
@@ -462,6 +540,17 @@ typedef struct papuga_RequestIterator papuga_RequestIterator;
  */
 papuga_RequestIterator* papuga_create_RequestIterator( papuga_Allocator* allocator, const papuga_Request* request, papuga_ErrorCode* errcode);
 
+/*
+ * @brief Create an iterator on the method calls of a request still fed with content, returning the calls as soon as their scope is closed
+ * @param[in] allocator for memory allocation for the iterator
+ * @param[in] request request object to get the iterator on the request method calls, the iterator has to be destroyed before the request
+ * @param[out] errcode error code in case NULL is returned, papuga_NotAllowed if the automaton of the request is not streamable
+ * @return the iterator in case of success, or NULL in case of an error
+ * @remark papuga_RequestIterator_next_call returns NULL without error if no call is ready until more content is fed or the request is completed with papuga_Request_done
+ * @remark The result array is only available after papuga_Request_done and all calls have been fetched
+ */
+papuga_RequestIterator* papuga_create_RequestIterator_streaming( papuga_Allocator* allocator, papuga_Request* request, papuga_ErrorCode* errcode);
+
 /*
  * @brief Destructor of an iterator on the method calls of a closed request
  * @param[in] self request iterator to destroy
@@ -482,6 +571,24 @@ const papuga_RequestMethodCall* papuga_RequestIterator_next_call( papuga_Request
  */
 bool papuga_RequestIterator_push_call_result( papuga_RequestIterator* self, const papuga_ValueVariant* result);
 
+/*
+ * @brief Declare the value of a call fetched before, for calls executed out of the order of the iterator
+ * @param[in] self request iterator the call was fetched from
+ * @param[in] callidx index of the call (papuga_RequestMethodCall::callidx)
+ * @param[in] resultvarname result variable of the call
+ * @param[in] result value of the call
+ * @return true if the result was used, false else
+ */
+bool papuga_RequestIterator_push_call_result_at( papuga_RequestIterator* self, int callidx, const char* resultvarname, const papuga_ValueVariant* result);
+
+/*
+ * @brief Evaluate if the arguments of the next method call of a request are resolved from variables of the request context
+ * @note Used for scheduling calls executed in parallel: The variables read have to be assigned before fetching the call
+ * @param[in] self request iterator to inspect
+ * @return true, if the next call may read variables of the context, false if not or if there is no next call
+ */
+bool papuga_RequestIterator_next_call_reads_context( const papuga_RequestIterator* self);
+
 /*
  * @brief Get the list of all non empty results of a request, without content of variables (contentvar) attached to the result serialization yet
  * @note Empty result means that it was not created at all, not an empty content returned with the result)
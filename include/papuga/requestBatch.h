@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _PAPUGA_REQUEST_BATCH_H_INCLUDED
+#define _PAPUGA_REQUEST_BATCH_H_INCLUDED
+/*
+* @brief Parsing of a batch of independent request documents (JSON lines or concatenated XML) in parallel
+* @file requestBatch.h
+*/
+#include "papuga/typedefs.h"
+#include "papuga/request.h"
+#include "papuga/requestLogger.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* @brief Result of parsing one document of a batch
+*/
+typedef struct papuga_RequestBatchItem
+{
+	papuga_Request* request;		/*< request fed with the document, NULL in case of an error or if released */
+	papuga_ErrorCode errcode;		/*< error code of the document, papuga_Ok on success */
+	int erritemid;				/*< item identifier of the error reported by the request or -1 */
+	size_t docpos;				/*< start of the document in bytes in the UTF-8 content of the batch */
+	size_t docsize;				/*< size of the document in bytes */
+} papuga_RequestBatchItem;
+
+/*
+* @brief Batch of requests parsed
+*/
+typedef struct papuga_RequestBatch papuga_RequestBatch;
+
+/*
+* @brief Split a batch of documents at the document boundaries and parse each document into its own request
+* @param[in] atm automaton of the requests (must be completed with papuga_RequestAutomaton_done)
+* @param[in] logger logger for the requests, called from all worker threads, so it must be thread safe, or NULL
+* @param[in] doctype content type of all documents in the batch (newline delimited or concatenated JSON or concatenated XML documents)
+* @param[in] encoding character set encoding of the batch, converted to UTF-8 before splitting it if not UTF-8
+* @param[in] content pointer to the batch content
+* @param[in] size size of the batch content in bytes
+* @param[in] limits limits applied to each document or NULL for default limits
+* @param[in] nofThreads maximum number of worker threads to use, 0 for the number of cores available
+* @param[out] errcode error code in case of an error of the batch as a whole
+* @return the batch with the results in input order or NULL in case of error
+* @note Errors of a single document are reported in the item of the document and do not affect the other documents
+*/
+papuga_RequestBatch* papuga_create_RequestBatch(
+		const papuga_RequestAutomaton* atm,
+		papuga_RequestLogger* logger,
+		papuga_ContentType doctype,
+		papuga_StringEncoding encoding,
+		const char* content, size_t size,
+		const papuga_ContentLimits* limits,
+		int nofThreads,
+		papuga_ErrorCode* errcode);
+
+/*
+* @brief Destroy a batch and all requests not released
+* @param[in] self batch to destroy
+*/
+void papuga_destroy_RequestBatch( papuga_RequestBatch* self);
+
+/*
+* @brief Get the number of documents in a batch
+* @param[in] self batch to query
+* @return the number of documents
+*/
+int papuga_RequestBatch_size( const papuga_RequestBatch* self);
+
+/*
+* @brief Get the result of parsing a document of a batch
+* @param[in] self batch to query
+* @param[in] idx index of the document in input order starting with 0
+* @return pointer to the item or NULL if idx is out of range
+*/
+const papuga_RequestBatchItem* papuga_RequestBatch_get( const papuga_RequestBatch* self, int idx);
+
+/*
+* @brief Take the ownership of a request parsed from a batch
+* @param[in] self batch to release the request from
+* @param[in] idx index of the document in input order starting with 0
+* @return the request, to be destroyed by the caller with papuga_destroy_Request, or NULL if not available
+*/
+papuga_Request* papuga_RequestBatch_release_request( papuga_RequestBatch* self, int idx);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
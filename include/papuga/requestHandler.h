@@ -51,6 +51,48 @@ papuga_RequestContext* papuga_create_RequestContext();
  */
 void papuga_destroy_RequestContext( papuga_RequestContext* self);
 
+/*
+ * @brief Reset a request context to the state of a context created, keeping the memory allocated for reuse
+ * @param[in] self this pointer to the request context to reset
+ * @remark Variables inherited or transferred to other contexts are released and not reused
+ */
+void papuga_RequestContext_reset( papuga_RequestContext* self);
+
+/*
+ * @brief Pool of request contexts reset for reuse, avoiding the allocation of a context per request
+ */
+typedef struct papuga_RequestContextPool papuga_RequestContextPool;
+
+/*
+ * @brief Creates a pool of request contexts
+ * @param[in] maxsize maximum number of contexts kept in the pool, e.g. the number of threads handling requests
+ * @return the pool created or NULL in case of a memory allocation error
+ */
+papuga_RequestContextPool* papuga_create_RequestContextPool( int maxsize);
+
+/*
+ * @brief Destroys a pool of request contexts and the contexts kept in it
+ * @param[in] self this pointer to the pool to destroy
+ * @remark Contexts acquired and not released are not affected
+ */
+void papuga_destroy_RequestContextPool( papuga_RequestContextPool* self);
+
+/*
+ * @brief Get a context from the pool or create a new one if the pool is empty
+ * @param[in] self this pointer to the pool
+ * @return the context (to pass back with papuga_RequestContextPool_release or to destroy with papuga_destroy_RequestContext) or NULL in case of a memory allocation error
+ * @remark Thread safe
+ */
+papuga_RequestContext* papuga_RequestContextPool_acquire( papuga_RequestContextPool* self);
+
+/*
+ * @brief Reset a context and keep it in the pool for reuse or destroy it if the pool is full
+ * @param[in] self this pointer to the pool
+ * @param[in] context context acquired with papuga_RequestContextPool_acquire or created with papuga_create_RequestContext, passed with ownership
+ * @remark Thread safe
+ */
+void papuga_RequestContextPool_release( papuga_RequestContextPool* self, papuga_RequestContext* context);
+
 /*
  * @brief Get the last error in the request
  * @param[in] self this pointer to the object to get the error from
@@ -72,7 +114,8 @@ bool papuga_RequestContext_define_variable( papuga_RequestContext* self, const c
  * @brief Get a variable reference in the context
  * @param[in] self this pointer to the object to get the variable reference from
  * @param[in] name name of variable to get
- * @return the variable value on success, NULL if it does not exist
+ * @remark A variable defined in the context itself hides the variables with the same name inherited
+ * @return the variable value on success, NULL if it does not exist or if different variables with this name are inherited from different contexts (last error papuga_DuplicateDefinition then)
  */
 const papuga_ValueVariant* papuga_RequestContext_get_variable( const papuga_RequestContext* self, const char* name);
 
@@ -90,7 +133,9 @@ const char** papuga_RequestContext_list_variables( const papuga_RequestContext*
  * @brief Inherit all non local variables from another context
  * @param[in,out] self this pointer
  * @param[in] context to inherit from 
- * @remark Not thread safe, synchronization has to be done by the caller
+ * @remark Not thread safe for self, synchronization has to be done by the caller, the lookup in the handler is safe against concurrent updates of its contexts
+ * @remark The variables are not copied, the context inherited is referenced as scope searched for variables not defined in self, until self is destroyed
+ * @remark Duplicate definitions are not checked here, they are reported by the lookup of a variable defined differently in two contexts inherited
  * @return true on success, false on failure
  */
 bool papuga_RequestContext_inherit( papuga_RequestContext* self, const papuga_RequestHandler* handler, const char* type, const char* name);
@@ -103,6 +148,16 @@ bool papuga_RequestContext_inherit( papuga_RequestContext* self, const papuga_Re
  */
 papuga_RequestHandler* papuga_create_RequestHandler( const papuga_ClassDef* classdefs);
 
+/*
+ * @brief Creates a request handler with the contexts partitioned into shards updated independently, for servers with many threads creating and removing contexts
+ * @param[in] classdefs interface description of structures and classes
+ * @param[in] nofshards number of shards, a context is stored in the shard selected by a hash of its type and name, 1 for a handler like one created with papuga_create_RequestHandler
+ * @remark papuga_ClassDef_NULL terminated
+ * @remark Updates of contexts in different shards do not conflict, each shard publishes its own immutable snapshot, whereas updates in the same shard are published one after the other and retried on a conflict
+ * @return pointer to request handler
+ */
+papuga_RequestHandler* papuga_create_RequestHandler_sharded( const papuga_ClassDef* classdefs, int nofshards);
+
 /*
  * @brief Destroys a request handler
  * @param[in] self this pointer to the request handler to destroy
@@ -116,7 +171,8 @@ void papuga_destroy_RequestHandler( papuga_RequestHandler* self);
  * @param[in] name name given to the context used with the type to address it
  * @param[in,out] context context moved with ownership to handler
  * @param[out] errcode error code in case of error, untouched in case of success
- * @remark Not thread safe, synchronization has to be done by the caller
+ * @remark Fails with papuga_DuplicateDefinition if different variables with the same name are inherited from different contexts, the context is not moved to the handler then
+ * @remark Thread safe, the contexts are published as an immutable snapshot replaced atomically, requests running keep the snapshot they started with
  * @return true on success, false on failure
  */
 bool papuga_RequestHandler_transfer_context( papuga_RequestHandler* self, const char* type, const char* name, papuga_RequestContext* context, papuga_ErrorCode* errcode);
@@ -126,11 +182,76 @@ bool papuga_RequestHandler_transfer_context( papuga_RequestHandler* self, const
  * @param[in] self this pointer to the request handler
  * @param[in] type type name given to the context used to address it and its schemas
  * @param[in] name name given to the context used with the type to address it
- * @remark Not thread safe, synchronization has to be done by the caller
+ * @remark Thread safe, the contexts are published as an immutable snapshot replaced atomically, the context is destroyed when the last request using it is finished
  * @return true on success, false if the addressed context does not exist or in case of an error
  */
 bool papuga_RequestHandler_remove_context( papuga_RequestHandler* self, const char* type, const char* name, papuga_ErrorCode* errcode);
 
+/*
+ * @brief Function called for a context evicted from the request handler
+ * @param[in] userdata data passed with the function to papuga_RequestHandler_set_context_limits
+ * @param[in] type type name of the context evicted
+ * @param[in] name name of the context evicted
+ * @param[in] memsize memory counted for the context evicted
+ */
+typedef void (*papuga_RequestContextEvictHandler)( void* userdata, const char* type, const char* name, size_t memsize);
+
+/*
+ * @brief Limit the number of contexts and the memory used by contexts transferred to the request handler
+ * @param[in] self this pointer to the request handler
+ * @param[in] maxnofcontexts maximum number of contexts or 0 for no limit
+ * @param[in] maxmemsize maximum memory used by contexts in bytes or 0 for no limit
+ * @param[in] evicthandler function called for every context evicted or NULL
+ * @param[in] evicthandler_data data passed to evicthandler
+ * @remark If a limit is exceeded after a context transfer, the contexts inherited least recently (except the one transferred) are removed until the limits are met
+ * @remark The memory of a context is counted when it is transferred as the memory of its variable allocators, host objects referenced by variables are not counted
+ * @remark The function evicthandler is called by the thread transferring the context, after the contexts evicted have been removed
+ * @remark Not thread safe, must not be called while contexts are transferred, removed or loaded by other threads, the limits are read without synchronization, call it before the handler is shared
+ */
+void papuga_RequestHandler_set_context_limits( papuga_RequestHandler* self, size_t maxnofcontexts, size_t maxmemsize, papuga_RequestContextEvictHandler evicthandler, void* evicthandler_data);
+
+/*
+ * @brief Get the memory counted for a context transferred to the request handler
+ * @param[in] self this pointer to the request handler
+ * @param[in] type type name of the context
+ * @param[in] name name of the context
+ * @param[out] memsize memory counted for the context in bytes
+ * @return true on success, false if the addressed context does not exist
+ */
+bool papuga_RequestHandler_context_memsize( const papuga_RequestHandler* self, const char* type, const char* name, size_t* memsize);
+
+/*
+ * @brief Get the sum of the memory counted for all contexts transferred to the request handler
+ * @param[in] self this pointer to the request handler
+ * @return the memory used in bytes
+ */
+size_t papuga_RequestHandler_total_context_memsize( const papuga_RequestHandler* self);
+
+/*
+ * @brief Write a snapshot of all contexts transferred to the request handler to a file, to reload them with papuga_RequestHandler_load_contexts after a restart
+ * @param[in] self this pointer to the request handler
+ * @param[in] filename path of the snapshot file written
+ * @param[out] errcode error code in case of error, untouched in case of success
+ * @return true on success, false on failure
+ * @remark Host objects are written with the serialize function of their class, writing fails with papuga_NotImplemented for a class without serialize and deserialize function or for an iterator
+ * @remark Variables shared by several contexts are written once and shared again by the contexts loaded
+ * @remark Thread safe, the snapshot written is the one of the contexts at the time of the call
+ * @remark The snapshot file is written to a temporary file created with the access rights of mkstemp (owner only) and renamed when complete
+ */
+bool papuga_RequestHandler_save_contexts( const papuga_RequestHandler* self, const char* filename, papuga_ErrorCode* errcode);
+
+/*
+ * @brief Load the contexts of a snapshot file written with papuga_RequestHandler_save_contexts into the request handler
+ * @param[in] self this pointer to the request handler
+ * @param[in] filename path of the snapshot file to read
+ * @param[out] errcode error code in case of error, untouched in case of success
+ * @return true on success, false on failure
+ * @remark Host objects are recreated with the deserialize function of their class, the request handler has to be created with the class definitions of the handler the snapshot was written from
+ * @remark Contexts with the same type and name as a context loaded are replaced, the contexts are published only if the whole file was read without error
+ * @remark A file truncated or not written as snapshot is refused with papuga_SyntaxError
+ */
+bool papuga_RequestHandler_load_contexts( papuga_RequestHandler* self, const char* filename, papuga_ErrorCode* errcode);
+
 /*
  * @brief Defines a new context for requests inherited from another context addressed by name in the request handler
  * @param[in] self this pointer to the request handler
@@ -220,6 +341,68 @@ const char** papuga_RequestHandler_list_methods( const papuga_RequestHandler* se
  */
 bool papuga_RequestContext_execute_request( papuga_RequestContext* context, const papuga_Request* request, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct);
 
+/*
+ * @brief Execute the method calls of a request fed incrementally, that are ready
+ * @param[in,out] context context of the request
+ * @param[in] request request still fed with content or completed
+ * @param[in,out] itr iterator on the request created with papuga_create_RequestIterator_streaming
+ * @param[in] allocator allocator to use for the request, the same for all calls of a request
+ * @param[in] logger logger for logging errors and the calls of the request
+ * @param[out] errstruct description of the error for a detailed error message
+ * @return true on success, false on failure
+ * @remark Called after feeding parts of the request to overlap execution with parsing, and a last time after papuga_Request_done
+ */
+bool papuga_RequestContext_execute_ready_calls( papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestError* errstruct);
+
+/*
+ * @brief Get the results of a request executed incrementally with papuga_RequestContext_execute_ready_calls
+ * @param[in,out] context context of the request
+ * @param[in,out] itr iterator on the request completed with papuga_Request_done and with all calls executed
+ * @param[in] allocator allocator to use for the request
+ * @param[out] results array of results of the request
+ * @param[out] nofResults number of results of the request
+ * @param[out] errstruct description of the error for a detailed error message
+ * @return true on success, false on failure
+ */
+bool papuga_RequestContext_finish_request( papuga_RequestContext* context, papuga_RequestIterator* itr, papuga_Allocator* allocator, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct);
+
+/*
+ * @brief Pool of threads executing independent method calls of requests in parallel, kept for the lifetime of the application
+ */
+typedef struct papuga_RequestThreadPool papuga_RequestThreadPool;
+
+/*
+ * @brief Creates a pool of threads for executing requests in parallel
+ * @param[in] nofThreads number of threads executing calls including the thread executing the request, 0 for the number of cores available
+ * @return the pool created or NULL in case of a memory allocation error
+ */
+papuga_RequestThreadPool* papuga_create_RequestThreadPool( int nofThreads);
+
+/*
+ * @brief Destroys a pool of threads for executing requests in parallel, waiting for its threads to terminate
+ * @param[in] self this pointer to the pool to destroy
+ * @remark No request must be executed with the pool anymore
+ */
+void papuga_destroy_RequestThreadPool( papuga_RequestThreadPool* self);
+
+/*
+ * @brief Execute a request, running independent method calls in parallel
+ * @param[in,out] context context of the request
+ * @param[in] request content of the request
+ * @param[in] allocator allocator to use for the request
+ * @param[in] logger logger for logging errors and the calls of the request, called only from the calling thread
+ * @param[in] pool threads executing method calls, shared by requests executed at the same time, NULL or a pool of one thread for executing the request sequentially
+ * @param[out] results array of results of the request
+ * @param[out] nofResults number of results of the request
+ * @param[out] errstruct description of the error for a detailed error message
+ * @return true on success, false on failure
+ * @note Method calls on different host objects not depending on each others results are executed in parallel, the methods called must be thread safe in this case
+ * @note Results are applied and logged in the order of the request, constructors and variable assignments are executed in order after all calls before them
+ * @note In case of an error, the first call failing is reported, but later calls not depending on it may already have been executed
+ * @remark Thread safe, batches of calls of requests sharing the pool are executed one after the other
+ */
+bool papuga_RequestContext_execute_request_parallel( papuga_RequestContext* context, const papuga_Request* request, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestThreadPool* pool, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct);
+
 /*
  * @brief Get the dump of the context as string for debugging purposes
  * @param[in] self context to dump
@@ -75,6 +75,26 @@ const char* papuga_parseRootElement_xml( char* buf, size_t bufsize, const char*
  */
 const char* papuga_parseRootElement_json( char* buf, size_t bufsize, const char* src, size_t srcsize);
 
+/*
+ * @brief Properties of a content guessed from its start in one pass
+ */
+typedef struct papuga_ContentHeader {
+	papuga_ContentType doctype;					/*< content type, papuga_ContentType_Unknown if not recognized */
+	papuga_StringEncoding encoding;					/*< character set encoding, papuga_Binary if not recognized */
+	size_t bomsize;							/*< size of the byte order mark (BOM) in bytes, 0 if there is none */
+	const char* root;						/*< root element name as UTF-8 string (pointer into rootbuf) or NULL if not found */
+	char rootbuf[ 128];						/*< buffer for root */
+} papuga_ContentHeader;
+
+/*
+ * @brief Guess content type, character set encoding, byte order mark and root element of a content at once
+ * @param[out] hdr the properties of the content guessed
+ * @param[in] src pointer to source
+ * @param[in] srcsize size of src in bytes
+ * @note Equivalent to calling 'papuga_guess_ContentType', 'papuga_guess_StringEncoding' and 'papuga_parseRootElement_xml/json', but with the BOM detection and the XML header parsed only once
+ */
+void papuga_guess_ContentHeader( papuga_ContentHeader* hdr, const char* src, size_t srcsize);
+
 /*
  * @brief Request parser element type enumeration
  */
@@ -89,6 +109,20 @@ typedef enum {
 
 const char* papuga_requestElementTypeName( papuga_RequestElementType tp);
 
+/*
+ * @brief Request parser event, element of a batch of elements fetched from a document with one call
+ * @note String values of events fetched in a batch are UTF-8 and null terminated
+ */
+typedef struct papuga_RequestParserEvent {
+	papuga_RequestElementType type;					/*< type of the element */
+	papuga_ValueVariant value;					/*< value of the element */
+} papuga_RequestParserEvent;
+
+/*
+ * @brief Number of events fetched and fed in one batch by 'papuga_RequestParser_feed_request'
+ */
+#define papuga_RequestParser_EventBatchSize 64
+
 /*
  * Document parser interface
  */
@@ -107,8 +141,12 @@ typedef struct papuga_RequestParserHeader {
 		papuga_RequestParser* self);					/*< methodtable: destructor */
 	papuga_RequestElementType (*next)(
 		papuga_RequestParser* self, papuga_ValueVariant* value);	/*< methodtable: method fetching the next element */
+	int (*next_events)(
+		papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize);/*< methodtable: method fetching the next batch of elements */
 	int (*position)(
 		const papuga_RequestParser* self, char* buf, size_t size);	/*< methodtable: method getting the current position with a location hint as string */
+	void (*event_position)(
+		papuga_RequestParser* self, int eventidx);			/*< methodtable: method setting the position to an element of the last batch fetched */
 } papuga_RequestParserHeader;
 
 /*
@@ -145,6 +183,59 @@ papuga_RequestParser* papuga_create_RequestParser_json( papuga_Allocator* alloca
  */
 papuga_RequestParser* papuga_create_RequestParser( papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* content, size_t size, papuga_ErrorCode* errcode);
 
+/*
+ * @brief Create a document parser for an XML document with limits on the resources used for parsing it
+ * @param[in] allocator allocator to use
+ * @param[in] encoding character set encoding
+ * @param[in] content pointer to source
+ * @param[in] size size of src in bytes
+ * @param[in] limits limits on depth, number of elements and memory used for parsing or NULL for default limits
+ * @param[out] error code set in case of failure
+ * @return The document parser structure or NULL in case of failure
+ * @note Exceeding a limit is reported as parser error (papuga_MaxRecursionDepthReached for the depth, papuga_ComplexityOfProblem for the others)
+ */
+papuga_RequestParser* papuga_create_RequestParser_xml_limits( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode);
+
+/*
+ * @brief Create a document parser for a JSON document with limits on the resources used for parsing it
+ * @param[in] allocator allocator to use
+ * @param[in] encoding character set encoding
+ * @param[in] content pointer to source
+ * @param[in] size size of src in bytes
+ * @param[in] limits limits on depth, number of elements and memory used for parsing or NULL for default limits
+ * @param[out] error code set in case of failure
+ * @return The document parser structure or NULL in case of failure
+ * @note Exceeding a limit is reported as parser error (papuga_MaxRecursionDepthReached for the depth, papuga_ComplexityOfProblem for the others)
+ */
+papuga_RequestParser* papuga_create_RequestParser_json_limits( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode);
+
+/*
+ * @brief Create a document parser for a document depending on a document type with limits on the resources used for parsing it
+ * @param[in] allocator allocator to use
+ * @param[in] doctype content type
+ * @param[in] encoding character set encoding
+ * @param[in] content pointer to source
+ * @param[in] size size of src in bytes
+ * @param[in] limits limits on depth, number of elements and memory used for parsing or NULL for default limits
+ * @param[out] error code set in case of failure
+ * @return The document parser structure or NULL in case of failure
+ */
+papuga_RequestParser* papuga_create_RequestParser_limits( papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode);
+
+/*
+ * @brief Create a document parser for a document depending on a document type, borrowing the content instead of copying it
+ * @param[in] allocator allocator to use
+ * @param[in] doctype content type
+ * @param[in] encoding character set encoding
+ * @param[in] content pointer to source, must be null terminated (content[size] == 0) and must live as long as the parser (e.g. a papuga_FileContent)
+ * @param[in] size size of src in bytes
+ * @param[in] limits limits on depth, number of elements and memory used for parsing or NULL for default limits
+ * @param[out] error code set in case of failure
+ * @return The document parser structure or NULL in case of failure
+ * @note Content in another encoding than UTF-8 is still converted into a copy
+ */
+papuga_RequestParser* papuga_create_RequestParser_borrowed( papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode);
+
 
 /*
  * @brief Destroy a document parser
@@ -159,6 +250,16 @@ void papuga_destroy_RequestParser( papuga_RequestParser* self);
  */
 papuga_RequestElementType papuga_RequestParser_next( papuga_RequestParser* self, papuga_ValueVariant* value);
 
+/*
+ * @brief Fetch the next batch of elements from the document
+ * @param[in] self the document parser structure to fetch the elements from
+ * @param[out] ar array where to write the elements fetched to
+ * @param[in] arsize allocation size of ar in elements
+ * @return the number of elements fetched, 0 on EOF or error (check 'papuga_RequestParser_last_error')
+ * @note the values of the elements returned are valid until the next call of 'papuga_RequestParser_next_events' or 'papuga_RequestParser_next'
+ */
+int papuga_RequestParser_next_events( papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize);
+
 /*
  * @brief Get the last error of the document parser
  * @param[in] self document parser to get the last error from
@@ -175,6 +276,14 @@ papuga_ErrorCode papuga_RequestParser_last_error( const papuga_RequestParser* se
  */
 int papuga_RequestParser_get_position( const papuga_RequestParser* self, char* locbuf, size_t locbufsize);
 
+/*
+ * @brief Set the position reported by 'papuga_RequestParser_get_position' to an element of the last batch fetched with 'papuga_RequestParser_next_events'
+ * @param[in,out] self document parser
+ * @param[in] eventidx index of the element in the last batch fetched
+ * @note used to report the position of an element rejected by a request after the whole batch has been fetched
+ */
+void papuga_RequestParser_set_event_position( papuga_RequestParser* self, int eventidx);
+
 /*
  * @brief Feed a request iterating with a request parser on some content
  * @param[in,out] parser the iterator on content
@@ -182,9 +291,27 @@ int papuga_RequestParser_get_position( const papuga_RequestParser* self, char* l
  * @param[out] errcode the error code in case of an error
  * @return true on success, error on failure
  * @note to get the error position in case of an error with a hint on the location call 'papuga_RequestParser_get_position'
+ * @note elements are fetched and fed in batches of papuga_RequestParser_EventBatchSize, the position of an error reported by the request refers to the element rejected
  */
 bool papuga_RequestParser_feed_request( papuga_RequestParser* parser, papuga_Request* request, papuga_ErrorCode* errcode);
 
+/*
+ * @brief Feed a batch of request parser elements to a request
+ * @param[in,out] self the request to feed
+ * @param[in] ar array of elements (string values must be null terminated)
+ * @param[in] arsize number of elements in ar
+ * @return true on success, false on failure (check 'papuga_Request_last_error')
+ * @note equivalent to calling 'papuga_Request_feed_open_tag', 'papuga_Request_feed_close_tag', etc. for each element, but with one call and with UTF-8 values passed to the automaton without conversion
+ */
+bool papuga_Request_feed_events( papuga_Request* self, const papuga_RequestParserEvent* ar, int arsize);
+
+/*
+ * @brief Get the element of the last batch fed with 'papuga_Request_feed_events' that caused the last error
+ * @param[in] self request to get the element of the last error from
+ * @return the index of the element in the batch or -1 if the last error was not caused by an element of a batch
+ */
+int papuga_Request_last_error_event( const papuga_Request* self);
+
 /*
  * @brief Get the request content as it is seen from a request parser in a scope defined by an ordinal as string
  * @note intended to be used for location info in error messages or for logging the content of a request
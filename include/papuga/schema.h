@@ -65,6 +65,24 @@ bool papuga_schema_parse(
 		const char* contentstr, size_t contentlen,
 		papuga_SchemaError* err);
 
+/*
+ * @brief Parse document content according to a schema without copying the content for the parser
+ * @param[in,out] schema where to append the result to
+ * @param[in] doctype document content type
+ * @param[in] encoding document content encoding
+ * @param[in] contentstr pointer to document content string, must be null terminated (contentstr[contentlen] == 0), e.g. from a papuga_FileContent
+ * @param[in] contentlen size of document content in bytes
+ * @param[out] err error code in case of failure
+ * @return true in case of success, false in case of failure
+ */
+bool papuga_schema_parse_borrowed(
+		papuga_Serialization* dest,
+		papuga_Schema const* schema,
+		papuga_ContentType doctype,
+		papuga_StringEncoding encoding,
+		const char* contentstr, size_t contentlen,
+		papuga_SchemaError* err);
+
 /*
  * @brief Print the content of the schema automaton for debugging purposes
  * @param[in,out] allocator allocator for the result string returned
@@ -256,6 +256,19 @@ bool papuga_Serialization_pushValue_bool( papuga_Serialization* self, bool value
 */
 bool papuga_Serialization_append_json( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, papuga_ErrorCode* errcode);
 
+/*
+* @brief Add a JSON document as structure without starting/ending open/close to the serialization with limits on the resources used
+* @param[in,out] self pointer to structure
+* @param[in] content pointer to content of the JSON document to append
+* @param[in] contentlen length of the content of the JSON document in bytes
+* @param[in] enc encoding of the content of the JSON document to append
+* @param[in] withRoot true if to serialize with single root element, false if the root element is not part of the serialization
+* @param[in] limits limits on depth, number of elements and memory used or NULL for default limits
+* @param[out] errcode error code in case of error (papuga_MaxRecursionDepthReached or papuga_ComplexityOfProblem if a limit is exceeded)
+* @return true on success, false on error, see error code returned as out parameter for the error
+*/
+bool papuga_Serialization_append_json_limits( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode);
+
 /*
 * @brief Add an XML document as structure without starting/ending open/close to the serialization
 * @param[in,out] self pointer to structure
@@ -269,6 +282,21 @@ bool papuga_Serialization_append_json( papuga_Serialization* self, const char* c
 */
 bool papuga_Serialization_append_xml( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, bool ignoreEmptyContent, papuga_ErrorCode* errcode);
 
+/*
+* @brief Add an XML document as structure without starting/ending open/close to the serialization with limits on the resources used
+* @param[in,out] self pointer to structure
+* @param[in] content pointer to content of the XML document to append
+* @param[in] contentlen length of the content of the XML document in bytes
+* @param[in] enc encoding of the content of the XML document to append
+* @param[in] withRoot true if to serialize with single root element, false if the root element is not part of the serialization
+* @param[in] ignoreEmptyContent true, accept beautified XML, ignoring content containing only spaces and end of lines, false standard XML behaviour
+* @param[in] limits limits on depth, number of elements and memory used or NULL for default limits
+* @param[out] errcode error code in case of error (papuga_MaxRecursionDepthReached or papuga_ComplexityOfProblem if a limit is exceeded)
+* @return true on success, false on error, see error code returned as out parameter for the error
+* @note the depth is also limited by PAPUGA_MAX_RECURSION_DEPTH
+*/
+bool papuga_Serialization_append_xml_limits( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, bool ignoreEmptyContent, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode);
+
 /*
 * @brief Release the part of the serialization starting on a defined iterator position
 * @param[in,out] self pointer to structure
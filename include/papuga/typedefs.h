@@ -62,7 +62,9 @@ typedef enum papuga_ErrorCode
 	papuga_UnknownSchema=30,
 	papuga_MissingStructureDescription=31,
 	papuga_DelegateRequestFailed=32,
-	papuga_ServiceImplementationError=33
+	papuga_ServiceImplementationError=33,
+	papuga_FileReadError=34,
+	papuga_FileWriteError=35
 } papuga_ErrorCode;
 
 /*
@@ -137,6 +139,25 @@ typedef enum {
 	papuga_ContentType_JSON					/*< Content type is JSON */
 } papuga_ContentType;
 
+/*
+ * @brief Budget for processing a single request content (XML or JSON document)
+ */
+typedef struct papuga_ContentLimits
+{
+	int maxdepth;						/*< maximum nesting depth of elements, the root element at depth 1, 0 for unlimited */
+	int maxnofelements;					/*< maximum number of elements (tags, attributes and values), 0 for unlimited */
+	size_t maxmemsize;					/*< maximum number of bytes allocated for the content processed (content copy, parse tree, elements), 0 for unlimited */
+} papuga_ContentLimits;
+
+/*
+* @brief Content limits initializer
+* @param[out] self_ pointer to structure
+* @param[in] maxdepth_ maximum nesting depth of elements, the root element at depth 1, 0 for unlimited
+* @param[in] maxnofelements_ maximum number of elements, 0 for unlimited
+* @param[in] maxmemsize_ maximum number of bytes allocated, 0 for unlimited
+*/
+#define papuga_init_ContentLimits(self_,maxdepth_,maxnofelements_,maxmemsize_)	{papuga_ContentLimits* s = self_; s->maxdepth=(maxdepth_); s->maxnofelements=(maxnofelements_); s->maxmemsize=(maxmemsize_);}
+
 /*
 * @brief Tag identifier of a papuga serialization node
 */
@@ -35,6 +35,10 @@ public:
 		:std::shared_ptr<X>(o){}
 	shared_ptr( const std::shared_ptr<X>& o)
 		:std::shared_ptr<X>(o){}
+	/// \brief Aliasing constructor, pointer to a part of an object sharing the ownership of the object
+	template <class Y>
+	shared_ptr( const std::shared_ptr<Y>& owner, X* ptr)
+		:std::shared_ptr<X>(owner,ptr){}
 	shared_ptr()
 		:std::shared_ptr<X>(){}
 };
@@ -54,6 +58,10 @@ public:
 		:boost::shared_ptr<X>(ptr){}
 	shared_ptr( const shared_ptr& o)
 		:boost::shared_ptr<X>(o){}
+	/// \brief Aliasing constructor, pointer to a part of an object sharing the ownership of the object
+	template <class Y>
+	shared_ptr( const boost::shared_ptr<Y>& owner, X* ptr)
+		:boost::shared_ptr<X>(owner,ptr){}
 	shared_ptr()
 		:boost::shared_ptr<X>(){}
 };
@@ -38,7 +38,7 @@ class unordered_map
 public:
 	unordered_map(){}
 	unordered_map( const unordered_map& o)
-		:std::unordered_map<Key,Elem>(){}
+		:std::unordered_map<Key,Elem,Hash,Pred>(o){}
 };
 }//namespace
 
@@ -55,7 +55,7 @@ class unordered_map
 public:
 	unordered_map(){}
 	unordered_map( const unordered_map& o)
-		:boost::unordered_map<Key,Elem>(){}
+		:boost::unordered_map<Key,Elem,Hash,Pred>(o){}
 };
 }//namespace
 #endif //PAPUGA_USE_STD_UNORDERED_MAP
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _PAPUGA_CONTENT_LIMITS_UTILS_HPP_INCLUDED
+#define _PAPUGA_CONTENT_LIMITS_UTILS_HPP_INCLUDED
+/// \brief Private helper class for accounting the resources used for processing a content against its limits
+/// \file contentLimits_utils.hpp
+#include "papuga/typedefs.h"
+#include "papuga/constants.h"
+#include <cstddef>
+
+namespace papuga {
+
+/// \brief Accounting of depth, number of elements and memory used for processing a content
+/// \note The memory accounted is an estimate based on the sizes of the structures built, allocator overhead is not counted
+class ContentBudget
+{
+public:
+	/// \brief Constructor
+	/// \param[in] limits limits to check or NULL for the default (maximum depth PAPUGA_MAX_RECURSION_DEPTH, no other limits)
+	explicit ContentBudget( const papuga_ContentLimits* limits)
+		:m_maxdepth(PAPUGA_MAX_RECURSION_DEPTH),m_maxnofelements(0),m_maxmemsize(0),m_nofelements(0),m_memsize(0)
+	{
+		if (limits)
+		{
+			m_maxdepth = limits->maxdepth;
+			m_maxnofelements = limits->maxnofelements;
+			m_maxmemsize = limits->maxmemsize;
+		}
+	}
+
+	int maxdepth() const
+	{
+		return m_maxdepth;
+	}
+
+	/// \brief Check the nesting depth of an element, the root element at depth 1
+	bool checkDepth( int depth, papuga_ErrorCode* errcode) const
+	{
+		if (m_maxdepth > 0 && depth > m_maxdepth)
+		{
+			*errcode = papuga_MaxRecursionDepthReached;
+			return false;
+		}
+		return true;
+	}
+
+	bool addElements( int nofelements, papuga_ErrorCode* errcode)
+	{
+		m_nofelements += nofelements;
+		if (m_maxnofelements > 0 && m_nofelements > m_maxnofelements)
+		{
+			*errcode = papuga_ComplexityOfProblem;
+			return false;
+		}
+		return true;
+	}
+
+	bool addMemory( std::size_t memsize, papuga_ErrorCode* errcode)
+	{
+		m_memsize += memsize;
+		if (m_maxmemsize > 0 && m_memsize > m_maxmemsize)
+		{
+			*errcode = papuga_ComplexityOfProblem;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	int m_maxdepth;
+	int m_maxnofelements;
+	std::size_t m_maxmemsize;
+	int m_nofelements;
+	std::size_t m_memsize;
+};
+
+}//namespace
+#endif
+
@@ -55,6 +55,8 @@ const char* papuga_ErrorCode_tostring( papuga_ErrorCode errorcode)
 		case papuga_MissingStructureDescription: return _TXT("cannot serialize structure with members referenced by position without having a structure description");
 		case papuga_DelegateRequestFailed: return _TXT("delegate request failed");
 		case papuga_ServiceImplementationError: return _TXT("service implementation error");
+		case papuga_FileReadError: return _TXT("failed to read file");
+		case papuga_FileWriteError: return _TXT("failed to write file");
 		default: return _TXT("unknown error");
 	}
 }
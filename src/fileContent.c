@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/*
+* @brief Read only access to the content of a file for passing it to the parsers without copying it
+* @file fileContent.c
+*/
+#define _DEFAULT_SOURCE
+#include "papuga/fileContent.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_CHUNK_SIZE (1<<16)
+
+static void init_empty( papuga_FileContent* self)
+{
+	self->ptr = "";
+	self->size = 0;
+	self->mapbase = NULL;
+	self->mapsize = 0;
+	self->buf = NULL;
+}
+
+/* @brief Map a regular file with at least one byte of zeros following the content
+ * @note The mapping is reserved as anonymous zero pages and the file is mapped over it,
+ *	so the byte after the content is null even if the file size is a multiple of the page size
+ */
+static bool mapFile( papuga_FileContent* self, int fd, size_t filesize)
+{
+	size_t pagesize = (size_t)sysconf( _SC_PAGESIZE);
+	size_t mapsize = ((filesize + pagesize) / pagesize) * pagesize;
+	void* base = mmap( NULL, mapsize, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) return false;
+	if (MAP_FAILED == mmap( base, filesize, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0))
+	{
+		munmap( base, mapsize);
+		return false;
+	}
+	self->ptr = (const char*)base;
+	self->size = filesize;
+	self->mapbase = base;
+	self->mapsize = mapsize;
+	return true;
+}
+
+static bool readFile( papuga_FileContent* self, int fd, papuga_ErrorCode* errcode)
+{
+	size_t allocsize = READ_CHUNK_SIZE;
+	size_t size = 0;
+	char* buf = (char*)malloc( allocsize);
+	if (!buf)
+	{
+		*errcode = papuga_NoMemError;
+		return false;
+	}
+	for (;;)
+	{
+		ssize_t nn;
+		if (size + 1 >= allocsize)
+		{
+			char* newbuf = (char*)realloc( buf, allocsize * 2);
+			if (!newbuf)
+			{
+				free( buf);
+				*errcode = papuga_NoMemError;
+				return false;
+			}
+			buf = newbuf;
+			allocsize *= 2;
+		}
+		nn = read( fd, buf + size, allocsize - size - 1);
+		if (nn < 0)
+		{
+			if (errno == EINTR) continue;
+			free( buf);
+			*errcode = papuga_FileReadError;
+			return false;
+		}
+		if (nn == 0) break;
+		size += nn;
+	}
+	buf[ size] = 0;
+	self->ptr = buf;
+	self->size = size;
+	self->buf = buf;
+	return true;
+}
+
+bool papuga_init_FileContent( papuga_FileContent* self, const char* path, papuga_ErrorCode* errcode)
+{
+	struct stat st;
+	bool rt;
+	int fd;
+
+	init_empty( self);
+	fd = open( path, O_RDONLY);
+	if (fd < 0)
+	{
+		*errcode = papuga_FileReadError;
+		return false;
+	}
+	if (0==fstat( fd, &st) && S_ISREG( st.st_mode))
+	{
+		if (st.st_size == 0)
+		{
+			close( fd);
+			return true;
+		}
+		if (mapFile( self, fd, (size_t)st.st_size))
+		{
+			close( fd);
+			return true;
+		}
+	}
+	/* ... fallback for pipes, devices and file systems not supporting mmap */
+	rt = readFile( self, fd, errcode);
+	close( fd);
+	return rt;
+}
+
+void papuga_destroy_FileContent( papuga_FileContent* self)
+{
+	if (self->mapbase)
+	{
+		munmap( self->mapbase, self->mapsize);
+	}
+	if (self->buf)
+	{
+		free( self->buf);
+	}
+	init_empty( self);
+}
+
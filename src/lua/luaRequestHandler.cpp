@@ -965,8 +965,10 @@ static int papuga_lua_content( lua_State* ls)
 	std::size_t contentlen;
 	const char* contentstr = lua_tolstring( ls, 1, &contentlen);
 
-	papuga_ContentType doctype = papuga_guess_ContentType( contentstr, contentlen);
-	papuga_StringEncoding encoding = papuga_guess_StringEncoding( contentstr, contentlen);
+	papuga_ContentHeader contenthdr;
+	papuga_guess_ContentHeader( &contenthdr, contentstr, contentlen);
+	papuga_ContentType doctype = contenthdr.doctype;
+	papuga_StringEncoding encoding = contenthdr.encoding;
 	if (doctype == papuga_ContentType_Unknown)
 	{
 		luaL_error( ls, papuga_ErrorCode_tostring( papuga_UnknownContentType));
@@ -1006,8 +1008,10 @@ static int papuga_lua_schema( lua_State* ls)
 		const char* contentstr = lua_tolstring( ls, 2, &contentlen);
 		papuga_ErrorCode errcode;
 
-		papuga_ContentType doctype = papuga_guess_ContentType( contentstr, contentlen);
-		papuga_StringEncoding encoding = papuga_guess_StringEncoding( contentstr, contentlen);
+		papuga_ContentHeader contenthdr;
+		papuga_guess_ContentHeader( &contenthdr, contentstr, contentlen);
+		papuga_ContentType doctype = contenthdr.doctype;
+		papuga_StringEncoding encoding = contenthdr.encoding;
 		if (doctype == papuga_ContentType_Unknown)
 		{
 			luaL_error( ls, papuga_ErrorCode_tostring( papuga_UnknownContentType));
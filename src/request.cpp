@@ -8,16 +8,15 @@
 /// \brief Automaton to execute papuga XML and JSON requests
 /// \file request.cpp
 #include "papuga/request.h"
+#include "papuga/requestParser.h"
 #include "papuga/requestHandler.h"
 #include "papuga/serialization.h"
 #include "papuga/serialization.hpp"
 #include "papuga/allocator.h"
 #include "papuga/valueVariant.h"
 #include "papuga/valueVariant.hpp"
-#include "papuga/callArgs.h"
 #include "papuga/classdef.h"
 #include "papuga/allocator.h"
-#include "papuga/stack.h"
 #include "papuga/errors.h"
 #include "papuga/errors.hpp"
 #include "textwolf/xmlpathautomatonparse.hpp"
@@ -25,6 +24,7 @@
 #include "textwolf/charset.hpp"
 #include "request_utils.hpp"
 #include "requestResult_utils.hpp"
+#include "requestAutomaton_image.hpp"
 #include <stdexcept>
 #include <sstream>
 #include <iostream>
@@ -112,15 +112,18 @@ struct CallDef
 	CallArgDef* args;
 	int nofargs;
 	int groupid;
+	int resultvarid;	//< unique index of the result variable name or -1 if undefined, compiled when the automaton is done
+	int minargc;		//< number of arguments without the optional arguments at the end of the argument list, compiled when the automaton is done
+	bool readsContext;	//< true if an argument may be resolved from a variable of the context, compiled when the automaton is done
 
 	CallDef( const papuga_RequestMethodId* methodid_, const char* selfvarname_, const char* resultvarname_, CallArgDef* args_, int nofargs_, int groupid_)
-		:selfvarname(selfvarname_),resultvarname(resultvarname_),args(args_),nofargs(nofargs_),groupid(groupid_)
+		:selfvarname(selfvarname_),resultvarname(resultvarname_),args(args_),nofargs(nofargs_),groupid(groupid_),resultvarid(-1),minargc(nofargs_),readsContext(true)
 	{
 		methodid.classid = methodid_->classid;
 		methodid.functionid  = methodid_->functionid;
 	}
 	CallDef( const CallDef& o)
-		:selfvarname(o.selfvarname),resultvarname(o.resultvarname),args(o.args),nofargs(o.nofargs),groupid(o.groupid)
+		:selfvarname(o.selfvarname),resultvarname(o.resultvarname),args(o.args),nofargs(o.nofargs),groupid(o.groupid),resultvarid(o.resultvarid),minargc(o.minargc),readsContext(o.readsContext)
 	{
 		methodid.classid = o.methodid.classid;
 		methodid.functionid = o.methodid.functionid;
@@ -174,13 +177,13 @@ public:
 	AutomatonDescription( const papuga_ClassDef* classdefs_, bool strict_, bool exclusiveAccess_)
 		:m_classdefs(classdefs_)
 		,m_nof_classdefs(nofClassDefs(classdefs_))
-		,m_calldefs(),m_structdefs(),m_valuedefs(),m_inheritdefs(),m_resultdefs(),m_resultVariables()
+		,m_calldefs(),m_callnodes(),m_calledges(),m_structdefs(),m_valuedefs(),m_inheritdefs(),m_resultdefs(),m_resultVariables()
 		,m_acceptedRootTags()
 		,m_nofEnvAssignments(0)
 		,m_strict(strict_)
 		,m_exclusiveAccess(exclusiveAccess_)
 		,m_atm(),m_maxitemid(0)
-		,m_errcode(papuga_Ok),m_groupidmap(),m_groupid(-1),m_done(false)
+		,m_errcode(papuga_Ok),m_groupidmap(),m_groupid(-1),m_requiredInheritedContextsMask(0),m_maxnofargs(1),m_hasPrioritizedCalls(false),m_hasValueConditions(false),m_streamable(false),m_done(false)
 	{
 		std::memset( m_envAssignmentAr, 0, sizeof(m_envAssignmentAr));
 		papuga_init_Allocator( &m_allocator, m_allocatorbuf, sizeof(m_allocatorbuf));
@@ -213,6 +216,18 @@ public:
 		}
 		return NULL;
 	}
+	/// \brief Copy a block of memory to the allocator of the automaton, used for strings referenced but not copied by the automaton
+	const char* copyBlock( const char* ptr, std::size_t size)
+	{
+		char* rt = (char*)papuga_Allocator_alloc( &m_allocator, size ? size : 1, 1);
+		if (!rt)
+		{
+			m_errcode = papuga_NoMemError;
+			return NULL;
+		}
+		if (size) std::memcpy( rt, ptr, size);
+		return rt;
+	}
 
 	bool inheritFrom( const char* type, const char* name_expression, bool required)
 	{
@@ -240,6 +255,7 @@ public:
 			std::string close_expression( open_expression + "~");
 
 			int evid = AtmRef_get( MethodCallPrioritize, m_calldefs.size()-1);
+			m_hasPrioritizedCalls = true;
 			return addExpression( evid, close_expression);
 		}
 		catch (...)
@@ -722,10 +738,33 @@ public:
 				ci->groupid = gi->second;
 			}
 		}
+		if (!compileExecutionPlan()) return false;
+		if (!compileCallDependencies()) return false;
 		m_done = true;
 		return true;
 	}
 
+	/// \brief Mask of the inherited contexts required (bit i set if m_inheritdefs[i] is required), compiled when the automaton is done
+	int requiredInheritedContextsMask() const
+	{
+		return m_requiredInheritedContextsMask;
+	}
+	/// \brief Maximum number of arguments of a call (at least 1 for variable assignments), compiled when the automaton is done
+	int maxnofargs() const
+	{
+		return m_maxnofargs;
+	}
+	/// \brief True if a select expression has a condition on an attribute value or a content, so that the automaton has to see the values
+	bool hasValueConditions() const
+	{
+		return m_hasValueConditions;
+	}
+	/// \brief True if calls of requests can be executed while the request is fed, compiled when the automaton is done
+	bool streamable() const
+	{
+		return m_streamable;
+	}
+
 	bool addEnvAssignment( const char* variable, int envid, const char* argument)
 	{
 		if (m_nofEnvAssignments > MaxNofEnvAssignments)
@@ -754,6 +793,7 @@ public:
 	enum {MaxNofCallDefs = 1<<15};
 
 	const std::vector<CallDef>& calldefs() const				{return m_calldefs;}
+	const std::vector<papuga_RequestCallNode>& callnodes() const		{return m_callnodes;}
 	const std::vector<StructDef>& structdefs() const			{return m_structdefs;}
 	const std::vector<ValueDef>& valuedefs() const				{return m_valuedefs;}
 	const std::vector<InheritFromDef>& inheritdefs() const			{return m_inheritdefs;}
@@ -762,12 +802,14 @@ public:
 	std::size_t maxitemid() const						{return m_maxitemid;}
 	const papuga_RequestEnvAssignment* envAssignments() const		{return m_envAssignmentAr;}
 	bool exclusiveAccess() const						{return m_exclusiveAccess;}
+	bool isDone() const							{return m_done;}
 
 private:
 	bool addExpression( int eventid, const char* expression)
 	{
 		std::size_t expressionsize = std::strlen(expression);
 		extractRootTagName( expression);
+		if (0!=std::strchr( expression, '=')) m_hasValueConditions = true;
 		if (0!=m_atm.addExpression( eventid, expression, expressionsize))
 		{
 			m_errcode = papuga_SyntaxError;
@@ -779,6 +821,7 @@ private:
 	bool addExpression( int eventid, const std::string& expression)
 	{
 		extractRootTagName( expression.c_str());
+		if (expression.find( '=') != std::string::npos) m_hasValueConditions = true;
 		if (0!=m_atm.addExpression( eventid, expression.c_str(), expression.size()))
 		{
 			m_errcode = papuga_SyntaxError;
@@ -858,10 +901,196 @@ private:
 		return std::string( expression, size);
 	}
 
+	/// \brief Compile what the requests derive from the call definitions into the definitions, so that requests only fill their slots
+	bool compileExecutionPlan()
+	{
+		try
+		{
+			// ... structures resolved as arguments may have members assigned from variables of the context:
+			bool structsReadContext = false;
+			// ... calls can be executed while a request is fed, if the order of calls is the order of occurrence, if no call
+			//	is suppressed later, if no item is resolved from a scope not yet closed and if no result refers to calls:
+			m_streamable = !m_hasPrioritizedCalls && m_inheritdefs.empty() && m_resultVariables.empty();
+			std::vector<StructDef>::const_iterator si = m_structdefs.begin(), se = m_structdefs.end();
+			for (; si != se; ++si)
+			{
+				for (int mi=0; mi < si->nofmembers; ++mi)
+				{
+					if (si->members[ mi].varname) structsReadContext = true;
+					if (!si->members[ mi].varname && si->members[ mi].resolvetype == papuga_ResolveTypeInherited) m_streamable = false;
+				}
+			}
+			std::map<CString,int> resultvarids;
+			std::vector<CallDef>::iterator ci = m_calldefs.begin(), ce = m_calldefs.end();
+			for (; ci != ce; ++ci)
+			{
+				ci->readsContext = false;
+				for (int ai=0; ai < ci->nofargs; ++ai)
+				{
+					if (ci->args[ ai].varname || structsReadContext) ci->readsContext = true;
+					if (!ci->args[ ai].varname && ci->args[ ai].resolvetype == papuga_ResolveTypeInherited) m_streamable = false;
+				}
+				if (ci->groupid != m_calldefs[0].groupid) m_streamable = false;
+				if (ci->resultvarname)
+				{
+					ci->resultvarid = resultvarids.insert( std::pair<CString,int>( ci->resultvarname, resultvarids.size())).first->second;
+				}
+				for (ci->minargc = ci->nofargs; ci->minargc > 0 && ci->args[ ci->minargc-1].resolvetype == papuga_ResolveTypeOptional; --ci->minargc){}
+				if (ci->nofargs > m_maxnofargs)
+				{
+					m_maxnofargs = ci->nofargs;
+				}
+			}
+			m_requiredInheritedContextsMask = 0;
+			std::vector<InheritFromDef>::const_iterator hi = m_inheritdefs.begin(), he = m_inheritdefs.end();
+			for (int hidx=0; hi != he; ++hi,++hidx)
+			{
+				if (hi->required)
+				{
+					m_requiredInheritedContextsMask |= (1 << hidx);
+				}
+			}
+			return true;
+		}
+		CATCH_LOCAL_EXCEPTION(m_errcode,false)
+	}
+
+	/// \brief Get the names of the variables a call may read
+	void collectCallVariableReads( std::set<CString>& res, const CallDef& calldef, const std::set<CString>& structvars) const
+	{
+		if (calldef.selfvarname) res.insert( calldef.selfvarname);
+		bool hasItemArg = false;
+		for (int ai=0; ai < calldef.nofargs; ++ai)
+		{
+			if (calldef.args[ ai].varname)
+			{
+				res.insert( calldef.args[ ai].varname);
+			}
+			else
+			{
+				hasItemArg = true;
+			}
+		}
+		// ... it is not known statically which structures an item argument resolves to, so all variables of structures are counted:
+		if (hasItemArg) res.insert( structvars.begin(), structvars.end());
+	}
+
+	/// \brief Build the graph of the calls producing the variables read by other calls, exposed to hosts for scheduling calls
+	/// \note A call depends on a call assigning a variable it reads, if the assigning call is in the same or in a group executed before
+	bool compileCallDependencies()
+	{
+		try
+		{
+			std::set<CString> structvars;
+			std::vector<StructDef>::const_iterator si = m_structdefs.begin(), se = m_structdefs.end();
+			for (; si != se; ++si)
+			{
+				for (int mi=0; mi < si->nofmembers; ++mi)
+				{
+					if (si->members[ mi].varname) structvars.insert( si->members[ mi].varname);
+				}
+			}
+			std::map<CString,std::vector<int> > producermap;
+			int cidx = 0;
+			std::vector<CallDef>::const_iterator ci = m_calldefs.begin(), ce = m_calldefs.end();
+			for (; ci != ce; ++ci,++cidx)
+			{
+				if (ci->resultvarname) producermap[ ci->resultvarname].push_back( cidx);
+			}
+			std::vector<std::pair<int,int> > edges;	//... (consumer,producer) pairs
+			std::vector<bool> readsOwnResult( m_calldefs.size(), false);
+			for (ci = m_calldefs.begin(),cidx=0; ci != ce; ++ci,++cidx)
+			{
+				std::set<CString> reads;
+				collectCallVariableReads( reads, *ci, structvars);
+				std::set<CString>::const_iterator ri = reads.begin(), re = reads.end();
+				for (; ri != re; ++ri)
+				{
+					std::map<CString,std::vector<int> >::const_iterator pi = producermap.find( *ri);
+					if (pi == producermap.end()) continue;
+					std::vector<int>::const_iterator xi = pi->second.begin(), xe = pi->second.end();
+					for (; xi != xe; ++xi)
+					{
+						if (*xi == cidx)
+						{
+							readsOwnResult[ cidx] = true;
+						}
+						else if (m_calldefs[ *xi].groupid <= ci->groupid)
+						{
+							edges.push_back( std::pair<int,int>( cidx, *xi));
+						}
+					}
+				}
+			}
+			std::sort( edges.begin(), edges.end());
+			edges.erase( std::unique( edges.begin(), edges.end()), edges.end());
+
+			std::vector<int> nofproducers( m_calldefs.size(), 0);
+			std::vector<int> nofconsumers( m_calldefs.size(), 0);
+			std::vector<std::pair<int,int> >::const_iterator ei = edges.begin(), ee = edges.end();
+			for (; ei != ee; ++ei)
+			{
+				++nofproducers[ ei->first];
+				++nofconsumers[ ei->second];
+			}
+			// ... the producers of call i start at producerofs[i], its consumers at consumerofs[i] in m_calledges:
+			m_calledges.assign( 2*edges.size(), -1);
+			std::vector<int> producerofs( m_calldefs.size(), 0);
+			std::vector<int> consumerofs( m_calldefs.size(), 0);
+			int ofs = 0;
+			for (cidx=0; cidx < (int)m_calldefs.size(); ++cidx)
+			{
+				producerofs[ cidx] = ofs;
+				ofs += nofproducers[ cidx];
+				consumerofs[ cidx] = ofs;
+				ofs += nofconsumers[ cidx];
+			}
+			std::vector<int> producerpos( producerofs);
+			std::vector<int> consumerpos( consumerofs);
+			for (ei = edges.begin(); ei != ee; ++ei)
+			{
+				m_calledges[ producerpos[ ei->first]++] = ei->second;
+				m_calledges[ consumerpos[ ei->second]++] = ei->first;
+			}
+			// ... variables used by the results of the request:
+			std::set<CString> resultvars( m_resultVariables);
+			std::vector<papuga_RequestResultDescription*>::const_iterator ri = m_resultdefs.begin(), re = m_resultdefs.end();
+			for (; ri != re; ++ri)
+			{
+				if ((*ri)->addressvar) resultvars.insert( (*ri)->addressvar);
+				for (int vi=0; vi < (*ri)->contentvarsize; ++vi) resultvars.insert( (*ri)->contentvar[ vi]);
+			}
+			m_callnodes.clear();
+			m_callnodes.reserve( m_calldefs.size());
+			for (ci = m_calldefs.begin(),cidx=0; ci != ce; ++ci,++cidx)
+			{
+				papuga_RequestCallNode node;
+				node.methodid = ci->methodid;
+				node.selfvarname = ci->selfvarname;
+				node.resultvarname = ci->resultvarname;
+				node.groupid = ci->groupid;
+				node.nofproducers = nofproducers[ cidx];
+				node.producers = nofproducers[ cidx] ? &m_calledges[ producerofs[ cidx]] : NULL;
+				node.nofconsumers = nofconsumers[ cidx];
+				node.consumers = nofconsumers[ cidx] ? &m_calledges[ consumerofs[ cidx]] : NULL;
+				node.resultunused = ci->resultvarname
+						&& ci->resultvarname[0] == '_'
+						&& nofconsumers[ cidx] == 0
+						&& !readsOwnResult[ cidx]
+						&& resultvars.find( ci->resultvarname) == resultvars.end();
+				m_callnodes.push_back( node);
+			}
+			return true;
+		}
+		CATCH_LOCAL_EXCEPTION(m_errcode,false)
+	}
+
 private:
 	const papuga_ClassDef* m_classdefs;			//< array of classes
 	int m_nof_classdefs;					//< number of classes defined in m_classdefs
 	std::vector<CallDef> m_calldefs;
+	std::vector<papuga_RequestCallNode> m_callnodes;	//< dependency graph of the calls, compiled when the automaton is done
+	std::vector<int> m_calledges;				//< producer and consumer lists referenced by m_callnodes
 	std::vector<StructDef> m_structdefs;
 	std::vector<ValueDef> m_valuedefs;
 	std::vector<InheritFromDef> m_inheritdefs;
@@ -879,6 +1108,11 @@ private:
 	papuga_ErrorCode m_errcode;
 	std::map<int,int> m_groupidmap;
 	int m_groupid;
+	int m_requiredInheritedContextsMask;
+	int m_maxnofargs;
+	bool m_hasPrioritizedCalls;				//< true, if a call is declared to outweigh others in a scope
+	bool m_hasValueConditions;				//< true, if an expression compares values (conservatively any expression containing '=')
+	bool m_streamable;
 	bool m_done;
 	char m_allocatorbuf[ 4096];
 };
@@ -1047,42 +1281,55 @@ struct MethodCallNode
 		:MethodCallKey(o),def(o.def),scope(o.scope),taglevel(o.taglevel){}
 };
 
-static void papuga_init_RequestMethodCall( papuga_RequestMethodCall* self)
+static void papuga_init_RequestMethodCall( papuga_RequestMethodCall* self, papuga_ValueVariant* argv)
 {
 	self->selfvarname = 0;
 	self->resultvarname = 0;
 	self->methodid.classid = -1;
 	self->methodid.functionid  = -1;
-	papuga_init_CallArgs( &self->args, self->membuf, sizeof(self->membuf));
+	self->args.argc = 0;
+	self->args.argv = argv;
+	self->callidx = -1;
 }
 
-class EventStack
+/// \brief Events issued by an element ordered by type for processing them in one linear walk
+class EventOrderBuffer
 {
 public:
-	EventStack()
+	EventOrderBuffer()
+		:m_ar(),m_ordered()
 	{
-		papuga_init_Stack( &m_stk, sizeof(int)/*element size*/, 256/*node size*/, &m_mem, sizeof(m_mem));
+		m_ar.reserve( 64);
+		m_ordered.reserve( 64);
 	}
-	~EventStack()
+
+	void clear()
 	{
-		papuga_destroy_Stack( &m_stk);
+		m_ar.clear();
 	}
 	void push( int ev)
 	{
-		int* elemptr = (int*)papuga_Stack_push( &m_stk);
-		if (!elemptr) throw std::bad_alloc();
-		*elemptr = ev;
+		m_ar.push_back( ev);
 	}
-	int pop()
+	/// \brief Order the events pushed by type (counting sort), events of the same type in reverse order of occurrence
+	/// \return the ordered events
+	const std::vector<int>& ordered()
 	{
-		int* elemptr = (int*)papuga_Stack_pop( &m_stk);
-		if (!elemptr) return 0;
-		return *elemptr;
+		if (m_ar.size() <= 1) return m_ar;
+		int pos[ MaxAtmRefType+2];
+		std::memset( pos, 0, sizeof(pos));
+		std::vector<int>::const_iterator ai = m_ar.begin(), ae = m_ar.end();
+		for (; ai != ae; ++ai) ++pos[ AtmRef_type( *ai)+1];
+		for (int ti=1; ti <= MaxAtmRefType+1; ++ti) pos[ ti] += pos[ ti-1];
+		m_ordered.resize( m_ar.size());
+		std::vector<int>::const_reverse_iterator ri = m_ar.rbegin(), re = m_ar.rend();
+		for (; ri != re; ++ri) m_ordered[ pos[ AtmRef_type( *ri)]++] = *ri;
+		return m_ordered;
 	}
 
 private:
-	papuga_Stack m_stk;
-	int m_mem[ 256];
+	std::vector<int> m_ar;
+	std::vector<int> m_ordered;
 };
 
 /* \brief Abstraction for building recursive structures */
@@ -1191,7 +1438,115 @@ private:
 };
 
 typedef std::pair<ScopeKey,ObjectDescr> ScopeObjElem;
-typedef std::multimap<ScopeKey,ObjectDescr> ScopeObjMap;
+
+/// \brief Map of scopes to the objects of one item, an append only array while processing the content, sorted once when the request is done
+/// \note Scopes arrive mostly in document order, so the sort is mostly skipped, elements with equal keys keep their order of insertion like in a std::multimap
+/// \note The covering index built with the sort is a tree of the maximum scope end of the elements in array order for finding covering scopes in O(log n)
+class ScopeObjMap
+{
+public:
+	typedef std::vector<ScopeObjElem>::const_iterator const_iterator;
+
+	ScopeObjMap()
+		:m_ar(),m_sorted(true),m_nofsorted(0),m_maxto(),m_leafs(0){}
+	ScopeObjMap( const ScopeObjMap& o)
+		:m_ar(o.m_ar),m_sorted(o.m_sorted),m_nofsorted(o.m_nofsorted),m_maxto(o.m_maxto),m_leafs(o.m_leafs){}
+
+	void insert( const ScopeObjElem& elem)
+	{
+		if (m_sorted && !m_ar.empty() && elem.first < m_ar.back().first)
+		{
+			m_sorted = false;
+		}
+		m_ar.push_back( elem);
+	}
+	/// \brief Sort the elements inserted since the last call into the elements already sorted
+	/// \return true if elements have been inserted since the last call
+	bool sync()
+	{
+		if (m_nofsorted == m_ar.size()) return false;
+		if (!m_sorted)
+		{
+			std::vector<ScopeObjElem>::iterator mid = m_ar.begin() + m_nofsorted;
+			std::stable_sort( mid, m_ar.end(), ElemOrder());
+			if (mid != m_ar.begin() && mid->first < (mid-1)->first)
+			{
+				// ... merge only the part of the sorted elements following the first element inserted
+				std::vector<ScopeObjElem>::iterator start = std::upper_bound( m_ar.begin(), mid, *mid, ElemOrder());
+				std::inplace_merge( start, mid, m_ar.end(), ElemOrder());
+			}
+			m_sorted = true;
+		}
+		m_nofsorted = m_ar.size();
+		return true;
+	}
+	/// \brief Sort the elements and build the covering index, called once when all elements are inserted
+	void build()
+	{
+		(void)sync();
+		for (m_leafs = 1; m_leafs < (int)m_ar.size(); m_leafs *= 2){}
+		m_maxto.assign( 2 * m_leafs, std::numeric_limits<int>::min());
+		for (std::size_t ai = 0; ai < m_ar.size(); ++ai)
+		{
+			m_maxto[ m_leafs + ai] = m_ar[ ai].first.to;
+		}
+		for (int ni = m_leafs-1; ni > 0; --ni)
+		{
+			m_maxto[ ni] = std::max( m_maxto[ 2*ni], m_maxto[ 2*ni+1]);
+		}
+	}
+
+	/// \brief Get the last element before an end with a scope ending at or after a position
+	/// \param[in] endidx index of the end of the elements searched
+	/// \param[in] to position the scope searched has to reach
+	/// \return the index of the element found or -1 if not found
+	int lastReaching( int endidx, int to) const
+	{
+		return m_leafs ? lastReaching( 1, 0, m_leafs, endidx, to) : -1;
+	}
+
+	const_iterator begin() const		{return m_ar.begin();}
+	const_iterator end() const		{return m_ar.end();}
+	bool empty() const			{return m_ar.empty();}
+	std::size_t size() const		{return m_ar.size();}
+
+	const_iterator lower_bound( const ScopeKey& key) const
+	{
+		return std::lower_bound( m_ar.begin(), m_ar.end(), key, ElemKeyOrder());
+	}
+
+private:
+	int lastReaching( int node, int nodestart, int nodesize, int endidx, int to) const
+	{
+		if (nodestart >= endidx || m_maxto[ node] < to) return -1;
+		if (nodesize == 1) return nodestart;
+		int half = nodesize / 2;
+		int rt = lastReaching( 2*node+1, nodestart+half, half, endidx, to);
+		return rt >= 0 ? rt : lastReaching( 2*node, nodestart, half, endidx, to);
+	}
+
+	struct ElemOrder
+	{
+		bool operator()( const ScopeObjElem& a, const ScopeObjElem& b) const
+		{
+			return a.first < b.first;
+		}
+	};
+	struct ElemKeyOrder
+	{
+		bool operator()( const ScopeObjElem& a, const ScopeKey& key) const
+		{
+			return a.first < key;
+		}
+	};
+
+private:
+	std::vector<ScopeObjElem> m_ar;
+	bool m_sorted;			//< true, if the elements are in ascending order
+	std::size_t m_nofsorted;	//< number of elements at the start of m_ar already sorted with sync
+	std::vector<int> m_maxto;	//< covering index, tree of the maximum scope end with the elements as leafs starting at m_leafs
+	int m_leafs;			//< number of leafs in the covering index (power of 2)
+};
 typedef ScopeObjMap::const_iterator ScopeObjItr;
 
 class AutomatonContext
@@ -1201,10 +1556,11 @@ public:
 		:m_atm(atm_),m_logContentEvent(0),m_loggerSelf(0)
 		,m_atmstate(&atm_->atm()),m_scopecnt(0),m_scopestack()
 		,m_valuenodes(),m_values(),m_structs(),m_scopeobjmap( atm_->maxitemid()+1, ScopeObjMap())
-		,m_methodcalls(),m_rootelements()
+		,m_methodcalls(),m_nofReadyCalls(0),m_rootelements()
 		,m_results( new RequestResultTemplate[ atm_->resultdefs().size()])
-		,m_maskOfRequiredInheritedContexts(getRequiredInheritedContextsMask(atm_)),m_nofInheritedContexts(0)
-		,m_done(false),m_errcode(papuga_Ok),m_erritemid(-1)
+		,m_maskOfRequiredInheritedContexts(atm_->requiredInheritedContextsMask()),m_nofInheritedContexts(0)
+		,m_streaming(false),m_scopeobjmapChanged(false),m_generation(0)
+		,m_done(false),m_errcode(papuga_Ok),m_erritemid(-1),m_errevent(-1)
 	{
 		if (logger && logger->logContentEvent && logger->self)
 		{
@@ -1243,22 +1599,25 @@ public:
 		return m_erritemid;
 	}
 
+	int lastErrorEvent() const
+	{
+		return m_errevent;
+	}
+
 	bool processEvents( const textwolf::XMLScannerBase::ElementType tp, const papuga_ValueVariant* value, const char* valuestr, size_t valuelen)
 	{
 		AutomatonState::iterator itr = m_atmstate.push( tp, valuestr, valuelen);
+		m_events.clear();
 		for (*itr; *itr; ++itr)
 		{
-			int ev = *itr;
-			m_event_stacks[ AtmRef_type(ev)].push( ev);
+			m_events.push( *itr);
 		}
 		// Ensure that events are issued in the order InstantiateValue,CollectValue,CloseStruct and MethodCall:
-		int ei = 0, ee = MaxAtmRefType+1;
-		for (;ei < ee; ++ei)
+		const std::vector<int>& events = m_events.ordered();
+		std::vector<int>::const_iterator ei = events.begin(), ee = events.end();
+		for (; ei != ee; ++ei)
 		{
-			for (int ev=m_event_stacks[ei].pop(); ev; ev=m_event_stacks[ei].pop())
-			{
-				if (!processEvent( ev, value)) return false;
-			}
+			if (!processEvent( *ei, value)) return false;
 		}
 		return true;
 	}
@@ -1268,12 +1627,44 @@ public:
 		char localbuf[ 1024];
 		size_t valuelen;
 		const char* valuestr = (const char*)papuga_ValueVariant_tostring_enc( value, papuga_UTF8, localbuf, sizeof(localbuf)-1, &valuelen, &m_errcode);
-		if (!valuestr) return false;
+		if (!valuestr)
+		{
+			if (m_errcode != papuga_BufferOverflowError || !papuga_ValueVariant_isstring( value)) return false;
+			// ... strings not fitting into the local buffer are converted in a buffer kept for the next elements
+			m_errcode = papuga_Ok;
+			m_valuebuf.resize( value->length * 6 + 4);
+			valuestr = (const char*)papuga_ValueVariant_tostring_enc( value, papuga_UTF8, &m_valuebuf[0], m_valuebuf.size()-1, &valuelen, &m_errcode);
+			if (!valuestr) return false;
+			m_valuebuf[ valuelen] = 0;	//... textwolf needs null termination
+			return processEvents( tp, value, valuestr, valuelen);
+		}
 		localbuf[ valuelen] = 0;	//... textwolf needs null termination
 
 		return processEvents( tp, value, valuestr, valuelen);
 	}
 
+	/// \brief Push a value only selected but never compared by the automaton, if it has no value conditions, without converting it to UTF-8
+	bool pushSelectedValueAndProcessEvents( const textwolf::XMLScannerBase::ElementType tp, const papuga_ValueVariant* value, bool terminated)
+	{
+		if (!m_atm->hasValueConditions())
+		{
+			return processEvents( tp, value, "", 0);
+		}
+		return terminated
+			? pushTerminatedValueAndProcessEvents( tp, value)
+			: pushValueAndProcessEvents( tp, value);
+	}
+
+	/// \brief Push a value that is known to be null terminated if it is a UTF-8 string, avoiding the conversion into a local buffer
+	bool pushTerminatedValueAndProcessEvents( const textwolf::XMLScannerBase::ElementType tp, const papuga_ValueVariant* value)
+	{
+		if (value->valuetype == papuga_TypeString && value->encoding == papuga_UTF8)
+		{
+			return processEvents( tp, value, value->value.string, value->length);
+		}
+		return pushValueAndProcessEvents( tp, value);
+	}
+
 	bool pushEmptyAndProcessEvents( const textwolf::XMLScannerBase::ElementType tp, const papuga_ValueVariant* value)
 	{
 		return processEvents( tp, value, "", 0);
@@ -1283,21 +1674,7 @@ public:
 	{
 		try
 		{
-			++m_scopecnt;
-			if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "open tag", -1/*itemid*/, tagname);
-			if (m_scopestack.size() <= 1 && papuga_ValueVariant_isstring(tagname))
-			{
-				std::string elem = papuga::ValueVariant_tostring( *tagname, m_errcode);
-				if (elem.empty())
-				{
-					if (m_errcode == papuga_Ok) m_errcode = papuga_SyntaxError;
-					return false;
-				}
-				m_rootelements.insert( elem);
-			}
-			m_scopestack.push_back( m_scopecnt);
-			if (!pushValueAndProcessEvents( textwolf::XMLScannerBase::OpenTag, tagname)) return false;
-			return true;
+			return openTag( tagname, false) && syncStreaming();
 		}
 		CATCH_LOCAL_EXCEPTION(m_errcode,false)
 	}
@@ -1306,10 +1683,7 @@ public:
 	{
 		try
 		{
-			++m_scopecnt;
-			if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "attribute name", -1/*itemid*/, attrname);
-			if (!pushValueAndProcessEvents( textwolf::XMLScannerBase::TagAttribName, attrname)) return false;
-			return true;
+			return attributeName( attrname, false) && syncStreaming();
 		}
 		CATCH_LOCAL_EXCEPTION(m_errcode,false)
 	}
@@ -1317,10 +1691,7 @@ public:
 	{
 		try
 		{
-			++m_scopecnt;
-			if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "attribute value", -1/*itemid*/, value);
-			if (!pushValueAndProcessEvents( textwolf::XMLScannerBase::TagAttribValue, value)) return false;
-			return true;
+			return attributeValue( value, false) && syncStreaming();
 		}
 		CATCH_LOCAL_EXCEPTION(m_errcode,false)
 	}
@@ -1329,27 +1700,58 @@ public:
 	{
 		try
 		{
-			++m_scopecnt;
-			if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "content value", -1/*itemid*/, value);
-			if (!pushEmptyAndProcessEvents( textwolf::XMLScannerBase::Content, value)) return false;
-			return true;
+			return contentValue( value) && syncStreaming();
 		}
 		CATCH_LOCAL_EXCEPTION(m_errcode,false)
 	}
 
 	bool processCloseTag()
 	{
-		static const Value empty;
 		try
 		{
-			++m_scopecnt;
-			if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "close tag", -1/*itemid*/, NULL/*value*/);
-			if (!pushEmptyAndProcessEvents( textwolf::XMLScannerBase::CloseTag, &empty.content)) return false;
-			m_scopestack.pop_back();
+			return closeTag() && syncStreaming();
+		}
+		CATCH_LOCAL_EXCEPTION(m_errcode,false)
+	}
+
+	bool processEventBatch( const papuga_RequestParserEvent* ar, int arsize)
+	{
+		try
+		{
+			// ... m_errevent is the index of the event processed, kept on failure and reset on success
+			for (m_errevent = 0; m_errevent < arsize; ++m_errevent)
+			{
+				const papuga_RequestParserEvent& ev = ar[ m_errevent];
+				switch (ev.type)
+				{
+					case papuga_RequestElementType_None:
+						break;
+					case papuga_RequestElementType_Open:
+						if (!openTag( &ev.value, true)) return false;
+						break;
+					case papuga_RequestElementType_Close:
+						if (!closeTag()) return false;
+						break;
+					case papuga_RequestElementType_AttributeName:
+						if (!attributeName( &ev.value, true)) return false;
+						break;
+					case papuga_RequestElementType_AttributeValue:
+						if (!attributeValue( &ev.value, true)) return false;
+						break;
+					case papuga_RequestElementType_Value:
+						if (!contentValue( &ev.value)) return false;
+						break;
+				}
+			}
+			// ... a failure synchronizing the calls fetched while streaming is assigned to the last event
+			m_errevent = arsize-1;
+			if (!syncStreaming()) return false;
+			m_errevent = -1;
 			return true;
 		}
 		CATCH_LOCAL_EXCEPTION(m_errcode,false)
 	}
+
 	bool done()
 	{
 		try
@@ -1357,7 +1759,12 @@ public:
 			if (m_done) return true;
 			++m_scopecnt;
 			// Order method calls according grouping and order of occurrence:
-			std::sort( m_methodcalls.begin(), m_methodcalls.end());
+			std::sort( m_methodcalls.begin() + m_nofReadyCalls, m_methodcalls.end());
+			m_nofReadyCalls = m_methodcalls.size();
+			// Order the scope to object maps and build their index for resolving items:
+			std::vector<ScopeObjMap>::iterator mi = m_scopeobjmap.begin(), me = m_scopeobjmap.end();
+			for (; mi != me; ++mi) mi->build();
+			++m_generation;
 			// Initialize list of all root elements:
 			if (!m_atm->isValidRootTagSet( m_rootelements))
 			{
@@ -1371,7 +1778,20 @@ public:
 	}
 	const MethodCallNode* methodCallNode( int idx) const
 	{
-		return (idx >= (int)m_methodcalls.size()) ? NULL : &m_methodcalls[ idx];
+		return (idx >= m_nofReadyCalls) ? NULL : &m_methodcalls[ idx];
+	}
+	/// \brief Declare that calls are fetched while the request is fed
+	/// \return false if the automaton does not allow to execute calls before the request is completed
+	bool startStreaming()
+	{
+		if (!m_atm->streamable()) return false;
+		m_streaming = true;
+		return syncStreaming();
+	}
+	/// \brief Counter incremented whenever the scope to object maps are reordered, iterators on them have to be reset then
+	int generation() const
+	{
+		return m_generation;
 	}
 	const std::vector<Value>& values() const
 	{
@@ -1388,6 +1808,7 @@ public:
 	void insertObjectRef( int itemid, const ScopeKeyType& type, const Scope& scope, int taglevel_, const ObjectRef& objref)
 	{
 		m_scopeobjmap[ itemid].insert( ScopeObjElem( ScopeKey(type,scope), ObjectDescr( objref, taglevel_)));
+		m_scopeobjmapChanged = true;
 	}
 	Scope curscope() const
 	{
@@ -1454,13 +1875,91 @@ public:
 	{
 		return m_loggerSelf;
 	}
+	int maxnofargs() const
+	{
+		return m_atm->maxnofargs();
+	}
 
 private:
-	static bool isequalVarname( const char* v1, const char* v2)
+	/// \brief Make the calls issued available to the iterator in streaming mode, called after every element fed
+	/// \note All calls issued are complete, because events of calls come after the events of the items in their scope
+	bool syncStreaming()
 	{
-		if (v1 == v2) return true;
-		if (!v1) return false;
-		return (0==std::strcmp( v1, v2));
+		if (!m_streaming || m_done) return true;
+		std::sort( m_methodcalls.begin() + m_nofReadyCalls, m_methodcalls.end());
+		int nofready = m_methodcalls.size();
+		if (nofready > m_nofReadyCalls && m_methodcalls[ nofready-1].def->isVariableAssignment())
+		{
+			// ... hold back a trailing sequence of assignments to the same variable, because it may get continued and is bound to an array then
+			const MethodCallNode& last = m_methodcalls[ nofready-1];
+			while (nofready > m_nofReadyCalls
+				&& m_methodcalls[ nofready-1].def->isVariableAssignment()
+				&& m_methodcalls[ nofready-1].group == last.group
+				&& m_methodcalls[ nofready-1].def->resultvarid == last.def->resultvarid)
+			{
+				--nofready;
+			}
+		}
+		m_nofReadyCalls = nofready;
+		if (m_scopeobjmapChanged)
+		{
+			std::vector<ScopeObjMap>::iterator mi = m_scopeobjmap.begin(), me = m_scopeobjmap.end();
+			for (; mi != me; ++mi) (void)mi->sync();
+			m_scopeobjmapChanged = false;
+			++m_generation;
+		}
+		return true;
+	}
+
+	/// \brief Handlers of the request elements, the exceptions are caught by the caller
+	/// \param[in] terminated true if a UTF-8 string value passed is known to be null terminated
+	bool openTag( const papuga_ValueVariant* tagname, bool terminated)
+	{
+		++m_scopecnt;
+		if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "open tag", -1/*itemid*/, tagname);
+		if (m_scopestack.size() <= 1 && papuga_ValueVariant_isstring(tagname))
+		{
+			std::string elem = papuga::ValueVariant_tostring( *tagname, m_errcode);
+			if (elem.empty())
+			{
+				if (m_errcode == papuga_Ok) m_errcode = papuga_SyntaxError;
+				return false;
+			}
+			m_rootelements.insert( elem);
+		}
+		m_scopestack.push_back( m_scopecnt);
+		return terminated
+			? pushTerminatedValueAndProcessEvents( textwolf::XMLScannerBase::OpenTag, tagname)
+			: pushValueAndProcessEvents( textwolf::XMLScannerBase::OpenTag, tagname);
+	}
+	bool attributeName( const papuga_ValueVariant* attrname, bool terminated)
+	{
+		++m_scopecnt;
+		if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "attribute name", -1/*itemid*/, attrname);
+		return terminated
+			? pushTerminatedValueAndProcessEvents( textwolf::XMLScannerBase::TagAttribName, attrname)
+			: pushValueAndProcessEvents( textwolf::XMLScannerBase::TagAttribName, attrname);
+	}
+	bool attributeValue( const papuga_ValueVariant* value, bool terminated)
+	{
+		++m_scopecnt;
+		if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "attribute value", -1/*itemid*/, value);
+		return pushSelectedValueAndProcessEvents( textwolf::XMLScannerBase::TagAttribValue, value, terminated);
+	}
+	bool contentValue( const papuga_ValueVariant* value)
+	{
+		++m_scopecnt;
+		if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "content value", -1/*itemid*/, value);
+		return pushEmptyAndProcessEvents( textwolf::XMLScannerBase::Content, value);
+	}
+	bool closeTag()
+	{
+		static const Value empty;
+		++m_scopecnt;
+		if (m_logContentEvent) m_logContentEvent( m_loggerSelf, "close tag", -1/*itemid*/, NULL/*value*/);
+		if (!pushEmptyAndProcessEvents( textwolf::XMLScannerBase::CloseTag, &empty.content)) return false;
+		m_scopestack.pop_back();
+		return true;
 	}
 
 	bool processEvent( int ev, const papuga_ValueVariant* evalue)
@@ -1555,7 +2054,7 @@ private:
 						const MethodCallNode& mc = m_methodcalls[mi-1];
 						if (mc.scope.inside( cscope)
 							&& calldef != mc.def
-							&& isequalVarname( mc.def->resultvarname, calldef->resultvarname))
+							&& mc.def->resultvarid == calldef->resultvarid)
 						{
 							if (m_logContentEvent)
 							{
@@ -1676,20 +2175,6 @@ private:
 		}
 	};
 
-	static int getRequiredInheritedContextsMask( const AutomatonDescription* atm)
-	{
-		int rt = 0;
-		std::vector<AutomatonDescription::InheritFromDef>::const_iterator hi = atm->inheritdefs().begin(), he = atm->inheritdefs().end();
-		for (int hidx=0; hi != he; ++hi,++hidx)
-		{
-			if (hi->required)
-			{
-				rt |= (1 << hidx);
-			}
-		}
-		return rt;
-	}
-
 	bool pushInheritedContext( int idx, const papuga_ValueVariant* value)
 	{
 		if (m_nofInheritedContexts >= MaxNofInheritedContexts)
@@ -1735,6 +2220,7 @@ private:
 	AutomatonState m_atmstate;
 	papuga_Allocator m_allocator;
 	char m_allocator_membuf[ 4096];
+	std::string m_valuebuf;					//< buffer for converting values too big for the local buffer
 	int m_scopecnt;
 	std::vector<int> m_scopestack;
 	std::vector<ValueNode> m_valuenodes;
@@ -1742,16 +2228,21 @@ private:
 	std::vector<const StructDef*> m_structs;
 	std::vector<ScopeObjMap> m_scopeobjmap;
 	std::vector<MethodCallNode> m_methodcalls;
+	int m_nofReadyCalls;					//< number of calls in m_methodcalls ready to be fetched by the iterator
 	std::set<std::string> m_rootelements;
 	RequestResultTemplate* m_results;
 	enum {MaxNofInheritedContexts=31};
 	int m_maskOfRequiredInheritedContexts;
 	int m_nofInheritedContexts;
 	papuga_RequestInheritedContextDef m_inheritedContexts[ MaxNofInheritedContexts+1];
+	bool m_streaming;					//< true, if calls are fetched while the request is fed
+	bool m_scopeobjmapChanged;				//< true, if elements have been inserted into the scope to object maps since the last sync
+	int m_generation;
 	bool m_done;
 	papuga_ErrorCode m_errcode;
 	int m_erritemid;
-	EventStack m_event_stacks[ MaxAtmRefType+1];
+	int m_errevent;						//< index of the event in the last batch fed that caused the last error, -1 if none
+	EventOrderBuffer m_events;				//< events issued by the element processed
 };
 
 class RequestIterator
@@ -1767,16 +2258,19 @@ public:
 		,m_loggerSelf(ctx_->loggerSelf())
 		,m_resolvers(ctx_->scopeobjmap().size(),ScopeObjItr())
 		,m_curr_methodidx(0)
+		,m_generation(ctx_->generation())
 		,m_structpath()
 	{
 		papuga_init_RequestError( &m_errstruct);
 		papuga_init_Allocator( &m_allocator, m_allocator_membuf, sizeof(m_allocator_membuf));
-		papuga_init_RequestMethodCall( &m_curr_methodcall);
-		std::vector<ScopeObjMap>::const_iterator mi = ctx_->scopeobjmap().begin(), me = ctx_->scopeobjmap().end();
-		for (int midx=0; mi != me; ++mi,++midx)
+		papuga_ValueVariant* argv = (papuga_ValueVariant*)papuga_Allocator_alloc( &m_allocator, ctx_->maxnofargs() * sizeof(papuga_ValueVariant), 0);
+		if (!argv)
 		{
-			m_resolvers[ midx] = mi->end();
+			papuga_destroy_Allocator( &m_allocator);
+			throw std::bad_alloc();
 		}
+		papuga_init_RequestMethodCall( &m_curr_methodcall, argv);
+		resetResolvers();
 	}
 
 	~RequestIterator()
@@ -1827,10 +2321,20 @@ public:
 		try
 		{
 			if (!m_ctx) return NULL;
+			if (m_generation != m_ctx->generation())
+			{
+				// ... the scope to object maps have been changed by content fed in streaming mode
+				resetResolvers();
+				m_generation = m_ctx->generation();
+			}
 			const MethodCallNode* mcnode = m_ctx->methodCallNode( m_curr_methodidx);
 			if (!mcnode)
 			{
-				std::memset( &m_curr_methodcall, 0, sizeof(m_curr_methodcall));
+				m_curr_methodcall.selfvarname = 0;
+				m_curr_methodcall.resultvarname = 0;
+				m_curr_methodcall.methodid.classid = 0;
+				m_curr_methodcall.methodid.functionid = 0;
+				m_curr_methodcall.args.argc = 0;
 				return NULL;
 			}
 			m_curr_methodcall.selfvarname = mcnode->def->selfvarname;
@@ -1839,9 +2343,9 @@ public:
 			m_curr_methodcall.methodid.functionid = mcnode->def->methodid.functionid;
 
 			m_errstruct.scopestart = mcnode->scope.from;
-			papuga_init_CallArgs( &m_curr_methodcall.args, m_curr_methodcall.membuf, sizeof(m_curr_methodcall.membuf));
-
-			papuga_CallArgs* args = &m_curr_methodcall.args;
+			m_curr_methodcall.callidx = m_curr_methodidx;
+			papuga_RequestMethodArgs* args = &m_curr_methodcall.args;
+			args->argc = 0;
 
 			if (mcnode->def->isVariableAssignment())
 			{
@@ -1856,7 +2360,7 @@ public:
 				if (mcnode_itr
 					&& mcnode_itr->group == mcnode->group
 					&& mcnode_itr->def->isVariableAssignment()
-					&& 0==std::strcmp( mcnode_itr->def->resultvarname, mcnode->def->resultvarname))
+					&& mcnode_itr->def->resultvarid == mcnode->def->resultvarid)
 				{
 					// ... more than one variable assignments of the same group are bound to an array
 					papuga_Serialization* ser = papuga_Allocator_alloc_Serialization( &m_allocator);
@@ -1867,7 +2371,7 @@ public:
 						mcnode_itr
 							&& mcnode_itr->group == mcnode->group
 							&& mcnode_itr->def->isVariableAssignment()
-							&& 0==std::strcmp( mcnode_itr->def->resultvarname, mcnode->def->resultvarname);
+							&& mcnode_itr->def->resultvarid == mcnode->def->resultvarid;
 						++m_curr_methodidx, mcnode_itr = m_ctx->methodCallNode( m_curr_methodidx))
 					{
 						papuga_ValueVariant val;
@@ -1910,9 +2414,7 @@ public:
 						return NULL;
 					}
 				}
-				for (; ai
-					&& !papuga_ValueVariant_defined( args->argv+(ai-1)) 
-					&& mcdef->args[ai-1].resolvetype == papuga_ResolveTypeOptional; --ai){}
+				for (; ai > mcdef->minargc && !papuga_ValueVariant_defined( args->argv+(ai-1)); --ai){}
 				/// ... remove optional arguments at the end of the argument list, to make them replaced by default values
 
 				args->argc = ai;
@@ -1934,13 +2436,18 @@ public:
 
 	bool pushCallResult( const papuga_ValueVariant& result)
 	{
-		if (!m_curr_methodcall.resultvarname)
+		return pushCallResultAt( m_curr_methodidx-1, m_curr_methodcall.resultvarname, result);
+	}
+
+	bool pushCallResultAt( int callidx, const char* resultvarname, const papuga_ValueVariant& result)
+	{
+		if (!resultvarname)
 		{
 			m_errstruct.errcode = papuga_ValueUndefined;
 			return false;
 		}
 		bool used = false;
-		if (m_curr_methodidx <= 0)
+		if (callidx < 0 || callidx >= m_curr_methodidx)
 		{
 			m_errstruct.errcode = papuga_ExecutionOrder;
 			return false;
@@ -1950,13 +2457,13 @@ public:
 			std::size_t ri = 0, re = m_ctx->nofResults();
 			for (; ri != re; ++ri)
 			{
-				const MethodCallNode* mcnode = m_ctx->methodCallNode( m_curr_methodidx-1);
+				const MethodCallNode* mcnode = m_ctx->methodCallNode( callidx);
 				if (!mcnode)
 				{
 					m_errstruct.errcode = papuga_ExecutionOrder;
 					return false;
 				}
-				used |= m_ctx->results()[ ri].pushResult( m_curr_methodcall.resultvarname, mcnode->scope, result, m_errstruct.errcode);
+				used |= m_ctx->results()[ ri].pushResult( resultvarname, mcnode->scope, result, m_errstruct.errcode);
 			}
 		}
 		catch (const std::bad_alloc&)
@@ -1974,8 +2481,14 @@ public:
 
 	papuga_RequestResult* getResultArray( const papuga_RequestContext* context, papuga_Allocator* allocator, int& nofResults)
 	{
-		int ri = 0, re = m_ctx->nofResults();
 		nofResults = 0;
+		if (!m_ctx->isDone())
+		{
+			// ... in streaming mode the results are only available after the request is completed
+			m_errstruct.errcode = papuga_ExecutionOrder;
+			return NULL;
+		}
+		int ri = 0, re = m_ctx->nofResults();
 		for (; ri < re; ++ri)
 		{
 			if (m_ctx->results()[ ri].valid()) ++nofResults;
@@ -2145,12 +2658,27 @@ public:
 	{
 		return m_errstruct.errcode == papuga_Ok ? NULL : &m_errstruct;
 	}
+	bool nextCallReadsContext() const
+	{
+		const MethodCallNode* mcnode = m_ctx ? m_ctx->methodCallNode( m_curr_methodidx) : NULL;
+		return mcnode && mcnode->def->readsContext;
+	}
+
 	const papuga_RequestMethodCall* lastCall() const
 	{
 		return m_ctx->methodCallNode( m_curr_methodidx) ? &m_curr_methodcall : NULL;
 	}
 
 private:
+	void resetResolvers()
+	{
+		std::vector<ScopeObjMap>::const_iterator mi = m_ctx->scopeobjmap().begin(), me = m_ctx->scopeobjmap().end();
+		for (int midx=0; mi != me; ++mi,++midx)
+		{
+			m_resolvers[ midx] = mi->end();
+		}
+	}
+
 	typedef std::pair<int,int> TagLevelRange;
 	TagLevelRange getTagLevelRange( papuga_ResolveType resolvetype, int taglevel, int tagdiff)
 	{
@@ -2190,40 +2718,35 @@ private:
 		}
 	};
 
+	static bool inTagLevelRange( const ScopeObjElem& elem, const TagLevelRange& taglevelRange)
+	{
+		return elem.second.taglevel >= taglevelRange.first && elem.second.taglevel <= taglevelRange.second;
+	}
+
 	ResolvedObject resolveNearItemCoveringScope( const Scope& scope, const TagLevelRange& taglevelRange, int itemid)
 	{
-		// Seek backwards for scope overlapping search scope: 
+		// Search the nearest scope covering the search scope with the covering index:
 		const ScopeObjMap& objmap = m_ctx->scopeobjmap()[ itemid];
-		ScopeObjMap::const_iterator it = m_resolvers[ itemid];
-
-		if (it == objmap.end())
-		{
-			if (objmap.empty()) return ResolvedObject();
-			--it;
-		}
-		while (it->first.from > scope.from)
-		{
-			if (it == objmap.begin()) return ResolvedObject();
-			--it;
-		}
-		if (it->first.to >= scope.to && it->second.taglevel >= taglevelRange.first && it->second.taglevel <= taglevelRange.second)
-		{
-			return ResolvedObject( it->second.objref, it->second.taglevel, it->first);
-		}
-		else
+		int endidx = objmap.lower_bound( ScopeKey::search( scope.from+1)) - objmap.begin();
+		for (;;)
 		{
-			while (it != objmap.begin())
+			// ... all elements from the start of the group of elements starting at the same position as the element
+			//	found up to the element found are covering the search scope, because the ends are sorted descending
+			int lastidx = objmap.lastReaching( endidx, scope.to);
+			if (lastidx < 0) return ResolvedObject();
+			ScopeObjMap::const_iterator last = objmap.begin() + lastidx;
+			ScopeObjMap::const_iterator first = objmap.lower_bound( ScopeKey::search( last->first.from));
+			ScopeObjMap::const_iterator it = first;
+			for (; it <= last; ++it)
 			{
-				--it;
-				if (it->first.to > scope.from) break;
-				if (it->first.to >= scope.to && it->second.taglevel >= taglevelRange.first && it->second.taglevel <= taglevelRange.second)
+				if (inTagLevelRange( *it, taglevelRange))
 				{
 					m_resolvers[ itemid] = it;
 					return ResolvedObject( it->second.objref, it->second.taglevel, it->first);
 				}
 			}
+			endidx = first - objmap.begin();
 		}
-		return ResolvedObject();
 	}
 
 	ResolvedObject resolveNearItemInsideScope( const Scope& scope, const TagLevelRange& taglevelRange, int itemid)
@@ -2319,22 +2842,22 @@ private:
 		}
 	}
 
+	/// \brief Test if there is another item with the same start as the one found with resolveNearItemCoveringScope covering the search scope, making the reference ambiguous
 	bool hasNextCoveringItem( const Scope& scope, const TagLevelRange& taglevelRange, int itemid)
 	{
 		const ScopeObjMap& objmap = m_ctx->scopeobjmap()[ itemid];
-		ScopeObjMap::const_iterator& curitr = m_resolvers[ itemid];
+		ScopeObjMap::const_iterator curitr = m_resolvers[ itemid];
 
 		if (curitr == objmap.end()) return false;
-		for (;;)
+		int from = curitr->first.from;
+		for (++curitr; curitr != objmap.end() && curitr->first.from == from && curitr->first.to >= scope.to; ++curitr)
 		{
-			++curitr;
-			if (curitr == objmap.end() || curitr->first.from > scope.from) return false;
-			if (curitr->second.taglevel >= taglevelRange.first && curitr->second.taglevel <= taglevelRange.second
-				&& scope.inside( curitr->first))
+			if (inTagLevelRange( *curitr, taglevelRange))
 			{
 				return true;
 			}
 		}
+		return false;
 	}
 
 	bool build_structure( ValueSink& sink, const Scope& scope, int taglevel, int structidx, const papuga_RequestContext* context)
@@ -2678,6 +3201,7 @@ private:
 	void* m_loggerSelf;
 	std::vector<ScopeObjItr> m_resolvers;
 	int m_curr_methodidx;
+	int m_generation;				//< generation of the scope to object maps the resolvers refer to
 	papuga_Allocator m_allocator;
 	char m_allocator_membuf[ 4096];
 	std::vector<std::string> m_structpath;
@@ -2709,6 +3233,7 @@ struct papuga_RequestAutomaton
 {
 	AutomatonDescription atm;
 	const papuga_StructInterfaceDescription* structdefs;
+	AutomatonImageWriter image;
 };
 
 extern "C" papuga_RequestAutomaton* papuga_create_RequestAutomaton(
@@ -2722,6 +3247,15 @@ extern "C" papuga_RequestAutomaton* papuga_create_RequestAutomaton(
 	try
 	{
 		new (&rt->atm) AutomatonDescription( classdefs, strict, exclusiveAccess);
+		try
+		{
+			new (&rt->image) AutomatonImageWriter( strict, exclusiveAccess);
+		}
+		catch (...)
+		{
+			rt->atm.~AutomatonDescription();
+			throw;
+		}
 		rt->structdefs = structdefs;
 		return rt;
 	}
@@ -2734,6 +3268,7 @@ extern "C" papuga_RequestAutomaton* papuga_create_RequestAutomaton(
 
 extern "C" void papuga_destroy_RequestAutomaton( papuga_RequestAutomaton* self)
 {
+	self->image.~AutomatonImageWriter();
 	self->atm.~AutomatonDescription();
 	std::free( self);
 }
@@ -2750,7 +3285,12 @@ extern "C" bool papuga_RequestAutomaton_inherit_from(
 		const char* name_expression,
 		bool required)
 {
-	return self->atm.inheritFrom( type, name_expression, required);
+	if (!self->atm.inheritFrom( type, name_expression, required)) return false;
+	self->image.pushOp( AutomatonImageInheritFrom);
+	self->image.pushString( type);
+	self->image.pushString( name_expression);
+	self->image.pushInt( required ? 1:0);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_add_call(
@@ -2761,34 +3301,60 @@ extern "C" bool papuga_RequestAutomaton_add_call(
 		const char* resultvarname,
 		int nargs)
 {
-	return self->atm.addCall( expression, method, selfvarname, resultvarname, nargs);
+	if (!self->atm.addCall( expression, method, selfvarname, resultvarname, nargs)) return false;
+	self->image.pushOp( AutomatonImageAddCall);
+	self->image.pushString( expression);
+	self->image.pushInt( method->classid);
+	self->image.pushInt( method->functionid);
+	self->image.pushString( selfvarname);
+	self->image.pushString( resultvarname);
+	self->image.pushInt( nargs);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_set_call_arg_var( papuga_RequestAutomaton* self, int idx, const char* varname)
 {
-	return self->atm.setCallArgVar( idx, varname);
+	if (!self->atm.setCallArgVar( idx, varname)) return false;
+	self->image.pushOp( AutomatonImageSetCallArgVar);
+	self->image.pushInt( idx);
+	self->image.pushString( varname);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_set_call_arg_item( papuga_RequestAutomaton* self, int idx, int itemid, papuga_ResolveType resolvetype, int max_tag_diff)
 {
-	return self->atm.setCallArgItem( idx, itemid, resolvetype, max_tag_diff);
+	if (!self->atm.setCallArgItem( idx, itemid, resolvetype, max_tag_diff)) return false;
+	self->image.pushOp( AutomatonImageSetCallArgItem);
+	self->image.pushInt( idx);
+	self->image.pushInt( itemid);
+	self->image.pushInt( (int)resolvetype);
+	self->image.pushInt( max_tag_diff);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_prioritize_last_call(
 		papuga_RequestAutomaton* self,
 		const char* scope_expression)
 {
-	return self->atm.prioritizeLastCallInScope( scope_expression);
+	if (!self->atm.prioritizeLastCallInScope( scope_expression)) return false;
+	self->image.pushOp( AutomatonImagePrioritizeLastCall);
+	self->image.pushString( scope_expression);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_open_group( papuga_RequestAutomaton* self, int groupid)
 {
-	return self->atm.openGroup( groupid);
+	if (!self->atm.openGroup( groupid)) return false;
+	self->image.pushOp( AutomatonImageOpenGroup);
+	self->image.pushInt( groupid);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_close_group( papuga_RequestAutomaton* self)
 {
-	return self->atm.closeGroup();
+	if (!self->atm.closeGroup()) return false;
+	self->image.pushOp( AutomatonImageCloseGroup);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_add_structure(
@@ -2797,7 +3363,12 @@ extern "C" bool papuga_RequestAutomaton_add_structure(
 		int itemid,
 		int nofmembers)
 {
-	return self->atm.addStructure( expression, itemid, nofmembers);
+	if (!self->atm.addStructure( expression, itemid, nofmembers)) return false;
+	self->image.pushOp( AutomatonImageAddStructure);
+	self->image.pushString( expression);
+	self->image.pushInt( itemid);
+	self->image.pushInt( nofmembers);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_set_structure_element_item(
@@ -2808,7 +3379,14 @@ extern "C" bool papuga_RequestAutomaton_set_structure_element_item(
 		papuga_ResolveType resolvetype,
 		int max_tag_diff)
 {
-	return self->atm.setMemberItem( idx, name, itemid, resolvetype, max_tag_diff);
+	if (!self->atm.setMemberItem( idx, name, itemid, resolvetype, max_tag_diff)) return false;
+	self->image.pushOp( AutomatonImageSetMemberItem);
+	self->image.pushInt( idx);
+	self->image.pushString( name);
+	self->image.pushInt( itemid);
+	self->image.pushInt( (int)resolvetype);
+	self->image.pushInt( max_tag_diff);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_set_structure_element_var(
@@ -2817,7 +3395,12 @@ extern "C" bool papuga_RequestAutomaton_set_structure_element_var(
 		const char* name,
 		const char* varname)
 {
-	return self->atm.setMemberVar( idx, name, varname);
+	if (!self->atm.setMemberVar( idx, name, varname)) return false;
+	self->image.pushOp( AutomatonImageSetMemberVar);
+	self->image.pushInt( idx);
+	self->image.pushString( name);
+	self->image.pushString( varname);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomaton_add_value(
@@ -2826,14 +3409,91 @@ extern "C" bool papuga_RequestAutomaton_add_value(
 		const char* select_expression,
 		int itemid)
 {
-	return self->atm.addValue( scope_expression, select_expression, itemid);
+	if (!self->atm.addValue( scope_expression, select_expression, itemid)) return false;
+	self->image.pushOp( AutomatonImageAddValue);
+	self->image.pushString( scope_expression);
+	self->image.pushString( select_expression);
+	self->image.pushInt( itemid);
+	return true;
+}
+
+/* Record a result description as the sequence of calls building it, a structure node is recorded with its open node, the close node following it implicitly */
+static void pushResultDescriptionImage( AutomatonImageWriter& image, const papuga_RequestResultDescription* descr)
+{
+	image.pushOp( AutomatonImageAddResult);
+	image.pushString( descr->name);
+	image.pushString( descr->schema);
+	image.pushString( descr->requestmethod);
+	image.pushString( descr->addressvar);
+	image.pushString( descr->path);
+	image.pushInt( descr->contentvarsize);
+	int ci = 0, ce = descr->contentvarsize;
+	for (; ci != ce; ++ci)
+	{
+		image.pushString( descr->contentvar[ ci]);
+	}
+	int nofnodes = 0;
+	int ni = 0, ne = descr->nodearsize;
+	for (; ni != ne; ++ni)
+	{
+		if (descr->nodear[ ni].type != papuga_ResultNodeCloseStructure && descr->nodear[ ni].type != papuga_ResultNodeCloseArray) ++nofnodes;
+	}
+	image.pushInt( nofnodes);
+	for (ni = 0; ni != ne; ++ni)
+	{
+		const papuga_RequestResultNodeDescription& nd = descr->nodear[ ni];
+		switch (nd.type)
+		{
+			case papuga_ResultNodeConstant:
+				image.pushInt( nd.type);
+				image.pushString( nd.inputselect);
+				image.pushString( nd.tagname);
+				image.pushString( nd.value.str);
+				break;
+			case papuga_ResultNodeOpenStructure:
+			case papuga_ResultNodeOpenArray:
+			{
+				papuga_RequestResultNodeType closetype = nd.type == papuga_ResultNodeOpenArray ? papuga_ResultNodeCloseArray : papuga_ResultNodeCloseStructure;
+				if (ni+1 == ne || descr->nodear[ ni+1].type != closetype)
+				{
+					image.setError( papuga_NotImplemented);
+					return;
+				}
+				image.pushInt( nd.type);
+				image.pushString( nd.inputselect);
+				image.pushString( nd.tagname);
+				++ni;
+				break;
+			}
+			case papuga_ResultNodeCloseStructure:
+			case papuga_ResultNodeCloseArray:
+				image.setError( papuga_NotImplemented);
+				return;
+			case papuga_ResultNodeInputReference:
+				image.pushInt( nd.type);
+				image.pushString( nd.inputselect);
+				image.pushString( nd.tagname);
+				image.pushInt( nd.value.itemid);
+				image.pushInt( (int)nd.resolvetype);
+				break;
+			case papuga_ResultNodeResultReference:
+				image.pushInt( nd.type);
+				image.pushString( nd.inputselect);
+				image.pushString( nd.tagname);
+				image.pushString( nd.value.str);
+				image.pushInt( (int)nd.resolvetype);
+				break;
+		}
+	}
 }
 
 extern "C" bool papuga_RequestAutomation_add_result(
 		papuga_RequestAutomaton* self,
 		papuga_RequestResultDescription* descr)
 {
-	return self->atm.addResultDescription( descr);
+	if (!self->atm.addResultDescription( descr)) return false;
+	pushResultDescriptionImage( self->image, descr);
+	return true;
 }
 
 extern "C" bool papuga_RequestAutomation_add_env_assignment(
@@ -2842,7 +3502,12 @@ extern "C" bool papuga_RequestAutomation_add_env_assignment(
 		int envid,
 		const char* argument)
 {
-	return self->atm.addEnvAssignment( variable, envid, argument);
+	if (!self->atm.addEnvAssignment( variable, envid, argument)) return false;
+	self->image.pushOp( AutomatonImageAddEnvAssignment);
+	self->image.pushString( variable);
+	self->image.pushInt( envid);
+	self->image.pushString( argument);
+	return true;
 }
 
 extern "C" const papuga_RequestEnvAssignment* papuga_RequestAutomation_get_env_assignments( const papuga_RequestAutomaton* self)
@@ -2857,7 +3522,233 @@ extern "C" bool papuga_RequestAutomaton_has_exclusive_access( const papuga_Reque
 
 extern "C" bool papuga_RequestAutomaton_done( papuga_RequestAutomaton* self)
 {
-	return self->atm.done();
+	if (!self->atm.done()) return false;
+	self->image.build();
+	return true;
+}
+
+extern "C" const void* papuga_RequestAutomaton_save( const papuga_RequestAutomaton* self, size_t* imagesize, papuga_ErrorCode* errcode)
+{
+	if (!self->atm.isDone())
+	{
+		*errcode = papuga_ExecutionOrder;
+		return NULL;
+	}
+	if (self->image.lastError() != papuga_Ok)
+	{
+		*errcode = self->image.lastError();
+		return NULL;
+	}
+	*imagesize = self->image.image().size();
+	return self->image.image().c_str();
+}
+
+static bool readResultDescriptionImage( papuga_RequestResultDescription*& descr, AutomatonImageReader& reader)
+{
+	const char* name;
+	const char* schema;
+	const char* requestmethod;
+	const char* addressvar;
+	const char* path;
+	int nofcontentvars;
+	if (!reader.readString( name) || !reader.readString( schema) || !reader.readString( requestmethod)
+	||  !reader.readString( addressvar) || !reader.readString( path) || !reader.readInt( nofcontentvars)) return false;
+
+	descr = papuga_create_RequestResultDescription( name, schema, requestmethod, addressvar, path);
+	if (!descr) return false;
+	int ci = 0;
+	for (; ci < nofcontentvars; ++ci)
+	{
+		const char* variable;
+		if (!reader.readString( variable) || !papuga_RequestResultDescription_push_content_variable( descr, variable)) return false;
+	}
+	int nofnodes;
+	if (!reader.readInt( nofnodes)) return false;
+	int ni = 0;
+	for (; ni < nofnodes; ++ni)
+	{
+		int nodetype;
+		const char* inputselect;
+		const char* tagname;
+		const char* str;
+		int itemid;
+		int resolvetype;
+		if (!reader.readInt( nodetype) || !reader.readString( inputselect) || !reader.readString( tagname)) return false;
+		switch ((papuga_RequestResultNodeType)nodetype)
+		{
+			case papuga_ResultNodeConstant:
+				if (!reader.readString( str)
+				||  !papuga_RequestResultDescription_push_constant( descr, inputselect, tagname, str)) return false;
+				break;
+			case papuga_ResultNodeOpenStructure:
+			case papuga_ResultNodeOpenArray:
+				if (!papuga_RequestResultDescription_push_structure( descr, inputselect, tagname, nodetype == papuga_ResultNodeOpenArray)) return false;
+				break;
+			case papuga_ResultNodeInputReference:
+				if (!reader.readInt( itemid) || !reader.readInt( resolvetype)
+				||  !papuga_RequestResultDescription_push_input( descr, inputselect, tagname, itemid, (papuga_ResolveType)resolvetype)) return false;
+				break;
+			case papuga_ResultNodeResultReference:
+				if (!reader.readString( str) || !reader.readInt( resolvetype)
+				||  !papuga_RequestResultDescription_push_callresult( descr, inputselect, tagname, str, (papuga_ResolveType)resolvetype)) return false;
+				break;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+/* Replay the calls recorded in an image on an automaton created, the automaton records them again, so that a loaded automaton can be saved */
+static bool loadAutomatonImage( papuga_RequestAutomaton* self, AutomatonImageReader& reader, papuga_ErrorCode& errcode)
+{
+	while (!reader.eof())
+	{
+		AutomatonImageOp op;
+		const char* str1;
+		const char* str2;
+		const char* str3;
+		int val1;
+		int val2;
+		int val3;
+		int val4;
+		bool rt = false;
+		errcode = papuga_SyntaxError;
+
+		if (!reader.readOp( op)) return false;
+		switch (op)
+		{
+			case AutomatonImageInheritFrom:
+				if (!reader.readString( str1) || !reader.readString( str2) || !reader.readInt( val1)) return false;
+				rt = papuga_RequestAutomaton_inherit_from( self, str1, str2, val1 != 0);
+				break;
+			case AutomatonImageAddCall:
+			{
+				papuga_RequestMethodId method;
+				if (!reader.readString( str1) || !reader.readInt( method.classid) || !reader.readInt( method.functionid)
+				||  !reader.readString( str2) || !reader.readString( str3) || !reader.readInt( val1)) return false;
+				rt = papuga_RequestAutomaton_add_call( self, str1, &method, str2, str3, val1);
+				break;
+			}
+			case AutomatonImageSetCallArgVar:
+				if (!reader.readInt( val1) || !reader.readString( str1)) return false;
+				rt = papuga_RequestAutomaton_set_call_arg_var( self, val1, str1);
+				break;
+			case AutomatonImageSetCallArgItem:
+				if (!reader.readInt( val1) || !reader.readInt( val2) || !reader.readInt( val3) || !reader.readInt( val4)) return false;
+				rt = papuga_RequestAutomaton_set_call_arg_item( self, val1, val2, (papuga_ResolveType)val3, val4);
+				break;
+			case AutomatonImagePrioritizeLastCall:
+				if (!reader.readString( str1)) return false;
+				rt = papuga_RequestAutomaton_prioritize_last_call( self, str1);
+				break;
+			case AutomatonImageOpenGroup:
+				if (!reader.readInt( val1)) return false;
+				rt = papuga_RequestAutomaton_open_group( self, val1);
+				break;
+			case AutomatonImageCloseGroup:
+				rt = papuga_RequestAutomaton_close_group( self);
+				break;
+			case AutomatonImageAddStructure:
+				if (!reader.readString( str1) || !reader.readInt( val1) || !reader.readInt( val2)) return false;
+				rt = papuga_RequestAutomaton_add_structure( self, str1, val1, val2);
+				break;
+			case AutomatonImageSetMemberItem:
+				if (!reader.readInt( val1) || !reader.readString( str1) || !reader.readInt( val2) || !reader.readInt( val3) || !reader.readInt( val4)) return false;
+				rt = papuga_RequestAutomaton_set_structure_element_item( self, val1, str1, val2, (papuga_ResolveType)val3, val4);
+				break;
+			case AutomatonImageSetMemberVar:
+				if (!reader.readInt( val1) || !reader.readString( str1) || !reader.readString( str2)) return false;
+				rt = papuga_RequestAutomaton_set_structure_element_var( self, val1, str1, str2);
+				break;
+			case AutomatonImageAddValue:
+				if (!reader.readString( str1) || !reader.readString( str2) || !reader.readInt( val1)) return false;
+				rt = papuga_RequestAutomaton_add_value( self, str1, str2, val1);
+				break;
+			case AutomatonImageAddResult:
+			{
+				papuga_RequestResultDescription* descr = NULL;
+				if (!readResultDescriptionImage( descr, reader))
+				{
+					if (descr) papuga_destroy_RequestResultDescription( descr);
+					return false;
+				}
+				rt = papuga_RequestAutomation_add_result( self, descr);
+				if (!rt) papuga_destroy_RequestResultDescription( descr);
+				break;
+			}
+			case AutomatonImageAddEnvAssignment:
+				if (!reader.readString( str1) || !reader.readInt( val1) || !reader.readString( str2)) return false;
+				rt = papuga_RequestAutomation_add_env_assignment( self, str1, val1, str2);
+				break;
+			default:
+				return false;
+		}
+		if (!rt)
+		{
+			errcode = self->atm.lastError();
+			return false;
+		}
+	}
+	if (!papuga_RequestAutomaton_done( self))
+	{
+		errcode = self->atm.lastError();
+		return false;
+	}
+	errcode = papuga_Ok;
+	return true;
+}
+
+extern "C" papuga_RequestAutomaton* papuga_load_RequestAutomaton(
+		const papuga_ClassDef* classdefs,
+		const papuga_StructInterfaceDescription* structdefs,
+		const void* image,
+		size_t imagesize,
+		papuga_ErrorCode* errcode)
+{
+	AutomatonImageReader reader( image, imagesize);
+	if (!reader.valid())
+	{
+		*errcode = papuga_SyntaxError;
+		return NULL;
+	}
+	papuga_RequestAutomaton* rt = papuga_create_RequestAutomaton( classdefs, structdefs, reader.strict(), reader.exclusiveAccess());
+	if (!rt)
+	{
+		*errcode = papuga_NoMemError;
+		return NULL;
+	}
+	const char* strings = rt->atm.copyBlock( reader.strings(), reader.stringssize());
+	if (!strings)
+	{
+		*errcode = papuga_NoMemError;
+		papuga_destroy_RequestAutomaton( rt);
+		return NULL;
+	}
+	reader.setStringBase( strings);
+	if (!loadAutomatonImage( rt, reader, *errcode))
+	{
+		papuga_destroy_RequestAutomaton( rt);
+		return NULL;
+	}
+	return rt;
+}
+
+extern "C" bool papuga_RequestAutomaton_is_streamable( const papuga_RequestAutomaton* self)
+{
+	return self->atm.streamable();
+}
+
+extern "C" int papuga_RequestAutomaton_nof_calls( const papuga_RequestAutomaton* self)
+{
+	return self->atm.callnodes().size();
+}
+
+extern "C" const papuga_RequestCallNode* papuga_RequestAutomaton_get_call_node( const papuga_RequestAutomaton* self, int callidx)
+{
+	const std::vector<papuga_RequestCallNode>& nodes = self->atm.callnodes();
+	if (callidx < 0 || callidx >= (int)nodes.size()) return NULL;
+	return &nodes[ callidx];
 }
 
 struct papuga_Request
@@ -2924,6 +3815,16 @@ extern "C" bool papuga_Request_feed_content_value( papuga_Request* self, const p
 	return self->ctx.processValue( value);
 }
 
+extern "C" bool papuga_Request_feed_events( papuga_Request* self, const papuga_RequestParserEvent* ar, int arsize)
+{
+	return self->ctx.processEventBatch( ar, arsize);
+}
+
+extern "C" int papuga_Request_last_error_event( const papuga_Request* self)
+{
+	return self->ctx.lastErrorEvent();
+}
+
 extern "C" bool papuga_Request_done( papuga_Request* self)
 {
 	return self->ctx.done();
@@ -2974,6 +3875,30 @@ extern "C" papuga_RequestIterator* papuga_create_RequestIterator( papuga_Allocat
 	}
 }
 
+extern "C" papuga_RequestIterator* papuga_create_RequestIterator_streaming( papuga_Allocator* allocator, papuga_Request* request, papuga_ErrorCode* errcode)
+{
+	papuga_RequestIterator* rt = (papuga_RequestIterator*)papuga_Allocator_alloc( allocator, sizeof(*rt), 0);
+	if (!rt) return NULL;
+	try
+	{
+		if (request->ctx.startStreaming())
+		{
+			new (&rt->itr) RequestIterator( &request->ctx);
+		}
+		else
+		{
+			*errcode = papuga_NotAllowed;
+			rt = NULL;
+		}
+		return rt;
+	}
+	catch (...)
+	{
+		*errcode = papuga_NoMemError;
+		return NULL;
+	}
+}
+
 extern "C" void papuga_destroy_RequestIterator( papuga_RequestIterator* self)
 {
 	self->itr.~RequestIterator();
@@ -2989,6 +3914,16 @@ extern "C" bool papuga_RequestIterator_push_call_result( papuga_RequestIterator*
 	return self->itr.pushCallResult( *result);
 }
 
+extern "C" bool papuga_RequestIterator_push_call_result_at( papuga_RequestIterator* self, int callidx, const char* resultvarname, const papuga_ValueVariant* result)
+{
+	return self->itr.pushCallResultAt( callidx, resultvarname, *result);
+}
+
+extern "C" bool papuga_RequestIterator_next_call_reads_context( const papuga_RequestIterator* self)
+{
+	return self->itr.nextCallReadsContext();
+}
+
 extern "C" papuga_RequestResult* papuga_RequestIterator_get_result_array( papuga_RequestIterator* self, const papuga_RequestContext* context, papuga_Allocator* allocator, int* nofResults)
 {
 	return self->itr.getResultArray( context, allocator, *nofResults);
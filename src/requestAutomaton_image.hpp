@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _PAPUGA_REQUEST_AUTOMATON_IMAGE_HPP_INCLUDED
+#define _PAPUGA_REQUEST_AUTOMATON_IMAGE_HPP_INCLUDED
+/// \brief Private helper classes to write and read the binary image of a request automaton
+/// \file requestAutomaton_image.hpp
+#include "papuga/typedefs.h"
+#include <string>
+#include <map>
+#include <cstring>
+#include <cstddef>
+
+namespace papuga {
+
+/// \brief Operations recorded in an automaton image, one per call of a function building the automaton
+/// \note An image is a log of the calls building an automaton, loading it replays them and compiles the select expressions again
+enum AutomatonImageOp
+{
+	AutomatonImageInheritFrom = 1,
+	AutomatonImageAddCall,
+	AutomatonImageSetCallArgVar,
+	AutomatonImageSetCallArgItem,
+	AutomatonImagePrioritizeLastCall,
+	AutomatonImageOpenGroup,
+	AutomatonImageCloseGroup,
+	AutomatonImageAddStructure,
+	AutomatonImageSetMemberItem,
+	AutomatonImageSetMemberVar,
+	AutomatonImageAddValue,
+	AutomatonImageAddResult,
+	AutomatonImageAddEnvAssignment
+};
+
+/// \brief Layout of an automaton image:
+///	header: magic (8 bytes), version, flags, size of the operations, size of the string table (32 bit little endian integers each)
+///	operations: sequence of 32 bit little endian integers, an operation code followed by its arguments
+///	string table: '\0' terminated strings referenced by their offset, 0xFFFFFFFF for NULL
+/// \note The image contains no pointers and no alignment requirements, it can be read in place from any address (e.g. a memory mapped file)
+struct AutomatonImageHeader
+{
+	enum {
+		Version = 1,
+		FlagStrict = 0x1,
+		FlagExclusiveAccess = 0x2,
+		MagicSize = 8,
+		Size = MagicSize + 4 * 4
+	};
+	static const char* magic()	{return "PAPUGATM";}
+};
+
+/// \brief Recorder of the functions called for building an automaton
+/// \note Methods do not throw, a memory allocation error is reported by lastError()
+class AutomatonImageWriter
+{
+public:
+	AutomatonImageWriter( bool strict, bool exclusiveAccess)
+		:m_flags((strict ? AutomatonImageHeader::FlagStrict : 0) | (exclusiveAccess ? AutomatonImageHeader::FlagExclusiveAccess : 0))
+		,m_ops(),m_strings(),m_stringmap(),m_image(),m_errcode(papuga_Ok){}
+
+	void pushOp( AutomatonImageOp op)
+	{
+		pushInt( (int)op);
+	}
+	void pushInt( int value)
+	{
+		try
+		{
+			appendUint32( m_ops, (unsigned int)value);
+		}
+		catch (...)
+		{
+			m_errcode = papuga_NoMemError;
+		}
+	}
+	void pushString( const char* str)
+	{
+		try
+		{
+			if (!str)
+			{
+				appendUint32( m_ops, NullString);
+				return;
+			}
+			std::pair<std::map<std::string,unsigned int>::iterator,bool>
+				ins = m_stringmap.insert( std::pair<std::string,unsigned int>( str, m_strings.size()));
+			if (ins.second)
+			{
+				m_strings.append( str);
+				m_strings.push_back( '\0');
+			}
+			appendUint32( m_ops, ins.first->second);
+		}
+		catch (...)
+		{
+			m_errcode = papuga_NoMemError;
+		}
+	}
+
+	/// \brief Mark the image as not serializable
+	void setError( papuga_ErrorCode errcode)
+	{
+		if (m_errcode == papuga_Ok) m_errcode = errcode;
+	}
+
+	/// \brief Build the image from the operations recorded and free the recording, an error is reported by lastError()
+	void build()
+	{
+		if (m_errcode != papuga_Ok)
+		{
+			clearRecording();
+			return;
+		}
+		try
+		{
+			m_image.clear();
+			m_image.reserve( AutomatonImageHeader::Size + m_ops.size() + m_strings.size());
+			m_image.append( AutomatonImageHeader::magic(), AutomatonImageHeader::MagicSize);
+			appendUint32( m_image, AutomatonImageHeader::Version);
+			appendUint32( m_image, m_flags);
+			appendUint32( m_image, m_ops.size());
+			appendUint32( m_image, m_strings.size());
+			m_image.append( m_ops);
+			m_image.append( m_strings);
+		}
+		catch (...)
+		{
+			m_errcode = papuga_NoMemError;
+		}
+		clearRecording();
+	}
+
+	papuga_ErrorCode lastError() const
+	{
+		return m_errcode;
+	}
+
+	/// \brief Get the image built with build()
+	const std::string& image() const
+	{
+		return m_image;
+	}
+
+	enum {NullString = 0xFFFFFFFFU};
+
+private:
+	/// \brief Free the operations and strings recorded, they are copied into the image or not needed anymore
+	void clearRecording()
+	{
+		std::string().swap( m_ops);
+		std::string().swap( m_strings);
+		std::map<std::string,unsigned int>().swap( m_stringmap);
+	}
+	static void appendUint32( std::string& dest, unsigned int value)
+	{
+		char buf[ 4];
+		buf[0] = (char)(unsigned char)(value & 0xFF);
+		buf[1] = (char)(unsigned char)((value >> 8) & 0xFF);
+		buf[2] = (char)(unsigned char)((value >> 16) & 0xFF);
+		buf[3] = (char)(unsigned char)((value >> 24) & 0xFF);
+		dest.append( buf, sizeof(buf));
+	}
+
+private:
+	unsigned int m_flags;
+	std::string m_ops;
+	std::string m_strings;
+	std::map<std::string,unsigned int> m_stringmap;
+	std::string m_image;
+	papuga_ErrorCode m_errcode;
+};
+
+/// \brief Reader of the operations of an automaton image
+/// \note All reads are checked against the bounds of the image
+class AutomatonImageReader
+{
+public:
+	AutomatonImageReader( const void* image, std::size_t imagesize)
+		:m_ops(0),m_opssize(0),m_opspos(0),m_strings(0),m_stringssize(0),m_flags(0),m_valid(false)
+	{
+		const char* ptr = (const char*)image;
+		if (!ptr || imagesize < (std::size_t)AutomatonImageHeader::Size) return;
+		if (0!=std::memcmp( ptr, AutomatonImageHeader::magic(), AutomatonImageHeader::MagicSize)) return;
+		unsigned int version = readUint32( ptr + AutomatonImageHeader::MagicSize);
+		m_flags = readUint32( ptr + AutomatonImageHeader::MagicSize + 4);
+		m_opssize = readUint32( ptr + AutomatonImageHeader::MagicSize + 8);
+		m_stringssize = readUint32( ptr + AutomatonImageHeader::MagicSize + 12);
+		if (version != AutomatonImageHeader::Version) return;
+		if (m_opssize % 4 != 0) return;
+		if (m_opssize > imagesize - AutomatonImageHeader::Size) return;
+		if (m_stringssize != imagesize - AutomatonImageHeader::Size - m_opssize) return;
+		m_ops = ptr + AutomatonImageHeader::Size;
+		m_strings = m_ops + m_opssize;
+		if (m_stringssize && m_strings[ m_stringssize-1] != '\0') return;
+		m_valid = true;
+	}
+
+	bool valid() const			{return m_valid;}
+	bool strict() const			{return 0!=(m_flags & AutomatonImageHeader::FlagStrict);}
+	bool exclusiveAccess() const		{return 0!=(m_flags & AutomatonImageHeader::FlagExclusiveAccess);}
+	bool eof() const			{return m_opspos >= m_opssize;}
+
+	/// \brief String table of the image, to copy for references to strings that have to outlive the image
+	const char* strings() const		{return m_strings;}
+	std::size_t stringssize() const		{return m_stringssize;}
+
+	/// \brief Set the base address the strings read are returned relative to (a copy of the string table)
+	void setStringBase( const char* base)
+	{
+		m_strings = base;
+	}
+
+	bool readOp( AutomatonImageOp& op)
+	{
+		int value;
+		if (!readInt( value)) return false;
+		op = (AutomatonImageOp)value;
+		return true;
+	}
+	bool readInt( int& value)
+	{
+		if (m_opspos + 4 > m_opssize) return false;
+		value = (int)readUint32( m_ops + m_opspos);
+		m_opspos += 4;
+		return true;
+	}
+	bool readString( const char*& str)
+	{
+		if (m_opspos + 4 > m_opssize) return false;
+		unsigned int ofs = readUint32( m_ops + m_opspos);
+		m_opspos += 4;
+		if (ofs == (unsigned int)AutomatonImageWriter::NullString)
+		{
+			str = NULL;
+			return true;
+		}
+		if (ofs >= m_stringssize) return false;
+		str = m_strings + ofs;
+		return true;
+	}
+
+private:
+	static unsigned int readUint32( const char* ptr)
+	{
+		unsigned char buf[ 4];
+		std::memcpy( buf, ptr, sizeof(buf));
+		return (unsigned int)buf[0] | ((unsigned int)buf[1] << 8) | ((unsigned int)buf[2] << 16) | ((unsigned int)buf[3] << 24);
+	}
+
+private:
+	const char* m_ops;
+	std::size_t m_opssize;
+	std::size_t m_opspos;
+	const char* m_strings;
+	std::size_t m_stringssize;
+	unsigned int m_flags;
+	bool m_valid;
+};
+
+}//namespace
+#endif
+
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/* @brief Parsing of a batch of independent request documents (JSON lines or concatenated XML) in parallel
+ * @file requestBatch.cpp
+ */
+#include "papuga/requestBatch.h"
+#include "papuga/requestParser.h"
+#include "papuga/allocator.h"
+#include "papuga/valueVariant.h"
+#include "papuga/valueVariant.hpp"
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+struct DocumentRange
+{
+	std::size_t pos;
+	std::size_t size;
+
+	DocumentRange( std::size_t pos_, std::size_t size_)
+		:pos(pos_),size(size_){}
+};
+
+static const char* skipSpaces( const char* si, const char* se)
+{
+	for (; si != se && (unsigned char)*si <= 32; ++si){}
+	return si;
+}
+
+static const char* skipUntilEoln( const char* si, const char* se)
+{
+	for (; si != se && *si != '\n'; ++si){}
+	return si;
+}
+
+/// \brief Skip to the end of a delimiter sequence, return the end of the content if not found
+static const char* skipBeyond( const char* si, const char* se, const char* delim)
+{
+	std::size_t delimlen = std::strlen( delim);
+	for (; si + delimlen <= se; ++si)
+	{
+		if (0==std::memcmp( si, delim, delimlen)) return si + delimlen;
+	}
+	return se;
+}
+
+static bool startsWith( const char* si, const char* se, const char* prefix)
+{
+	std::size_t prefixlen = std::strlen( prefix);
+	return si + prefixlen <= se && 0==std::memcmp( si, prefix, prefixlen);
+}
+
+/// \brief Get the end of a JSON document (object, array or scalar value) starting at si
+/// \note A document that is not well formed ends at the end of the line, so that the error is reported for this document only
+static const char* endOfJsonDocument( const char* si, const char* se)
+{
+	const char* start = si;
+	int depth = 0;
+	if (*si != '{' && *si != '[')
+	{
+		return skipUntilEoln( si, se);
+	}
+	for (; si != se; ++si)
+	{
+		switch (*si)
+		{
+			case '"':
+				for (++si; si != se && *si != '"'; ++si)
+				{
+					if (*si == '\\' && si+1 != se) ++si;
+				}
+				if (si == se) return se;
+				break;
+			case '{':
+			case '[':
+				++depth;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0) return si+1;
+				if (depth < 0) return skipUntilEoln( start, se);
+				break;
+			default:
+				break;
+		}
+	}
+	return se;
+}
+
+/// \brief Skip an XML tag starting with '<' at si and return the end of it, quoted attribute values may contain '>'
+static const char* skipXmlTag( const char* si, const char* se)
+{
+	for (++si; si != se && *si != '>'; ++si)
+	{
+		if (*si == '"' || *si == '\'')
+		{
+			char eb = *si;
+			for (++si; si != se && *si != eb; ++si){}
+			if (si == se) return se;
+		}
+	}
+	return (si == se) ? se : si+1;
+}
+
+/// \brief Skip a DOCTYPE declaration starting with '<!' at si, with an internal subset in brackets that may contain '>'
+static const char* skipXmlDoctype( const char* si, const char* se)
+{
+	int brkdepth = 0;
+	for (si += 2; si != se; ++si)
+	{
+		if (*si == '[') ++brkdepth;
+		else if (*si == ']') --brkdepth;
+		else if (*si == '>' && brkdepth <= 0) return si+1;
+	}
+	return se;
+}
+
+/// \brief Skip XML comments and spaces between documents
+static const char* skipXmlComments( const char* si, const char* se)
+{
+	si = skipSpaces( si, se);
+	while (startsWith( si, se, "<!--"))
+	{
+		si = skipSpaces( skipBeyond( si+4, se, "-->"), se);
+	}
+	return si;
+}
+
+/// \brief Get the end of an XML document (header, declarations and the root element) starting at si
+/// \note A document not well formed may swallow the following documents, but the parser reports an error for it then
+static const char* endOfXmlDocument( const char* si, const char* se)
+{
+	int depth = 0;
+	bool hasRoot = false;
+	while (si != se)
+	{
+		if (*si != '<')
+		{
+			if (hasRoot && depth == 0) return si;
+			for (; si != se && *si != '<'; ++si){}
+			continue;
+		}
+		if (startsWith( si, se, "<?"))
+		{
+			if (hasRoot && depth == 0) return si;
+			si = skipBeyond( si+2, se, "?>");
+		}
+		else if (startsWith( si, se, "<!--"))
+		{
+			si = skipBeyond( si+4, se, "-->");
+		}
+		else if (startsWith( si, se, "<![CDATA["))
+		{
+			si = skipBeyond( si+9, se, "]]>");
+		}
+		else if (startsWith( si, se, "<!"))
+		{
+			if (hasRoot && depth == 0) return si;
+			si = skipXmlDoctype( si, se);
+		}
+		else if (startsWith( si, se, "</"))
+		{
+			si = skipXmlTag( si, se);
+			if (--depth <= 0) return si;
+		}
+		else
+		{
+			if (hasRoot && depth == 0) return si;
+			hasRoot = true;
+			const char* tagend = skipXmlTag( si, se);
+			bool empty = (tagend - si >= 2 && tagend[-1] == '>' && tagend[-2] == '/');
+			si = tagend;
+			if (!empty) ++depth;
+			if (depth == 0) return si;
+		}
+	}
+	return se;
+}
+
+/// \brief Split a batch content in UTF-8 into the ranges of the documents it contains
+static void splitDocuments( std::vector<DocumentRange>& res, papuga_ContentType doctype, const char* content, std::size_t size)
+{
+	const char* si = content;
+	const char* se = content + size;
+	if (startsWith( si, se, "\xEF\xBB\xBF")) si += 3;	//... skip BOM
+
+	for (;;)
+	{
+		si = (doctype == papuga_ContentType_XML) ? skipXmlComments( si, se) : skipSpaces( si, se);
+		if (si == se) break;
+		const char* de = (doctype == papuga_ContentType_XML) ? endOfXmlDocument( si, se) : endOfJsonDocument( si, se);
+		res.push_back( DocumentRange( si - content, de - si));
+		si = de;
+	}
+}
+
+/// \brief Parse one document of a batch into a request
+static void parseDocument(
+		papuga_RequestBatchItem& item,
+		const papuga_RequestAutomaton* atm, papuga_RequestLogger* logger,
+		papuga_ContentType doctype, const char* content,
+		const papuga_ContentLimits* limits)
+{
+	papuga_Allocator allocator;
+	int allocatormem[ 1024];
+	papuga_init_Allocator( &allocator, allocatormem, sizeof(allocatormem));
+
+	papuga_RequestParser* parser = papuga_create_RequestParser_limits( &allocator, doctype, papuga_UTF8, content + item.docpos, item.docsize, limits, &item.errcode);
+	if (parser)
+	{
+		item.request = papuga_create_Request( atm, logger);
+		if (!item.request)
+		{
+			item.errcode = papuga_NoMemError;
+		}
+		else if (!papuga_RequestParser_feed_request( parser, item.request, &item.errcode))
+		{
+			item.erritemid = papuga_Request_last_error_itemid( item.request);
+			papuga_destroy_Request( item.request);
+			item.request = NULL;
+		}
+		papuga_destroy_RequestParser( parser);
+	}
+	else if (item.errcode == papuga_Ok)
+	{
+		item.errcode = papuga_NoMemError;
+	}
+	papuga_destroy_Allocator( &allocator);
+}
+
+/// \brief Pool of worker threads taking the documents of a batch to parse in the order of the input
+class RequestBatchWorkers
+{
+public:
+	RequestBatchWorkers(
+			std::vector<papuga_RequestBatchItem>& items_,
+			const papuga_RequestAutomaton* atm_, papuga_RequestLogger* logger_,
+			papuga_ContentType doctype_, const char* content_,
+			const papuga_ContentLimits* limits_)
+		:m_items(items_),m_atm(atm_),m_logger(logger_),m_doctype(doctype_),m_content(content_),m_limits(limits_),m_next(0){}
+
+	void run( int nofThreads)
+	{
+		std::vector<std::thread> threads;
+		try
+		{
+			// ... no reallocation of the vector after the first thread started, a std::thread destroyed while joinable calls std::terminate
+			if (nofThreads > 1) threads.reserve( nofThreads-1);
+			for (int ti=1; ti < nofThreads; ++ti)
+			{
+				threads.push_back( std::thread( &RequestBatchWorkers::work, this));
+			}
+		}
+		catch (...)
+		{
+			//... continue with the threads started, the calling thread is also working
+		}
+		work();
+		std::vector<std::thread>::iterator ti = threads.begin(), te = threads.end();
+		for (; ti != te; ++ti) ti->join();
+	}
+
+private:
+	void work()
+	{
+		for (std::size_t idx = m_next++; idx < m_items.size(); idx = m_next++)
+		{
+			parseDocument( m_items[ idx], m_atm, m_logger, m_doctype, m_content, m_limits);
+		}
+	}
+
+private:
+	std::vector<papuga_RequestBatchItem>& m_items;
+	const papuga_RequestAutomaton* m_atm;
+	papuga_RequestLogger* m_logger;
+	papuga_ContentType m_doctype;
+	const char* m_content;
+	const papuga_ContentLimits* m_limits;
+	std::atomic<std::size_t> m_next;
+};
+
+}//anonymous namespace
+
+struct papuga_RequestBatch
+{
+	std::vector<papuga_RequestBatchItem> items;
+
+	papuga_RequestBatch()
+		:items(){}
+	~papuga_RequestBatch()
+	{
+		std::vector<papuga_RequestBatchItem>::iterator ii = items.begin(), ie = items.end();
+		for (; ii != ie; ++ii)
+		{
+			if (ii->request) papuga_destroy_Request( ii->request);
+		}
+	}
+};
+
+extern "C" papuga_RequestBatch* papuga_create_RequestBatch(
+		const papuga_RequestAutomaton* atm,
+		papuga_RequestLogger* logger,
+		papuga_ContentType doctype,
+		papuga_StringEncoding encoding,
+		const char* content, size_t size,
+		const papuga_ContentLimits* limits,
+		int nofThreads,
+		papuga_ErrorCode* errcode)
+{
+	if (doctype != papuga_ContentType_XML && doctype != papuga_ContentType_JSON)
+	{
+		*errcode = doctype == papuga_ContentType_Unknown ? papuga_ValueUndefined : papuga_NotImplemented;
+		return NULL;
+	}
+	papuga_RequestBatch* rt = (papuga_RequestBatch*)std::calloc( 1, sizeof(*rt));
+	if (!rt)
+	{
+		*errcode = papuga_NoMemError;
+		return NULL;
+	}
+	try
+	{
+		new (rt) papuga_RequestBatch();
+
+		std::string contentUTF8;
+		if (encoding != papuga_UTF8)
+		{
+			papuga_ValueVariant input;
+			papuga_init_ValueVariant_string_enc( &input, encoding, content, size);
+			contentUTF8 = papuga::ValueVariant_tostring( input, *errcode);
+			if (*errcode != papuga_Ok)
+			{
+				papuga_destroy_RequestBatch( rt);
+				return NULL;
+			}
+			content = contentUTF8.c_str();
+			size = contentUTF8.size();
+		}
+		std::vector<DocumentRange> docs;
+		splitDocuments( docs, doctype, content, size);
+
+		rt->items.reserve( docs.size());
+		std::vector<DocumentRange>::const_iterator di = docs.begin(), de = docs.end();
+		for (; di != de; ++di)
+		{
+			papuga_RequestBatchItem item;
+			item.request = NULL;
+			item.errcode = papuga_Ok;
+			item.erritemid = -1;
+			item.docpos = di->pos;
+			item.docsize = di->size;
+			rt->items.push_back( item);
+		}
+		if (nofThreads <= 0)
+		{
+			nofThreads = std::thread::hardware_concurrency();
+		}
+		if (nofThreads > (int)rt->items.size())
+		{
+			nofThreads = rt->items.size();
+		}
+		RequestBatchWorkers workers( rt->items, atm, logger, doctype, content, limits);
+		workers.run( nofThreads);
+		return rt;
+	}
+	catch (const std::bad_alloc&)
+	{
+		*errcode = papuga_NoMemError;
+	}
+	catch (...)
+	{
+		*errcode = papuga_UncaughtException;
+	}
+	papuga_destroy_RequestBatch( rt);
+	return NULL;
+}
+
+extern "C" void papuga_destroy_RequestBatch( papuga_RequestBatch* self)
+{
+	self->~papuga_RequestBatch();
+	std::free( self);
+}
+
+extern "C" int papuga_RequestBatch_size( const papuga_RequestBatch* self)
+{
+	return self->items.size();
+}
+
+extern "C" const papuga_RequestBatchItem* papuga_RequestBatch_get( const papuga_RequestBatch* self, int idx)
+{
+	return (idx >= 0 && idx < (int)self->items.size()) ? &self->items[ idx] : NULL;
+}
+
+extern "C" papuga_Request* papuga_RequestBatch_release_request( papuga_RequestBatch* self, int idx)
+{
+	if (idx < 0 || idx >= (int)self->items.size()) return NULL;
+	papuga_Request* rt = self->items[ idx].request;
+	self->items[ idx].request = NULL;
+	return rt;
+}
+
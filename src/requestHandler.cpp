@@ -19,18 +19,29 @@
 #include "papuga/valueVariant.hpp"
 #include "papuga/errors.h"
 #include "papuga/callResult.h"
+#include "papuga/constants.h"
+#include "papuga/fileContent.h"
 #include "private/shared_ptr.hpp"
 #include "private/unordered_map.hpp"
+#include "requestHandler_snapshot.hpp"
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
+#include <new>
 #include <string>
 #include <vector>
 #include <list>
 #include <map>
+#include <algorithm>
 #include <stdexcept>
 #include <cstdio>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unistd.h>
 
 /* @brief Hook for GETTEXT */
 #define _TXT(x) x
@@ -50,25 +61,37 @@ static TYPE* add_list( TYPE* lst, TYPE* elem)
 	return elem;
 }
 
+/* @brief FNV-1a hash of a null terminated string continuing the hash value passed */
+static unsigned int hashString( unsigned int hs, const char* str)
+{
+	for (; *str; ++str)
+	{
+		hs ^= (unsigned char)*str;
+		hs *= 16777619U;
+	}
+	return hs;
+}
+
+static const unsigned int HashInitValue = 2166136261U;	/* FNV-1a offset basis */
+
 struct RequestSchemaList
 {
 	struct RequestSchemaList* next;			/*< pointer next element in the single linked list */
 	const char* type;				/*< type name of the context this schema is valid for */
 	const char* name;				/*< name of the schema */
-	int hs;						/*< hash value on name and type */
+	unsigned int hs;				/*< hash value on name and type */
 	const papuga_RequestAutomaton* automaton;	/*< automaton of the schema */
 	const papuga_SchemaDescription* description;	/*< description of the schema */
 
-	static int hash( const char* type, const char* name)
+	static unsigned int hash( const char* type, const char* name)
 	{
-		int rt = type[0];
-		rt <<= 8;
-		if (type[0]) rt += type[1];
-		rt <<= 8;
-		rt += name[0];
-		rt <<= 8;
-		if (name[0]) rt += name[1];
-		return rt;
+		unsigned int rt = hashString( HashInitValue, type);
+		rt = (rt ^ 0xFFU) * 16777619U;
+		return hashString( rt, name);
+	}
+	bool equal( const RequestSchemaList& o) const
+	{
+		return 0==std::strcmp( name, o.name) && 0==std::strcmp( type, o.type);
 	}
 };
 
@@ -76,7 +99,89 @@ struct RequestMethodList
 {
 	struct RequestMethodList* next;			/*< pointer next element in the single linked list */
 	const char* name;				/*< name of the schema */
+	unsigned int hs;				/*< hash value on class and name */
 	papuga_RequestMethodDescription method;		/*< method description */
+
+	static unsigned int hash( int classid, const char* name)
+	{
+		unsigned int rt = (HashInitValue ^ (unsigned int)classid) * 16777619U;
+		return hashString( rt, name);
+	}
+	bool equal( const RequestMethodList& o) const
+	{
+		return method.id.classid == o.method.id.classid && method.has_content == o.method.has_content && 0==std::strcmp( name, o.name);
+	}
+};
+
+/* @brief Hash index with open addressing on elements allocated in the allocator of the request handler
+ * @note Built while the handler is set up, the table is doubled if it gets half full, so that a lookup probes one or two slots on average
+ * @note An element added replaces an equal element added before, the same as the first match in the single linked lists of the elements
+ */
+template <typename ELEM>
+struct RequestHandlerIndex
+{
+	ELEM** ar;					/*< table of the elements, NULL if empty */
+	unsigned int mask;				/*< size of the table minus one, the size is a power of two */
+	unsigned int nofelem;				/*< number of elements inserted */
+
+	void init()
+	{
+		ar = NULL;
+		mask = 0;
+		nofelem = 0;
+	}
+	bool insert( papuga_Allocator* allocator, ELEM* elem)
+	{
+		if (!ar || (nofelem+1) * 2 > mask+1)
+		{
+			if (!resize( allocator, ar ? (mask+1) * 2 : InitSize)) return false;
+		}
+		if (insertElem( ar, mask, elem)) ++nofelem;
+		return true;
+	}
+	const ELEM* find( const ELEM& key) const
+	{
+		if (!ar) return NULL;
+		unsigned int pos = key.hs & mask;
+		for (; ar[ pos]; pos = (pos+1) & mask)
+		{
+			if (ar[ pos]->hs == key.hs && ar[ pos]->equal( key)) return ar[ pos];
+		}
+		return NULL;
+	}
+
+private:
+	enum {InitSize=16};
+
+	/* @return true if the element is new, false if it replaced an equal element */
+	static bool insertElem( ELEM** tab, unsigned int tabmask, ELEM* elem)
+	{
+		unsigned int pos = elem->hs & tabmask;
+		for (; tab[ pos]; pos = (pos+1) & tabmask)
+		{
+			if (tab[ pos]->hs == elem->hs && tab[ pos]->equal( *elem))
+			{
+				tab[ pos] = elem;
+				return false;
+			}
+		}
+		tab[ pos] = elem;
+		return true;
+	}
+	bool resize( papuga_Allocator* allocator, unsigned int newsize)
+	{
+		ELEM** newar = (ELEM**)papuga_Allocator_alloc( allocator, newsize * sizeof(ELEM*), sizeof(ELEM*));
+		if (!newar) return false;
+		std::memset( newar, 0, newsize * sizeof(ELEM*));
+		if (ar)
+		{
+			unsigned int ai = 0, ae = mask+1;
+			for (; ai != ae; ++ai) if (ar[ ai]) insertElem( newar, newsize-1, ar[ ai]);
+		}
+		ar = newar;
+		mask = newsize-1;
+		return true;
+	}
 };
 
 struct RequestVariable
@@ -96,6 +201,30 @@ struct RequestVariable
 	{
 		papuga_destroy_Allocator( &allocator);
 	}
+	/// \brief Release the value and the memory allocated for the variable, keeping the object for reuse
+	void clear()
+	{
+		papuga_destroy_Allocator( &allocator);
+		init();
+		name = "";
+	}
+	/// \brief Memory used by the variable, not counting the memory of host objects referenced
+	std::size_t memsize() const
+	{
+		std::size_t rt = sizeof(*this);
+		papuga_AllocatorNode const* nd = &allocator.root;
+		for (; nd; nd = nd->next)
+		{
+			if (nd->allocated) rt += nd->allocsize;
+		}
+		return rt;
+	}
+	/// \brief Assign a new name to a variable cleared for reuse
+	void rename( const char* name_)
+	{
+		name = papuga_Allocator_copy_charp( &allocator, name_);
+		if (!name) throw std::bad_alloc();
+	}
 
 	papuga_Allocator allocator;
 	const char* name;				/*< name of variable associated with this value */
@@ -114,12 +243,15 @@ private:
 struct RequestVariableRef
 {
 	papuga::shared_ptr<RequestVariable> ptr;	/*< pointer to variable */
+	unsigned int hs;				/*< hash value of the variable name */
 	int inheritcnt;					/*< counter of inheritance */
 
-	RequestVariableRef( const char* name)
-		:ptr(new RequestVariable(name)),inheritcnt(0){}
+	RequestVariableRef( const char* name, unsigned int hs_)
+		:ptr(std::make_shared<RequestVariable>(name)),hs(hs_),inheritcnt(0){}
+	RequestVariableRef( const papuga::shared_ptr<RequestVariable>& ptr_, unsigned int hs_)
+		:ptr(ptr_),hs(hs_),inheritcnt(0){}
 	RequestVariableRef( const RequestVariableRef& o, bool incrementInheritCnt=false)
-		:ptr(o.ptr),inheritcnt(o.inheritcnt)
+		:ptr(o.ptr),hs(o.hs),inheritcnt(o.inheritcnt)
 	{
 		if (incrementInheritCnt) ++inheritcnt;
 	}
@@ -130,58 +262,145 @@ static bool isLocalVariable( const char* name)
 	return name[0] == '_';
 }
 
+struct RequestVariableMap;
+typedef papuga::shared_ptr<const RequestVariableMap> RequestVariableScopeRef;
+
 /*
- * @brief Defines a map of variables of a request as list
- * @remark A request does not need too many variables, maybe 2 or 3, so a list is fine for search
+ * @brief Defines a map of variables of a request as list with a hash index and a list of immutable parent scopes inherited
+ * @remark Most requests need only 2 or 3 variables, so the hash index is built only for maps with many variables and a list is searched otherwise
+ * @remark Variables of parent scopes are consulted if not found in the map itself, so inheriting does not copy them
+ * @remark Duplicate definitions are resolved at lookup: a variable of the map itself hides the ones of the parent scopes, different variables with the same name inherited from different scopes are ambiguous
  */
 struct RequestVariableMap
 {
 public:
 	RequestVariableMap()
-		:m_impl(){}
+		:m_impl(),m_index(),m_parents(),m_free(){}
 	RequestVariableMap( const RequestVariableMap& o)
-		:m_impl(o.m_impl){}
+		:m_impl(o.m_impl),m_index(o.m_index),m_parents(o.m_parents),m_free(){}
 	~RequestVariableMap(){}
 
 	RequestVariable* create( const char* name)
 	{
-		m_impl.push_back( RequestVariableRef( name));
+		m_impl.push_back( newVariable( name, hashString( HashInitValue, name)));
+		indexAppended();
 		return m_impl.back().ptr.get();
 	}
+	/* @brief Add a variable shared with other maps, used for contexts loaded from a snapshot
+	 * @return false if a variable with the same name is already defined in the map
+	 */
+	bool insert( const papuga::shared_ptr<RequestVariable>& var, int inheritcnt)
+	{
+		unsigned int hs = hashString( HashInitValue, var->name);
+		if (findIndex( var->name, hs) >= 0) return false;
+		m_impl.push_back( RequestVariableRef( var, hs));
+		m_impl.back().inheritcnt = inheritcnt;
+		indexAppended();
+		return true;
+	}
+	/* @brief Remove all variables and scopes, keeping the memory of the containers and the variables not shared for reuse
+	 * @note Does not throw
+	 */
+	void clear()
+	{
+		std::vector<RequestVariableRef>::iterator vi = m_impl.begin(), ve = m_impl.end();
+		for (; vi != ve; ++vi) recycle( *vi);
+		m_impl.clear();
+		m_index.clear();
+		m_parents.clear();
+	}
 	void append( const RequestVariableMap& map)
 	{
 		m_impl.insert( m_impl.end(), map.m_impl.begin(), map.m_impl.end());
+		rebuildIndex();
+	}
+	/* @brief Add a scope to inherit the variables from
+	 * @param[in] parent scope added, must not be changed anymore
+	 * @note Does not check for duplicate definitions, they are resolved at lookup
+	 */
+	void inherit( const RequestVariableScopeRef& parent)
+	{
+		m_parents.push_back( parent);
 	}
-	bool merge( const RequestVariableMap& map)
+	/* @brief Copy the references to the variables of the parent scopes into the map, so that it does not refer to the scopes anymore
+	 * @remark Called for a context stored in the handler, so that chains of contexts inheriting from their predecessors do not grow
+	 * @return false if different variables with the same name are inherited from different scopes, the map is not changed then
+	 */
+	bool flatten()
 	{
-		std::vector<RequestVariableRef>::const_iterator vi = map.m_impl.begin(), ve = map.m_impl.end();
+		if (m_parents.empty()) return true;
+		std::vector<VisibleVariable> vars;
+		collect( vars);
+		std::vector<RequestVariableRef> impl;
+		impl.reserve( vars.size());
+		std::vector<VisibleVariable>::const_iterator vi = vars.begin(), ve = vars.end();
 		for (; vi != ve; ++vi)
 		{
-			const papuga_ValueVariant* var = findVariable( vi->ptr->name);
-			if (var)
+			if (vi->inheritcnt > vi->ref->inheritcnt)
 			{
-				if (var != &vi->ptr->value) return false;
-			}
-			else
-			{
-				m_impl.push_back( RequestVariableRef( *vi, true));
+				bool ambiguous = false;
+				find( vi->ref->ptr->name, vi->ref->hs, ambiguous);
+				if (ambiguous) return false;
 			}
+			impl.push_back( *vi->ref);
+			impl.back().inheritcnt = vi->inheritcnt;
 		}
+		m_impl.swap( impl);
+		m_parents.clear();
+		rebuildIndex();
 		return true;
 	}
 
-	typedef std::vector<RequestVariableRef>::const_iterator const_iterator;
-	const_iterator begin() const
+	struct VisibleVariable
+	{
+		const RequestVariableRef* ref;		/*< reference to the variable */
+		int inheritcnt;				/*< counter of inheritance seen from the map collecting it */
+	};
+	/* @brief Get all variables visible, the ones of parent scopes with the inheritance counter incremented, each name once
+	 * @remark Visits the scopes depth first in the order of lookup with an explicit stack, a variable is visible if the lookup of its name finds it
+	 */
+	void collect( std::vector<VisibleVariable>& result) const
 	{
-		return m_impl.begin();
+		std::vector<RequestVariableRef>::const_iterator li = m_impl.begin(), le = m_impl.end();
+		for (; li != le; ++li)
+		{
+			VisibleVariable visible = {&*li, li->inheritcnt};
+			result.push_back( visible);
+		}
+		if (m_parents.empty()) return;
+		std::vector<ScopeVisit> stk( 1, ScopeVisit( this, 0));
+		while (!stk.empty())
+		{
+			ScopeVisit& top = stk.back();
+			if (top.parentidx == top.map->m_parents.size())
+			{
+				stk.pop_back();
+				continue;
+			}
+			const RequestVariableMap* parent = top.map->m_parents[ top.parentidx++].get();
+			int inheritofs = top.inheritofs + 1;
+			for (li = parent->m_impl.begin(), le = parent->m_impl.end(); li != le; ++li)
+			{
+				if (findFirst( li->ptr->name, li->hs) != &*li) continue; //... hidden by a variable found before
+				VisibleVariable visible = {&*li, li->inheritcnt + inheritofs};
+				result.push_back( visible);
+			}
+			if (!parent->m_parents.empty()) stk.push_back( ScopeVisit( parent, inheritofs));
+		}
 	}
-	const_iterator end() const
+	/* @brief Get the memory used by the variables of the map itself, variables shared with other maps are counted for each
+	 */
+	std::size_t memsize() const
 	{
-		return m_impl.end();
+		std::size_t rt = m_impl.capacity() * sizeof(RequestVariableRef) + m_index.capacity() * sizeof(int);
+		std::vector<RequestVariableRef>::const_iterator vi = m_impl.begin(), ve = m_impl.end();
+		for (; vi != ve; ++vi) rt += vi->ptr->memsize();
+		return rt;
 	}
 	void removeLocalVariables()
 	{
 		std::size_t vidx = 0;
+		std::size_t nofvars = m_impl.size();
 		while (vidx < m_impl.size())
 		{
 			if (isLocalVariable( m_impl[vidx].ptr->name))
@@ -193,46 +412,186 @@ public:
 				++vidx;
 			}
 		}
+		if (nofvars != m_impl.size()) rebuildIndex();
 	}
-	const papuga_ValueVariant* findVariable( const char* name) const
+	/* @brief Find the value of a variable visible in the map
+	 * @param[out] errcode set to papuga_DuplicateDefinition if different variables with this name are inherited from different scopes
+	 * @return the value or NULL if not defined or defined ambiguously
+	 */
+	const papuga_ValueVariant* findVariable( const char* name, papuga_ErrorCode& errcode) const
 	{
-		std::vector<RequestVariableRef>::const_iterator vi = m_impl.begin(), ve = m_impl.end();
-		for (; vi != ve; ++vi)
+		bool ambiguous = false;
+		const RequestVariableRef* ref = find( name, hashString( HashInitValue, name), ambiguous);
+		if (ambiguous)
 		{
-			if (0==std::strcmp( vi->ptr->name, name)) break;
+			errcode = papuga_DuplicateDefinition;
+			return NULL;
+		}
+		return ref ? &ref->ptr->value : NULL;
+	}
+	/* @brief Find a variable visible in the map, the first one found in the map itself or in the parent scopes in the order of inheritance
+	 * @param[out] ambiguous set to true if a different variable with the same name is inherited from another scope not hidden by the map itself
+	 */
+	const RequestVariableRef* find( const char* name, unsigned int hs, bool& ambiguous) const
+	{
+		int vidx = findIndex( name, hs);
+		if (vidx >= 0) return &m_impl[ vidx];
+		const RequestVariableRef* rt = NULL;
+		std::vector<RequestVariableScopeRef>::const_iterator pi = m_parents.begin(), pe = m_parents.end();
+		for (; pi != pe; ++pi)
+		{
+			const RequestVariableRef* ref = (*pi)->find( name, hs, ambiguous);
+			if (!ref) continue;
+			if (!rt)
+			{
+				rt = ref;
+			}
+			else if (ref->ptr.get() != rt->ptr.get())
+			{
+				ambiguous = true;
+			}
 		}
-		return (vi == ve) ? NULL : &vi->ptr->value;
+		return rt;
 	}
 	RequestVariable* createVariable( const char* name)
 	{
-		std::vector<RequestVariableRef>::iterator vi = m_impl.begin(), ve = m_impl.end();
-		for (; vi != ve; ++vi) if (0==std::strcmp( vi->ptr->name, name)) break;
-		if (vi == ve)
+		unsigned int hs = hashString( HashInitValue, name);
+		int vidx = findIndex( name, hs);
+		if (vidx < 0)
 		{
 			return create( name);
 		}
 		else
 		{
-			*vi = RequestVariableRef( name);
-			return vi->ptr.get();
+			RequestVariableRef var = newVariable( name, hs);
+			recycle( m_impl[ vidx]);
+			m_impl[ vidx] = var;
+			return m_impl[ vidx].ptr.get();
 		}
 	}
 	const char** listVariables( int max_inheritcnt, char const** buf, size_t bufsize) const
 	{
 		size_t bufpos = 0;
-		std::vector<RequestVariableRef>::const_iterator vi = m_impl.begin(), ve = m_impl.end();
+		std::vector<VisibleVariable> vars;
+		collect( vars);
+		std::vector<VisibleVariable>::const_iterator vi = vars.begin(), ve = vars.end();
 		for (; vi != ve; ++vi)
 		{
 			if (bufpos >= bufsize) return NULL;
 			if (max_inheritcnt >= 0 && vi->inheritcnt > max_inheritcnt) continue;
-			buf[ bufpos++] = vi->ptr->name;
+			buf[ bufpos++] = vi->ref->ptr->name;
 		}
 		if (bufpos >= bufsize) return NULL;
 		buf[ bufpos] = NULL;
 		return buf;
 	}
+
+private:
+	enum {MinIndexSize=8, InitIndexSize=16, MaxNofFreeVariables=32};
+
+	RequestVariableRef newVariable( const char* name, unsigned int hs)
+	{
+		if (m_free.empty())
+		{
+			return RequestVariableRef( name, hs);
+		}
+		papuga::shared_ptr<RequestVariable> var( m_free.back());
+		m_free.pop_back();
+		var->rename( name);
+		return RequestVariableRef( var, hs);
+	}
+	/* @brief Keep a variable removed from the map for reuse if it is not referenced anywhere else */
+	void recycle( const RequestVariableRef& ref)
+	{
+		if (ref.ptr.use_count() != 1 || m_free.size() >= (std::size_t)MaxNofFreeVariables) return;
+		try
+		{
+			m_free.push_back( ref.ptr);
+			m_free.back()->clear();
+		}
+		catch (...){}
+	}
+
+	/* @brief Find the first variable with a name in the map itself or in the parent scopes in the order of lookup, without checking for ambiguity */
+	const RequestVariableRef* findFirst( const char* name, unsigned int hs) const
+	{
+		int vidx = findIndex( name, hs);
+		if (vidx >= 0) return &m_impl[ vidx];
+		std::vector<RequestVariableScopeRef>::const_iterator pi = m_parents.begin(), pe = m_parents.end();
+		for (; pi != pe; ++pi)
+		{
+			const RequestVariableRef* ref = (*pi)->findFirst( name, hs);
+			if (ref) return ref;
+		}
+		return NULL;
+	}
+
+	/* @brief State of a scope visited by collect */
+	struct ScopeVisit
+	{
+		const RequestVariableMap* map;		/*< scope visited */
+		int inheritofs;				/*< number of inheritance steps from the map collecting to the scope */
+		std::size_t parentidx;			/*< index of the next parent scope of the scope to visit */
+
+		ScopeVisit( const RequestVariableMap* map_, int inheritofs_)
+			:map(map_),inheritofs(inheritofs_),parentidx(0){}
+	};
+
+	int findIndex( const char* name, unsigned int hs) const
+	{
+		if (m_index.empty())
+		{
+			std::size_t vi = 0, ve = m_impl.size();
+			for (; vi != ve; ++vi)
+			{
+				if (m_impl[ vi].hs == hs && 0==std::strcmp( m_impl[ vi].ptr->name, name)) return vi;
+			}
+			return -1;
+		}
+		std::size_t mask = m_index.size()-1;
+		std::size_t pos = hs & mask;
+		for (; m_index[ pos]; pos = (pos+1) & mask)
+		{
+			const RequestVariableRef& ref = m_impl[ m_index[ pos]-1];
+			if (ref.hs == hs && 0==std::strcmp( ref.ptr->name, name)) return m_index[ pos]-1;
+		}
+		return -1;
+	}
+	void insertIndex( int vidx)
+	{
+		std::size_t mask = m_index.size()-1;
+		std::size_t pos = m_impl[ vidx].hs & mask;
+		while (m_index[ pos]) pos = (pos+1) & mask;
+		m_index[ pos] = vidx+1;
+	}
+	void indexAppended()
+	{
+		if (m_impl.size() < (std::size_t)MinIndexSize) return;
+		if (m_index.size() < m_impl.size() * 2)
+		{
+			rebuildIndex();
+		}
+		else
+		{
+			insertIndex( m_impl.size()-1);
+		}
+	}
+	void rebuildIndex()
+	{
+		m_index.clear();
+		if (m_impl.size() < (std::size_t)MinIndexSize) return;
+		std::size_t indexsize = InitIndexSize;
+		while (indexsize < m_impl.size() * 4) indexsize *= 2;
+		m_index.resize( indexsize, 0);
+		std::size_t vi = 0, ve = m_impl.size();
+		for (; vi != ve; ++vi) insertIndex( vi);
+	}
+
 private:
 	std::vector<RequestVariableRef> m_impl;
+	std::vector<int> m_index;			//< open addressing hash table of indices into m_impl plus one (0 for an empty slot), empty if the map is small
+	std::vector<RequestVariableScopeRef> m_parents;	//< scopes inherited, consulted in the order of inheritance
+	std::vector<papuga::shared_ptr<RequestVariable> > m_free;	//< variables cleared for reuse
 };
 
 /*
@@ -240,7 +599,7 @@ private:
  */
 struct papuga_RequestContext
 {
-	papuga_ErrorCode errcode;		//< last error in the request context
+	mutable papuga_ErrorCode errcode;	//< last error in the request context, also set by the lookup of a variable defined ambiguously
 	RequestVariableMap varmap;		//< map of variables defined in this context
 
 	explicit papuga_RequestContext()
@@ -250,14 +609,23 @@ struct papuga_RequestContext
 	~papuga_RequestContext()
 	{}
 
+	void reset()
+	{
+		errcode = papuga_Ok;
+		varmap.clear();
+	}
+
 	std::string tostring( const char* indent, papuga_StructInterfaceDescription* structdefs) const
 	{
 		std::ostringstream out;
-		RequestVariableMap::const_iterator vi = varmap.begin(), ve = varmap.end();
+		std::vector<RequestVariableMap::VisibleVariable> vars;
+		varmap.collect( vars);
+		std::vector<RequestVariableMap::VisibleVariable>::const_iterator vi = vars.begin(), ve = vars.end();
 		for (; vi != ve; ++vi)
 		{
+			const RequestVariable& var = *vi->ref->ptr;
 			papuga_ErrorCode errcode_local = papuga_Ok;
-			out << indent << vi->ptr->name << " #" << vi->ptr.use_count() << "=" << papuga::ValueVariant_todump( vi->ptr->value, structdefs, true/*deterministic*/, errcode_local) << "\n";
+			out << indent << var.name << " #" << vi->ref->ptr.use_count() << "=" << papuga::ValueVariant_todump( var.value, structdefs, true/*deterministic*/, errcode_local) << "\n";
 		}
 		return out.str();
 	}
@@ -315,90 +683,336 @@ struct SymKeyHashFunc
 };
 
 typedef papuga::shared_ptr<papuga_RequestContext> RequestContextRef;
-typedef papuga::unordered_map<SymKey,RequestContextRef,SymKeyHashFunc,MapSymKeyEqual> RequestContextTab;
-struct RequestContextMap
+
+// \brief Immutable entry of the context map, owning the key the tables refer to, shared by all snapshots containing it
+struct RequestContextEntry
+{
+	std::string key;
+	std::string type;
+	std::string name;
+	RequestContextRef context;
+	std::size_t memsize;					//< memory used by the context, counted when it was transferred
+	mutable std::atomic<unsigned long> lastaccess;		//< value of the access counter of the handler when the context was inherited last
+	enum LruState {LruUnlinked,LruLinked,LruRemoved};
+	LruState lrustate;					//< state of the entry in the LRU index of the handler, guarded by the mutex of the index
+	unsigned long lrustamp;					//< key of the entry in the LRU index of the handler, guarded by the mutex of the index
+
+	RequestContextEntry( const SymKey& key_, const char* type_, const char* name_, const RequestContextRef& context_, unsigned long accesscnt)
+		:key(key_.str,key_.len),type(type_),name(name_),context(context_),memsize(context_->varmap.memsize() + sizeof(papuga_RequestContext)),lastaccess(accesscnt)
+		,lrustate(LruUnlinked),lrustamp(accesscnt){}
+};
+typedef papuga::shared_ptr<RequestContextEntry> RequestContextEntryRef;
+typedef papuga::unordered_map<SymKey,RequestContextEntryRef,SymKeyHashFunc,MapSymKeyEqual> RequestContextTab;
+
+// \brief Shard of the context map, copied on an update of one of its entries
+struct RequestContextShard
 {
-	std::list<std::string> keylist;
 	RequestContextTab tab;
 
+	RequestContextShard()
+		:tab(){}
+	RequestContextShard( const RequestContextShard& o)
+		:tab(o.tab){}
+};
+typedef papuga::shared_ptr<RequestContextShard> RequestContextShardRef;
+
+// \brief Map of contexts as array of shards, an update copies the array of shard references and the shard changed only
+struct RequestContextMap
+{
+	enum {NofShards=64};
+	RequestContextShardRef shards[ NofShards];		//< shards, NULL if empty
+
 	~RequestContextMap(){}
-	RequestContextMap()
-		:keylist(),tab(){}
+	RequestContextMap(){}
 	RequestContextMap( const RequestContextMap& o)
-		:keylist(),tab()
 	{
-		RequestContextTab::const_iterator ti = o.tab.begin(), te = o.tab.end();
-		for (; ti != te; ++ti)
+		for (int si=0; si<NofShards; ++si) shards[ si] = o.shards[ si];
+	}
+	/* @return the entry replaced or NULL */
+	RequestContextEntryRef addEntry( const RequestContextEntryRef& entry)
+	{
+		RequestContextEntryRef rt;
+		SymKey key( entry->key.c_str(), entry->key.size());
+		RequestContextShardRef& shard = shards[ shardIndex( key)];
+		RequestContextShardRef shard_copy( shard.get() ? new RequestContextShard( *shard) : new RequestContextShard());
+		RequestContextTab::iterator mi = shard_copy->tab.find( key);
+		if (mi != shard_copy->tab.end())
 		{
-			tab[ allocKey( ti->first)] = ti->second;
+			rt = mi->second;
+			// ... the key of the element refers to the key string of the entry replaced, that dies with it
+			shard_copy->tab.erase( mi);
 		}
+		shard_copy->tab.insert( RequestContextTab::value_type( key, entry));
+		shard = shard_copy;
+		return rt;
 	}
-	void addOwnership( const SymKey& key, papuga_RequestContext* context)
+	/* @param[in] expected entry to remove or NULL for any entry with the key
+	 * @return the entry removed or NULL */
+	RequestContextEntryRef remove( const SymKey& key, const RequestContextEntry* expected)
 	{
-		tab[ allocKey( key)].reset( context);
+		RequestContextShardRef& shard = shards[ shardIndex( key)];
+		if (!shard.get()) return RequestContextEntryRef();
+		RequestContextTab::const_iterator mi = shard->tab.find( key);
+		if (mi == shard->tab.end() || (expected && mi->second.get() != expected)) return RequestContextEntryRef();
+		RequestContextEntryRef rt = mi->second;
+		RequestContextShardRef shard_copy( new RequestContextShard( *shard));
+		shard_copy->tab.erase( key);
+		shard = shard_copy;
+		return rt;
 	}
-	const papuga_RequestContext* operator[]( const SymKey& key) const
+	RequestContextEntryRef findEntry( const SymKey& key) const
 	{
-		RequestContextTab::const_iterator mi = tab.find( key);
-		return mi == tab.end() ? NULL : mi->second.get();
+		const RequestContextShardRef& shard = shards[ shardIndex( key)];
+		if (!shard.get()) return RequestContextEntryRef();
+		RequestContextTab::const_iterator mi = shard->tab.find( key);
+		return mi == shard->tab.end() ? RequestContextEntryRef() : mi->second;
 	}
-
-	std::string tostring( papuga_StructInterfaceDescription* structdefs) const
+	RequestContextRef find( const SymKey& key) const
 	{
-		std::map<SymKey,papuga_RequestContext*> deterministicMap;
-		std::ostringstream out;
-		auto ci = tab.begin(), ce = tab.end();
-		for (; ci != ce; ++ci)
-		{
-			deterministicMap[ ci->first] = &*ci->second;
-		}
-		auto di = deterministicMap.begin(), de = deterministicMap.end();
-		for (; di != de; ++di)
+		RequestContextEntryRef entry = findEntry( key);
+		return entry.get() ? entry->context : RequestContextRef();
+	}
+	/* @brief Collect the entries of the map ordered by key, the entries are kept alive by the map */
+	void collectEntries( std::map<SymKey,const RequestContextEntry*>& result) const
+	{
+		for (int si=0; si<NofShards; ++si)
 		{
-			out << std::string(di->first.str,di->first.len) << ":" << std::endl;
-			out << di->second->tostring( "\t", structdefs) << std::endl;
+			if (!shards[ si].get()) continue;
+			auto ci = shards[ si]->tab.begin(), ce = shards[ si]->tab.end();
+			for (; ci != ce; ++ci)
+			{
+				result[ ci->first] = ci->second.get();
+			}
 		}
-		return out.str();
 	}
 
 private:
-	SymKey allocKey( const SymKey& key)
+	static int shardIndex( const SymKey& key)
 	{
-		keylist.push_back( std::string( key.str, key.len));
-		return SymKey( keylist.back().c_str(), keylist.back().size());
+		// ... use the upper bits of the hash, the lower bits select the bucket in the table of the shard
+		unsigned int hh = (unsigned int)SymKeyHashFunc()( key);
+		return ((hh >> 16) ^ (hh >> 24)) % NofShards;
 	}
 };
 
 typedef papuga::shared_ptr<RequestContextMap> RequestContextMapRef;
 
-// \brief Add with ownership
-static void RequestContextMap_transfer( RequestContextMapRef& cm, const char* type, const char* name, papuga_RequestContext* context)
+// \brief Get the current snapshot of the context map, the snapshot is immutable and kept alive by the reference returned
+// \note Snapshots are published with the atomic access functions for std::shared_ptr, readers are never blocked by an update
+static RequestContextMapRef RequestContextMap_snapshot( const RequestContextMapRef& cm)
 {
-	// Updates in the context map are very rare, so a copy of the whole map on an update is feasible and avoids a lock on read
-	char keybuf[ 256];
-	SymKey key = SymKey::create( keybuf, sizeof(keybuf), type, name);
-	RequestContextMapRef cm_ref( cm);
-	RequestContextMapRef cm_copy( new RequestContextMap( *cm_ref));
-	context->varmap.removeLocalVariables();
-	cm_copy->addOwnership( key, context);
-	cm = cm_copy;
+	return std::atomic_load( static_cast<const std::shared_ptr<RequestContextMap>*>( &cm));
 }
 
-static bool RequestContextMap_delete( RequestContextMapRef& cm, const char* type, const char* name)
+// \brief Publish an updated copy of the snapshot 'expected', fails if another update was published since 'expected' was got
+static bool RequestContextMap_publish( RequestContextMapRef& cm, RequestContextMapRef& expected, const RequestContextMapRef& cm_copy)
 {
-	// Updates in the context map are very rare, so a copy of the whole map on a delete is feasible and avoids a lock on read
-	char keybuf[ 256];
-	SymKey key = SymKey::create( keybuf, sizeof(keybuf), type, name);
-	RequestContextMapRef cm_ref( cm);
-	RequestContextMapRef cm_copy( new RequestContextMap( *cm_ref));
-	if (cm_copy->tab.erase( key) > 0)
+	std::shared_ptr<RequestContextMap> expected_ptr( expected);
+	if (std::atomic_compare_exchange_strong( static_cast<std::shared_ptr<RequestContextMap>*>( &cm), &expected_ptr, std::shared_ptr<RequestContextMap>( cm_copy)))
 	{
-		cm = cm_copy;
 		return true;
 	}
+	expected = expected_ptr;
 	return false;
 }
 
+// \brief Add with ownership
+// \param[out] replaced the entry replaced or NULL
+// \return the entry added
+static RequestContextEntryRef RequestContextMap_transfer( RequestContextMapRef& cm, const SymKey& key, const char* type, const char* name, papuga_RequestContext* context, unsigned long accesscnt, RequestContextEntryRef& replaced)
+{
+	// Updates copy only the shard of the entry changed, so that the snapshot read is never modified and reads do not need a lock
+	RequestContextRef context_ref( context);
+	RequestContextEntryRef entry( new RequestContextEntry( key, type, name, context_ref, accesscnt));
+	RequestContextMapRef cm_ref( RequestContextMap_snapshot( cm));
+	for (;;)
+	{
+		RequestContextMapRef cm_copy( new RequestContextMap( *cm_ref));
+		replaced = cm_copy->addEntry( entry);
+		if (RequestContextMap_publish( cm, cm_ref, cm_copy)) break;
+		// ... another update was published concurrently, retry with the new snapshot
+	}
+	return entry;
+}
+
+// \param[in] expected entry to remove or NULL for any entry with the key
+// \return the entry removed or NULL
+static RequestContextEntryRef RequestContextMap_delete( RequestContextMapRef& cm, const SymKey& key, const RequestContextEntry* expected)
+{
+	// Updates copy only the shard of the entry changed, so that the snapshot read is never modified and reads do not need a lock
+	RequestContextMapRef cm_ref( RequestContextMap_snapshot( cm));
+	for (;;)
+	{
+		RequestContextMapRef cm_copy( new RequestContextMap( *cm_ref));
+		RequestContextEntryRef removed = cm_copy->remove( key, expected);
+		if (!removed.get()) return removed;
+		if (RequestContextMap_publish( cm, cm_ref, cm_copy)) return removed;
+		// ... another update was published concurrently, retry with the new snapshot
+	}
+}
+
+static std::string RequestContextEntries_tostring( const std::map<SymKey,const RequestContextEntry*>& entries, papuga_StructInterfaceDescription* structdefs)
+{
+	std::ostringstream out;
+	auto di = entries.begin(), de = entries.end();
+	for (; di != de; ++di)
+	{
+		out << std::string(di->first.str,di->first.len) << ":" << std::endl;
+		out << di->second->context->tostring( "\t", structdefs) << std::endl;
+	}
+	return out.str();
+}
+
+// \brief Index of the contexts of a request handler ordered by their last access, with the totals of the contexts indexed
+// \note Inheriting a context only stamps the entry without locking, the order of the index is updated lazily, an entry found with a newer stamp when searching the least recently used is moved to its new position
+// \note An entry is linked after it has been published in the context map and unlinked after it has been removed from it, an entry removed before it gets linked is not linked anymore
+class RequestContextLruIndex
+{
+public:
+	RequestContextLruIndex()
+		:m_mutex(),m_map(),m_nofcontexts(0),m_memsize(0){}
+
+	std::mutex& mutex()
+	{
+		return m_mutex;
+	}
+	std::size_t nofcontexts() const
+	{
+		return m_nofcontexts.load();
+	}
+	std::size_t memsize() const
+	{
+		return m_memsize.load();
+	}
+	/* @brief Link an entry published in the context map, to call with the mutex locked */
+	void link( const RequestContextEntryRef& entry)
+	{
+		if (entry->lrustate != RequestContextEntry::LruUnlinked) return;
+		entry->lrustamp = entry->lastaccess.load();
+		m_map.insert( Map::value_type( entry->lrustamp, entry));
+		entry->lrustate = RequestContextEntry::LruLinked;
+		m_nofcontexts.store( m_nofcontexts.load() + 1);
+		m_memsize.store( m_memsize.load() + entry->memsize);
+	}
+	/* @brief Unlink an entry removed from the context map, to call with the mutex locked */
+	void unlink( const RequestContextEntryRef& entry)
+	{
+		if (entry->lrustate == RequestContextEntry::LruLinked)
+		{
+			std::pair<Map::iterator,Map::iterator> range = m_map.equal_range( entry->lrustamp);
+			for (; range.first != range.second; ++range.first)
+			{
+				if (range.first->second.get() == entry.get())
+				{
+					m_map.erase( range.first);
+					break;
+				}
+			}
+			m_nofcontexts.store( m_nofcontexts.load() - 1);
+			m_memsize.store( m_memsize.load() - entry->memsize);
+		}
+		entry->lrustate = RequestContextEntry::LruRemoved;
+	}
+	/* @brief Get the context inherited least recently, except the one passed as argument, to call with the mutex locked */
+	RequestContextEntryRef leastRecentlyUsed( const RequestContextEntry* except)
+	{
+		Map::iterator mi = m_map.begin();
+		while (mi != m_map.end())
+		{
+			unsigned long access = mi->second->lastaccess.load();
+			if (access != mi->first)
+			{
+				// ... inherited since it was put to its position, move it to the position of its last access
+				RequestContextEntryRef entry = mi->second;
+				m_map.erase( mi);
+				entry->lrustamp = access;
+				m_map.insert( Map::value_type( access, entry));
+				mi = m_map.begin();
+			}
+			else if (mi->second.get() == except)
+			{
+				++mi;
+			}
+			else
+			{
+				return mi->second;
+			}
+		}
+		return RequestContextEntryRef();
+	}
+
+private:
+	typedef std::multimap<unsigned long,RequestContextEntryRef> Map;
+	std::mutex m_mutex;
+	Map m_map;					//< entries by the stamp of their last access known by the index
+	std::atomic<std::size_t> m_nofcontexts;		//< number of contexts linked, modified with the mutex locked
+	std::atomic<std::size_t> m_memsize;		//< sum of the memory used by the contexts linked, modified with the mutex locked
+};
+
+enum {CacheLineSize=64};
+
+// \brief Root of the context map of a shard of a request handler, aligned to a cache line, so that updates of different shards do not contend on the same cache line
+// \note The two levels of sharding have different purposes: the RequestContextMap::NofShards shards of a context map bound the part of the map copied
+//	by an update, but all updates of a context map compete for publishing the same root and the losers have to copy and retry.
+//	The shards of the handler, each with its own root, let updates of contexts in different shards be published without conflicts.
+struct alignas(CacheLineSize) RequestContextMapRoot
+{
+	RequestContextMapRef ref;
+
+	RequestContextMapRoot()
+		:ref(new RequestContextMap()){}
+};
+
+// \brief Array of the roots of the context maps of the shards of a request handler
+// \note The memory is aligned explicitly, because std::allocator does not respect the alignment of over-aligned types before C++17
+class RequestContextMapRootArray
+{
+public:
+	explicit RequestContextMapRootArray( std::size_t size_)
+		:m_mem(std::malloc( size_ * sizeof(RequestContextMapRoot) + CacheLineSize)),m_ar(0),m_size(0)
+	{
+		if (!m_mem) throw std::bad_alloc();
+		m_ar = (RequestContextMapRoot*)(((uintptr_t)m_mem + CacheLineSize - 1) & ~(uintptr_t)(CacheLineSize - 1));
+		try
+		{
+			for (; m_size < size_; ++m_size) new (m_ar + m_size) RequestContextMapRoot();
+		}
+		catch (...)
+		{
+			clear();
+			throw;
+		}
+	}
+	~RequestContextMapRootArray()
+	{
+		clear();
+	}
+
+	std::size_t size() const					{return m_size;}
+	RequestContextMapRoot& operator[]( std::size_t idx)		{return m_ar[ idx];}
+	const RequestContextMapRoot& operator[]( std::size_t idx) const	{return m_ar[ idx];}
+
+	typedef const RequestContextMapRoot* const_iterator;
+	const_iterator begin() const					{return m_ar;}
+	const_iterator end() const					{return m_ar + m_size;}
+
+private:
+	RequestContextMapRootArray( const RequestContextMapRootArray&) = delete;	//... non copyable
+	void operator=( const RequestContextMapRootArray&) = delete;		//... non copyable
+
+	void clear()
+	{
+		for (; m_size > 0; --m_size) m_ar[ m_size-1].~RequestContextMapRoot();
+		std::free( m_mem);
+		m_mem = 0;
+	}
+
+private:
+	void* m_mem;
+	RequestContextMapRoot* m_ar;
+	std::size_t m_size;
+};
+
 
 static int nofClassDefs( const papuga_ClassDef* classdefs)
 {
@@ -410,18 +1024,29 @@ static int nofClassDefs( const papuga_ClassDef* classdefs)
 
 struct papuga_RequestHandler
 {
-	RequestContextMapRef contextmap;
+	RequestContextMapRootArray contextmaps;			//< context maps of the shards, a context is stored in the shard selected by the hash of its key
 	RequestSchemaList* schemas;
+	RequestHandlerIndex<RequestSchemaList> schemaindex;
 	RequestMethodList** classmethodmap;
+	RequestHandlerIndex<RequestMethodList> methodindex;
 	int classmethodmapsize;
 	const papuga_ClassDef* classdefs;
 	papuga_Allocator allocator;
 	int allocator_membuf[ 1024];
-
-	explicit papuga_RequestHandler( const papuga_ClassDef* classdefs_)
-		:contextmap(new RequestContextMap()),schemas(NULL),classmethodmap(NULL),classmethodmapsize(nofClassDefs(classdefs_)),classdefs(classdefs_)
+	mutable std::atomic<unsigned long> accesscnt;		//< counter of accesses to contexts for the order of eviction
+	std::size_t maxnofcontexts;				//< maximum number of contexts before evicting the least recently used, 0 for no limit
+	std::size_t maxmemsize;					//< maximum memory used by contexts before evicting the least recently used, 0 for no limit
+	papuga_RequestContextEvictHandler evicthandler;		//< function called for a context evicted or NULL
+	void* evicthandler_data;				//< data passed to evicthandler
+	RequestContextLruIndex lruindex;			//< contexts ordered by their last access for eviction and the totals of the contexts
+
+	papuga_RequestHandler( const papuga_ClassDef* classdefs_, int nofshards)
+		:contextmaps(nofshards > 0 ? nofshards : 1),schemas(NULL),classmethodmap(NULL),classmethodmapsize(nofClassDefs(classdefs_)),classdefs(classdefs_)
+		,accesscnt(0),maxnofcontexts(0),maxmemsize(0),evicthandler(NULL),evicthandler_data(NULL),lruindex()
 	{
 		papuga_init_Allocator( &allocator, allocator_membuf, sizeof(allocator_membuf));
+		schemaindex.init();
+		methodindex.init();
 		std::size_t classmethodmapmem = (classmethodmapsize+1) * sizeof(RequestMethodList*);
 		classmethodmap = (RequestMethodList**)papuga_Allocator_alloc( &allocator, classmethodmapmem, sizeof(RequestMethodList*));
 		if (!classmethodmap) throw std::bad_alloc();
@@ -432,6 +1057,26 @@ struct papuga_RequestHandler
 	{
 		papuga_destroy_Allocator( &allocator);
 	}
+
+	std::size_t shardIndex( const SymKey& key) const
+	{
+		// ... keys are null terminated, the hash is independent of the one selecting the shard and the bucket inside a context map
+		return contextmaps.size() == 1 ? 0 : hashString( HashInitValue, key.str) % contextmaps.size();
+	}
+	RequestContextMapRef& contextmap( const SymKey& key)
+	{
+		return contextmaps[ shardIndex( key)].ref;
+	}
+	const RequestContextMapRef& contextmap( const SymKey& key) const
+	{
+		return contextmaps[ shardIndex( key)].ref;
+	}
+	/* @brief Get the snapshots of the context maps of all shards */
+	void snapshots( std::vector<RequestContextMapRef>& result) const
+	{
+		RequestContextMapRootArray::const_iterator ri = contextmaps.begin(), re = contextmaps.end();
+		for (; ri != re; ++ri) result.push_back( RequestContextMap_snapshot( ri->ref));
+	}
 };
 
 extern "C" papuga_RequestContext* papuga_create_RequestContext()
@@ -452,7 +1097,75 @@ extern "C" void papuga_destroy_RequestContext( papuga_RequestContext* self)
 	delete self;
 }
 
-extern "C" papuga_ErrorCode papuga_RequestContext_last_error( papuga_RequestContext* self, bool clear)
+extern "C" void papuga_RequestContext_reset( papuga_RequestContext* self)
+{
+	self->reset();
+}
+
+struct papuga_RequestContextPool
+{
+	std::mutex mutex;
+	std::vector<papuga_RequestContext*> contexts;	//< contexts reset for reuse
+	std::size_t maxsize;				//< maximum number of contexts kept
+
+	explicit papuga_RequestContextPool( std::size_t maxsize_)
+		:mutex(),contexts(),maxsize(maxsize_)
+	{
+		contexts.reserve( maxsize);
+	}
+	~papuga_RequestContextPool()
+	{
+		std::vector<papuga_RequestContext*>::iterator ci = contexts.begin(), ce = contexts.end();
+		for (; ci != ce; ++ci) delete *ci;
+	}
+};
+
+extern "C" papuga_RequestContextPool* papuga_create_RequestContextPool( int maxsize)
+{
+	try
+	{
+		return new papuga_RequestContextPool( maxsize > 0 ? maxsize : 0);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+extern "C" void papuga_destroy_RequestContextPool( papuga_RequestContextPool* self)
+{
+	delete self;
+}
+
+extern "C" papuga_RequestContext* papuga_RequestContextPool_acquire( papuga_RequestContextPool* self)
+{
+	{
+		std::unique_lock<std::mutex> lock( self->mutex);
+		if (!self->contexts.empty())
+		{
+			papuga_RequestContext* rt = self->contexts.back();
+			self->contexts.pop_back();
+			return rt;
+		}
+	}
+	return papuga_create_RequestContext();
+}
+
+extern "C" void papuga_RequestContextPool_release( papuga_RequestContextPool* self, papuga_RequestContext* context)
+{
+	context->reset();
+	{
+		std::unique_lock<std::mutex> lock( self->mutex);
+		if (self->contexts.size() < self->maxsize)
+		{
+			self->contexts.push_back( context);
+			return;
+		}
+	}
+	delete context;
+}
+
+extern "C" papuga_ErrorCode papuga_RequestContext_last_error( papuga_RequestContext* self, bool clear)
 {
 	if (clear)
 	{
@@ -488,7 +1201,7 @@ extern "C" bool papuga_RequestContext_define_variable( papuga_RequestContext* se
 
 extern "C" const papuga_ValueVariant* papuga_RequestContext_get_variable( const papuga_RequestContext* self, const char* name)
 {
-	return self->varmap.findVariable( name);
+	return self->varmap.findVariable( name, self->errcode);
 }
 
 extern "C" const char** papuga_RequestContext_list_variables( const papuga_RequestContext* self, int max_inheritcnt, char const** buf, size_t bufsize)
@@ -503,19 +1216,17 @@ extern "C" bool papuga_RequestContext_inherit( papuga_RequestContext* self, cons
 		char keybuf[ 256];
 		SymKey key = SymKey::create( keybuf, sizeof(keybuf), type, name);
 
-		RequestContextMapRef contextmap( handler->contextmap);	//... keep instance of context map alive until job is done
-		const papuga_RequestContext* context = (*contextmap)[ key];
-
-		if (!context)
+		RequestContextMapRef contextmap( RequestContextMap_snapshot( handler->contextmap( key)));
+		RequestContextEntryRef entry = contextmap->findEntry( key);
+		if (!entry.get())
 		{
 			self->errcode = papuga_AddressedItemNotFound;
 			return false;
 		}
-		if (!self->varmap.merge( context->varmap))
-		{
-			self->errcode = papuga_DuplicateDefinition;
-			return false;
-		}
+		entry->lastaccess.store( ++handler->accesscnt);
+		RequestContextRef context = entry->context;	//... the scope inherited keeps the context alive, also if it gets removed from the handler
+
+		self->varmap.inherit( RequestVariableScopeRef( context, &context->varmap));
 		return true;
 	}
 	catch (...)
@@ -529,7 +1240,7 @@ extern "C" papuga_RequestHandler* papuga_create_RequestHandler( const papuga_Cla
 {
 	try
 	{
-		return new papuga_RequestHandler( classdefs);
+		return new papuga_RequestHandler( classdefs, 1);
 	}
 	catch (...)
 	{
@@ -537,30 +1248,33 @@ extern "C" papuga_RequestHandler* papuga_create_RequestHandler( const papuga_Cla
 	}
 }
 
-extern "C" void papuga_destroy_RequestHandler( papuga_RequestHandler* self)
-{
-	delete self;
-}
-
-extern "C" bool papuga_RequestHandler_remove_context( papuga_RequestHandler* self, const char* type, const char* name, papuga_ErrorCode* errcode)
+extern "C" papuga_RequestHandler* papuga_create_RequestHandler_sharded( const papuga_ClassDef* classdefs, int nofshards)
 {
 	try
 	{
-		return RequestContextMap_delete( self->contextmap, type, name);
+		return new papuga_RequestHandler( classdefs, nofshards);
 	}
 	catch (...)
 	{
-		*errcode = papuga_NoMemError;
-		return false;
+		return NULL;
 	}
-	return true;
 }
 
-extern "C" bool papuga_RequestHandler_transfer_context( papuga_RequestHandler* self, const char* type, const char* name, papuga_RequestContext* context, papuga_ErrorCode* errcode)
+extern "C" void papuga_destroy_RequestHandler( papuga_RequestHandler* self)
+{
+	delete self;
+}
+
+extern "C" bool papuga_RequestHandler_remove_context( papuga_RequestHandler* self, const char* type, const char* name, papuga_ErrorCode* errcode)
 {
 	try
 	{
-		RequestContextMap_transfer( self->contextmap, type, name, context);
+		char keybuf[ 256];
+		SymKey key = SymKey::create( keybuf, sizeof(keybuf), type, name);
+		RequestContextEntryRef removed = RequestContextMap_delete( self->contextmap( key), key, NULL);
+		if (!removed.get()) return false;
+		std::unique_lock<std::mutex> lock( self->lruindex.mutex());
+		self->lruindex.unlink( removed);
 		return true;
 	}
 	catch (...)
@@ -571,424 +1285,1753 @@ extern "C" bool papuga_RequestHandler_transfer_context( papuga_RequestHandler* s
 	return true;
 }
 
-extern "C" bool papuga_RequestHandler_add_schema( papuga_RequestHandler* self, const char* type, const char* name, const papuga_RequestAutomaton* automaton, const papuga_SchemaDescription* description)
-{
-	RequestSchemaList* listitem = alloc_type<RequestSchemaList>( &self->allocator);
-	if (!listitem) return false;
-	listitem->type = papuga_Allocator_copy_charp( &self->allocator, type);
-	listitem->name = papuga_Allocator_copy_charp( &self->allocator, name);
-	listitem->hs = RequestSchemaList::hash( listitem->type, listitem->name);
-	if (!listitem->type || !listitem->name) return false;
-	listitem->automaton = automaton;
-	listitem->description = description;
-	self->schemas = add_list( self->schemas, listitem);
-	return true;
-}
-
-static RequestSchemaList* find_schema( RequestSchemaList* ll, const char* type, const char* name)
+// \brief Link the entry added to the context map to the LRU index and unlink the one it replaced
+static void RequestHandler_link_context( papuga_RequestHandler* self, const RequestContextEntryRef& added, const RequestContextEntryRef& replaced)
 {
-	int hs = RequestSchemaList::hash( type, name);
-	for (; ll; ll = ll->next){if (ll->hs == hs && 0==std::strcmp( ll->name, name) && 0==std::strcmp( ll->type, type)) break;}
-	return ll;
+	std::unique_lock<std::mutex> lock( self->lruindex.mutex());
+	if (replaced.get()) self->lruindex.unlink( replaced);
+	self->lruindex.link( added);
 }
 
-static const char** RequestHandler_list_all_schema_names( const papuga_RequestHandler* self, char const** buf, size_t bufsize)
+// \brief Remove the least recently used contexts until the limits of the handler are met
+// \param[in] except context not to evict (the one added)
+static void RequestHandler_evict_contexts( papuga_RequestHandler* self, const RequestContextEntry* except)
 {
-	size_t bufpos = 0;
-	RequestSchemaList const* sl = self->schemas;
-	for (; sl; sl = sl->next)
+	if (!self->maxnofcontexts && !self->maxmemsize) return;
+	std::vector<RequestContextEntryRef> evicted;
 	{
-		size_t bi = 0;
-		for (; bi < bufpos; ++bi){if (0==std::strcmp(buf[bi],sl->name)) break;}
-		if (bi < bufpos) continue;
-		if (bufpos >= bufsize) return NULL;
-		buf[ bufpos++] = sl->name;
+		std::unique_lock<std::mutex> lock( self->lruindex.mutex());
+		while ((self->maxnofcontexts && self->lruindex.nofcontexts() > self->maxnofcontexts)
+		||     (self->maxmemsize && self->lruindex.memsize() > self->maxmemsize))
+		{
+			RequestContextEntryRef victim = self->lruindex.leastRecentlyUsed( except);
+			if (!victim.get()) break;
+			SymKey key( victim->key.c_str(), victim->key.size());
+			// ... the entry might have been removed or replaced concurrently, its removal from the index is then pending and done here
+			if (RequestContextMap_delete( self->contextmap( key), key, victim.get()).get())
+			{
+				evicted.push_back( victim);
+			}
+			self->lruindex.unlink( victim);
+		}
 	}
-	if (bufpos >= bufsize) return NULL;
-	buf[ bufpos] = NULL;
-	return buf;
-}
-
-const char** papuga_RequestHandler_list_schema_types( const papuga_RequestHandler* self, char const** buf, size_t bufsize)
-{
-	size_t bufpos = 0;
-	RequestSchemaList const* sl = self->schemas;
-	for (; sl; sl = sl->next)
+	if (self->evicthandler)
 	{
-		size_t bi = 0;
-		for (; bi < bufpos; ++bi){if (0==std::strcmp(buf[bi],sl->type)) break;}
-		if (bi < bufpos) continue;
-		if (bufpos >= bufsize) return NULL;
-		buf[ bufpos++] = sl->type;
+		std::vector<RequestContextEntryRef>::const_iterator ei = evicted.begin(), ee = evicted.end();
+		for (; ei != ee; ++ei)
+		{
+			self->evicthandler( self->evicthandler_data, (*ei)->type.c_str(), (*ei)->name.c_str(), (*ei)->memsize);
+		}
 	}
-	if (bufpos >= bufsize) return NULL;
-	buf[ bufpos] = NULL;
-	return buf;
 }
 
-extern "C" const char** papuga_RequestHandler_list_schema_names( const papuga_RequestHandler* self, const char* type, char const** buf, size_t bufsize)
+extern "C" void papuga_RequestHandler_set_context_limits( papuga_RequestHandler* self, size_t maxnofcontexts, size_t maxmemsize, papuga_RequestContextEvictHandler evicthandler, void* evicthandler_data)
 {
-	size_t bufpos = 0;
-	RequestSchemaList const* sl = self->schemas;
+	self->maxnofcontexts = maxnofcontexts;
+	self->maxmemsize = maxmemsize;
+	self->evicthandler = evicthandler;
+	self->evicthandler_data = evicthandler_data;
+}
 
-	if (!type)
+extern "C" bool papuga_RequestHandler_context_memsize( const papuga_RequestHandler* self, const char* type, const char* name, size_t* memsize)
+{
+	try
 	{
-		return RequestHandler_list_all_schema_names( self, buf, bufsize);
+		char keybuf[ 256];
+		SymKey key = SymKey::create( keybuf, sizeof(keybuf), type, name);
+		RequestContextMapRef contextmap( RequestContextMap_snapshot( self->contextmap( key)));
+		RequestContextEntryRef entry = contextmap->findEntry( key);
+		if (!entry.get()) return false;
+		*memsize = entry->memsize;
+		return true;
 	}
-	for (; sl; sl = sl->next)
+	catch (...)
 	{
-		if (!type || 0==std::strcmp(type, sl->type))
-		{
-			if (bufpos >= bufsize) return NULL;
-			buf[ bufpos++] = sl->name;
-		}
+		return false;
 	}
-	if (bufpos >= bufsize) return NULL;
-	buf[ bufpos] = NULL;
-	return buf;
-}
-
-extern "C" const papuga_RequestAutomaton* papuga_RequestHandler_get_automaton( const papuga_RequestHandler* self, const char* type, const char* name)
-{
-	const RequestSchemaList* sl = find_schema( self->schemas, type?type:"", name);
-	return sl ? sl->automaton : NULL;
 }
 
-extern "C" const papuga_SchemaDescription* papuga_RequestHandler_get_description( const papuga_RequestHandler* self, const char* type, const char* name)
+extern "C" size_t papuga_RequestHandler_total_context_memsize( const papuga_RequestHandler* self)
 {
-	const RequestSchemaList* sl = find_schema( self->schemas, type?type:"", name);
-	return sl ? sl->description : NULL;
+	return self->lruindex.memsize();
 }
 
-extern "C" bool papuga_RequestHandler_add_method( papuga_RequestHandler* self, const char* name, const papuga_RequestMethodDescription* method)
+extern "C" bool papuga_RequestHandler_transfer_context( papuga_RequestHandler* self, const char* type, const char* name, papuga_RequestContext* context, papuga_ErrorCode* errcode)
 {
-	int nofparams = 0;
-	if (method->id.classid == 0 || method->id.classid > self->classmethodmapsize) return false;
-	while (method->paramtypes[nofparams]) ++nofparams;
-	RequestMethodList** mlst = self->classmethodmap + (method->id.classid-1);
-	RequestMethodList* listitem = alloc_type<RequestMethodList>( &self->allocator);
-	if (!listitem) return false;
-	std::memcpy( &listitem->method, method, sizeof( listitem->method));
-	listitem->name = papuga_Allocator_copy_charp( &self->allocator, name);
-	listitem->method.paramtypes = (int*)papuga_Allocator_alloc( &self->allocator, (nofparams+1) * sizeof(int), sizeof(int));
-	if (!listitem->name || !listitem->method.paramtypes) return false;
-	std::memcpy( listitem->method.paramtypes, (const void*)method->paramtypes, (nofparams+1) * sizeof(int));
-	*mlst = add_list( *mlst, listitem);
+	try
+	{
+		char keybuf[ 256];
+		SymKey key = SymKey::create( keybuf, sizeof(keybuf), type, name);
+		context->varmap.removeLocalVariables();
+		if (!context->varmap.flatten())
+		{
+			*errcode = papuga_DuplicateDefinition;
+			return false;
+		}
+		RequestContextEntryRef replaced;
+		RequestContextEntryRef entry = RequestContextMap_transfer( self->contextmap( key), key, type, name, context, ++self->accesscnt, replaced);
+		RequestHandler_link_context( self, entry, replaced);
+		RequestHandler_evict_contexts( self, entry.get());
+		return true;
+	}
+	catch (...)
+	{
+		*errcode = papuga_NoMemError;
+		return false;
+	}
 	return true;
 }
 
-extern "C" const papuga_RequestMethodDescription* papuga_RequestHandler_get_method( const papuga_RequestHandler* self, int classid, const char* name, bool with_content)
-{
-	if (classid == 0 || classid > self->classmethodmapsize) return NULL;
-	RequestMethodList const* ml = self->classmethodmap[ classid-1];
-	for (; ml; ml = ml->next){if (ml->method.has_content == with_content && ml->name[0] == name[0] && 0==std::strcmp( ml->name, name)) break;}
-	return ml ? &ml->method : NULL;
-}
+static bool writeSnapshotSerialization( papuga::ContextSnapshotWriter& writer, const papuga_Serialization* ser, const papuga_ClassDef* classdefs, int nofclassdefs, int depth, papuga_ErrorCode& errcode);
 
-const char** papuga_RequestHandler_list_methods( const papuga_RequestHandler* self, int classid, char const** buf, size_t bufsize)
+// \brief Write a value to a snapshot, host objects with the serialize function of their class
+// \note Throws std::bad_alloc on a memory allocation error
+static bool writeSnapshotValue( papuga::ContextSnapshotWriter& writer, const papuga_ValueVariant& value, const papuga_ClassDef* classdefs, int nofclassdefs, int depth, papuga_ErrorCode& errcode)
 {
-	if (classid == 0 || classid > self->classmethodmapsize) return NULL;
-	size_t bufpos = 0;
-	RequestMethodList const* ml = self->classmethodmap[ classid-1];
-
-	for (; ml; ml = ml->next)
+	if (depth > papuga::ContextSnapshotHeader::MaxValueDepth)
 	{
-		if (bufpos >= bufsize) return NULL;
-		buf[ bufpos++] = ml->name;
+		errcode = papuga_MaxRecursionDepthReached;
+		return false;
 	}
-	if (bufpos >= bufsize) return NULL;
-	buf[ bufpos] = NULL;
-	return buf;
-}
-
-static void assignErrMethod( papuga_RequestError& errstruct, const papuga_RequestMethodId& mid, const papuga_ClassDef* classdefs)
-{
-	if (mid.classid)
+	writer.pushByte( value.valuetype);
+	switch ((papuga_Type)value.valuetype)
 	{
-		errstruct.classname = classdefs[ mid.classid-1].name;
-		if (mid.functionid)
+		case papuga_TypeVoid:
+			return true;
+		case papuga_TypeDouble:
 		{
-			errstruct.methodname = classdefs[ mid.classid-1].methodnames[ mid.functionid-1];
+			uint64_t bits;
+			std::memcpy( &bits, &value.value.Double, sizeof(bits));
+			writer.pushUint64( bits);
+			return true;
 		}
-		else
+		case papuga_TypeInt:
+			writer.pushUint64( (uint64_t)value.value.Int);
+			return true;
+		case papuga_TypeBool:
+			writer.pushByte( value.value.Bool ? 1:0);
+			return true;
+		case papuga_TypeString:
+			writer.pushByte( value.encoding);
+			writer.pushString( value.value.string, value.length);
+			return true;
+		case papuga_TypeHostObject:
 		{
-			errstruct.methodname = 0;
+			const papuga_HostObject* hobj = value.value.hostObject;
+			if (hobj->classid <= 0 || hobj->classid > nofclassdefs)
+			{
+				errcode = papuga_InvalidAccess;
+				return false;
+			}
+			const papuga_ClassDef& cdef = classdefs[ hobj->classid-1];
+			if (!cdef.serialize || !cdef.deserialize)
+			{
+				errcode = papuga_NotImplemented;
+				return false;
+			}
+			writer.pushUint32( hobj->classid);
+
+			int allocatormem[ 256];
+			papuga_Allocator allocator;
+			papuga_init_Allocator( &allocator, allocatormem, sizeof(allocatormem));
+			papuga_Serialization ser;
+			papuga_init_Serialization( &ser, &allocator);
+			bool rt;
+			try
+			{
+				rt = cdef.serialize( hobj->data, &ser, &errcode)
+					&& writeSnapshotSerialization( writer, &ser, classdefs, nofclassdefs, depth+1, errcode);
+				if (!rt && errcode == papuga_Ok) errcode = papuga_HostObjectError;
+			}
+			catch (...)
+			{
+				papuga_destroy_Allocator( &allocator);
+				throw;
+			}
+			papuga_destroy_Allocator( &allocator);
+			return rt;
 		}
+		case papuga_TypeSerialization:
+			return writeSnapshotSerialization( writer, value.value.serialization, classdefs, nofclassdefs, depth+1, errcode);
+		case papuga_TypeIterator:
+			errcode = papuga_NotImplemented;
+			return false;
 	}
-	else
-	{
-		errstruct.classname = 0;
-		errstruct.methodname = 0;
-	}
+	errcode = papuga_TypeError;
+	return false;
 }
 
-static void assignErrMessage( papuga_RequestError& errstruct, const char* msg)
+static bool writeSnapshotSerialization( papuga::ContextSnapshotWriter& writer, const papuga_Serialization* ser, const papuga_ClassDef* classdefs, int nofclassdefs, int depth, papuga_ErrorCode& errcode)
 {
-	std::size_t msgsize = std::strlen(msg);
-	if (msgsize >= sizeof( errstruct.errormsg)) msgsize = sizeof( errstruct.errormsg)-1;
-	std::memcpy( errstruct.errormsg, msg, msgsize);
+	writer.pushUint32( ser->structid);
+	papuga_SerializationIter itr;
+	papuga_init_SerializationIter( &itr, ser);
+	for (; !papuga_SerializationIter_eof( &itr); papuga_SerializationIter_skip( &itr))
+	{
+		writer.pushByte( papuga_SerializationIter_tag( &itr));
+		if (!writeSnapshotValue( writer, *papuga_SerializationIter_value( &itr), classdefs, nofclassdefs, depth, errcode)) return false;
+	}
+	writer.pushByte( papuga::ContextSnapshotHeader::EndOfSerialization);
+	return true;
 }
 
-extern "C" bool papuga_RequestContext_execute_request( papuga_RequestContext* context, const papuga_Request* request, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct)
-{
-	papuga_RequestIterator* itr = 0;
-	*results = 0;
-	*nofResults = 0;
-	std::memset( errstruct, 0, sizeof(*errstruct));
+static bool readSnapshotSerialization( papuga::ContextSnapshotReader& reader, papuga_Serialization* ser, const papuga_ClassDef* classdefs, int nofclassdefs, int depth, papuga_ErrorCode& errcode);
 
-	try
+// \brief Read a value from a snapshot into memory of an allocator, host objects with the deserialize function of their class
+static bool readSnapshotValue( papuga::ContextSnapshotReader& reader, papuga_Allocator* allocator, papuga_ValueVariant& value, const papuga_ClassDef* classdefs, int nofclassdefs, int depth, papuga_ErrorCode& errcode)
+{
+	unsigned char valuetype;
+	if (depth > papuga::ContextSnapshotHeader::MaxValueDepth)
 	{
-		papuga_ErrorBuffer errorbuf_call;
-
-		const papuga_ClassDef* classdefs = papuga_Request_classdefs( request);
-		itr = papuga_create_RequestIterator( allocator, request, &errstruct->errcode);
-		if (!itr) return false;
-
-		papuga_init_ErrorBuffer( &errorbuf_call, errstruct->errormsg, sizeof(errstruct->errormsg));
-
-		const papuga_RequestMethodCall* call;
-		while (!!(call = papuga_RequestIterator_next_call( itr, context)))
+		errcode = papuga_MaxRecursionDepthReached;
+		return false;
+	}
+	if (!reader.readByte( valuetype))
+	{
+		errcode = papuga_SyntaxError;
+		return false;
+	}
+	switch ((papuga_Type)valuetype)
+	{
+		case papuga_TypeVoid:
+			papuga_init_ValueVariant( &value);
+			return true;
+		case papuga_TypeDouble:
+		{
+			uint64_t bits;
+			double dval;
+			if (!reader.readUint64( bits)) break;
+			std::memcpy( &dval, &bits, sizeof(dval));
+			papuga_init_ValueVariant_double( &value, dval);
+			return true;
+		}
+		case papuga_TypeInt:
+		{
+			uint64_t ival;
+			if (!reader.readUint64( ival)) break;
+			papuga_init_ValueVariant_int( &value, (int64_t)ival);
+			return true;
+		}
+		case papuga_TypeBool:
 		{
-			// Execute all method calls and variable assignments:
-			if (call->methodid.classid == 0)
+			unsigned char bval;
+			if (!reader.readByte( bval)) break;
+			papuga_init_ValueVariant_bool( &value, bval);
+			return true;
+		}
+		case papuga_TypeString:
+		{
+			unsigned char enc;
+			const char* str;
+			std::size_t len;
+			if (!reader.readByte( enc) || !reader.readString( str, len)) break;
+			if (enc > papuga_Binary)
 			{
-				// [A] Variable assignment:
-				// [A.0] Create the result variable
-				if (!call->resultvarname || call->args.argc != 1)
-				{
-					errstruct->errcode = papuga_ValueUndefined;
-					papuga_destroy_RequestIterator( itr);
-					return false;
-				}
-				RequestVariable* var = NULL;
-				if (!papuga_Request_is_result_variable( request, call->resultvarname))
-				{
-					// ... HACK const_cast: We know that the source is only modified by the following deepcopy_value in the case
-					//	of a host object moved. But we know that a variable assignment is constructed from content and cannot
-					//	contain host object references.
-					papuga_ValueVariant* source = const_cast<papuga_ValueVariant*>( &call->args.argv[0]);
-
-					var = context->varmap.createVariable( call->resultvarname);
-					if (!papuga_Allocator_deepcopy_value( &var->allocator, &var->value, source, false/*movehostobj*/, &errstruct->errcode))
-					{
-						errstruct->variable = call->resultvarname;
-						papuga_destroy_RequestIterator( itr);
-						return false;
-					}
-				}
-				else
+				errcode = papuga_EncodingError;
+				return false;
+			}
+			char* strcopy = papuga_Allocator_copy_string_enc( allocator, str, len, (papuga_StringEncoding)enc);
+			if (!strcopy)
+			{
+				errcode = papuga_NoMemError;
+				return false;
+			}
+			papuga_init_ValueVariant_string_enc( &value, (papuga_StringEncoding)enc, strcopy, len);
+			return true;
+		}
+		case papuga_TypeHostObject:
+		{
+			unsigned int classid;
+			if (!reader.readUint32( classid)) break;
+			if (classid == 0 || classid > (unsigned int)nofclassdefs)
+			{
+				errcode = papuga_InvalidAccess;
+				return false;
+			}
+			const papuga_ClassDef& cdef = classdefs[ classid-1];
+			if (!cdef.deserialize)
+			{
+				errcode = papuga_NotImplemented;
+				return false;
+			}
+			int allocatormem[ 256];
+			papuga_Allocator ser_allocator;
+			papuga_init_Allocator( &ser_allocator, allocatormem, sizeof(allocatormem));
+			papuga_Serialization ser;
+			papuga_init_Serialization( &ser, &ser_allocator);
+			void* obj = NULL;
+			if (readSnapshotSerialization( reader, &ser, classdefs, nofclassdefs, depth+1, errcode))
+			{
+				char errbufmem[ 1024];
+				papuga_ErrorBuffer errbuf;
+				papuga_init_ErrorBuffer( &errbuf, errbufmem, sizeof(errbufmem));
+				obj = cdef.deserialize( &errbuf, &ser);
+				if (!obj) errcode = papuga_HostObjectError;
+			}
+			papuga_destroy_Allocator( &ser_allocator);
+			if (!obj) return false;
+
+			papuga_HostObject* hobj = papuga_Allocator_alloc_HostObject( allocator, classid, obj, cdef.destructor);
+			if (!hobj)
+			{
+				cdef.destructor( obj);
+				errcode = papuga_NoMemError;
+				return false;
+			}
+			papuga_init_ValueVariant_hostobj( &value, hobj);
+			return true;
+		}
+		case papuga_TypeSerialization:
+		{
+			papuga_Serialization* ser = papuga_Allocator_alloc_Serialization( allocator);
+			if (!ser)
+			{
+				errcode = papuga_NoMemError;
+				return false;
+			}
+			if (!readSnapshotSerialization( reader, ser, classdefs, nofclassdefs, depth+1, errcode)) return false;
+			papuga_init_ValueVariant_serialization( &value, ser);
+			return true;
+		}
+		case papuga_TypeIterator:
+			errcode = papuga_NotImplemented;
+			return false;
+		default:
+			errcode = papuga_SyntaxError;
+			return false;
+	}
+	errcode = papuga_SyntaxError;
+	return false;
+}
+
+static bool readSnapshotSerialization( papuga::ContextSnapshotReader& reader, papuga_Serialization* ser, const papuga_ClassDef* classdefs, int nofclassdefs, int depth, papuga_ErrorCode& errcode)
+{
+	unsigned int structid;
+	if (!reader.readUint32( structid))
+	{
+		errcode = papuga_SyntaxError;
+		return false;
+	}
+	papuga_Serialization_set_structid( ser, structid);
+	for (;;)
+	{
+		unsigned char tag;
+		if (!reader.readByte( tag))
+		{
+			errcode = papuga_SyntaxError;
+			return false;
+		}
+		if (tag == papuga::ContextSnapshotHeader::EndOfSerialization) return true;
+		if (tag > papuga_TagName)
+		{
+			errcode = papuga_SyntaxError;
+			return false;
+		}
+		papuga_ValueVariant nodevalue;
+		if (!readSnapshotValue( reader, ser->allocator, nodevalue, classdefs, nofclassdefs, depth, errcode)) return false;
+		if (!papuga_Serialization_push( ser, (papuga_Tag)tag, &nodevalue))
+		{
+			errcode = papuga_NoMemError;
+			return false;
+		}
+	}
+}
+
+// \brief Write a snapshot of the contexts passed ordered by key, the variables shared by contexts are written once
+// \note Throws std::bad_alloc on a memory allocation error
+static bool RequestContextEntries_write_snapshot( papuga::ContextSnapshotWriter& writer, const std::map<SymKey,const RequestContextEntry*>& deterministicMap, const papuga_ClassDef* classdefs, int nofclassdefs, papuga_ErrorCode& errcode)
+{
+	std::map<const RequestVariable*,unsigned int> varindexmap;
+	std::vector<const RequestVariable*> variables;
+	std::vector<std::vector<RequestVariableMap::VisibleVariable> > contextvars;
+	std::map<SymKey,const RequestContextEntry*>::const_iterator di = deterministicMap.begin(), de = deterministicMap.end();
+	for (; di != de; ++di)
+	{
+		contextvars.push_back( std::vector<RequestVariableMap::VisibleVariable>());
+		di->second->context->varmap.collect( contextvars.back());
+		std::vector<RequestVariableMap::VisibleVariable>::const_iterator vi = contextvars.back().begin(), ve = contextvars.back().end();
+		for (; vi != ve; ++vi)
+		{
+			const RequestVariable* var = vi->ref->ptr.get();
+			if (varindexmap.insert( std::pair<const RequestVariable*,unsigned int>( var, variables.size())).second)
+			{
+				variables.push_back( var);
+			}
+		}
+	}
+	writer.pushHeader( variables.size(), deterministicMap.size());
+	std::vector<const RequestVariable*>::const_iterator vi = variables.begin(), ve = variables.end();
+	for (; vi != ve; ++vi)
+	{
+		writer.pushString( (*vi)->name, std::strlen( (*vi)->name));
+		if (!writeSnapshotValue( writer, (*vi)->value, classdefs, nofclassdefs, 0, errcode)) return false;
+	}
+	std::vector<std::vector<RequestVariableMap::VisibleVariable> >::const_iterator ci = contextvars.begin();
+	for (di = deterministicMap.begin(); di != de; ++di,++ci)
+	{
+		writer.pushString( di->second->type.c_str(), di->second->type.size());
+		writer.pushString( di->second->name.c_str(), di->second->name.size());
+		writer.pushUint32( ci->size());
+		std::vector<RequestVariableMap::VisibleVariable>::const_iterator ei = ci->begin(), ee = ci->end();
+		for (; ei != ee; ++ei)
+		{
+			writer.pushUint32( varindexmap[ ei->ref->ptr.get()]);
+			writer.pushUint32( ei->inheritcnt);
+		}
+	}
+	return true;
+}
+
+// \brief Read the contexts of a snapshot and add them to the context map of a handler, replacing contexts with the same key
+// \note Throws std::bad_alloc on a memory allocation error
+static bool RequestHandler_read_snapshot( papuga_RequestHandler* self, papuga::ContextSnapshotReader& reader, papuga_ErrorCode& errcode)
+{
+	unsigned int nofvariables;
+	unsigned int nofcontexts;
+	if (!reader.readHeader( nofvariables, nofcontexts))
+	{
+		errcode = papuga_SyntaxError;
+		return false;
+	}
+	std::vector<papuga::shared_ptr<RequestVariable> > variables;
+	unsigned int vi = 0;
+	for (; vi < nofvariables; ++vi)
+	{
+		const char* name;
+		std::size_t namelen;
+		if (!reader.readString( name, namelen))
+		{
+			errcode = papuga_SyntaxError;
+			return false;
+		}
+		papuga::shared_ptr<RequestVariable> var( std::make_shared<RequestVariable>( std::string( name, namelen).c_str()));
+		if (!readSnapshotValue( reader, &var->allocator, var->value, self->classdefs, self->classmethodmapsize, 0, errcode)) return false;
+		variables.push_back( var);
+	}
+	std::vector<std::vector<RequestContextEntryRef> > shardentries( self->contextmaps.size());
+	unsigned long accesscnt = ++self->accesscnt;
+	unsigned int ci = 0;
+	for (; ci < nofcontexts; ++ci)
+	{
+		const char* typeptr;
+		std::size_t typelen;
+		const char* nameptr;
+		std::size_t namelen;
+		unsigned int nofvars;
+		if (!reader.readString( typeptr, typelen) || !reader.readString( nameptr, namelen) || !reader.readUint32( nofvars))
+		{
+			errcode = papuga_SyntaxError;
+			return false;
+		}
+		std::string type( typeptr, typelen);
+		std::string name( nameptr, namelen);
+		RequestContextRef context( new papuga_RequestContext());
+		unsigned int ei = 0;
+		for (; ei < nofvars; ++ei)
+		{
+			unsigned int varidx;
+			unsigned int inheritcnt;
+			if (!reader.readUint32( varidx) || !reader.readUint32( inheritcnt))
+			{
+				errcode = papuga_SyntaxError;
+				return false;
+			}
+			if (varidx >= variables.size())
+			{
+				errcode = papuga_SyntaxError;
+				return false;
+			}
+			if (!context->varmap.insert( variables[ varidx], inheritcnt))
+			{
+				errcode = papuga_DuplicateDefinition;
+				return false;
+			}
+		}
+		char keybuf[ 256];
+		SymKey key = SymKey::create( keybuf, sizeof(keybuf), type.c_str(), name.c_str());
+		shardentries[ self->shardIndex( key)].push_back( RequestContextEntryRef( new RequestContextEntry( key, type.c_str(), name.c_str(), context, accesscnt)));
+	}
+	if (!reader.eof())
+	{
+		errcode = papuga_SyntaxError;
+		return false;
+	}
+	std::size_t si = 0, se = shardentries.size();
+	for (; si != se; ++si)
+	{
+		const std::vector<RequestContextEntryRef>& entries = shardentries[ si];
+		if (entries.empty()) continue;
+		std::vector<RequestContextEntryRef> replaced( entries.size());
+		RequestContextMapRef& cm = self->contextmaps[ si].ref;
+		RequestContextMapRef cm_ref( RequestContextMap_snapshot( cm));
+		for (;;)
+		{
+			RequestContextMapRef cm_copy( new RequestContextMap( *cm_ref));
+			std::size_t ni = 0, ne = entries.size();
+			for (; ni != ne; ++ni) replaced[ ni] = cm_copy->addEntry( entries[ ni]);
+			if (RequestContextMap_publish( cm, cm_ref, cm_copy)) break;
+			// ... another update was published concurrently, retry with the new snapshot
+		}
+		std::unique_lock<std::mutex> lock( self->lruindex.mutex());
+		std::size_t ni = 0, ne = entries.size();
+		for (; ni != ne; ++ni)
+		{
+			if (replaced[ ni].get()) self->lruindex.unlink( replaced[ ni]);
+			self->lruindex.link( entries[ ni]);
+		}
+	}
+	RequestHandler_evict_contexts( self, NULL);
+	return true;
+}
+
+extern "C" bool papuga_RequestHandler_save_contexts( const papuga_RequestHandler* self, const char* filename, papuga_ErrorCode* errcode)
+{
+	try
+	{
+		papuga::ContextSnapshotWriter writer;
+		std::vector<RequestContextMapRef> snapshots;	//... keep the entries collected alive
+		self->snapshots( snapshots);
+		std::map<SymKey,const RequestContextEntry*> entries;
+		std::vector<RequestContextMapRef>::const_iterator si = snapshots.begin(), se = snapshots.end();
+		for (; si != se; ++si) (*si)->collectEntries( entries);
+		if (!RequestContextEntries_write_snapshot( writer, entries, self->classdefs, self->classmethodmapsize, *errcode)) return false;
+
+		// ... write to a temporary file with a unique name renamed when complete and synced, so that a snapshot file is never seen partially written, also with concurrent saves
+		std::string tmpfilename = std::string( filename) + ".XXXXXX";
+		int fd = ::mkstemp( &tmpfilename[0]);
+		if (fd < 0)
+		{
+			*errcode = papuga_FileWriteError;
+			return false;
+		}
+		std::FILE* file = ::fdopen( fd, "wb");
+		if (!file)
+		{
+			::close( fd);
+			std::remove( tmpfilename.c_str());
+			*errcode = papuga_FileWriteError;
+			return false;
+		}
+		const std::string& content = writer.content();
+		bool written = content.size() == std::fwrite( content.c_str(), 1, content.size(), file)
+				&& 0==std::fflush( file)
+				&& 0==::fsync( fd);
+		if (0!=std::fclose( file)) written = false;
+		if (!written || 0!=std::rename( tmpfilename.c_str(), filename))
+		{
+			std::remove( tmpfilename.c_str());
+			*errcode = papuga_FileWriteError;
+			return false;
+		}
+		return true;
+	}
+	catch (...)
+	{
+		*errcode = papuga_NoMemError;
+		return false;
+	}
+}
+
+extern "C" bool papuga_RequestHandler_load_contexts( papuga_RequestHandler* self, const char* filename, papuga_ErrorCode* errcode)
+{
+	papuga_FileContent content;
+	if (!papuga_init_FileContent( &content, filename, errcode)) return false;
+	bool rt;
+	try
+	{
+		papuga::ContextSnapshotReader reader( content.ptr, content.size);
+		rt = RequestHandler_read_snapshot( self, reader, *errcode);
+	}
+	catch (...)
+	{
+		*errcode = papuga_NoMemError;
+		rt = false;
+	}
+	papuga_destroy_FileContent( &content);
+	return rt;
+}
+
+extern "C" bool papuga_RequestHandler_add_schema( papuga_RequestHandler* self, const char* type, const char* name, const papuga_RequestAutomaton* automaton, const papuga_SchemaDescription* description)
+{
+	RequestSchemaList* listitem = alloc_type<RequestSchemaList>( &self->allocator);
+	if (!listitem) return false;
+	listitem->type = papuga_Allocator_copy_charp( &self->allocator, type);
+	listitem->name = papuga_Allocator_copy_charp( &self->allocator, name);
+	if (!listitem->type || !listitem->name) return false;
+	listitem->hs = RequestSchemaList::hash( listitem->type, listitem->name);
+	listitem->automaton = automaton;
+	listitem->description = description;
+	if (!self->schemaindex.insert( &self->allocator, listitem)) return false;
+	self->schemas = add_list( self->schemas, listitem);
+	return true;
+}
+
+static const RequestSchemaList* find_schema( const papuga_RequestHandler* self, const char* type, const char* name)
+{
+	RequestSchemaList key;
+	key.type = type;
+	key.name = name;
+	key.hs = RequestSchemaList::hash( type, name);
+	return self->schemaindex.find( key);
+}
+
+static const char** RequestHandler_list_all_schema_names( const papuga_RequestHandler* self, char const** buf, size_t bufsize)
+{
+	size_t bufpos = 0;
+	RequestSchemaList const* sl = self->schemas;
+	for (; sl; sl = sl->next)
+	{
+		size_t bi = 0;
+		for (; bi < bufpos; ++bi){if (0==std::strcmp(buf[bi],sl->name)) break;}
+		if (bi < bufpos) continue;
+		if (bufpos >= bufsize) return NULL;
+		buf[ bufpos++] = sl->name;
+	}
+	if (bufpos >= bufsize) return NULL;
+	buf[ bufpos] = NULL;
+	return buf;
+}
+
+const char** papuga_RequestHandler_list_schema_types( const papuga_RequestHandler* self, char const** buf, size_t bufsize)
+{
+	size_t bufpos = 0;
+	RequestSchemaList const* sl = self->schemas;
+	for (; sl; sl = sl->next)
+	{
+		size_t bi = 0;
+		for (; bi < bufpos; ++bi){if (0==std::strcmp(buf[bi],sl->type)) break;}
+		if (bi < bufpos) continue;
+		if (bufpos >= bufsize) return NULL;
+		buf[ bufpos++] = sl->type;
+	}
+	if (bufpos >= bufsize) return NULL;
+	buf[ bufpos] = NULL;
+	return buf;
+}
+
+extern "C" const char** papuga_RequestHandler_list_schema_names( const papuga_RequestHandler* self, const char* type, char const** buf, size_t bufsize)
+{
+	size_t bufpos = 0;
+	RequestSchemaList const* sl = self->schemas;
+
+	if (!type)
+	{
+		return RequestHandler_list_all_schema_names( self, buf, bufsize);
+	}
+	for (; sl; sl = sl->next)
+	{
+		if (!type || 0==std::strcmp(type, sl->type))
+		{
+			if (bufpos >= bufsize) return NULL;
+			buf[ bufpos++] = sl->name;
+		}
+	}
+	if (bufpos >= bufsize) return NULL;
+	buf[ bufpos] = NULL;
+	return buf;
+}
+
+extern "C" const papuga_RequestAutomaton* papuga_RequestHandler_get_automaton( const papuga_RequestHandler* self, const char* type, const char* name)
+{
+	const RequestSchemaList* sl = find_schema( self, type?type:"", name);
+	return sl ? sl->automaton : NULL;
+}
+
+extern "C" const papuga_SchemaDescription* papuga_RequestHandler_get_description( const papuga_RequestHandler* self, const char* type, const char* name)
+{
+	const RequestSchemaList* sl = find_schema( self, type?type:"", name);
+	return sl ? sl->description : NULL;
+}
+
+extern "C" bool papuga_RequestHandler_add_method( papuga_RequestHandler* self, const char* name, const papuga_RequestMethodDescription* method)
+{
+	int nofparams = 0;
+	if (method->id.classid == 0 || method->id.classid > self->classmethodmapsize) return false;
+	while (method->paramtypes[nofparams]) ++nofparams;
+	RequestMethodList** mlst = self->classmethodmap + (method->id.classid-1);
+	RequestMethodList* listitem = alloc_type<RequestMethodList>( &self->allocator);
+	if (!listitem) return false;
+	std::memcpy( &listitem->method, method, sizeof( listitem->method));
+	listitem->name = papuga_Allocator_copy_charp( &self->allocator, name);
+	listitem->method.paramtypes = (int*)papuga_Allocator_alloc( &self->allocator, (nofparams+1) * sizeof(int), sizeof(int));
+	if (!listitem->name || !listitem->method.paramtypes) return false;
+	std::memcpy( listitem->method.paramtypes, (const void*)method->paramtypes, (nofparams+1) * sizeof(int));
+	listitem->hs = RequestMethodList::hash( method->id.classid, listitem->name);
+	if (!self->methodindex.insert( &self->allocator, listitem)) return false;
+	*mlst = add_list( *mlst, listitem);
+	return true;
+}
+
+extern "C" const papuga_RequestMethodDescription* papuga_RequestHandler_get_method( const papuga_RequestHandler* self, int classid, const char* name, bool with_content)
+{
+	if (classid == 0 || classid > self->classmethodmapsize) return NULL;
+	RequestMethodList key;
+	key.name = name;
+	key.method.id.classid = classid;
+	key.method.has_content = with_content;
+	key.hs = RequestMethodList::hash( classid, name);
+	const RequestMethodList* ml = self->methodindex.find( key);
+	return ml ? &ml->method : NULL;
+}
+
+const char** papuga_RequestHandler_list_methods( const papuga_RequestHandler* self, int classid, char const** buf, size_t bufsize)
+{
+	if (classid == 0 || classid > self->classmethodmapsize) return NULL;
+	size_t bufpos = 0;
+	RequestMethodList const* ml = self->classmethodmap[ classid-1];
+
+	for (; ml; ml = ml->next)
+	{
+		if (bufpos >= bufsize) return NULL;
+		buf[ bufpos++] = ml->name;
+	}
+	if (bufpos >= bufsize) return NULL;
+	buf[ bufpos] = NULL;
+	return buf;
+}
+
+static void assignErrMethod( papuga_RequestError& errstruct, const papuga_RequestMethodId& mid, const papuga_ClassDef* classdefs)
+{
+	if (mid.classid)
+	{
+		errstruct.classname = classdefs[ mid.classid-1].name;
+		if (mid.functionid)
+		{
+			errstruct.methodname = classdefs[ mid.classid-1].methodnames[ mid.functionid-1];
+		}
+		else
+		{
+			errstruct.methodname = 0;
+		}
+	}
+	else
+	{
+		errstruct.classname = 0;
+		errstruct.methodname = 0;
+	}
+}
+
+static void assignErrMessage( papuga_RequestError& errstruct, const char* msg)
+{
+	std::size_t msgsize = std::strlen(msg);
+	if (msgsize >= sizeof( errstruct.errormsg)) msgsize = sizeof( errstruct.errormsg)-1;
+	std::memcpy( errstruct.errormsg, msg, msgsize);
+}
+
+/// \brief Build the result value of a method call from the values returned
+static bool buildCallResultValue( papuga_ValueVariant& resultvalue, papuga_CallResult& retval, papuga_Allocator* allocator)
+{
+	if (retval.nofvalues == 0)
+	{
+		papuga_init_ValueVariant( &resultvalue);
+	}
+	else if (retval.nofvalues == 1)
+	{
+		papuga_init_ValueVariant_value( &resultvalue, &retval.valuear[0]);
+	}
+	else
+	{
+		// ... handle multiple return values as a serialization:
+		int vi = 0, ve = retval.nofvalues;
+		papuga_Serialization* ser = papuga_Allocator_alloc_Serialization( allocator);
+		bool sc = true;
+		if (ser)
+		{
+			sc &= papuga_Serialization_pushOpen( ser);
+			for (; vi < ve; ++vi)
+			{
+				sc &= papuga_Serialization_pushValue( ser, retval.valuear + vi);
+			}
+			sc &= papuga_Serialization_pushClose( ser);
+		}
+		if (!ser || !sc) return false;
+		papuga_init_ValueVariant_serialization( &resultvalue, ser);
+	}
+	return true;
+}
+
+static void logMethodCall( papuga_RequestLogger* logger, const papuga_ClassDef* classdefs, const papuga_RequestMethodId& methodid, size_t argc, const papuga_ValueVariant* argv, const char* resultvarname, const papuga_ValueVariant& resultvalue)
+{
+	if (papuga_ValueVariant_defined( &resultvalue))
+	{
+		(*logger->logMethodCall)( logger->self, 6,
+					papuga_LogItemClassName, classdefs[ methodid.classid-1].name,
+					papuga_LogItemMethodName, classdefs[ methodid.classid-1].methodnames[ methodid.functionid-1],
+					papuga_LogItemArgc, argc,
+					papuga_LogItemArgv, argv,
+					papuga_LogItemResultVariable, resultvarname,
+					papuga_LogItemResult, &resultvalue);
+	}
+	else
+	{
+		(*logger->logMethodCall)( logger->self, 4,
+				papuga_LogItemClassName, classdefs[ methodid.classid-1].name,
+				papuga_LogItemMethodName, classdefs[ methodid.classid-1].methodnames[ methodid.functionid-1],
+				papuga_LogItemArgc, argc,
+				papuga_LogItemArgv, argv);
+	}
+}
+
+/// \brief Get the host object to call a method on or NULL if not defined or not of the class of the method, without reporting an error
+static void* findMethodCallSelf( papuga_RequestContext* context, const papuga_RequestMethodCall* call)
+{
+	papuga_ErrorCode errcode = papuga_Ok;
+	const papuga_ValueVariant* selfvalue = context->varmap.findVariable( call->selfvarname, errcode);
+	if (selfvalue && selfvalue->valuetype == papuga_TypeHostObject && selfvalue->value.hostObject->classid == call->methodid.classid)
+	{
+		return selfvalue->value.hostObject->data;
+	}
+	return NULL;
+}
+
+/// \brief Get the host object to call a method on
+static void* getMethodCallSelf( papuga_RequestContext* context, const papuga_RequestMethodCall* call, const papuga_ClassDef* classdefs, papuga_RequestError* errstruct)
+{
+	papuga_ErrorCode errcode = papuga_Ok;
+	const papuga_ValueVariant* selfvalue = context->varmap.findVariable( call->selfvarname, errcode);
+	if (!selfvalue)
+	{
+		assignErrMethod( *errstruct, call->methodid, classdefs);
+		errstruct->variable = call->selfvarname;
+		errstruct->errcode = errcode == papuga_Ok ? papuga_MissingSelf : errcode;
+		return NULL;
+	}
+	if (selfvalue->valuetype != papuga_TypeHostObject || selfvalue->value.hostObject->classid != call->methodid.classid)
+	{
+		assignErrMethod( *errstruct, call->methodid, classdefs);
+		errstruct->variable = call->selfvarname;
+		errstruct->errcode = papuga_TypeError;
+		return NULL;
+	}
+	return selfvalue->value.hostObject->data;
+}
+
+/// \brief Execute one call fetched from the request iterator
+static bool executeCall( papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, const papuga_RequestMethodCall* call, const papuga_ClassDef* classdefs, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_ErrorBuffer& errorbuf_call, papuga_RequestError* errstruct)
+{
+	if (call->methodid.classid == 0)
+	{
+		// [A] Variable assignment:
+		// [A.0] Create the result variable
+		if (!call->resultvarname || call->args.argc != 1)
+		{
+			errstruct->errcode = papuga_ValueUndefined;
+			return false;
+		}
+		RequestVariable* var = NULL;
+		if (!papuga_Request_is_result_variable( request, call->resultvarname))
+		{
+			// ... HACK const_cast: We know that the source is only modified by the following deepcopy_value in the case
+			//	of a host object moved. But we know that a variable assignment is constructed from content and cannot
+			//	contain host object references.
+			papuga_ValueVariant* source = const_cast<papuga_ValueVariant*>( &call->args.argv[0]);
+
+			var = context->varmap.createVariable( call->resultvarname);
+			if (!papuga_Allocator_deepcopy_value( &var->allocator, &var->value, source, false/*movehostobj*/, &errstruct->errcode))
+			{
+				errstruct->variable = call->resultvarname;
+				return false;
+			}
+		}
+		else
+		{
+			// Add the result to be substituted in the result content template:
+			(void)papuga_RequestIterator_push_call_result( itr, &call->args.argv[0]);
+		}
+		// [A.1] Log the assignment if logging enabled
+		if (logger->logMethodCall)
+		{
+			(*logger->logMethodCall)( logger->self, 2,
+				papuga_LogItemResultVariable, call->resultvarname,
+				papuga_LogItemResult, &call->args.argv[0]);
+		}
+	}
+	else if (call->methodid.functionid == 0)
+	{
+		// [B] Constructor call:
+		// [B.0] Create the result variable
+		RequestVariable* var;
+		if (call->resultvarname)
+		{
+			if (papuga_Request_is_result_variable( request, call->resultvarname))
+			{
+				errstruct->variable = call->resultvarname;
+				errstruct->errcode = papuga_MixedConstruction;
+				return false;
+			}
+			var = context->varmap.createVariable( call->resultvarname);
+		}
+		else
+		{
+			var = NULL;
+		}
+		// [B.1] Call the constructor
+		const papuga_ClassConstructor func = classdefs[ call->methodid.classid-1].constructor;
+		void* self;
+
+		if (!(self=(*func)( &errorbuf_call, call->args.argc, call->args.argv)))
+		{
+			errstruct->errcode = papuga_HostObjectError;
+			assignErrMethod( *errstruct, call->methodid, classdefs);
+			return false;
+		}
+		// [B.2] Assign the result value to a variant type variable and log the call
+		if (var)
+		{
+			papuga_Deleter destroy_hobj = classdefs[ call->methodid.classid-1].destructor;
+			papuga_HostObject* hobj = papuga_Allocator_alloc_HostObject( &var->allocator, call->methodid.classid, self, destroy_hobj);
+			if (!hobj)
+			{
+				destroy_hobj( self);
+				errstruct->errcode = papuga_NoMemError;
+				return false;
+			}
+			papuga_init_ValueVariant_hostobj( &var->value, hobj);
+		}
+		// [B.3] Log the call if logging enabled
+		if (logger->logMethodCall)
+		{
+			if (var)
+			{
+				(*logger->logMethodCall)( logger->self, 5,
+					papuga_LogItemClassName, classdefs[ call->methodid.classid-1].name,
+					papuga_LogItemArgc, call->args.argc,
+					papuga_LogItemArgv, &call->args.argv[0],
+					papuga_LogItemResultVariable, call->resultvarname,
+					papuga_LogItemResult, &var->value);
+			}
+			else
+			{
+				(*logger->logMethodCall)( logger->self, 3,
+					papuga_LogItemClassName, classdefs[ call->methodid.classid-1].name,
+					papuga_LogItemArgc, call->args.argc,
+					papuga_LogItemArgv, &call->args.argv[0]);
+			}
+		}
+	}
+	else
+	{
+		// [C] Method call:
+		RequestVariable* var;
+		if (call->resultvarname && !papuga_Request_is_result_variable( request, call->resultvarname))
+		{
+			var = context->varmap.createVariable( call->resultvarname);
+		}
+		else
+		{
+			var = NULL;
+		}
+		// [C.1] Get the method and the object of the method to call
+		const papuga_ClassMethod func = classdefs[ call->methodid.classid-1].methodtable[ call->methodid.functionid-1];
+		void* self = getMethodCallSelf( context, call, classdefs, errstruct);
+		if (!self) return false;
+
+		// [C.2] Call the method and report an error on failure
+		papuga_CallResult retval;
+		papuga_init_CallResult( &retval, var ? &var->allocator : allocator, false/*ownership*/, errstruct->errormsg, sizeof(errstruct->errormsg));
+		if (!(*func)( self, &retval, call->args.argc, call->args.argv))
+		{
+			errstruct->errcode = papuga_HostObjectError;
+			assignErrMethod( *errstruct, call->methodid, classdefs);
+			errstruct->variable = call->selfvarname;
+			return false;
+		}
+		// [C.3] Build the result value
+		papuga_ValueVariant resultvalue;
+		if (!buildCallResultValue( resultvalue, retval, var ? &var->allocator : allocator))
+		{
+			errstruct->errcode = papuga_NoMemError;
+			return false;
+		}
+		// [C.4] Assign the result
+		if (var)
+		{
+			// [C.4.1] Assign the result to the result variable
+			papuga_init_ValueVariant_value( &var->value, &resultvalue);
+		}
+		else if (papuga_ValueVariant_defined( &resultvalue))
+		{
+			// [C.4.2] Add the result to be substituted in the result content template
+			(void)papuga_RequestIterator_push_call_result( itr, &resultvalue);
+		}
+		// [C.5] Log the call if logging enabled
+		if (logger->logMethodCall)
+		{
+			logMethodCall( logger, classdefs, call->methodid, call->args.argc, call->args.argv, call->resultvarname, resultvalue);
+		}
+	}
+	return true;
+}
+
+/// \brief Report the errors of the iterator and build the results after all calls of a request have been executed
+static bool finishRequest( papuga_RequestContext* context, papuga_RequestIterator* itr, papuga_Allocator* allocator, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct)
+{
+	// Report error if we could not resolve all parts of a method call:
+	const papuga_RequestError* itr_errstruct = papuga_RequestIterator_get_last_error( itr);
+	if (errstruct->errcode != papuga_Ok)
+	{
+		return false;
+	}
+	else if (itr_errstruct)
+	{
+		std::memcpy( errstruct, itr_errstruct, sizeof(papuga_RequestError));
+		return false;
+	}
+	*results = papuga_RequestIterator_get_result_array( itr, context, allocator, nofResults);
+	if (!*results)
+	{
+		itr_errstruct = papuga_RequestIterator_get_last_error( itr);
+		if (itr_errstruct)
+		{
+			std::memcpy( errstruct, itr_errstruct, sizeof(papuga_RequestError));
+			return false;
+		}
+	}
+	return true;
+}
+
+namespace {
+
+/// \brief Consecutive calls of the same method on the same object, collected for one invocation of the batched method
+class MethodCallBatch
+{
+public:
+	enum {MaxBatchSize=256};
+
+	MethodCallBatch()
+		:m_func(0),m_self(0),m_selfvarname(0),m_argv(),m_argofs(),m_argc(),m_resultvarnames(),m_callidx(),m_argvptr(),m_retvals()
+	{
+		m_methodid.classid = 0;
+		m_methodid.functionid = 0;
+	}
+
+	bool empty() const
+	{
+		return m_argc.empty();
+	}
+
+	/// \brief Get the batched method to use for a call or NULL if the method has no batched version
+	static papuga_ClassMethodBatch batchMethod( const papuga_RequestMethodCall* call, const papuga_ClassDef* classdefs)
+	{
+		if (call->methodid.classid == 0 || call->methodid.functionid == 0 || !call->selfvarname) return NULL;
+		const papuga_ClassMethodBatch* mt = classdefs[ call->methodid.classid-1].batchmethodtable;
+		return mt ? mt[ call->methodid.functionid-1] : NULL;
+	}
+
+	/// \brief Evaluate if a call can be appended to the batch
+	bool accepts( const papuga_RequestMethodCall* call, void* self) const
+	{
+		return m_self == self
+			&& m_argc.size() < (std::size_t)MaxBatchSize
+			&& m_methodid.classid == call->methodid.classid
+			&& m_methodid.functionid == call->methodid.functionid
+			&& !writesSelf( call);
+	}
+
+	/// \brief Evaluate if a call assigns its result to the variable of its object, so that it cannot be batched
+	static bool writesSelf( const papuga_RequestMethodCall* call)
+	{
+		return call->resultvarname && 0==std::strcmp( call->resultvarname, call->selfvarname);
+	}
+
+	void push( const papuga_RequestMethodCall* call, papuga_ClassMethodBatch func, void* self)
+	{
+		if (empty())
+		{
+			m_func = func;
+			m_self = self;
+			m_selfvarname = call->selfvarname;
+			m_methodid = call->methodid;
+		}
+		m_argofs.push_back( m_argv.size());
+		m_argv.insert( m_argv.end(), call->args.argv, call->args.argv + call->args.argc);
+		m_argc.push_back( call->args.argc);
+		m_resultvarnames.push_back( call->resultvarname);
+		m_callidx.push_back( call->callidx);
+	}
+
+	/// \brief Execute the calls of the batch with one invocation and apply their results in order
+	bool flush( papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, const papuga_ClassDef* classdefs, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestError* errstruct)
+	{
+		if (empty()) return true;
+		std::size_t ci = 0, ce = m_argc.size();
+		m_argvptr.resize( ce);
+		m_retvals.resize( ce);
+		for (; ci != ce; ++ci)
+		{
+			m_argvptr[ ci] = m_argc[ ci] ? &m_argv[ m_argofs[ ci]] : NULL;
+			papuga_init_CallResult( &m_retvals[ ci], allocator, false/*ownership*/, errstruct->errormsg, sizeof(errstruct->errormsg));
+		}
+		std::size_t nofdone = (*m_func)( m_self, &m_retvals[0], ce, &m_argc[0], &m_argvptr[0]);
+		bool rt = true;
+		for (ci = 0; rt && ci < nofdone && ci < ce; ++ci)
+		{
+			rt = apply( ci, context, request, itr, classdefs, allocator, logger, errstruct);
+		}
+		if (rt && nofdone < ce)
+		{
+			// [C.2] Report an error on failure of the call
+			errstruct->errcode = papuga_HostObjectError;
+			assignErrMethod( *errstruct, m_methodid, classdefs);
+			errstruct->variable = m_selfvarname;
+			rt = false;
+		}
+		clear();
+		return rt;
+	}
+
+private:
+	void clear()
+	{
+		m_func = 0;
+		m_self = 0;
+		m_selfvarname = 0;
+		m_argv.clear();
+		m_argofs.clear();
+		m_argc.clear();
+		m_resultvarnames.clear();
+		m_callidx.clear();
+	}
+
+	bool apply( std::size_t ci, papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, const papuga_ClassDef* classdefs, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestError* errstruct)
+	{
+		const char* resultvarname = m_resultvarnames[ ci];
+		// [C.3] Build the result value
+		papuga_ValueVariant resultvalue;
+		if (!buildCallResultValue( resultvalue, m_retvals[ ci], allocator))
+		{
+			errstruct->errcode = papuga_NoMemError;
+			return false;
+		}
+		// [C.4] Assign the result
+		if (resultvarname && !papuga_Request_is_result_variable( request, resultvarname))
+		{
+			// [C.4.1] Assign the result to the result variable
+			RequestVariable* var = context->varmap.createVariable( resultvarname);
+			if (!papuga_Allocator_deepcopy_value( &var->allocator, &var->value, &resultvalue, true/*movehostobj*/, &errstruct->errcode))
+			{
+				errstruct->variable = resultvarname;
+				return false;
+			}
+		}
+		else if (papuga_ValueVariant_defined( &resultvalue))
+		{
+			// [C.4.2] Add the result to be substituted in the result content template
+			(void)papuga_RequestIterator_push_call_result_at( itr, m_callidx[ ci], resultvarname, &resultvalue);
+		}
+		// [C.5] Log the call if logging enabled
+		if (logger->logMethodCall)
+		{
+			logMethodCall( logger, classdefs, m_methodid, m_argc[ ci], m_argvptr[ ci], resultvarname, resultvalue);
+		}
+		return true;
+	}
+
+private:
+	papuga_ClassMethodBatch m_func;
+	void* m_self;
+	const char* m_selfvarname;
+	papuga_RequestMethodId m_methodid;
+	std::vector<papuga_ValueVariant> m_argv;
+	std::vector<std::size_t> m_argofs;
+	std::vector<std::size_t> m_argc;
+	std::vector<const char*> m_resultvarnames;
+	std::vector<int> m_callidx;
+	std::vector<const papuga_ValueVariant*> m_argvptr;
+	std::vector<papuga_CallResult> m_retvals;
+};
+
+}//anonymous namespace
+
+extern "C" bool papuga_RequestContext_execute_request( papuga_RequestContext* context, const papuga_Request* request, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct)
+{
+	papuga_RequestIterator* itr = 0;
+	*results = 0;
+	*nofResults = 0;
+	std::memset( errstruct, 0, sizeof(*errstruct));
+
+	try
+	{
+		papuga_ErrorBuffer errorbuf_call;
+
+		const papuga_ClassDef* classdefs = papuga_Request_classdefs( request);
+		itr = papuga_create_RequestIterator( allocator, request, &errstruct->errcode);
+		if (!itr) return false;
+
+		papuga_init_ErrorBuffer( &errorbuf_call, errstruct->errormsg, sizeof(errstruct->errormsg));
+
+		MethodCallBatch batch;
+		bool success = true;
+		for (;;)
+		{
+			// Calls resolving arguments from variables have to see the assignments of the calls batched:
+			if (!batch.empty() && papuga_RequestIterator_next_call_reads_context( itr))
+			{
+				if (!(success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct))) break;
+			}
+			const papuga_RequestMethodCall* call = papuga_RequestIterator_next_call( itr, context);
+			if (!call) break;
+
+			// Consecutive calls of a method with a batched version on the same object are executed with one invocation:
+			papuga_ClassMethodBatch batchfunc = MethodCallBatch::batchMethod( call, classdefs);
+			if (batchfunc)
+			{
+				if (!batch.empty())
 				{
-					// Add the result to be substituted in the result content template:
-					(void)papuga_RequestIterator_push_call_result( itr, &call->args.argv[0]);
+					void* self = findMethodCallSelf( context, call);
+					if (self && batch.accepts( call, self))
+					{
+						batch.push( call, batchfunc, self);
+						continue;
+					}
+					if (!(success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct))) break;
 				}
-				// [A.1] Log the assignment if logging enabled
-				if (logger->logMethodCall)
+				if (!MethodCallBatch::writesSelf( call))
 				{
-					(*logger->logMethodCall)( logger->self, 2,
-						papuga_LogItemResultVariable, call->resultvarname,
-						papuga_LogItemResult, &call->args.argv[0]);
+					void* self = getMethodCallSelf( context, call, classdefs, errstruct);
+					if (!self)
+					{
+						success = false;
+						break;
+					}
+					batch.push( call, batchfunc, self);
+					continue;
 				}
 			}
-			else if (call->methodid.functionid == 0)
+			// Execute all other method calls and variable assignments:
+			if (!(success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct))) break;
+			if (!(success = executeCall( context, request, itr, call, classdefs, allocator, logger, errorbuf_call, errstruct))) break;
+		}
+		if (success)
+		{
+			success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct)
+				&& finishRequest( context, itr, allocator, results, nofResults, errstruct);
+		}
+		papuga_destroy_RequestIterator( itr);
+		return success;
+	}
+	catch (const std::bad_alloc& err)
+	{
+		if (itr) papuga_destroy_RequestIterator( itr);
+		errstruct->errcode = papuga_NoMemError;
+		return false;
+	}
+	catch (const std::runtime_error& err)
+	{
+		if (itr) papuga_destroy_RequestIterator( itr);
+		errstruct->errcode = papuga_UncaughtException;
+		assignErrMessage( *errstruct, err.what());
+		return false;
+	}
+}
+
+extern "C" bool papuga_RequestContext_execute_ready_calls( papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestError* errstruct)
+{
+	std::memset( errstruct, 0, sizeof(*errstruct));
+	try
+	{
+		papuga_ErrorBuffer errorbuf_call;
+		const papuga_ClassDef* classdefs = papuga_Request_classdefs( request);
+		papuga_init_ErrorBuffer( &errorbuf_call, errstruct->errormsg, sizeof(errstruct->errormsg));
+
+		const papuga_RequestMethodCall* call;
+		while (!!(call = papuga_RequestIterator_next_call( itr, context)))
+		{
+			if (!executeCall( context, request, itr, call, classdefs, allocator, logger, errorbuf_call, errstruct)) return false;
+		}
+		// Report error if we could not resolve all parts of a method call:
+		const papuga_RequestError* itr_errstruct = papuga_RequestIterator_get_last_error( itr);
+		if (itr_errstruct)
+		{
+			std::memcpy( errstruct, itr_errstruct, sizeof(papuga_RequestError));
+			return false;
+		}
+		return true;
+	}
+	catch (const std::bad_alloc& err)
+	{
+		errstruct->errcode = papuga_NoMemError;
+		return false;
+	}
+	catch (const std::runtime_error& err)
+	{
+		errstruct->errcode = papuga_UncaughtException;
+		assignErrMessage( *errstruct, err.what());
+		return false;
+	}
+}
+
+extern "C" bool papuga_RequestContext_finish_request( papuga_RequestContext* context, papuga_RequestIterator* itr, papuga_Allocator* allocator, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct)
+{
+	*results = 0;
+	*nofResults = 0;
+	std::memset( errstruct, 0, sizeof(*errstruct));
+	try
+	{
+		return finishRequest( context, itr, allocator, results, nofResults, errstruct);
+	}
+	catch (const std::bad_alloc& err)
+	{
+		errstruct->errcode = papuga_NoMemError;
+		return false;
+	}
+	catch (const std::runtime_error& err)
+	{
+		errstruct->errcode = papuga_UncaughtException;
+		assignErrMessage( *errstruct, err.what());
+		return false;
+	}
+}
+
+namespace {
+
+/// \brief Collect the host objects referenced by a value, including the ones in serializations
+/// \return false if the structure is too deep to inspect
+static bool collectHostObjects( std::vector<void*>& objects, const papuga_ValueVariant& value, int depth)
+{
+	if (value.valuetype == papuga_TypeHostObject)
+	{
+		objects.push_back( value.value.hostObject->data);
+	}
+	else if (value.valuetype == papuga_TypeSerialization)
+	{
+		if (depth >= PAPUGA_MAX_RECURSION_DEPTH) return false;
+		papuga_SerializationIter itr;
+		papuga_init_SerializationIter( &itr, value.value.serialization);
+		for (; !papuga_SerializationIter_eof( &itr); papuga_SerializationIter_skip( &itr))
+		{
+			if (!collectHostObjects( objects, *papuga_SerializationIter_value( &itr), depth+1)) return false;
+		}
+	}
+	return true;
+}
+
+/// \brief Collect the host objects accessed by a method call, the object called first followed by the ones passed as arguments
+/// \return false if the arguments cannot be inspected
+static bool collectMethodCallObjects( std::vector<void*>& objects, const papuga_RequestMethodCall* call, void* self)
+{
+	objects.clear();
+	objects.push_back( self);
+	for (std::size_t ai=0; ai < call->args.argc; ++ai)
+	{
+		if (!collectHostObjects( objects, call->args.argv[ ai], 0)) return false;
+	}
+	return true;
+}
+
+/// \brief Method call fetched from the request iterator, deferred for executing it in parallel with other independent method calls
+struct DeferredMethodCall
+{
+	papuga_RequestMethodId methodid;
+	const char* selfvarname;
+	const char* resultvarname;
+	int callidx;
+	papuga_ClassMethod func;
+	void* self;
+	std::vector<void*> objects;				//< host objects accessed by the call, self first followed by the ones passed as arguments
+	std::vector<papuga_ValueVariant> argv;
+	papuga_Allocator allocator;
+	papuga_CallResult retval;
+	bool success;
+	papuga_ErrorCode errcode;				//< error code reported on failure of the call
+	char errormsg[ 2048];
+	char allocator_membuf[ 1024];
+
+	DeferredMethodCall()
+		:selfvarname(0),resultvarname(0),callidx(-1),func(0),self(0),objects(),argv(),success(false),errcode(papuga_Ok)
+	{
+		methodid.classid = 0;
+		methodid.functionid = 0;
+		errormsg[0] = 0;
+		papuga_init_Allocator( &allocator, allocator_membuf, sizeof(allocator_membuf));
+	}
+	~DeferredMethodCall()
+	{
+		papuga_destroy_Allocator( &allocator);
+	}
+
+	void init( const papuga_RequestMethodCall* call, papuga_ClassMethod func_, const std::vector<void*>& objects_)
+	{
+		methodid = call->methodid;
+		selfvarname = call->selfvarname;
+		resultvarname = call->resultvarname;
+		callidx = call->callidx;
+		func = func_;
+		self = objects_[0];
+		objects = objects_;
+		argv.assign( call->args.argv, call->args.argv + call->args.argc);
+		success = false;
+		errcode = papuga_Ok;
+		errormsg[0] = 0;
+		papuga_init_CallResult( &retval, &allocator, false/*ownership*/, errormsg, sizeof(errormsg));
+	}
+	void reset()
+	{
+		papuga_destroy_Allocator( &allocator);
+		papuga_init_Allocator( &allocator, allocator_membuf, sizeof(allocator_membuf));
+	}
+	/// \brief Execute the call, catching all exceptions as they must not escape a worker thread
+	void execute()
+	{
+		try
+		{
+			success = (*func)( self, &retval, argv.size(), argv.empty() ? NULL : &argv[0]);
+			if (!success) errcode = papuga_HostObjectError;
+		}
+		catch (const std::bad_alloc& err)
+		{
+			success = false;
+			errcode = papuga_NoMemError;
+			errormsg[0] = 0;
+		}
+		catch (const std::exception& err)
+		{
+			success = false;
+			errcode = papuga_UncaughtException;
+			std::snprintf( errormsg, sizeof(errormsg), "%s", err.what());
+		}
+		catch (...)
+		{
+			success = false;
+			errcode = papuga_UncaughtException;
+			errormsg[0] = 0;
+		}
+	}
+
+private:
+	DeferredMethodCall( const DeferredMethodCall&);		//... non copyable
+	void operator=( const DeferredMethodCall&);		//... non copyable
+};
+
+/// \brief Pool of threads executing a batch of independent method calls
+class MethodCallExecutorPool
+{
+public:
+	explicit MethodCallExecutorPool( int nofThreads)
+		:m_batch(0),m_batchsize(0),m_next(0),m_nofdone(0),m_nofactive(0),m_generation(0),m_stop(false)
+	{
+		if (nofThreads <= 0)
+		{
+			nofThreads = std::thread::hardware_concurrency();
+		}
+		try
+		{
+			// ... reserve the vector before, a reallocation throwing while moving a running thread in would terminate the process
+			if (nofThreads > 1) m_threads.reserve( nofThreads-1);
+			for (int ti=1; ti < nofThreads; ++ti)
 			{
-				// [B] Constructor call:
-				// [B.0] Create the result variable
-				RequestVariable* var;
-				if (call->resultvarname)
-				{
-					if (papuga_Request_is_result_variable( request, call->resultvarname))
-					{
-						errstruct->variable = call->resultvarname;
-						errstruct->errcode = papuga_MixedConstruction;
-						papuga_destroy_RequestIterator( itr);
-						return false;
-					}
-					var = context->varmap.createVariable( call->resultvarname);
-				}
-				else
-				{
-					var = NULL;
-				}
-				// [B.1] Call the constructor
-				const papuga_ClassConstructor func = classdefs[ call->methodid.classid-1].constructor;
-				void* self;
+				m_threads.push_back( std::thread( &MethodCallExecutorPool::run, this));
+			}
+		}
+		catch (...)
+		{
+			//... continue with the threads started, the calling thread is also working
+		}
+	}
+	~MethodCallExecutorPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock( m_mutex);
+			m_stop = true;
+		}
+		m_startcond.notify_all();
+		std::vector<std::thread>::iterator ti = m_threads.begin(), te = m_threads.end();
+		for (; ti != te; ++ti) ti->join();
+	}
 
-				if (!(self=(*func)( &errorbuf_call, call->args.argc, call->args.argv)))
-				{
-					errstruct->errcode = papuga_HostObjectError;
-					assignErrMethod( *errstruct, call->methodid, classdefs);
-					papuga_destroy_RequestIterator( itr);
-					return false;
-				}
-				// [B.2] Assign the result value to a variant type variable and log the call
-				if (var)
-				{
-					papuga_Deleter destroy_hobj = classdefs[ call->methodid.classid-1].destructor;
-					papuga_HostObject* hobj = papuga_Allocator_alloc_HostObject( &var->allocator, call->methodid.classid, self, destroy_hobj);
-					if (!hobj)
-					{
-						destroy_hobj( self);
-						papuga_destroy_RequestIterator( itr);
-						errstruct->errcode = papuga_NoMemError;
-						return false;
-					}
-					papuga_init_ValueVariant_hostobj( &var->value, hobj);
-				}
-				// [B.3] Log the call if logging enabled
-				if (logger->logMethodCall)
+	/// \brief Number of threads executing calls, including the calling thread
+	int nofThreads() const
+	{
+		return m_threads.size() + 1;
+	}
+
+	/// \brief Execute all calls of a batch and return when all of them have been executed
+	/// \note Batches of requests sharing the pool are executed one after the other
+	void execute( DeferredMethodCall** batch, int batchsize)
+	{
+		std::unique_lock<std::mutex> executelock( m_executemutex);
+		{
+			std::unique_lock<std::mutex> lock( m_mutex);
+			m_batch = batch;
+			m_batchsize = batchsize;
+			m_next = 0;
+			m_nofdone = 0;
+			++m_generation;
+		}
+		m_startcond.notify_all();
+		work( batch, batchsize);
+		std::unique_lock<std::mutex> lock( m_mutex);
+		while (m_nofdone < m_batchsize || m_nofactive > 0)
+		{
+			m_donecond.wait( lock);
+		}
+		m_batch = 0;
+		m_batchsize = 0;
+	}
+
+private:
+	void run()
+	{
+		int generation = 0;
+		for (;;)
+		{
+			DeferredMethodCall** batch;
+			int batchsize;
+			{
+				std::unique_lock<std::mutex> lock( m_mutex);
+				while (!m_stop && generation == m_generation)
 				{
-					if (var)
-					{
-						(*logger->logMethodCall)( logger->self, 5,
-							papuga_LogItemClassName, classdefs[ call->methodid.classid-1].name,
-							papuga_LogItemArgc, call->args.argc,
-							papuga_LogItemArgv, &call->args.argv[0],
-							papuga_LogItemResultVariable, call->resultvarname,
-							papuga_LogItemResult, &var->value);
-					}
-					else
-					{
-						(*logger->logMethodCall)( logger->self, 3,
-							papuga_LogItemClassName, classdefs[ call->methodid.classid-1].name,
-							papuga_LogItemArgc, call->args.argc,
-							papuga_LogItemArgv, &call->args.argv[0]);
-					}
+					m_startcond.wait( lock);
 				}
+				if (m_stop) return;
+				generation = m_generation;
+				batch = m_batch;
+				batchsize = m_batchsize;
+				++m_nofactive;
 			}
-			else
+			work( batch, batchsize);
 			{
-				// [C] Method call:
-				RequestVariable* var;
-				if (call->resultvarname && !papuga_Request_is_result_variable( request, call->resultvarname))
-				{
-					var = context->varmap.createVariable( call->resultvarname);
-				}
-				else
-				{
-					var = NULL;
-				}
-				// [C.1] Get the method and the object of the method to call
-				const papuga_ClassMethod func = classdefs[ call->methodid.classid-1].methodtable[ call->methodid.functionid-1];
-				const papuga_ValueVariant* selfvalue = context->varmap.findVariable( call->selfvarname);
-				if (!selfvalue)
-				{
-					assignErrMethod( *errstruct, call->methodid, classdefs);
-					errstruct->variable = call->selfvarname;
-					errstruct->errcode = papuga_MissingSelf;
-					break;
-				}
-				if (selfvalue->valuetype != papuga_TypeHostObject || selfvalue->value.hostObject->classid != call->methodid.classid)
-				{
-					assignErrMethod( *errstruct, call->methodid, classdefs);
-					errstruct->variable = call->selfvarname;
-					errstruct->errcode = papuga_TypeError;
-					break;
-				}
-				// [C.2] Call the method and report an error on failure
-				void* self = selfvalue->value.hostObject->data;
-				papuga_CallResult retval;
-				papuga_init_CallResult( &retval, var ? &var->allocator : allocator, false/*ownership*/, errstruct->errormsg, sizeof(errstruct->errormsg));
-				if (!(*func)( self, &retval, call->args.argc, call->args.argv))
-				{
-					errstruct->errcode = papuga_HostObjectError;
-					assignErrMethod( *errstruct, call->methodid, classdefs);
-					errstruct->variable = call->selfvarname;
-					break;
-				}
-				// [C.3] Build the result value
-				papuga_ValueVariant resultvalue;
-				if (retval.nofvalues == 0)
-				{
-					papuga_init_ValueVariant( &resultvalue);
-				}
-				else if (retval.nofvalues == 1)
-				{
-					papuga_init_ValueVariant_value( &resultvalue, &retval.valuear[0]);
-				}
-				else
-				{
-					// ... handle multiple return values as a serialization:
-					int vi = 0, ve = retval.nofvalues;
-					papuga_Serialization* ser = papuga_Allocator_alloc_Serialization( var ? &var->allocator : allocator);
-					bool sc = true;
-					if (ser)
-					{
-						sc &= papuga_Serialization_pushOpen( ser);
-						for (; vi < ve; ++vi)
-						{
-							sc &= papuga_Serialization_pushValue( ser, retval.valuear + vi);
-						}
-						sc &= papuga_Serialization_pushClose( ser);
-					}
-					if (!ser || !sc)
-					{
-						errstruct->errcode = papuga_NoMemError;
-						break;
-					}
-					papuga_init_ValueVariant_serialization( &resultvalue, ser);
-				}
-				// [C.4] Assign the result
-				if (var)
-				{
-					// [C.4.1] Assign the result to the result variable
-					papuga_init_ValueVariant_value( &var->value, &resultvalue);
-				}
-				else if (papuga_ValueVariant_defined( &resultvalue))
-				{
-					// [C.4.2] Add the result to be substituted in the result content template
-					(void)papuga_RequestIterator_push_call_result( itr, &resultvalue);
-				}
-				// [C.5] Log the call if logging enabled
-				if (logger->logMethodCall)
-				{
-					if (papuga_ValueVariant_defined( &resultvalue))
-					{
-						(*logger->logMethodCall)( logger->self, 6,
-									papuga_LogItemClassName, classdefs[ call->methodid.classid-1].name,
-									papuga_LogItemMethodName, classdefs[ call->methodid.classid-1].methodnames[ call->methodid.functionid-1],
-									papuga_LogItemArgc, call->args.argc,
-									papuga_LogItemArgv, &call->args.argv[0],
-									papuga_LogItemResultVariable, call->resultvarname,
-									papuga_LogItemResult, &resultvalue);
-					}
-					else
-					{
-						(*logger->logMethodCall)( logger->self, 4,
-								papuga_LogItemClassName, classdefs[ call->methodid.classid-1].name,
-								papuga_LogItemMethodName, classdefs[ call->methodid.classid-1].methodnames[ call->methodid.functionid-1],
-								papuga_LogItemArgc, call->args.argc,
-								papuga_LogItemArgv, &call->args.argv[0]);
-					}
-				}
+				std::unique_lock<std::mutex> lock( m_mutex);
+				--m_nofactive;
 			}
+			m_donecond.notify_all();
 		}
-		// Report error if we could not resolve all parts of a method call:
-		const papuga_RequestError* itr_errstruct = papuga_RequestIterator_get_last_error( itr);
-		if (errstruct->errcode != papuga_Ok)
+	}
+
+	void work( DeferredMethodCall** batch, int batchsize)
+	{
+		if (!batchsize) return; //... woken up after the batch has been completed
+		for (int idx = m_next++; idx < batchsize; idx = m_next++)
+		{
+			batch[ idx]->execute();
+			std::unique_lock<std::mutex> lock( m_mutex);
+			if (++m_nofdone == batchsize) m_donecond.notify_all();
+		}
+	}
+
+private:
+	std::vector<std::thread> m_threads;
+	std::mutex m_executemutex;
+	std::mutex m_mutex;
+	std::condition_variable m_startcond;
+	std::condition_variable m_donecond;
+	DeferredMethodCall** m_batch;
+	int m_batchsize;
+	std::atomic<int> m_next;
+	int m_nofdone;
+	int m_nofactive;
+	int m_generation;
+	bool m_stop;
+};
+
+/// \brief Batch of method calls deferred for parallel execution and applied in the order of the request
+class DeferredMethodCallBatch
+{
+public:
+	enum {MaxBatchSize=128};
+
+	DeferredMethodCallBatch( MethodCallExecutorPool* pool_)
+		:m_pool(pool_),m_size(0)
+	{
+		for (int bi=0; bi < MaxBatchSize; ++bi) m_calls[ bi] = 0;
+	}
+	~DeferredMethodCallBatch()
+	{
+		for (int bi=0; bi < MaxBatchSize; ++bi) delete m_calls[ bi];
+	}
+
+	bool empty() const	{return m_size == 0;}
+	bool full() const	{return m_size == MaxBatchSize;}
+
+	/// \brief Evaluate if a call has to wait for the calls deferred, because it uses an object or a variable the deferred calls use or assign
+	/// \param[in] objects host objects accessed by the call (see collectMethodCallObjects)
+	bool conflicts( const papuga_RequestMethodCall* call, const std::vector<void*>& objects) const
+	{
+		if (call->resultvarname && call->selfvarname && 0==std::strcmp( call->resultvarname, call->selfvarname)) return true;
+		for (int bi=0; bi < m_size; ++bi)
+		{
+			const DeferredMethodCall* dc = m_calls[ bi];
+			// ... an object called or passed as argument by one call must not be accessed by another one at the same time
+			if (std::find_first_of( dc->objects.begin(), dc->objects.end(), objects.begin(), objects.end()) != dc->objects.end()) return true;
+			if (dc->resultvarname)
+			{
+				if (0==std::strcmp( dc->resultvarname, call->selfvarname)) return true;
+				if (call->resultvarname && 0==std::strcmp( dc->resultvarname, call->resultvarname)) return true;
+			}
+			if (call->resultvarname && 0==std::strcmp( dc->selfvarname, call->resultvarname)) return true;
+		}
+		return false;
+	}
+
+	void push( const papuga_RequestMethodCall* call, papuga_ClassMethod func, const std::vector<void*>& objects)
+	{
+		if (!m_calls[ m_size]) m_calls[ m_size] = new DeferredMethodCall();
+		m_calls[ m_size]->init( call, func, objects);
+		++m_size;
+	}
+
+	/// \brief Execute the calls deferred and apply their results in the order of the request
+	bool flush( papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, const papuga_ClassDef* classdefs, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestError* errstruct)
+	{
+		if (m_size == 0) return true;
+		m_pool->execute( m_calls, m_size);
+		bool rt = true;
+		int bi = 0;
+		for (; rt && bi < m_size; ++bi)
+		{
+			rt = apply( *m_calls[ bi], context, request, itr, classdefs, allocator, logger, errstruct);
+		}
+		for (bi = 0; bi < m_size; ++bi)
 		{
-			papuga_destroy_RequestIterator( itr);
+			m_calls[ bi]->reset();
+		}
+		m_size = 0;
+		return rt;
+	}
+
+private:
+	static bool apply( DeferredMethodCall& dc, papuga_RequestContext* context, const papuga_Request* request, papuga_RequestIterator* itr, const papuga_ClassDef* classdefs, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestError* errstruct)
+	{
+		// [C.2] Report an error on failure of the call
+		if (!dc.success)
+		{
+			errstruct->errcode = dc.errcode;
+			if (dc.errcode == papuga_HostObjectError)
+			{
+				assignErrMethod( *errstruct, dc.methodid, classdefs);
+				errstruct->variable = dc.selfvarname;
+			}
+			//... an exception thrown is reported without method like in a sequential execution
+			assignErrMessage( *errstruct, dc.errormsg);
 			return false;
 		}
-		else if (itr_errstruct)
+		// [C.3] Build the result value
+		papuga_ValueVariant resultvalue;
+		if (!buildCallResultValue( resultvalue, dc.retval, &dc.allocator))
 		{
-			std::memcpy( errstruct, itr_errstruct, sizeof(papuga_RequestError));
-			papuga_destroy_RequestIterator( itr);
+			errstruct->errcode = papuga_NoMemError;
 			return false;
 		}
-		*results = papuga_RequestIterator_get_result_array( itr, context, allocator, nofResults);
-		if (!*results)
+		// [C.4] Assign the result, moving it from the allocator of the deferred call
+		if (dc.resultvarname && !papuga_Request_is_result_variable( request, dc.resultvarname))
 		{
-			itr_errstruct = papuga_RequestIterator_get_last_error( itr);
-			if (itr_errstruct)
+			// [C.4.1] Assign the result to the result variable
+			RequestVariable* var = context->varmap.createVariable( dc.resultvarname);
+			if (!papuga_Allocator_deepcopy_value( &var->allocator, &var->value, &resultvalue, true/*movehostobj*/, &errstruct->errcode))
 			{
-				std::memcpy( errstruct, itr_errstruct, sizeof(papuga_RequestError));
-				papuga_destroy_RequestIterator( itr);
+				errstruct->variable = dc.resultvarname;
 				return false;
 			}
 		}
-		papuga_destroy_RequestIterator( itr);
+		else if (papuga_ValueVariant_defined( &resultvalue))
+		{
+			// [C.4.2] Add the result to be substituted in the result content template
+			papuga_ValueVariant resultcopy;
+			if (!papuga_Allocator_deepcopy_value( allocator, &resultcopy, &resultvalue, true/*movehostobj*/, &errstruct->errcode))
+			{
+				return false;
+			}
+			(void)papuga_RequestIterator_push_call_result_at( itr, dc.callidx, dc.resultvarname, &resultcopy);
+		}
+		// [C.5] Log the call if logging enabled
+		if (logger->logMethodCall)
+		{
+			logMethodCall( logger, classdefs, dc.methodid, dc.argv.size(), dc.argv.empty() ? NULL : &dc.argv[0], dc.resultvarname, resultvalue);
+		}
 		return true;
 	}
+
+private:
+	MethodCallExecutorPool* m_pool;
+	DeferredMethodCall* m_calls[ MaxBatchSize];
+	int m_size;
+};
+
+}//anonymous namespace
+
+struct papuga_RequestThreadPool
+{
+	MethodCallExecutorPool executor;
+
+	explicit papuga_RequestThreadPool( int nofThreads)
+		:executor(nofThreads){}
+};
+
+extern "C" papuga_RequestThreadPool* papuga_create_RequestThreadPool( int nofThreads)
+{
+	try
+	{
+		return new papuga_RequestThreadPool( nofThreads);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+extern "C" void papuga_destroy_RequestThreadPool( papuga_RequestThreadPool* self)
+{
+	delete self;
+}
+
+extern "C" bool papuga_RequestContext_execute_request_parallel( papuga_RequestContext* context, const papuga_Request* request, papuga_Allocator* allocator, papuga_RequestLogger* logger, papuga_RequestThreadPool* pool, papuga_RequestResult** results, int* nofResults, papuga_RequestError* errstruct)
+{
+	if (!pool || pool->executor.nofThreads() <= 1)
+	{
+		return papuga_RequestContext_execute_request( context, request, allocator, logger, results, nofResults, errstruct);
+	}
+	papuga_RequestIterator* itr = 0;
+	*results = 0;
+	*nofResults = 0;
+	std::memset( errstruct, 0, sizeof(*errstruct));
+
+	try
+	{
+		papuga_ErrorBuffer errorbuf_call;
+
+		const papuga_ClassDef* classdefs = papuga_Request_classdefs( request);
+		itr = papuga_create_RequestIterator( allocator, request, &errstruct->errcode);
+		if (!itr) return false;
+
+		papuga_init_ErrorBuffer( &errorbuf_call, errstruct->errormsg, sizeof(errstruct->errormsg));
+
+		DeferredMethodCallBatch batch( &pool->executor);
+		std::vector<void*> objects;
+		bool success = true;
+		for (;;)
+		{
+			// Calls resolving arguments from variables have to see the assignments of the calls deferred:
+			if (!batch.empty() && papuga_RequestIterator_next_call_reads_context( itr))
+			{
+				if (!(success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct))) break;
+			}
+			const papuga_RequestMethodCall* call = papuga_RequestIterator_next_call( itr, context);
+			if (!call) break;
+
+			if (call->methodid.classid != 0 && call->methodid.functionid != 0 && call->selfvarname)
+			{
+				// Method calls are deferred, if they do not depend on the calls already deferred:
+				void* self = findMethodCallSelf( context, call);
+				if (self && collectMethodCallObjects( objects, call, self) && !batch.conflicts( call, objects))
+				{
+					const papuga_ClassMethod func = classdefs[ call->methodid.classid-1].methodtable[ call->methodid.functionid-1];
+					batch.push( call, func, objects);
+					if (batch.full() && !(success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct))) break;
+					continue;
+				}
+			}
+			// Other calls are executed in order after the calls deferred:
+			if (!(success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct))) break;
+			if (!(success = executeCall( context, request, itr, call, classdefs, allocator, logger, errorbuf_call, errstruct))) break;
+		}
+		if (success)
+		{
+			success = batch.flush( context, request, itr, classdefs, allocator, logger, errstruct)
+				&& finishRequest( context, itr, allocator, results, nofResults, errstruct);
+		}
+		papuga_destroy_RequestIterator( itr);
+		return success;
+	}
 	catch (const std::bad_alloc& err)
 	{
 		if (itr) papuga_destroy_RequestIterator( itr);
@@ -1033,8 +3076,12 @@ extern "C" const char* papuga_RequestHandler_debug_contextmap_tostring( const pa
 	try
 	{
 		char* rt;
-		RequestContextMapRef contextmap( self->contextmap);
-		std::string dump = contextmap->tostring( structdefs);
+		std::vector<RequestContextMapRef> snapshots;	//... keep the entries collected alive
+		self->snapshots( snapshots);
+		std::map<SymKey,const RequestContextEntry*> entries;
+		std::vector<RequestContextMapRef>::const_iterator si = snapshots.begin(), se = snapshots.end();
+		for (; si != se; ++si) (*si)->collectEntries( entries);
+		std::string dump = RequestContextEntries_tostring( entries, structdefs);
 		if (allocator)
 		{
 			rt = papuga_Allocator_copy_string( allocator, dump.c_str(), dump.size());
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _PAPUGA_REQUEST_HANDLER_SNAPSHOT_HPP_INCLUDED
+#define _PAPUGA_REQUEST_HANDLER_SNAPSHOT_HPP_INCLUDED
+/// \brief Private helper classes to write and read the binary snapshot of the contexts of a request handler
+/// \file requestHandler_snapshot.hpp
+#include "papuga/typedefs.h"
+#include <string>
+#include <cstring>
+#include <cstddef>
+
+namespace papuga {
+
+/// \brief Layout of a context snapshot:
+///	header: magic (8 bytes), version, number of variables, number of contexts (32 bit little endian integers each)
+///	variables: name and value of each variable, variables shared by several contexts are written once
+///	contexts: type, name, number of variables and for each variable its index in the list of variables and its inheritance counter
+/// \note Strings are written as 32 bit length followed by the bytes of the string
+/// \note A value is written as byte with its type followed by the value, serializations as sequence of nodes (tag byte and value) terminated by EndOfSerialization
+struct ContextSnapshotHeader
+{
+	enum {
+		Version = 1,
+		MagicSize = 8,
+		Size = MagicSize + 3 * 4,
+		EndOfSerialization = 0xFF,
+		MaxValueDepth = 64
+	};
+	static const char* magic()	{return "PAPUGACS";}
+};
+
+/// \brief Writer of a context snapshot
+/// \note Methods throw std::bad_alloc on a memory allocation error
+class ContextSnapshotWriter
+{
+public:
+	ContextSnapshotWriter()
+		:m_content(){}
+
+	void pushHeader( unsigned int nofvariables, unsigned int nofcontexts)
+	{
+		m_content.append( ContextSnapshotHeader::magic(), ContextSnapshotHeader::MagicSize);
+		pushUint32( ContextSnapshotHeader::Version);
+		pushUint32( nofvariables);
+		pushUint32( nofcontexts);
+	}
+	void pushByte( unsigned char value)
+	{
+		m_content.push_back( (char)value);
+	}
+	void pushUint32( unsigned int value)
+	{
+		char buf[ 4];
+		for (int bi=0; bi<4; ++bi) buf[ bi] = (char)(unsigned char)((value >> (bi*8)) & 0xFF);
+		m_content.append( buf, sizeof(buf));
+	}
+	void pushUint64( uint64_t value)
+	{
+		char buf[ 8];
+		for (int bi=0; bi<8; ++bi) buf[ bi] = (char)(unsigned char)((value >> (bi*8)) & 0xFF);
+		m_content.append( buf, sizeof(buf));
+	}
+	void pushString( const char* str, std::size_t len)
+	{
+		pushUint32( len);
+		m_content.append( str, len);
+	}
+
+	const std::string& content() const
+	{
+		return m_content;
+	}
+
+private:
+	std::string m_content;
+};
+
+/// \brief Reader of a context snapshot
+/// \note All reads are checked against the bounds of the snapshot
+class ContextSnapshotReader
+{
+public:
+	ContextSnapshotReader( const char* content, std::size_t contentsize)
+		:m_content(content),m_contentsize(contentsize),m_pos(0){}
+
+	bool readHeader( unsigned int& nofvariables, unsigned int& nofcontexts)
+	{
+		unsigned int version;
+		if (m_contentsize < (std::size_t)ContextSnapshotHeader::Size) return false;
+		if (0!=std::memcmp( m_content, ContextSnapshotHeader::magic(), ContextSnapshotHeader::MagicSize)) return false;
+		m_pos = ContextSnapshotHeader::MagicSize;
+		return readUint32( version) && version == ContextSnapshotHeader::Version
+			&& readUint32( nofvariables) && readUint32( nofcontexts);
+	}
+	bool eof() const
+	{
+		return m_pos >= m_contentsize;
+	}
+	bool readByte( unsigned char& value)
+	{
+		if (m_pos + 1 > m_contentsize) return false;
+		value = (unsigned char)m_content[ m_pos++];
+		return true;
+	}
+	bool readUint32( unsigned int& value)
+	{
+		if (m_pos + 4 > m_contentsize) return false;
+		value = 0;
+		for (int bi=0; bi<4; ++bi) value |= (unsigned int)(unsigned char)m_content[ m_pos+bi] << (bi*8);
+		m_pos += 4;
+		return true;
+	}
+	bool readUint64( uint64_t& value)
+	{
+		if (m_pos + 8 > m_contentsize) return false;
+		value = 0;
+		for (int bi=0; bi<8; ++bi) value |= (uint64_t)(unsigned char)m_content[ m_pos+bi] << (bi*8);
+		m_pos += 8;
+		return true;
+	}
+	/// \brief Read a string, the pointer returned refers to the content of the snapshot and the string is not null terminated
+	bool readString( const char*& str, std::size_t& len)
+	{
+		unsigned int strsize;
+		if (!readUint32( strsize) || strsize > m_contentsize - m_pos) return false;
+		str = m_content + m_pos;
+		len = strsize;
+		m_pos += strsize;
+		return true;
+	}
+
+private:
+	const char* m_content;
+	std::size_t m_contentsize;
+	std::size_t m_pos;
+};
+
+}//namespace
+#endif
+
@@ -11,6 +11,7 @@
 #include "papuga/requestParser.h"
 #include "papuga/request.h"
 #include "papuga/allocator.h"
+#include "requestParser_utils.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -63,11 +64,18 @@ int papuga_RequestParser_get_position( const papuga_RequestParser* self, char* l
 	return ((papuga_RequestParserHeader*)self)->position( self, locbuf, locbufsize);
 }
 
-static bool parse_xml_header( char* hdrbuf, size_t hdrbufsize, const char* src, size_t srcsize)
+void papuga_RequestParser_set_event_position( papuga_RequestParser* self, int eventidx)
+{
+	((papuga_RequestParserHeader*)self)->event_position( self, eventidx);
+}
+
+/* @param[out] hdrsize offset of the content following the XML header, 0 if the content has no XML header */
+static bool parse_xml_header( char* hdrbuf, size_t hdrbufsize, const char* src, size_t srcsize, size_t* hdrsize)
 {
 	int state = 0;
 	size_t si = 0;
 	size_t hi = 0;
+	*hdrsize = 0;
 	for (; si < srcsize && hi < hdrbufsize; ++si)
 	{
 		if (src[si] == '\0') continue;
@@ -103,6 +111,7 @@ static bool parse_xml_header( char* hdrbuf, size_t hdrbufsize, const char* src,
 				break;
 			case 3:
 				hdrbuf[hi] = 0;
+				*hdrsize = si;
 				return true;
 		}
 		hdrbuf[ hi++] = src[si];
@@ -123,23 +132,31 @@ static papuga_StringEncoding detectBOM( const char* src, size_t srcsize, size_t*
 	return papuga_Binary;
 }
 
+static bool startsWithJson( const char* src, size_t srcsize)
+{
+	size_t si;
+	for (si=0; si<srcsize; ++si)
+	{
+		if (src[si] == '\'' || src[si] == '\"' || src[si] == '{') return true;
+		if ((unsigned char)src[si]>32) break;
+	}
+	return false;
+}
+
+#define XML_HEADER_SCAN_SIZE 1024
+
 papuga_ContentType papuga_guess_ContentType( const char* src_, size_t srcsize)
 {
 	char const* src = src_;
-	size_t si;
 	char hdrbuf[ 256];
 	size_t BOM_size;
-	size_t xmlhdrsize = srcsize > 1024 ? 1024 : srcsize;
+	size_t hdrsize;
 
 	(void)detectBOM( src, srcsize, &BOM_size);
 	src += BOM_size;
 	srcsize -= BOM_size;
-	for (si=0; si<srcsize; ++si)
-	{
-		if (src[si] == '\'' || src[si] == '\"' || src[si] == '{') return papuga_ContentType_JSON;
-		if ((unsigned char)src[si]>32) break;
-	}
-	if (parse_xml_header( hdrbuf, sizeof(hdrbuf), src, xmlhdrsize)) return papuga_ContentType_XML;
+	if (startsWithJson( src, srcsize)) return papuga_ContentType_JSON;
+	if (parse_xml_header( hdrbuf, sizeof(hdrbuf), src, srcsize > XML_HEADER_SCAN_SIZE ? XML_HEADER_SCAN_SIZE : srcsize, &hdrsize)) return papuga_ContentType_XML;
 	return papuga_ContentType_Unknown;
 }
 
@@ -177,7 +194,7 @@ static papuga_StringEncoding detectCharsetFromXmlHeader( const char* hdrbuf, siz
 	return papuga_Binary;
 }
 
-papuga_StringEncoding papuga_guess_StringEncoding( const char* src, size_t srcsize)
+static papuga_StringEncoding detectCharsetFromNullBytes( const char* src, size_t srcsize)
 {
 	char const* ci = src;
 	size_t chunksize = 1024;
@@ -186,17 +203,7 @@ papuga_StringEncoding papuga_guess_StringEncoding( const char* src, size_t srcsi
 	unsigned int max_zcnt = 0;
 	unsigned int mcnt[ 4] = {0,0,0,0};
 	int cidx = 0;
-	size_t BOM_size;
-	char hdrbuf[ 256];
-
-	papuga_StringEncoding encoding = detectBOM( src, srcsize, &BOM_size);
-	if (encoding != papuga_Binary) return encoding;
 
-	if (parse_xml_header( hdrbuf, sizeof(hdrbuf), src, srcsize) && hdrbuf[0])
-	{
-		encoding = detectCharsetFromXmlHeader( hdrbuf, strlen(hdrbuf));
-		if (encoding != papuga_Binary) return encoding;
-	}
 	for (cidx=0; ci != ce; ++ci,++cidx)
 	{
 		if (*ci == 0x00)
@@ -233,64 +240,101 @@ papuga_StringEncoding papuga_guess_StringEncoding( const char* src, size_t srcsi
 	return papuga_Binary;
 }
 
+papuga_StringEncoding papuga_guess_StringEncoding( const char* src, size_t srcsize)
+{
+	size_t BOM_size;
+	char hdrbuf[ 256];
+	size_t hdrsize;
+
+	papuga_StringEncoding encoding = detectBOM( src, srcsize, &BOM_size);
+	if (encoding != papuga_Binary) return encoding;
+
+	if (parse_xml_header( hdrbuf, sizeof(hdrbuf), src, srcsize, &hdrsize) && hdrbuf[0])
+	{
+		encoding = detectCharsetFromXmlHeader( hdrbuf, strlen(hdrbuf));
+		if (encoding != papuga_Binary) return encoding;
+	}
+	return detectCharsetFromNullBytes( src, srcsize);
+}
+
+void papuga_guess_ContentHeader( papuga_ContentHeader* hdr, const char* src, size_t srcsize)
+{
+	char hdrbuf[ 256];
+	bool has_xmlhdr = false;
+	size_t hdrsize = 0;
+	papuga_StringEncoding bom_encoding = detectBOM( src, srcsize, &hdr->bomsize);
+	char const* content = src + hdr->bomsize;
+	size_t contentsize = srcsize - hdr->bomsize;
+
+	/* A content starting as JSON has no XML header, the XML header is only parsed otherwise: */
+	if (startsWithJson( content, contentsize))
+	{
+		hdr->doctype = papuga_ContentType_JSON;
+	}
+	else if ((has_xmlhdr = parse_xml_header( hdrbuf, sizeof(hdrbuf), content, contentsize > XML_HEADER_SCAN_SIZE ? XML_HEADER_SCAN_SIZE : contentsize, &hdrsize)))
+	{
+		hdr->doctype = papuga_ContentType_XML;
+	}
+	else
+	{
+		hdr->doctype = papuga_ContentType_Unknown;
+	}
+	hdr->encoding = bom_encoding;
+	if (hdr->encoding == papuga_Binary && has_xmlhdr && hdrbuf[0])
+	{
+		hdr->encoding = detectCharsetFromXmlHeader( hdrbuf, strlen(hdrbuf));
+	}
+	if (hdr->encoding == papuga_Binary)
+	{
+		/* ... without BOM the content starts at src, the null bytes of the BOM are never counted */
+		hdr->encoding = detectCharsetFromNullBytes( content, contentsize);
+	}
+	switch (hdr->doctype)
+	{
+		case papuga_ContentType_XML:
+			/* ... the root element is parsed from the end of the XML header already parsed */
+			hdr->root = papuga_parseRootElement_xml_body( hdr->rootbuf, sizeof(hdr->rootbuf), content + hdrsize, contentsize - hdrsize);
+			break;
+		case papuga_ContentType_JSON:
+			hdr->root = papuga_parseRootElement_json( hdr->rootbuf, sizeof(hdr->rootbuf), content, contentsize);
+			break;
+		case papuga_ContentType_Unknown:
+		default:
+			hdr->root = NULL;
+			break;
+	}
+}
+
 papuga_RequestElementType papuga_RequestParser_next( papuga_RequestParser* self, papuga_ValueVariant* value)
 {
 	papuga_RequestParserHeader* header = (papuga_RequestParserHeader*)self;
 	return header->next( self, value);
 }
 
+int papuga_RequestParser_next_events( papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize)
+{
+	papuga_RequestParserHeader* header = (papuga_RequestParserHeader*)self;
+	return header->next_events( self, ar, arsize);
+}
+
 bool papuga_RequestParser_feed_request( papuga_RequestParser* parser, papuga_Request* request, papuga_ErrorCode* errcode)
 {
-	papuga_ValueVariant value;
-	bool done = false;
+	papuga_RequestParserEvent eventar[ papuga_RequestParser_EventBatchSize];
+	int nofevents = papuga_RequestParser_next_events( parser, eventar, papuga_RequestParser_EventBatchSize);
 
-	while (!done)
+	for (; nofevents > 0; nofevents = papuga_RequestParser_next_events( parser, eventar, papuga_RequestParser_EventBatchSize))
 	{
-		papuga_RequestElementType elemtype = papuga_RequestParser_next( parser, &value);
-		switch (elemtype)
+		if (!papuga_Request_feed_events( request, eventar, nofevents))
 		{
-			case papuga_RequestElementType_None:
-				*errcode = papuga_RequestParser_last_error( parser);
-				if (*errcode != papuga_Ok) return false;
-				done = true;
-				break;
-			case papuga_RequestElementType_Open:
-				if (!papuga_Request_feed_open_tag( request, &value))
-				{
-					*errcode = papuga_Request_last_error( request);
-					return false;
-				}
-				break;
-			case papuga_RequestElementType_Close:
-				if (!papuga_Request_feed_close_tag( request))
-				{
-					*errcode = papuga_Request_last_error( request);
-					return false;
-				}
-				break;
-			case papuga_RequestElementType_AttributeName:
-				if (!papuga_Request_feed_attribute_name( request, &value))
-				{
-					*errcode = papuga_Request_last_error( request);
-					return false;
-				}
-				break;
-			case papuga_RequestElementType_AttributeValue:
-				if (!papuga_Request_feed_attribute_value( request, &value))
-				{
-					*errcode = papuga_Request_last_error( request);
-					return false;
-				}
-				break;
-			case papuga_RequestElementType_Value:
-				if (!papuga_Request_feed_content_value( request, &value))
-				{
-					*errcode = papuga_Request_last_error( request);
-					return false;
-				}
-				break;
+			int eventidx = papuga_Request_last_error_event( request);
+			if (eventidx >= 0) papuga_RequestParser_set_event_position( parser, eventidx);
+			*errcode = papuga_Request_last_error( request);
+			return false;
 		}
 	}
+	*errcode = papuga_RequestParser_last_error( parser);
+	if (*errcode != papuga_Ok) return false;
+
 	if (!papuga_Request_feed_close_tag( request) || !papuga_Request_done( request))
 	{
 		*errcode = papuga_Request_last_error( request);
@@ -300,11 +344,27 @@ bool papuga_RequestParser_feed_request( papuga_RequestParser* parser, papuga_Req
 }
 
 papuga_RequestParser* papuga_create_RequestParser( papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* content, size_t size, papuga_ErrorCode* errcode)
+{
+	return papuga_create_RequestParser_limits( allocator, doctype, encoding, content, size, NULL/*limits*/, errcode);
+}
+
+papuga_RequestParser* papuga_create_RequestParser_limits( papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode)
+{
+	switch (doctype)
+	{
+		case papuga_ContentType_XML:  return papuga_create_RequestParser_xml_limits( allocator, encoding, content, size, limits, errcode);
+		case papuga_ContentType_JSON: return papuga_create_RequestParser_json_limits( allocator, encoding, content, size, limits, errcode);
+		case papuga_ContentType_Unknown: *errcode = papuga_ValueUndefined; return NULL;
+		default: *errcode = papuga_NotImplemented; return NULL;
+	}
+}
+
+papuga_RequestParser* papuga_create_RequestParser_borrowed( papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode)
 {
 	switch (doctype)
 	{
-		case papuga_ContentType_XML:  return papuga_create_RequestParser_xml( allocator, encoding, content, size, errcode);
-		case papuga_ContentType_JSON: return papuga_create_RequestParser_json( allocator, encoding, content, size, errcode);
+		case papuga_ContentType_XML:  return papuga_create_RequestParser_xml_impl( allocator, encoding, content, size, limits, true/*borrowed*/, errcode);
+		case papuga_ContentType_JSON: return papuga_create_RequestParser_json_impl( allocator, encoding, content, size, limits, true/*borrowed*/, errcode);
 		case papuga_ContentType_Unknown: *errcode = papuga_ValueUndefined; return NULL;
 		default: *errcode = papuga_NotImplemented; return NULL;
 	}
@@ -9,6 +9,7 @@
  * @file requestParser.cpp
  */
 #include "papuga/requestParser.h"
+#include "requestParser_utils.h"
 
 static char nextNonSpaceChar( char const*& si, const char* se)
 {
@@ -48,6 +49,13 @@ extern "C" const char* papuga_parseRootElement_xml( char* buf, size_t bufsize, c
 	char const* si = src;
 	const char* se = src + srcsize;
 	skipXmlHeader( si, se);
+	return papuga_parseRootElement_xml_body( buf, bufsize, si, se - si);
+}
+
+extern "C" const char* papuga_parseRootElement_xml_body( char* buf, size_t bufsize, const char* src, size_t srcsize)
+{
+	char const* si = src;
+	const char* se = src + srcsize;
 	if (si == se) return 0;
 	if (nextNonSpaceChar( si, se) != '<') return 0;
 	++si;
@@ -16,6 +16,7 @@
 #include "cjson/cJSON.h"
 #include "textwolf/xmlscanner.hpp"
 #include "requestParser_utils.h"
+#include "contentLimits_utils.hpp"
 #include <cstdlib>
 #include <string>
 #include <vector>
@@ -40,8 +41,10 @@ struct TextwolfItem
 
 static void papuga_destroy_RequestParser_json( papuga_RequestParser* self);
 static papuga_RequestElementType papuga_RequestParser_json_next( papuga_RequestParser* self, papuga_ValueVariant* value);
+static int papuga_RequestParser_json_next_events( papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize);
 static int papuga_RequestParser_json_position( const papuga_RequestParser* self, char* locbuf, size_t locbufsize);
-static std::vector<TextwolfItem> getTextwolfItems( papuga_Allocator* allocator, const cJSON* tree, papuga_ErrorCode* errcode);
+static void papuga_RequestParser_json_event_position( papuga_RequestParser* self, int eventidx);
+static std::vector<TextwolfItem> getTextwolfItems( papuga_Allocator* allocator, const cJSON* tree, ContentBudget& budget, papuga_ErrorCode* errcode);
 
 #ifdef PAPUGA_LOWLEVEL_DEBUG
 static void printTextwolfItemList( std::ostream& out, const char* title, const std::vector<TextwolfItem>& tiar)
@@ -94,24 +97,46 @@ struct RequestParser_json
 	papuga_RequestParserHeader header;
 	papuga_Allocator* allocator;
 	std::string elembuf;
-	std::string content;
+	std::string contentbuf;
+	const char* content;
+	std::size_t contentsize;
 	JsonTreeRef tree;
 	std::vector<TextwolfItem> items;
 	std::vector<TextwolfItem>::const_iterator iter;
-
-	RequestParser_json( papuga_Allocator* allocator_, const std::string& content_)
-		:allocator(allocator_),elembuf(),content(content_),tree(),items(),iter()
+	std::size_t batchofs;				//< index of the first item of the last batch fetched
+	int locofs;					//< index of the item the location refers to, -1 for the current item
+
+	/// \param[in] content_ content borrowed (null terminated, living as long as the parser) or NULL if the content is passed with contentbuf_
+	/// \param[in] contentsize_ size of the content borrowed in bytes
+	/// \param[in,out] contentbuf_ content copy passed with ownership (swapped) if no content is borrowed
+	RequestParser_json( papuga_Allocator* allocator_, const char* content_, std::size_t contentsize_, std::string& contentbuf_, const papuga_ContentLimits* limits)
+		:allocator(allocator_),elembuf(),contentbuf(),content(content_),contentsize(contentsize_),tree(),items(),iter(),batchofs(0),locofs(-1)
 	{
+		if (!content)
+		{
+			contentbuf.swap( contentbuf_);
+			content = contentbuf.c_str();
+			contentsize = contentbuf.size();
+		}
 		header.type = papuga_ContentType_JSON;
 		header.errcode = papuga_Ok;
 		header.errpos = -1;
 		header.libname = "cjson";
 		header.destroy = &papuga_destroy_RequestParser_json;
 		header.next = &papuga_RequestParser_json_next;
+		header.next_events = &papuga_RequestParser_json_next_events;
 		header.position = &papuga_RequestParser_json_position;
+		header.event_position = &papuga_RequestParser_json_event_position;
 
+		ContentBudget budget( limits);
+		if (!budget.addMemory( contentsize, &header.errcode))
+		{
+			// ... shed oversized content before building the tree
+			iter = items.begin();
+			return;
+		}
 		cJSON_Context ctx;
-		tree = cJSON_Parse( content.c_str(), &ctx);
+		tree = cJSON_Parse( content, &ctx);
 		if (!tree)
 		{
 			if (ctx.position < 0)
@@ -126,7 +151,7 @@ struct RequestParser_json
 		}
 		else
 		{
-			items = getTextwolfItems( allocator, tree, &header.errcode);
+			items = getTextwolfItems( allocator, tree, budget, &header.errcode);
 #ifdef PAPUGA_LOWLEVEL_DEBUG
 			printTextwolfItemList( std::cerr, "JSON items parsed", items);
 #endif
@@ -137,11 +162,12 @@ struct RequestParser_json
 	void getLocationInfo( char* locbuf, std::size_t locbufsize) const
 	{
 		if (locbufsize == 0) return;
+		std::vector<TextwolfItem>::const_iterator loc = locofs >= 0 ? items.begin() + locofs : iter;
 		if (header.errpos >= 0)
 		{
-			fillErrorLocation( locbuf, locbufsize, content.c_str(), header.errpos, "<!>");
+			fillErrorLocation( locbuf, locbufsize, content, header.errpos, "<!>");
 		}
-		else if (iter != items.end())
+		else if (loc != items.end())
 		{
 			try
 			{
@@ -152,11 +178,11 @@ struct RequestParser_json
 				int cnt = 0;
 				stk.push_back( 0);
 
-				std::vector<TextwolfItem>::const_iterator start = iter;
+				std::vector<TextwolfItem>::const_iterator start = loc;
 				for (cnt=7; start != items.begin() && cnt; --cnt,--start){}
 				for (; start != items.end() && cnt < 15; ++start,++cnt)
 				{
-					if (start == iter)
+					if (start == loc)
 					{
 						out << "<!>";
 					}
@@ -258,6 +284,34 @@ struct RequestParser_json
 			return textWolfElementType2requestElementType[ tp];
 		}
 	}
+
+	int getNextEvents( papuga_RequestParserEvent* ar, int arsize)
+	{
+		// ... all values are null terminated strings referencing the cJSON tree or the allocator, no copy needed
+		batchofs = iter - items.begin();
+		int ai = 0;
+		for (; ai < arsize && iter != items.end(); ++ai,++iter)
+		{
+			if (iter->value)
+			{
+				papuga_init_ValueVariant_charp( &ar[ ai].value, iter->value);
+			}
+			else
+			{
+				papuga_init_ValueVariant( &ar[ ai].value);
+			}
+			ar[ ai].type = textWolfElementType2requestElementType[ iter->type];
+		}
+		return ai;
+	}
+
+	void setEventPosition( int eventidx)
+	{
+		if (eventidx >= 0 && batchofs + eventidx < items.size())
+		{
+			locofs = batchofs + eventidx;
+		}
+	}
 };
 }//anonymous namespace
 
@@ -293,14 +347,26 @@ static void getTextwolfValue( std::vector<TextwolfItem>& tiar, cJSON const* nd,
 	}
 }
 
-static bool getTextwolfItems_( std::vector<TextwolfItem>& itemar, papuga_Allocator* allocator, cJSON const* nd, int depth, papuga_ErrorCode* errcode)
+namespace {
+/// \brief Node visited in the iterative traversal of a cJSON tree
+struct JsonNodeFrame
+{
+	cJSON const* nd;		///< node visited
+	cJSON const* chnd;		///< next child of the node to visit
+	const char* closetag;		///< pending close tag of an array element visited
+	unsigned int idx;		///< index of the last array element visited
+
+	explicit JsonNodeFrame( cJSON const* nd_)
+		:nd(nd_),chnd(nd_->child),closetag(0),idx(0){}
+	JsonNodeFrame( const JsonNodeFrame& o)
+		:nd(o.nd),chnd(o.chnd),closetag(o.closetag),idx(o.idx){}
+};
+}//anonymous namespace
+
+static bool enterTextwolfNode( std::vector<TextwolfItem>& itemar, std::vector<JsonNodeFrame>& stk, cJSON const* nd, ContentBudget& budget, papuga_ErrorCode* errcode)
 {
-	if (depth > PAPUGA_MAX_RECURSION_DEPTH)
-	{
-		*errcode = papuga_MaxRecursionDepthReached;
-		return false;
-	}
 	typedef textwolf::XMLScannerBase TX;
+	if (!budget.addMemory( sizeof(cJSON), errcode)) return false;
 	switch (nd->type & 0x7F)
 	{
 		case cJSON_False:
@@ -328,72 +394,102 @@ static bool getTextwolfItems_( std::vector<TextwolfItem>& itemar, papuga_Allocat
 			getTextwolfValue( itemar, nd, nd->valuestring);
 			break;
 		case cJSON_Array:
-		{
-			cJSON const* chnd = nd->child;
+			stk.push_back( JsonNodeFrame( nd));
+			break;
+		case cJSON_Object:
 			if (nd->string)
 			{
-				for (;chnd; chnd = chnd->next)
-				{
-					itemar.push_back( TextwolfItem( TX::OpenTag, nd->string));
-					if (!getTextwolfItems_( itemar, allocator, chnd, depth+1, errcode)) return false;
-					itemar.push_back( TextwolfItem( TX::CloseTag, nd->string));
-				}
-			}
-			else
-			{
-				unsigned int idx=1;
-				char idxstr[ 64];
-				for (;chnd; chnd = chnd->next,++idx)
-				{
-					std::size_t idxstrlen = std::snprintf( idxstr, sizeof( idxstr), "%u", idx);
-					char* idxstr_copy = (char*)papuga_Allocator_alloc( allocator, idxstrlen+1, 1);
-					if (!idxstr_copy)
-					{
-						*errcode = papuga_NoMemError;
-						return false;
-					}
-					std::memcpy( idxstr_copy, idxstr, idxstrlen+1);
-					itemar.push_back( TextwolfItem( TX::OpenTag, idxstr_copy));
-					if (!getTextwolfItems_( itemar, allocator, chnd, depth+1, errcode)) return false;
-					itemar.push_back( TextwolfItem( TX::CloseTag, idxstr_copy));
-				}
+				itemar.push_back( TextwolfItem( TX::OpenTag, nd->string));
 			}
+			stk.push_back( JsonNodeFrame( nd));
 			break;
+		default:
+			*errcode = papuga_LogicError;
+			return false;
+	}
+	return true;
+}
+
+/// \brief Account the items appended since itemcnt, the depth checked is the nesting level of the tags as for XML, the root element at depth 1
+static bool accountTextwolfItems( const std::vector<TextwolfItem>& itemar, std::size_t itemcnt, int& taglevel, ContentBudget& budget, papuga_ErrorCode* errcode)
+{
+	typedef textwolf::XMLScannerBase TX;
+	std::vector<TextwolfItem>::const_iterator ti = itemar.begin() + itemcnt, te = itemar.end();
+	for (; ti != te; ++ti)
+	{
+		if (ti->type == TX::OpenTag)
+		{
+			if (!budget.checkDepth( ++taglevel, errcode)) return false;
 		}
-		case cJSON_Object:
+		else if (ti->type == TX::CloseTag || ti->type == TX::CloseTagIm)
 		{
-			cJSON const* chnd = nd->child;
-			if (nd->string)
+			--taglevel;
+		}
+	}
+	return budget.addElements( itemar.size() - itemcnt, errcode)
+		&& budget.addMemory( (itemar.size() - itemcnt) * sizeof(TextwolfItem), errcode);
+}
+
+static bool getTextwolfItems_( std::vector<TextwolfItem>& itemar, papuga_Allocator* allocator, cJSON const* tree, ContentBudget& budget, papuga_ErrorCode* errcode)
+{
+	typedef textwolf::XMLScannerBase TX;
+	std::vector<JsonNodeFrame> stk;
+	std::size_t itemcnt = 0;
+	int taglevel = 0;
+
+	if (!enterTextwolfNode( itemar, stk, tree, budget, errcode)) return false;
+	while (!stk.empty())
+	{
+		JsonNodeFrame& fr = stk.back();
+		if (fr.closetag)
+		{
+			itemar.push_back( TextwolfItem( TX::CloseTag, fr.closetag));
+			fr.closetag = 0;
+		}
+		if (!fr.chnd)
+		{
+			if ((fr.nd->type & 0x7F) == cJSON_Object && fr.nd->string)
 			{
-				itemar.push_back( TextwolfItem( TX::OpenTag, nd->string));
-				for (;chnd; chnd = chnd->next)
-				{
-					if (!getTextwolfItems_( itemar, allocator, chnd, depth+1, errcode)) return false;
-				}
-				itemar.push_back( TextwolfItem( TX::CloseTag, nd->string));
+				itemar.push_back( TextwolfItem( TX::CloseTag, fr.nd->string));
 			}
-			else
+			stk.pop_back();
+			continue;
+		}
+		cJSON const* chnd = fr.chnd;
+		fr.chnd = chnd->next;
+		if ((fr.nd->type & 0x7F) == cJSON_Array)
+		{
+			const char* tagname = fr.nd->string;
+			if (!tagname)
 			{
-				for (;chnd; chnd = chnd->next)
+				char idxstr[ 64];
+				std::size_t idxstrlen = std::snprintf( idxstr, sizeof( idxstr), "%u", ++fr.idx);
+				char* idxstr_copy = (char*)papuga_Allocator_alloc( allocator, idxstrlen+1, 1);
+				if (!idxstr_copy)
 				{
-					if (!getTextwolfItems_( itemar, allocator, chnd, depth+1, errcode)) return false;
+					*errcode = papuga_NoMemError;
+					return false;
 				}
+				std::memcpy( idxstr_copy, idxstr, idxstrlen+1);
+				if (!budget.addMemory( idxstrlen+1, errcode)) return false;
+				tagname = idxstr_copy;
 			}
-			break;
+			itemar.push_back( TextwolfItem( TX::OpenTag, tagname));
+			fr.closetag = tagname;
 		}
-		default:
-			*errcode = papuga_LogicError;
-			return false;
+		if (!enterTextwolfNode( itemar, stk, chnd, budget, errcode)) return false;
+		if (!accountTextwolfItems( itemar, itemcnt, taglevel, budget, errcode)) return false;
+		itemcnt = itemar.size();
 	}
-	return true;
+	return accountTextwolfItems( itemar, itemcnt, taglevel, budget, errcode);
 }
 
-static std::vector<TextwolfItem> getTextwolfItems( papuga_Allocator* allocator, const cJSON* tree, papuga_ErrorCode* errcode)
+static std::vector<TextwolfItem> getTextwolfItems( papuga_Allocator* allocator, const cJSON* tree, ContentBudget& budget, papuga_ErrorCode* errcode)
 {
 	std::vector<TextwolfItem> rt;
 	try
 	{
-		if (!getTextwolfItems_( rt, allocator, tree, 0, errcode)) return std::vector<TextwolfItem>();
+		if (!getTextwolfItems_( rt, allocator, tree, budget, errcode)) return std::vector<TextwolfItem>();
 	}
 	catch (const std::bad_alloc&)
 	{
@@ -416,10 +512,10 @@ static inline bool serializeJsonName( papuga_Serialization* serialization, cJSON
 	return true;
 }
 
-static bool getJsonSerialization( papuga_Serialization* serialization, cJSON const* nd, int depth, bool deep, papuga_ErrorCode* errcode)
+static bool enterJsonSerializationNode( papuga_Serialization* serialization, std::vector<JsonNodeFrame>& stk, cJSON const* nd, bool deep, papuga_ErrorCode* errcode)
 {
 	bool rt = true;
-	if (depth > PAPUGA_MAX_RECURSION_DEPTH)
+	if (stk.size() > PAPUGA_MAX_RECURSION_DEPTH)
 	{
 		*errcode = papuga_MaxRecursionDepthReached;
 		return false;
@@ -455,28 +551,18 @@ static bool getJsonSerialization( papuga_Serialization* serialization, cJSON con
 		case cJSON_Array:
 		case cJSON_Object:
 		{
-			cJSON const* chnd = nd->child;
 			if (nd->string)
 			{
 				const char* name = deep ? papuga_Allocator_copy_charp( serialization->allocator, nd->string) : nd->string;
 				rt &= papuga_Serialization_pushName_charp( serialization, name);
 			}
+			// ... the frame of an unnamed root is not enclosed in open/close, we mark the frame with a close tag to remember
 			bool isroot = papuga_Serialization_empty( serialization);
+			stk.push_back( JsonNodeFrame( nd));
 			if (!isroot)
 			{
 				rt &= papuga_Serialization_pushOpen( serialization);
-				for (;chnd; chnd = chnd->next)
-				{
-					rt &= getJsonSerialization( serialization, chnd, depth+1, deep, errcode);
-				}
-				rt &= papuga_Serialization_pushClose( serialization);
-			}
-			else
-			{
-				for (;chnd; chnd = chnd->next)
-				{
-					rt &= getJsonSerialization( serialization, chnd, depth+1, deep, errcode);
-				}
+				stk.back().closetag = "";
 			}
 			break;
 		}
@@ -484,19 +570,62 @@ static bool getJsonSerialization( papuga_Serialization* serialization, cJSON con
 			*errcode = papuga_LogicError;
 			return false;
 	}
+	if (!rt) *errcode = papuga_NoMemError;
 	return rt;
 }
 
+static bool getJsonSerialization( papuga_Serialization* serialization, cJSON const* tree, bool deep, papuga_ErrorCode* errcode)
+{
+	std::vector<JsonNodeFrame> stk;
+	if (!enterJsonSerializationNode( serialization, stk, tree, deep, errcode)) return false;
+	while (!stk.empty())
+	{
+		JsonNodeFrame& fr = stk.back();
+		if (!fr.chnd)
+		{
+			if (fr.closetag && !papuga_Serialization_pushClose( serialization))
+			{
+				*errcode = papuga_NoMemError;
+				return false;
+			}
+			stk.pop_back();
+			continue;
+		}
+		cJSON const* chnd = fr.chnd;
+		fr.chnd = chnd->next;
+		if (!enterJsonSerializationNode( serialization, stk, chnd, deep, errcode)) return false;
+	}
+	return true;
+}
+
 extern "C" papuga_RequestParser* papuga_create_RequestParser_json( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, papuga_ErrorCode* errcode)
+{
+	return papuga_create_RequestParser_json_limits( allocator, encoding, content, size, NULL/*limits*/, errcode);
+}
+
+extern "C" papuga_RequestParser* papuga_create_RequestParser_json_limits( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode)
+{
+	return papuga_create_RequestParser_json_impl( allocator, encoding, content, size, limits, false/*borrowed*/, errcode);
+}
+
+extern "C" papuga_RequestParser* papuga_create_RequestParser_json_impl( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, bool borrowed, papuga_ErrorCode* errcode)
 {
 	papuga_RequestParser* rt = (papuga_RequestParser*)papuga_Allocator_alloc( allocator, sizeof(papuga_RequestParser), 0/*default alignment*/);
 	if (!rt) return NULL;
 	try
 	{
 		std::string contentUTF8;
+		const char* contentref = NULL;
 		if (encoding == papuga_UTF8)
 		{
-			contentUTF8.append( content, size);
+			if (borrowed)
+			{
+				contentref = content;
+			}
+			else
+			{
+				contentUTF8.append( content, size);
+			}
 		}
 		else
 		{
@@ -504,7 +633,7 @@ extern "C" papuga_RequestParser* papuga_create_RequestParser_json( papuga_Alloca
 			papuga_init_ValueVariant_string_enc( &input, encoding, content, size);
 			contentUTF8 = ValueVariant_tostring( input, *errcode);
 		}
-		new (&rt->impl) RequestParser_json( allocator, contentUTF8);
+		new (&rt->impl) RequestParser_json( allocator, contentref, size, contentUTF8, limits);
 	}
 	catch (const std::bad_alloc&)
 	{
@@ -531,12 +660,29 @@ static papuga_RequestElementType papuga_RequestParser_json_next( papuga_RequestP
 	}
 }
 
+static int papuga_RequestParser_json_next_events( papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize)
+{
+	if (self->impl.header.errcode != papuga_Ok)
+	{
+		return 0;
+	}
+	else
+	{
+		return self->impl.getNextEvents( ar, arsize);
+	}
+}
+
 static int papuga_RequestParser_json_position( const papuga_RequestParser* self, char* locbuf, size_t locbufsize)
 {
 	self->impl.getLocationInfo( locbuf, locbufsize);
 	return self->impl.header.errpos;
 }
 
+static void papuga_RequestParser_json_event_position( papuga_RequestParser* self, int eventidx)
+{
+	self->impl.setEventPosition( eventidx);
+}
+
 extern "C" bool papuga_init_ValueVariant_json( papuga_ValueVariant* self, papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, papuga_ErrorCode* errcode)
 {
 	papuga_init_ValueVariant( self);
@@ -572,7 +718,7 @@ extern "C" bool papuga_init_ValueVariant_json( papuga_ValueVariant* self, papuga
 			*errcode = papuga_SyntaxError;
 			return false;
 		}
-		bool rt = getJsonSerialization( ser, tree, 0, true/*deep*/, errcode);
+		bool rt = getJsonSerialization( ser, tree, true/*deep*/, errcode);
 		if (rt)
 		{
 			papuga_init_ValueVariant_serialization( self, ser);
@@ -10,14 +10,22 @@
  */
 #ifndef _PAPUGA_REQUEST_PARSER_UTILS_H_INCLUDED
 #define _PAPUGA_REQUEST_PARSER_UTILS_H_INCLUDED
+#include "papuga/requestParser.h"
 #include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* \brief Extract the root element name of an XML content without XML header or with the XML header already skipped */
+const char* papuga_parseRootElement_xml_body( char* buf, size_t bufsize, const char* src, size_t srcsize);
+
 void fillErrorLocation( char* errlocbuf, size_t errlocbufsize, const char* source, size_t errpos, const char* marker);
 
+/* \brief Create a document parser, with borrowed=true the UTF-8 content (null terminated) is referenced and not copied */
+papuga_RequestParser* papuga_create_RequestParser_xml_impl( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, bool borrowed, papuga_ErrorCode* errcode);
+papuga_RequestParser* papuga_create_RequestParser_json_impl( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, bool borrowed, papuga_ErrorCode* errcode);
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,14 +14,18 @@
 #include "textwolf/xmlscanner.hpp"
 #include "textwolf/charset.hpp"
 #include "requestParser_utils.h"
+#include "contentLimits_utils.hpp"
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 using namespace papuga;
 
 static void papuga_destroy_RequestParser_xml( papuga_RequestParser* self);
 static papuga_RequestElementType papuga_RequestParser_xml_next( papuga_RequestParser* self, papuga_ValueVariant* value);
+static int papuga_RequestParser_xml_next_events( papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize);
 static int papuga_RequestParser_xml_position( const papuga_RequestParser* self, char* locbuf, size_t locbufsize);
+static void papuga_RequestParser_xml_event_position( papuga_RequestParser* self, int eventidx);
 
 namespace {
 struct RequestParser_xml
@@ -29,7 +33,13 @@ struct RequestParser_xml
 	papuga_RequestParserHeader header;
 	papuga_Allocator* allocator;
 	std::string elembuf;
-	std::string content;
+	std::string contentbuf;
+	const char* content;
+	std::size_t contentsize;
+	std::string eventbuf;
+	std::vector<std::size_t> eventofs;
+	std::vector<int> eventpos;		//< source position of each element of the last batch fetched
+	bool eof;
 
 	typedef textwolf::XMLScanner<
 			textwolf::SrcIterator,
@@ -45,33 +55,66 @@ struct RequestParser_xml
 	jmp_buf eom;
 	int taglevel;
 	int tagcnt;
+	ContentBudget budget;
 
-	explicit RequestParser_xml( papuga_Allocator* allocator_, const std::string& content_)
-		:allocator(allocator_),elembuf(),content(content_),taglevel(0),tagcnt(0)
+	/// \param[in] content_ content borrowed (null terminated, living as long as the parser) or NULL if the content is passed with contentbuf_
+	/// \param[in] contentsize_ size of the content borrowed in bytes
+	/// \param[in,out] contentbuf_ content copy passed with ownership (swapped) if no content is borrowed
+	RequestParser_xml( papuga_Allocator* allocator_, const char* content_, std::size_t contentsize_, std::string& contentbuf_, const papuga_ContentLimits* limits)
+		:allocator(allocator_),elembuf(),contentbuf(),content(content_),contentsize(contentsize_),eventbuf(),eventofs(),eventpos(),eof(false),taglevel(0),tagcnt(0),budget(limits)
 	{
+		if (!content)
+		{
+			contentbuf.swap( contentbuf_);
+			content = contentbuf.c_str();
+			contentsize = contentbuf.size();
+		}
 		header.type = papuga_ContentType_XML;
 		header.errcode = papuga_Ok;
 		header.errpos = -1;
 		header.libname = "textwolf";
 		header.destroy = &papuga_destroy_RequestParser_xml;
 		header.next = &papuga_RequestParser_xml_next;
+		header.next_events = &papuga_RequestParser_xml_next_events;
 		header.position = &papuga_RequestParser_xml_position;
+		header.event_position = &papuga_RequestParser_xml_event_position;
 
-		srciter.putInput( content.c_str(), content.size(), &eom);
+		srciter.putInput( content, contentsize, &eom);
 		scanner.setSource( srciter);
 		itr = scanner.begin( false);
 		end = scanner.end();
+		if (!budget.addMemory( contentsize, &header.errcode))
+		{
+			// ... shed oversized content before scanning it
+			eof = true;
+		}
+	}
+
+	bool checkElementBudget()
+	{
+		if (!budget.addElements( 1, &header.errcode)
+		||  !budget.checkDepth( taglevel, &header.errcode))
+		{
+			header.errpos = scanner.getTokenPosition();
+			eof = true;
+			return false;
+		}
+		return true;
 	}
 
 	papuga_RequestElementType getNext( papuga_ValueVariant* value)
 	{
 		typedef textwolf::XMLScannerBase tx;
+		if (header.errcode != papuga_Ok)
+		{
+			return papuga_RequestElementType_None;
+		}
 		if (setjmp(eom) != 0)
 		{
 			if (taglevel != 0 || tagcnt == 0)
 			{
 				header.errcode = papuga_UnexpectedEof;
-				header.errpos = content.size();
+				header.errpos = contentsize;
 			}
 			return papuga_RequestElementType_None;
 		}
@@ -99,26 +142,85 @@ struct RequestParser_xml
 				case tx::DocAttribEnd:
 					continue;
 				case tx::TagAttribName:
+					if (!checkElementBudget()) return papuga_RequestElementType_None;
 					papuga_init_ValueVariant_string( value, itr->content(), itr->size());
 					return papuga_RequestElementType_AttributeName;
 				case tx::TagAttribValue:
+					if (!checkElementBudget()) return papuga_RequestElementType_None;
 					papuga_init_ValueVariant_string( value, itr->content(), itr->size());
 					return papuga_RequestElementType_AttributeValue;
 				case tx::OpenTag:
 					++taglevel;++tagcnt;
+					if (!checkElementBudget()) return papuga_RequestElementType_None;
 					papuga_init_ValueVariant_string( value, itr->content(), itr->size());
 					return papuga_RequestElementType_Open;
 				case tx::CloseTag:
 				case tx::CloseTagIm:
 					--taglevel;
+					if (!checkElementBudget()) return papuga_RequestElementType_None;
 					papuga_init_ValueVariant( value);
 					return papuga_RequestElementType_Close;
 				case tx::Content:
+					if (!checkElementBudget()) return papuga_RequestElementType_None;
 					papuga_init_ValueVariant_string( value, itr->content(), itr->size());
 					return papuga_RequestElementType_Value;
 			}
 		}
 	}
+
+	int getNextEvents( papuga_RequestParserEvent* ar, int arsize)
+	{
+		// ... values returned by the scanner refer to a buffer overwritten by the next element,
+		//	we copy them into one buffer per batch and resolve the references when the batch is complete
+		if (eof) return 0;
+		try
+		{
+			eventbuf.clear();
+			eventofs.clear();
+			eventpos.clear();
+			int ai = 0;
+			for (; ai < arsize; ++ai)
+			{
+				papuga_RequestParserEvent& ev = ar[ ai];
+				ev.type = getNext( &ev.value);
+				if (ev.type == papuga_RequestElementType_None)
+				{
+					eof = true;
+					break;
+				}
+				eventpos.push_back( scanner.getTokenPosition());
+				if (ev.value.valuetype == papuga_TypeString)
+				{
+					eventofs.push_back( eventbuf.size());
+					eventbuf.append( ev.value.value.string, ev.value.length);
+					eventbuf.push_back( '\0');
+				}
+			}
+			std::vector<std::size_t>::const_iterator oi = eventofs.begin();
+			for (int ei = 0; ei < ai; ++ei)
+			{
+				if (ar[ ei].value.valuetype == papuga_TypeString)
+				{
+					ar[ ei].value.value.string = eventbuf.c_str() + *oi++;
+				}
+			}
+			return ai;
+		}
+		catch (const std::bad_alloc&)
+		{
+			header.errcode = papuga_NoMemError;
+			eof = true;
+			return 0;
+		}
+	}
+
+	void setEventPosition( int eventidx)
+	{
+		if (eventidx >= 0 && eventidx < (int)eventpos.size())
+		{
+			header.errpos = eventpos[ eventidx];
+		}
+	}
 };
 }//anonymous namespace
 
@@ -128,15 +230,33 @@ struct papuga_RequestParser
 };
 
 extern "C" papuga_RequestParser* papuga_create_RequestParser_xml( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, papuga_ErrorCode* errcode)
+{
+	return papuga_create_RequestParser_xml_limits( allocator, encoding, content, size, NULL/*limits*/, errcode);
+}
+
+extern "C" papuga_RequestParser* papuga_create_RequestParser_xml_limits( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode)
+{
+	return papuga_create_RequestParser_xml_impl( allocator, encoding, content, size, limits, false/*borrowed*/, errcode);
+}
+
+extern "C" papuga_RequestParser* papuga_create_RequestParser_xml_impl( papuga_Allocator* allocator, papuga_StringEncoding encoding, const char* content, size_t size, const papuga_ContentLimits* limits, bool borrowed, papuga_ErrorCode* errcode)
 {
 	papuga_RequestParser* rt = (papuga_RequestParser*)papuga_Allocator_alloc( allocator, sizeof(papuga_RequestParser), 0/*default alignment*/);
 	if (!rt) return NULL;
 	try
 	{
 		std::string contentUTF8;
+		const char* contentref = NULL;
 		if (encoding == papuga_UTF8)
 		{
-			contentUTF8.append( content, size);
+			if (borrowed)
+			{
+				contentref = content;
+			}
+			else
+			{
+				contentUTF8.append( content, size);
+			}
 		}
 		else
 		{
@@ -144,7 +264,7 @@ extern "C" papuga_RequestParser* papuga_create_RequestParser_xml( papuga_Allocat
 			papuga_init_ValueVariant_string_enc( &input, encoding, content, size);
 			contentUTF8 = ValueVariant_tostring( input, *errcode);
 		}
-		new (&rt->impl) RequestParser_xml( allocator, contentUTF8);
+		new (&rt->impl) RequestParser_xml( allocator, contentref, size, contentUTF8, limits);
 	}
 	catch (const std::bad_alloc&)
 	{
@@ -164,9 +284,19 @@ static papuga_RequestElementType papuga_RequestParser_xml_next( papuga_RequestPa
 	return self->impl.getNext( value);
 }
 
+static int papuga_RequestParser_xml_next_events( papuga_RequestParser* self, papuga_RequestParserEvent* ar, int arsize)
+{
+	return self->impl.getNextEvents( ar, arsize);
+}
+
 static int papuga_RequestParser_xml_position( const papuga_RequestParser* self, char* locbuf, size_t locbufsize)
 {
-	fillErrorLocation( locbuf, locbufsize, self->impl.content.c_str(), self->impl.header.errpos, "!$!");
+	fillErrorLocation( locbuf, locbufsize, self->impl.content, self->impl.header.errpos, "!$!");
 	return self->impl.header.errpos;
 }
 
+static void papuga_RequestParser_xml_event_position( papuga_RequestParser* self, int eventidx)
+{
+	self->impl.setEventPosition( eventidx);
+}
+
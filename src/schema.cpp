@@ -1154,7 +1154,22 @@ static inline textwolf::XMLScannerBase::ElementType requestElementType( papuga_R
 	return ar[ elemtype];
 }
 
-static bool parseRequest( std::vector<RequestElement>& res, papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, papuga_SchemaError* err)
+namespace {
+/// \brief Guard destroying a request parser when leaving scope
+struct RequestParserScope
+{
+	papuga_RequestParser* parser;
+
+	explicit RequestParserScope( papuga_RequestParser* parser_)
+		:parser(parser_){}
+	~RequestParserScope()
+	{
+		if (parser) papuga_destroy_RequestParser( parser);
+	}
+};
+}//anonymous namespace
+
+static bool parseRequest( std::vector<RequestElement>& res, papuga_Allocator* allocator, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, bool borrowed, papuga_SchemaError* err)
 {
 	papuga_RequestParser* parser = 0;
 	papuga_ErrorCode errcode = papuga_Ok;
@@ -1166,11 +1181,14 @@ static bool parseRequest( std::vector<RequestElement>& res, papuga_Allocator* al
 		case papuga_ContentType_Unknown:
 			errcode = papuga_InvalidRequest;
 		case papuga_ContentType_XML:
-			parser = papuga_create_RequestParser_xml( allocator, encoding, contentstr, contentlen, &errcode);
-			break;
 		case papuga_ContentType_JSON:
-			parser = papuga_create_RequestParser_json( allocator, encoding, contentstr, contentlen, &errcode);
+		{
+			papuga_ContentType parsertype = doctype == papuga_ContentType_JSON ? papuga_ContentType_JSON : papuga_ContentType_XML;
+			parser = borrowed
+				? papuga_create_RequestParser_borrowed( allocator, parsertype, encoding, contentstr, contentlen, NULL/*limits*/, &errcode)
+				: papuga_create_RequestParser_limits( allocator, parsertype, encoding, contentstr, contentlen, NULL/*limits*/, &errcode);
 			break;
+		}
 		default:
 			errcode = papuga_InvalidRequest;
 			break;
@@ -1179,6 +1197,7 @@ static bool parseRequest( std::vector<RequestElement>& res, papuga_Allocator* al
 	{
 		return SchemaError( err, errcode);
 	}
+	RequestParserScope parserScope( parser);
 	papuga_ValueVariant elemvalue;
 	papuga_RequestElementType elemtype = papuga_RequestParser_next( parser, &elemvalue);
 	for (; elemtype != papuga_RequestElementType_None; elemtype = papuga_RequestParser_next( parser, &elemvalue))
@@ -1543,7 +1562,7 @@ static bool serializeRequest( papuga_Serialization* output, papuga_Schema const*
 	return true;
 }
 
-extern "C" bool papuga_schema_parse( papuga_Serialization* dest, papuga_Schema const* schema, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, papuga_SchemaError* err)
+static bool schema_parse( papuga_Serialization* dest, papuga_Schema const* schema, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, bool borrowed, papuga_SchemaError* err)
 {
 	papuga_Allocator allocator;
 	int allocatormem[ 4096];
@@ -1552,7 +1571,7 @@ extern "C" bool papuga_schema_parse( papuga_Serialization* dest, papuga_Schema c
 	try
 	{
 		std::vector<RequestElement> request;
-		if (!parseRequest( request, &allocator, doctype, encoding, contentstr, contentlen, err)
+		if (!parseRequest( request, &allocator, doctype, encoding, contentstr, contentlen, borrowed, err)
 		||  !serializeRequest( dest, schema, request, err))
 		{
 			papuga_destroy_Allocator( &allocator);
@@ -1567,5 +1586,15 @@ extern "C" bool papuga_schema_parse( papuga_Serialization* dest, papuga_Schema c
 	return true;
 }
 
+extern "C" bool papuga_schema_parse( papuga_Serialization* dest, papuga_Schema const* schema, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, papuga_SchemaError* err)
+{
+	return schema_parse( dest, schema, doctype, encoding, contentstr, contentlen, false/*borrowed*/, err);
+}
+
+extern "C" bool papuga_schema_parse_borrowed( papuga_Serialization* dest, papuga_Schema const* schema, papuga_ContentType doctype, papuga_StringEncoding encoding, const char* contentstr, size_t contentlen, papuga_SchemaError* err)
+{
+	return schema_parse( dest, schema, doctype, encoding, contentstr, contentlen, true/*borrowed*/, err);
+}
+
 
 
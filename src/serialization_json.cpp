@@ -14,9 +14,13 @@
 #include "papuga/constants.h"
 #include "cjson/cJSON.h"
 #include "requestParser_utils.h"
+#include "contentLimits_utils.hpp"
 #include <cstdlib>
 #include <cstring>
 #include <new>
+#include <vector>
+
+using namespace papuga;
 
 static const char* copyString( papuga_Serialization* self, const char* str)
 {
@@ -25,19 +29,31 @@ static const char* copyString( papuga_Serialization* self, const char* str)
 	return valuestr;
 }
 
-static bool Serialization_append_node( papuga_Serialization* self, const cJSON* nd, bool isDict, int depth, papuga_ErrorCode* errcode)
+namespace {
+/// \brief Node visited in the iterative traversal of a cJSON tree
+struct JsonNodeFrame
+{
+	cJSON const* nd;		///< node visited
+	cJSON const* chnd;		///< next child of the node to visit
+
+	explicit JsonNodeFrame( cJSON const* nd_)
+		:nd(nd_),chnd(nd_->child){}
+};
+}//anonymous namespace
+
+static bool Serialization_enter_node( papuga_Serialization* self, std::vector<JsonNodeFrame>& stk, const cJSON* nd, bool isDict, ContentBudget& budget, papuga_ErrorCode* errcode)
 {
 	bool rt = true;
-	if (depth > PAPUGA_MAX_RECURSION_DEPTH)
-	{
-		*errcode = papuga_MaxRecursionDepthReached;
-		return false;
-	}
+	// ... depth of the element entered, the top level element at depth 1 as in XML
+	if (!budget.checkDepth( stk.size()+1, errcode)) return false;
 	if (isDict && !nd->string)
 	{
 		*errcode = papuga_SyntaxError;
 		return false;
 	}
+	// ... account a name and a value node and the strings copied
+	std::size_t strmemsize = (nd->string ? std::strlen( nd->string)+1 : 0) + (nd->valuestring ? std::strlen( nd->valuestring)+1 : 0);
+	if (!budget.addElements( 1, errcode) || !budget.addMemory( 2*sizeof(papuga_Node) + strmemsize, errcode)) return false;
 	switch (nd->type & 0x7F)
 	{
 		case cJSON_False:
@@ -71,25 +87,45 @@ static bool Serialization_append_node( papuga_Serialization* self, const cJSON*
 		case cJSON_Array:
 		case cJSON_Object:
 		{
-			bool isDictParent = (nd->type & 0x7F) == cJSON_Object;
-			cJSON const* chnd = nd->child;
 			if (nd->string) rt &= papuga_Serialization_pushName_charp( self, copyString( self, nd->string));
 			rt &= papuga_Serialization_pushOpen( self);
-			for (;chnd && rt; chnd = chnd->next)
-			{
-				rt &= Serialization_append_node( self, chnd, isDictParent, depth+1, errcode);
-			}
-			rt &= papuga_Serialization_pushClose( self);
+			stk.push_back( JsonNodeFrame( nd));
 			break;
 		}
 		default:
 			*errcode = papuga_LogicError;
 			return false;
 	}
+	if (!rt) *errcode = papuga_NoMemError;
 	return rt;
 }
 
-static bool Serialization_append_tree( papuga_Serialization* self, const cJSON* nd, bool isDict, int depth, papuga_ErrorCode* errcode)
+static bool Serialization_append_node( papuga_Serialization* self, const cJSON* nd, bool isDict, ContentBudget& budget, papuga_ErrorCode* errcode)
+{
+	std::vector<JsonNodeFrame> stk;
+	if (!Serialization_enter_node( self, stk, nd, isDict, budget, errcode)) return false;
+	while (!stk.empty())
+	{
+		JsonNodeFrame& fr = stk.back();
+		if (!fr.chnd)
+		{
+			if (!papuga_Serialization_pushClose( self))
+			{
+				*errcode = papuga_NoMemError;
+				return false;
+			}
+			stk.pop_back();
+			continue;
+		}
+		cJSON const* chnd = fr.chnd;
+		bool isDictParent = (fr.nd->type & 0x7F) == cJSON_Object;
+		fr.chnd = chnd->next;
+		if (!Serialization_enter_node( self, stk, chnd, isDictParent, budget, errcode)) return false;
+	}
+	return true;
+}
+
+static bool Serialization_append_tree( papuga_Serialization* self, const cJSON* nd, bool isDict, ContentBudget& budget, papuga_ErrorCode* errcode)
 {
 	bool rt = true;
 	if (nd->child)
@@ -99,7 +135,7 @@ static bool Serialization_append_tree( papuga_Serialization* self, const cJSON*
 			cJSON const* chnd = nd->child;
 			for (;chnd && rt; chnd = chnd->next)
 			{
-				rt &= Serialization_append_node( self, chnd, true/*isDict*/, 0/*depth*/, errcode);
+				rt &= Serialization_append_node( self, chnd, true/*isDict*/, budget, errcode);
 			}
 		}
 		catch (const std::bad_alloc&)
@@ -129,8 +165,15 @@ static bool Serialization_append_tree( papuga_Serialization* self, const cJSON*
 }
 
 extern "C" bool papuga_Serialization_append_json( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, papuga_ErrorCode* errcode)
+{
+	return papuga_Serialization_append_json_limits( self, content, contentlen, enc, withRoot, NULL/*limits*/, errcode);
+}
+
+extern "C" bool papuga_Serialization_append_json_limits( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode)
 {
 	bool rt = false;
+	ContentBudget budget( limits);
+	if (!budget.addMemory( contentlen, errcode)) return false;
 	if (enc != papuga_UTF8)
 	{
 		// Convert input to UTF8 as cjson is only capable of parsing UTF8
@@ -164,7 +207,7 @@ extern "C" bool papuga_Serialization_append_json( papuga_Serialization* self, co
 	}
 	else if (withRoot)
 	{
-		rt = Serialization_append_tree( self, tree, true/*isDict*/, 0/*depth*/, errcode);
+		rt = Serialization_append_tree( self, tree, true/*isDict*/, budget, errcode);
 	}
 	else
 	{
@@ -177,7 +220,7 @@ extern "C" bool papuga_Serialization_append_json( papuga_Serialization* self, co
 		}
 		else
 		{
-			rt = Serialization_append_tree( self, tree->child, true/*isDict*/, 0/*depth*/, errcode);
+			rt = Serialization_append_tree( self, tree->child, true/*isDict*/, budget, errcode);
 		}
 	}
 	cJSON_Delete( tree);
@@ -15,6 +15,7 @@
 #include "textwolf/xmlscanner.hpp"
 #include "textwolf/charset.hpp"
 #include "requestParser_utils.h"
+#include "contentLimits_utils.hpp"
 #include <cstdlib>
 #include <cstring>
 #include <string>
@@ -448,9 +449,15 @@ struct TagStack
 };
 
 extern "C" bool papuga_Serialization_append_xml( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, bool ignoreEmptyContent, papuga_ErrorCode* errcode)
+{
+	return papuga_Serialization_append_xml_limits( self, content, contentlen, enc, withRoot, ignoreEmptyContent, NULL/*limits*/, errcode);
+}
+
+extern "C" bool papuga_Serialization_append_xml_limits( papuga_Serialization* self, const char* content, size_t contentlen, papuga_StringEncoding enc, bool withRoot, bool ignoreEmptyContent, const papuga_ContentLimits* limits, papuga_ErrorCode* errcode)
 {
 	Structure currentStruct( errcode);
 	TagStack tagStack( errcode);
+	papuga::ContentBudget budget( limits);
 
 	textwolf::SrcIterator srciter;
 	XMLScanner scanner;
@@ -466,6 +473,11 @@ extern "C" bool papuga_Serialization_append_xml( papuga_Serialization* self, con
 		content = papuga_ValueVariant_tostring( &val, self->allocator, &contentlen, errcode);
 		if (!content) return false;
 	}
+	if (!budget.addMemory( contentlen, errcode))
+	{
+		// ... shed oversized content before scanning it
+		return false;
+	}
 	if (content[contentlen] != 0)
 	{
 		content = papuga_Allocator_copy_string( self->allocator, content, contentlen);
@@ -494,6 +506,10 @@ extern "C" bool papuga_Serialization_append_xml( papuga_Serialization* self, con
 
 			int valsize = itr->size();
 			const char* valstr = "";
+			if (!budget.addElements( 1, errcode) || !budget.addMemory( valsize + sizeof(papuga_Node), errcode))
+			{
+				return false;
+			}
 			if (itr->size() > 0)
 			{
 				valstr = papuga_Allocator_copy_string( self->allocator, itr->content(), itr->size());
@@ -541,7 +557,7 @@ extern "C" bool papuga_Serialization_append_xml( papuga_Serialization* self, con
 				{
 					rt &= currentStruct.flushStructure( self);
 					rt &= tagStack.push( valstr, valsize);
-					if (!rt) return false;
+					if (!rt || !budget.checkDepth( tagStack.m_depth, errcode)) return false;
 					if (tagStack.flags().isEndOfArray)
 					{
 						rt &= papuga_Serialization_pushClose( self);
@@ -191,14 +191,75 @@ static void reportRequestError( papuga_ErrorBuffer& errorbuf, const papuga_Reque
 	}
 }
 
+static bool appendRequestResults( const papuga_Request* request, const papuga_RequestResult* results, int nofResults, papuga_ContentType doctype, papuga_StringEncoding encoding, papuga_Allocator* allocator, std::string& resultblob, papuga_ErrorCode& errcode)
+{
+	const papuga_StructInterfaceDescription* structdefs = papuga_Request_struct_descriptions( request);
+	int ri=0;
+	for (; ri != nofResults; ++ri)
+	{
+		papuga_ValueVariant resultval;
+		papuga_init_ValueVariant_serialization( &resultval, const_cast<papuga_Serialization*>( &results[ ri].serialization));
+		const char* rootname = results[ri].name;
+		char* resstr = 0;
+		std::size_t reslen = 0;
+
+		// Map the result:
+		switch (doctype)
+		{
+			case papuga_ContentType_XML:  resstr = (char*)papuga_ValueVariant_toxml( &resultval, allocator, structdefs, encoding, true/*beautified*/, rootname, 0, &reslen, &errcode); break;
+			case papuga_ContentType_JSON: resstr = (char*)papuga_ValueVariant_tojson( &resultval, allocator, structdefs, encoding, true/*beautified*/, rootname, 0, &reslen, &errcode); break;
+			case papuga_ContentType_Unknown:
+			default: break;
+		}
+		if (!resstr) return false;
+		resultblob.append( resstr, reslen);
+	}
+	return true;
+}
+
+static void appendContextDump( const papuga_RequestContext* ctx, const papuga_Request* request, papuga_Allocator* allocator, std::string* contextdump)
+{
+	if (!contextdump) return;
+	const char* dump = papuga_RequestContext_debug_tostring( ctx, allocator, const_cast<papuga_StructInterfaceDescription*>( papuga_Request_struct_descriptions( request)));
+	if (dump) contextdump->append( dump);
+}
+
+static void reportFeedError( papuga_ErrorBuffer& errorbuf, papuga_RequestParser* parser, papuga_ErrorCode errcode)
+{
+	char buf[ 2048];
+	int pos = papuga_RequestParser_get_position( parser, buf, sizeof(buf));
+	if (pos >= 0)
+	{
+		papuga_ErrorBuffer_reportError( &errorbuf, "error feeding request at position %d: %s, location: %s", pos, papuga_ErrorCode_tostring( errcode), buf);
+	}
+	else
+	{
+		papuga_ErrorBuffer_reportError( &errorbuf, "error feeding request: %s, location: %s", papuga_ErrorCode_tostring( errcode), buf);
+	}
+}
+
+static bool defineRequestVariables( papuga_RequestContext* ctx, const RequestVariable* variables)
+{
+	RequestVariable const* vi = variables;
+	if (vi) for (; vi->name; ++vi)
+	{
+		papuga_ValueVariant value;
+		papuga_init_ValueVariant_charp( &value, vi->value);
+		if (!papuga_RequestContext_define_variable( ctx, vi->name, &value)) return false;
+	}
+	return true;
+}
+
 bool papuga_execute_request(
 			const papuga_RequestAutomaton* atm,
 			papuga_ContentType doctype,
 			papuga_StringEncoding encoding,
 			const std::string& doc,
 			const RequestVariable* variables,
+			papuga_RequestThreadPool* pool,
 			std::string& resultblob,
-			std::string& logout)
+			std::string& logout,
+			std::string* contextdump)
 {
 	bool rt = true;
 	char content_mem[ 4096];
@@ -208,12 +269,12 @@ bool papuga_execute_request(
 	papuga_Request* request = 0;
 	papuga_RequestParser* parser = 0;
 	papuga_RequestContext* ctx = 0;
-	RequestVariable const* vi;
 	LoggerContext logctx;
 	char* resstr = 0;
 	std::size_t reslen = 0;
 	papuga_Allocator allocator;
-	const char* rootname = 0;
+	papuga_RequestResult* results;
+	int nofResults;
 
 	papuga_init_Allocator( &allocator, content_mem, sizeof(content_mem));
 	papuga_RequestLogger logger = {&logctx, &logMethodCall, &logContentEvent};
@@ -232,16 +293,7 @@ bool papuga_execute_request(
 	// Parse the request document and feed it to the request:
 	if (!papuga_RequestParser_feed_request( parser, request, &errstruct.errcode))
 	{
-		char buf[ 2048];
-		int pos = papuga_RequestParser_get_position( parser, buf, sizeof(buf));
-		if (pos >= 0)
-		{
-			papuga_ErrorBuffer_reportError( &errorbuf, "error feeding request at position %d: %s, location: %s", pos, papuga_ErrorCode_tostring( errstruct.errcode), buf);
-		}
-		else
-		{
-			papuga_ErrorBuffer_reportError( &errorbuf, "error feeding request: %s, location: %s", papuga_ErrorCode_tostring( errstruct.errcode), buf);
-		}
+		reportFeedError( errorbuf, parser, errstruct.errcode);
 		resstr = papuga_ErrorBuffer_lastError(&errorbuf);
 		reslen = std::strlen( resstr);
 		resultblob.append( resstr, reslen);
@@ -249,51 +301,132 @@ bool papuga_execute_request(
 		goto RELEASE;
 	}
 	// Add variables to the request:
-	vi = variables;
-	if (vi) for (; vi->name; ++vi)
+	if (!defineRequestVariables( ctx, variables))
 	{
-		papuga_ValueVariant value;
-		papuga_init_ValueVariant_charp( &value, vi->value);
-		if (!papuga_RequestContext_define_variable( ctx, vi->name, &value))
+		errstruct.errcode = papuga_NoMemError;
+		goto ERROR;
+	}
+	// Execute the request and initialize the result:
+	if (pool)
+	{
+		if (!papuga_RequestContext_execute_request_parallel( ctx, request, &allocator, &logger, pool, &results, &nofResults, &errstruct))
 		{
-			errstruct.errcode = papuga_NoMemError;
 			goto ERROR;
 		}
 	}
-	// Execute the request and initialize the result:
-	papuga_RequestResult* results;
-	int nofResults;
-	if (!papuga_RequestContext_execute_request( ctx, request, &allocator, &logger, &results, &nofResults, &errstruct))
+	else if (!papuga_RequestContext_execute_request( ctx, request, &allocator, &logger, &results, &nofResults, &errstruct))
 	{
 		goto ERROR;
 	}
+	if (!appendRequestResults( request, results, nofResults, doctype, encoding, &allocator, resultblob, errstruct.errcode)) goto ERROR;
+	appendContextDump( ctx, request, &allocator, contextdump);
+	goto RELEASE;
+ERROR:
+	rt = false;
+	reportRequestError( errorbuf, errstruct, doctype, encoding, doc);
+	resstr = papuga_ErrorBuffer_lastError(&errorbuf);
+	reslen = std::strlen( resstr);
+	resultblob.append( resstr, reslen);
+RELEASE:
+	// ... the log contains the calls applied before a failure too
+	try
 	{
-		const papuga_StructInterfaceDescription* structdefs = papuga_Request_struct_descriptions( request);
-		int ri=0;
-		for (; ri != nofResults; ++ri)
-		{
-			papuga_ValueVariant resultval;
-			papuga_init_ValueVariant_serialization( &resultval, &results[ ri].serialization);
-			rootname = results[ri].name;
+		logout.append( logctx.out.str());
+	}
+	catch (const std::bad_alloc&)
+	{}
+	if (ctx) papuga_destroy_RequestContext( ctx);
+	if (parser) papuga_destroy_RequestParser( parser);
+	if (request) papuga_destroy_Request( request);
+	papuga_destroy_Allocator( &allocator);
+	return rt;
+}
 
-			// Map the result:
-			switch (doctype)
-			{
-				case papuga_ContentType_XML:  resstr = (char*)papuga_ValueVariant_toxml( &resultval, &allocator, structdefs, encoding, true/*beautified*/, rootname, 0, &reslen, &errstruct.errcode); break;
-				case papuga_ContentType_JSON: resstr = (char*)papuga_ValueVariant_tojson( &resultval, &allocator, structdefs, encoding, true/*beautified*/, rootname, 0, &reslen, &errstruct.errcode); break;
-				case papuga_ContentType_Unknown:
-				default: break;
-			}
-			if (!resstr) goto ERROR;
-			resultblob.append( resstr, reslen);
-		}
-		try
+bool papuga_execute_request_streaming(
+			const papuga_RequestAutomaton* atm,
+			papuga_ContentType doctype,
+			papuga_StringEncoding encoding,
+			const std::string& doc,
+			const RequestVariable* variables,
+			std::string& resultblob,
+			std::string& logout,
+			std::string* contextdump)
+{
+	bool rt = true;
+	char content_mem[ 4096];
+	char errbuf_mem[ 4096];
+	papuga_ErrorBuffer errorbuf;
+	papuga_RequestError errstruct;
+	papuga_Request* request = 0;
+	papuga_RequestParser* parser = 0;
+	papuga_RequestIterator* itr = 0;
+	papuga_RequestContext* ctx = 0;
+	LoggerContext logctx;
+	char* resstr = 0;
+	std::size_t reslen = 0;
+	papuga_Allocator allocator;
+	papuga_RequestParserEvent event;
+	papuga_RequestResult* results;
+	int nofResults;
+
+	papuga_init_Allocator( &allocator, content_mem, sizeof(content_mem));
+	papuga_RequestLogger logger = {&logctx, &logMethodCall, &logContentEvent};
+	std::memset( &errstruct, 0, sizeof(errstruct));
+
+	// Init output:
+	papuga_init_ErrorBuffer( &errorbuf, errbuf_mem, sizeof(errbuf_mem));
+
+	// Init locals, the variables have to be defined before the first call is executed:
+	ctx = papuga_create_RequestContext();
+	if (!ctx) {errstruct.errcode = papuga_NoMemError; goto ERROR;}
+	if (!defineRequestVariables( ctx, variables)) {errstruct.errcode = papuga_NoMemError; goto ERROR;}
+	parser = papuga_create_RequestParser( &allocator, doctype, encoding, doc.c_str(), doc.size(), &errstruct.errcode);
+	if (!parser) goto ERROR;
+	request = papuga_create_Request( atm, &logger);
+	if (!request) {errstruct.errcode = papuga_NoMemError; goto ERROR;}
+	itr = papuga_create_RequestIterator_streaming( &allocator, request, &errstruct.errcode);
+	if (!itr) goto ERROR;
+
+	// Feed the request document element by element and execute the calls ready after each element:
+	while (0 < papuga_RequestParser_next_events( parser, &event, 1))
+	{
+		if (!papuga_Request_feed_events( request, &event, 1))
 		{
-			logout.append( logctx.out.str());
+			errstruct.errcode = papuga_Request_last_error( request);
+			reportFeedError( errorbuf, parser, errstruct.errcode);
+			goto FEED_ERROR;
 		}
-		catch (const std::bad_alloc&)
-		{}
+		if (!papuga_RequestContext_execute_ready_calls( ctx, request, itr, &allocator, &logger, &errstruct)) goto ERROR;
+	}
+	errstruct.errcode = papuga_RequestParser_last_error( parser);
+	if (errstruct.errcode != papuga_Ok)
+	{
+		reportFeedError( errorbuf, parser, errstruct.errcode);
+		goto FEED_ERROR;
+	}
+	if (!papuga_Request_feed_close_tag( request) || !papuga_Request_done( request))
+	{
+		errstruct.errcode = papuga_Request_last_error( request);
+		reportFeedError( errorbuf, parser, errstruct.errcode);
+		goto FEED_ERROR;
 	}
+	// Execute the calls left and initialize the result:
+	if (!papuga_RequestContext_execute_ready_calls( ctx, request, itr, &allocator, &logger, &errstruct)) goto ERROR;
+	if (!papuga_RequestContext_finish_request( ctx, itr, &allocator, &results, &nofResults, &errstruct)) goto ERROR;
+	if (!appendRequestResults( request, results, nofResults, doctype, encoding, &allocator, resultblob, errstruct.errcode)) goto ERROR;
+	appendContextDump( ctx, request, &allocator, contextdump);
+	try
+	{
+		logout.append( logctx.out.str());
+	}
+	catch (const std::bad_alloc&)
+	{}
+	goto RELEASE;
+FEED_ERROR:
+	rt = false;
+	resstr = papuga_ErrorBuffer_lastError(&errorbuf);
+	reslen = std::strlen( resstr);
+	resultblob.append( resstr, reslen);
 	goto RELEASE;
 ERROR:
 	rt = false;
@@ -302,6 +435,7 @@ ERROR:
 	reslen = std::strlen( resstr);
 	resultblob.append( resstr, reslen);
 RELEASE:
+	if (itr) papuga_destroy_RequestIterator( itr);
 	if (ctx) papuga_destroy_RequestContext( ctx);
 	if (parser) papuga_destroy_RequestParser( parser);
 	if (request) papuga_destroy_Request( request);
@@ -309,4 +443,61 @@ RELEASE:
 	return rt;
 }
 
+bool papuga_execute_parsed_request(
+			papuga_Request* request,
+			papuga_ContentType doctype,
+			papuga_StringEncoding encoding,
+			const std::string& doc,
+			const RequestVariable* variables,
+			std::string& resultblob,
+			std::string& logout,
+			std::string* contextdump)
+{
+	bool rt = true;
+	char content_mem[ 4096];
+	char errbuf_mem[ 4096];
+	papuga_ErrorBuffer errorbuf;
+	papuga_RequestError errstruct;
+	papuga_RequestContext* ctx = 0;
+	LoggerContext logctx;
+	char* resstr = 0;
+	std::size_t reslen = 0;
+	papuga_Allocator allocator;
+	papuga_RequestResult* results;
+	int nofResults;
+
+	papuga_init_Allocator( &allocator, content_mem, sizeof(content_mem));
+	papuga_RequestLogger logger = {&logctx, &logMethodCall, &logContentEvent};
+	std::memset( &errstruct, 0, sizeof(errstruct));
+
+	// Init output:
+	papuga_init_ErrorBuffer( &errorbuf, errbuf_mem, sizeof(errbuf_mem));
+
+	// Init locals:
+	ctx = papuga_create_RequestContext();
+	if (!ctx) {errstruct.errcode = papuga_NoMemError; goto ERROR;}
+	if (!defineRequestVariables( ctx, variables)) {errstruct.errcode = papuga_NoMemError; goto ERROR;}
+
+	// Execute the request and initialize the result:
+	if (!papuga_RequestContext_execute_request( ctx, request, &allocator, &logger, &results, &nofResults, &errstruct)) goto ERROR;
+	if (!appendRequestResults( request, results, nofResults, doctype, encoding, &allocator, resultblob, errstruct.errcode)) goto ERROR;
+	appendContextDump( ctx, request, &allocator, contextdump);
+	try
+	{
+		logout.append( logctx.out.str());
+	}
+	catch (const std::bad_alloc&)
+	{}
+	goto RELEASE;
+ERROR:
+	rt = false;
+	reportRequestError( errorbuf, errstruct, doctype, encoding, doc);
+	resstr = papuga_ErrorBuffer_lastError(&errorbuf);
+	reslen = std::strlen( resstr);
+	resultblob.append( resstr, reslen);
+RELEASE:
+	if (ctx) papuga_destroy_RequestContext( ctx);
+	papuga_destroy_Allocator( &allocator);
+	return rt;
+}
 
@@ -18,14 +18,44 @@ struct RequestVariable
 	const char* value;
 };
 
+/// \param[in] pool threads executing independent method calls in parallel, NULL for executing the request sequentially
+/// \param[out] logout where to append the log of the calls applied, also of the ones applied before a failure
+/// \param[out] contextdump where to append the dump of the context after the request or NULL
 bool papuga_execute_request(
 		const papuga_RequestAutomaton* atm,
 		papuga_ContentType doctype,
 		papuga_StringEncoding encoding,
 		const std::string& doc,
 		const RequestVariable* variables,
+		papuga_RequestThreadPool* pool,
 		std::string& resultblob,
-		std::string& logout);
+		std::string& logout,
+		std::string* contextdump=0);
+
+/// \brief Execute a request fed element by element, executing the calls ready after each element
+/// \param[out] contextdump where to append the dump of the context after the request or NULL
+bool papuga_execute_request_streaming(
+		const papuga_RequestAutomaton* atm,
+		papuga_ContentType doctype,
+		papuga_StringEncoding encoding,
+		const std::string& doc,
+		const RequestVariable* variables,
+		std::string& resultblob,
+		std::string& logout,
+		std::string* contextdump=0);
+
+/// \brief Execute a request already fed, e.g. parsed from a batch of documents
+/// \param[in] doc document the request was fed with, for error messages
+/// \param[out] contextdump where to append the dump of the context after the request or NULL
+bool papuga_execute_parsed_request(
+		papuga_Request* request,
+		papuga_ContentType doctype,
+		papuga_StringEncoding encoding,
+		const std::string& doc,
+		const RequestVariable* variables,
+		std::string& resultblob,
+		std::string& logout,
+		std::string* contextdump=0);
 
 #endif
 
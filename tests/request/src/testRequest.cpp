@@ -8,6 +8,8 @@
 #include "papuga.hpp"
 #include "document.hpp"
 #include "execRequest.hpp"
+#include "papuga/requestBatch.h"
+#include "papuga/requestResult.h"
 #include <string>
 #include <cstring>
 #include <cstdlib>
@@ -17,10 +19,15 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
 
 #undef PAPUGA_LOWLEVEL_DEBUG
 
 std::string g_call_dump;
+std::mutex g_call_dump_mutex;	//... methods are called from several threads in parallel requests
 
 static void LOG_METHOD_CALL( const char* classname, const char* methodname, size_t argc, const papuga_ValueVariant* argv)
 {
@@ -41,6 +48,7 @@ static void LOG_METHOD_CALL( const char* classname, const char* methodname, size
 		}
 	}
 	out << ");\n";
+	std::lock_guard<std::mutex> lock( g_call_dump_mutex);
 	g_call_dump.append( out.str());
 }
 
@@ -89,13 +97,38 @@ static std::string mapDocument( const papuga::test::Document& doc, papuga_String
 class ObjectC1
 {
 public:
-	ObjectC1(){}
+	ObjectC1() :accesscnt(0){}
+	std::atomic<int> accesscnt;	//< number of method calls accessing the object
+};
+
+/// \brief Guard marking an object as accessed by a method call, detecting method calls accessing the same object at the same time
+class ObjectC1Access
+{
+public:
+	explicit ObjectC1Access( ObjectC1* obj_)
+		:m_obj(obj_),m_conflict(m_obj->accesscnt++ != 0){}
+	~ObjectC1Access()
+	{
+		--m_obj->accesscnt;
+	}
+	bool conflict() const
+	{
+		return m_conflict;
+	}
+private:
+	ObjectC1* m_obj;
+	bool m_conflict;
 };
 class ObjectC2
 {
 public:
 	ObjectC2(){}
 };
+class ObjectC3
+{
+public:
+	ObjectC3(){}
+};
 
 enum ConversionId {Ident,ToLower,ToUpper};
 static bool convertValueVariant( papuga_ValueVariant* dest, const papuga_ValueVariant* src, papuga_Allocator* allocator, ConversionId convId, papuga_ErrorCode* errcode)
@@ -112,6 +145,7 @@ static bool convertValueVariant( papuga_ValueVariant* dest, const papuga_ValueVa
 			switch (convId)
 			{
 				case Ident:
+					papuga_init_ValueVariant_value( dest, src);
 					break;
 				case ToLower:
 				{
@@ -221,14 +255,64 @@ static bool method_C1M3( void* self, papuga_CallResult* retval, size_t argc, con
 	LOG_METHOD_CALL( "C1", "m3", argc, argv);
 	return impl_method( "C1::m2", retval, argc, argv, Ident);
 }
-enum {methodtable_size_C1=3};
+/// \brief Method accessing the object called and the objects passed as arguments for a while, failing if another call accesses one of them at the same time
+static bool method_C1M4( void* self, papuga_CallResult* retval, size_t argc, const papuga_ValueVariant* argv)
+{
+	LOG_METHOD_CALL( "C1", "m4", argc, argv);
+	std::vector<ObjectC1Access*> accesslist;
+	accesslist.push_back( new ObjectC1Access( (ObjectC1*)self));
+	std::vector<papuga_ValueVariant> values;
+	size_t ai = 0, ae = argc;
+	for (; ai != ae; ++ai)
+	{
+		if (argv[ai].valuetype == papuga_TypeHostObject && argv[ai].value.hostObject->classid == 1)
+		{
+			accesslist.push_back( new ObjectC1Access( (ObjectC1*)argv[ai].value.hostObject->data));
+		}
+		else
+		{
+			values.push_back( argv[ai]);
+		}
+	}
+	std::this_thread::sleep_for( std::chrono::milliseconds( 20));
+	bool conflict = false;
+	std::vector<ObjectC1Access*>::iterator li = accesslist.begin(), le = accesslist.end();
+	for (; li != le; ++li)
+	{
+		conflict |= (*li)->conflict();
+		delete *li;
+	}
+	if (conflict)
+	{
+		papuga_CallResult_reportError( retval, "error in method %s: %s", "C1::m4", "object accessed by another call at the same time");
+		return false;
+	}
+	return impl_method( "C1::m4", retval, values.size(), values.empty() ? NULL : &values[0], Ident);
+}
+/// \brief Method always failing
+static bool method_C1M5( void* self, papuga_CallResult* retval, size_t argc, const papuga_ValueVariant* argv)
+{
+	LOG_METHOD_CALL( "C1", "m5", argc, argv);
+	papuga_CallResult_reportError( retval, "error in method %s: %s", "C1::m5", "failed");
+	return false;
+}
+/// \brief Method always throwing an exception
+static bool method_C1M6( void* self, papuga_CallResult* retval, size_t argc, const papuga_ValueVariant* argv)
+{
+	LOG_METHOD_CALL( "C1", "m6", argc, argv);
+	throw std::runtime_error( "error in method C1::m6: thrown");
+}
+enum {methodtable_size_C1=6};
 static papuga_ClassMethod methodtable_C1[ methodtable_size_C1] = {
 	&method_C1M1,
 	&method_C1M2,
-	&method_C1M3
+	&method_C1M3,
+	&method_C1M4,
+	&method_C1M5,
+	&method_C1M6
 };
 static const char* methodnames_C1[ methodtable_size_C1] = {
-	"M1","M2","M3"
+	"M1","M2","M3","M4","M5","M6"
 };
 static void destructor_C2( void* self)
 {
@@ -259,17 +343,76 @@ static papuga_ClassMethod methodtable_C2[ methodtable_size_C2] = {
 static const char* methodnames_C2[ methodtable_size_C2] = {
 	"M1","M2","M3"
 };
+static void* constructor_C3( papuga_ErrorBuffer* errbuf, size_t argc, const papuga_ValueVariant* argv)
+{
+	LOG_METHOD_CALL( "C3", "new", argc, argv);
+	return new ObjectC3();
+}
+static void destructor_C3( void* self)
+{
+	LOG_METHOD_CALL( "C3", "delete", 0, 0);
+	delete (ObjectC3*)self;
+}
+static bool method_C3M1( void* self, papuga_CallResult* retval, size_t argc, const papuga_ValueVariant* argv)
+{
+	LOG_METHOD_CALL( "C3", "m1", argc, argv);
+	return impl_method( "C3::m1", retval, argc, argv, ToUpper);
+}
+static bool method_C3M2( void* self, papuga_CallResult* retval, size_t argc, const papuga_ValueVariant* argv)
+{
+	LOG_METHOD_CALL( "C3", "m2", argc, argv);
+	return impl_method( "C3::m2", retval, argc, argv, Ident);
+}
+/// \brief Batched version of C3::m1, failing at the first call with an argument "fail"
+static size_t batchmethod_C3M1( void* self, papuga_CallResult* retvalar, size_t nofcalls, const size_t* argcar, const papuga_ValueVariant* const* argvar)
+{
+	{
+		std::ostringstream out;
+		out << "executing batch C3::m1 of " << nofcalls << " calls;\n";
+		std::lock_guard<std::mutex> lock( g_call_dump_mutex);
+		g_call_dump.append( out.str());
+	}
+	size_t ci = 0;
+	for (; ci != nofcalls; ++ci)
+	{
+		LOG_METHOD_CALL( "C3", "m1", argcar[ ci], argvar[ ci]);
+		for (size_t ai = 0; ai != argcar[ ci]; ++ai)
+		{
+			papuga_ErrorCode errcode = papuga_Ok;
+			if (papuga::ValueVariant_tostring( argvar[ ci][ ai], errcode) == "fail")
+			{
+				papuga_CallResult_reportError( &retvalar[ ci], "error in method %s: %s", "C3::m1", "failed");
+				return ci;
+			}
+		}
+		if (!impl_method( "C3::m1", &retvalar[ ci], argcar[ ci], argvar[ ci], ToUpper)) return ci;
+	}
+	return ci;
+}
+enum {methodtable_size_C3=2};
+static papuga_ClassMethod methodtable_C3[ methodtable_size_C3] = {
+	&method_C3M1,
+	&method_C3M2
+};
+static const papuga_ClassMethodBatch batchmethodtable_C3[ methodtable_size_C3] = {
+	&batchmethod_C3M1,
+	NULL
+};
+static const char* methodnames_C3[ methodtable_size_C3] = {
+	"M1","M2"
+};
 
 enum {nof_structdefs=0};
 papuga_StructInterfaceDescription g_structdefs[ nof_structdefs+1] = {
 	{NULL/*name*/,NULL/*doc*/,NULL/*members*/}
 };
 
-enum {nof_classdefs=2};
+enum {nof_classdefs=3};
 static const papuga_ClassDef g_classdefs[ nof_classdefs+1] = {
-	{"C1",constructor_C1,destructor_C1,methodtable_C1,methodnames_C1,methodtable_size_C1},
-	{"C2",		NULL,destructor_C2,methodtable_C2,methodnames_C2,methodtable_size_C2},
-	{NULL,NULL,NULL,NULL,NULL,0}
+	{"C1",constructor_C1,destructor_C1,methodtable_C1,methodnames_C1,methodtable_size_C1,NULL,NULL,NULL},
+	{"C2",		NULL,destructor_C2,methodtable_C2,methodnames_C2,methodtable_size_C2,NULL,NULL,NULL},
+	{"C3",constructor_C3,destructor_C3,methodtable_C3,methodnames_C3,methodtable_size_C3,batchmethodtable_C3,NULL,NULL},
+	{NULL,NULL,NULL,NULL,NULL,0,NULL,NULL,NULL}
 };
 
 struct C1
@@ -278,6 +421,9 @@ struct C1
 	static papuga_RequestMethodId m1() {papuga_RequestMethodId rt = {1,1}; return rt;}
 	static papuga_RequestMethodId m2() {papuga_RequestMethodId rt = {1,2}; return rt;}
 	static papuga_RequestMethodId m3() {papuga_RequestMethodId rt = {1,3}; return rt;}
+	static papuga_RequestMethodId m4() {papuga_RequestMethodId rt = {1,4}; return rt;}
+	static papuga_RequestMethodId m5() {papuga_RequestMethodId rt = {1,5}; return rt;}
+	static papuga_RequestMethodId m6() {papuga_RequestMethodId rt = {1,6}; return rt;}
 };
 struct C2
 {
@@ -285,6 +431,12 @@ struct C2
 	static papuga_RequestMethodId m2() {papuga_RequestMethodId rt = {2,2}; return rt;}
 	static papuga_RequestMethodId m3() {papuga_RequestMethodId rt = {2,3}; return rt;}
 };
+struct C3
+{
+	static papuga_RequestMethodId constructor() {papuga_RequestMethodId rt = {3,0}; return rt;}
+	static papuga_RequestMethodId m1() {papuga_RequestMethodId rt = {3,1}; return rt;}
+	static papuga_RequestMethodId m2() {papuga_RequestMethodId rt = {3,2}; return rt;}
+};
 
 enum
 {
@@ -296,11 +448,15 @@ enum
 	TreeNode,
 	TreeNodeValue,
 	TreeNodeLeft,
-	TreeNodeRight
+	TreeNodeRight,
+	TownName,
+	ElementId,
+	BatchKey,
+	BatchValue
 };
 static const char* itemName( int itemid)
 {
-	static const char* ar[] = {"VoidItem","PersonName","PersonContent","CityName","CityList","TreeNode","TreeNodeValue","TreeNodeLeft","TreeNodeRight",0};
+	static const char* ar[] = {"VoidItem","PersonName","PersonContent","CityName","CityList","TreeNode","TreeNodeValue","TreeNodeLeft","TreeNodeRight","TownName","ElementId","BatchKey","BatchValue",0};
 	return ar[ itemid];
 }
 
@@ -313,8 +469,9 @@ struct TestData
 	const RequestVariable* var;
 	const char** calls;
 	papuga::test::Document* expected;
+	const char* error;		//< error expected instead of the result or NULL
 
-	TestData() :description(0),doc(0),atm(0),var(0),calls(0),expected(0){}
+	TestData() :description(0),doc(0),atm(0),var(0),calls(0),expected(0),error(0){}
 	~TestData()
 	{
 		if (doc) delete doc;
@@ -803,6 +960,135 @@ static TestData* createTestData_6()
 	return data;
 }
 
+static TestData* createTestData_7()
+{
+	TestData* data = new TestData();
+	data->description = "parallel calls, object passed as argument";
+	data->doc = new papuga::test::Document(
+		"doc", {
+			{"city", {{"Bern"}}},
+			{"town", {{"Biel"}}}
+			}
+		);
+	data->atm = new papuga::RequestAutomaton(
+		g_classdefs, g_structdefs, itemName, true/*strict*/, false/*exclusive*/,
+		{/*env*/},
+		{/*result*/
+			{"list", { {"/doc/city", "city", "city", '!'},{"/doc/town", "town", "town", '!'} }}
+		},
+		{/*inherit*/},
+		{
+			{"/doc/city", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc/town", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc", "obj", 0, C1::constructor(), {} },
+			{"/doc", "arg", 0, C1::constructor(), {} },
+			// ... the call on the object passed as argument to the call before must not be executed at the same time
+			{"/doc/city", "city", "obj", C1::m4(), {{"arg"},{(int)CityName}} },
+			{"/doc/town", "town", "arg", C1::m4(), {{(int)CityName}} }
+		});
+	static const char* expected_calls[] = {
+		"executing method C1::new();",
+		"executing method C1::new();",
+		"executing method C1::m4( <HostObject>, 'Bern');",
+		"executing method C1::m4( 'Biel');",
+		"executing method C1::delete();",
+		"executing method C1::delete();",
+		"EV open tag -1 'doc'",
+		"EV open tag -1 'city'",
+		"EV content value -1 'Bern'",
+		"EV instantiate 3 'Bern'",
+		"EV close tag -1 ''",
+		"EV collect 3 'Bern'",
+		"EV open tag -1 'town'",
+		"EV content value -1 'Biel'",
+		"EV instantiate 3 'Biel'",
+		"EV close tag -1 ''",
+		"EV collect 3 'Biel'",
+		"EV close tag -1 ''",
+		"EV close tag -1 ''",
+		"C1 0  obj <HostObject>",
+		"C1 0  arg <HostObject>",
+		"EV resolved required 3 'Bern'",
+		"C1 M4 2 <HostObject> Bern city Bern",
+		"EV resolved required 3 'Biel'",
+		"C1 M4 1 Biel town Biel",
+		0};
+	data->calls = expected_calls;
+	data->expected = new papuga::test::Document(
+		"list", {
+			{"city", {{"Bern"}} },
+			{"town", {{"Biel"}} }
+			}
+		);
+	return data;
+}
+
+static TestData* createTestData_8()
+{
+	TestData* data = new TestData();
+	data->description = "calls on different objects, one failing";
+	data->doc = new papuga::test::Document(
+		"doc", {
+			{"city", {{"Bern"}}},
+			{"town", {{"Biel"}}},
+			{"village", {{"Thun"}}}
+			}
+		);
+	data->atm = new papuga::RequestAutomaton(
+		g_classdefs, g_structdefs, itemName, true/*strict*/, false/*exclusive*/,
+		{/*env*/},
+		{/*result*/
+			{"list", { {"/doc/city", "city", "city", '!'},{"/doc/town", "town", "town", '!'},{"/doc/village", "village", "village", '!'} }}
+		},
+		{/*inherit*/},
+		{
+			{"/doc/city", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc/town", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc/village", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc", "obj1", 0, C1::constructor(), {} },
+			{"/doc", "obj2", 0, C1::constructor(), {} },
+			{"/doc", "obj3", 0, C1::constructor(), {} },
+			{"/doc/city", "city", "obj1", C1::m4(), {{(int)CityName}} },
+			{"/doc/town", "town", "obj2", C1::m5(), {{(int)CityName}} },
+			{"/doc/village", "village", "obj3", C1::m4(), {{(int)CityName}} }
+		});
+	data->error = "error executing host object method in method C1::M5 argument 0 accessing variable 'obj2' message: error in method C1::m5: failed";
+	return data;
+}
+
+static TestData* createTestData_9()
+{
+	TestData* data = new TestData();
+	data->description = "calls on different objects, one throwing an exception";
+	data->doc = new papuga::test::Document(
+		"doc", {
+			{"city", {{"Bern"}}},
+			{"town", {{"Biel"}}},
+			{"village", {{"Thun"}}}
+			}
+		);
+	data->atm = new papuga::RequestAutomaton(
+		g_classdefs, g_structdefs, itemName, true/*strict*/, false/*exclusive*/,
+		{/*env*/},
+		{/*result*/
+			{"list", { {"/doc/city", "city", "city", '!'},{"/doc/town", "town", "town", '!'},{"/doc/village", "village", "village", '!'} }}
+		},
+		{/*inherit*/},
+		{
+			{"/doc/city", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc/town", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc/village", "()", (int)CityName, papuga_TypeString, "Berlin"},
+			{"/doc", "obj1", 0, C1::constructor(), {} },
+			{"/doc", "obj2", 0, C1::constructor(), {} },
+			{"/doc", "obj3", 0, C1::constructor(), {} },
+			{"/doc/city", "city", "obj1", C1::m4(), {{(int)CityName}} },
+			{"/doc/town", "town", "obj2", C1::m6(), {{(int)CityName}} },
+			{"/doc/village", "village", "obj3", C1::m4(), {{(int)CityName}} }
+		});
+	data->error = "uncaught exception message: error in method C1::m6: thrown";
+	return data;
+}
+
 static createTestDataFunction g_tests[] = {
 	&createTestData_1,
 	&createTestData_2,
@@ -810,6 +1096,9 @@ static createTestDataFunction g_tests[] = {
 	&createTestData_4,
 	&createTestData_5,
 	&createTestData_6,
+	&createTestData_7,
+	&createTestData_8,
+	&createTestData_9,
 	NULL};
 
 struct TestSet
@@ -831,16 +1120,121 @@ static const TestSet testsets[] = {
 	{papuga_UTF8,papuga_ContentType_Unknown}
 };
 
-static void executeTest( int tidx, const TestData& test)
+static papuga_RequestThreadPool* g_threadpool = 0;
+
+/// \brief Output of a request executed
+struct RequestOutput
+{
+	bool success;
+	std::string resout;
+	std::string logout;
+	std::string calldump;
+	std::string contextdump;
+
+	RequestOutput() :success(false),resout(),logout(),calldump(),contextdump(){}
+};
+
+/// \brief Map the output of a request to a form independent of the order of execution of the calls
+/// \note Methods are executed in any order and the calls are fetched ahead in a request executed in parallel, calls are executed while the content is fed in a request executed streaming, the log of the calls applied is kept in the order of the request
+static std::string mapUnorderedOutput( const std::string& calldump, const std::string& logout)
+{
+	std::vector<std::string> methodcalls;
+	std::vector<std::string> events;
+	std::string calls;
+	std::istringstream callstream( calldump);
+	std::string line;
+	while (std::getline( callstream, line)) methodcalls.push_back( line);
+	std::istringstream logstream( logout);
+	while (std::getline( logstream, line))
+	{
+		if (0==std::strncmp( line.c_str(), "EV ", 3))
+		{
+			events.push_back( line);
+		}
+		else
+		{
+			calls.append( line);
+			calls.push_back( '\n');
+		}
+	}
+	std::sort( methodcalls.begin(), methodcalls.end());
+	std::sort( events.begin(), events.end());
+	std::string rt;
+	std::vector<std::string>::const_iterator li = methodcalls.begin(), le = methodcalls.end();
+	for (; li != le; ++li) {rt.append( *li); rt.push_back( '\n');}
+	for (li = events.begin(), le = events.end(); li != le; ++li) {rt.append( *li); rt.push_back( '\n');}
+	return rt + calls;
+}
+
+/// \brief Compare the result, the calls, the context and the error of a request executed in another mode with the ones of the request executed sequentially
+static void compareRequestOutput( const char* mode, const RequestOutput& expected, const RequestOutput& result)
+{
+	if (expected.success != result.success)
+	{
+		throw std::runtime_error( std::string("request executed ") + mode + " " + (expected.success ? "failed: " + result.resout : std::string("succeeded")));
+	}
+	if (expected.resout != result.resout)
+	{
+		std::cout << "Result [" << result.resout.size() << "]:\n" << result.resout << std::endl;
+		std::cout << "Expected [" << expected.resout.size() << "]:\n" << expected.resout << std::endl;
+		throw std::runtime_error( std::string(expected.success ? "result" : "error") + " of request executed " + mode + " differs");
+	}
+	if (expected.success)
+	{
+		std::string expectedcalls = mapUnorderedOutput( expected.calldump, expected.logout);
+		std::string resultcalls = mapUnorderedOutput( result.calldump, result.logout);
+		if (expectedcalls != resultcalls)
+		{
+			std::cout << "Result [" << resultcalls.size() << "]:\n" << resultcalls << std::endl;
+			std::cout << "Expected [" << expectedcalls.size() << "]:\n" << expectedcalls << std::endl;
+			throw std::runtime_error( std::string("calls of request executed ") + mode + " differ");
+		}
+		if (expected.contextdump != result.contextdump)
+		{
+			std::cout << "Result [" << result.contextdump.size() << "]:\n" << result.contextdump << std::endl;
+			std::cout << "Expected [" << expected.contextdump.size() << "]:\n" << expected.contextdump << std::endl;
+			throw std::runtime_error( std::string("context of request executed ") + mode + " differs");
+		}
+	}
+}
+
+static RequestOutput executeRequest( const papuga_RequestAutomaton* atm, papuga_ContentType doctype, papuga_StringEncoding enc, const std::string& content, const RequestVariable* var, papuga_RequestThreadPool* pool)
+{
+	RequestOutput rt;
+	g_call_dump.clear();
+	rt.success = papuga_execute_request( atm, doctype, enc, content, var, pool, rt.resout, rt.logout, &rt.contextdump);
+	rt.calldump = g_call_dump;
+	return rt;
+}
+
+static RequestOutput executeRequestStreaming( const papuga_RequestAutomaton* atm, papuga_ContentType doctype, papuga_StringEncoding enc, const std::string& content, const RequestVariable* var)
+{
+	RequestOutput rt;
+	g_call_dump.clear();
+	rt.success = papuga_execute_request_streaming( atm, doctype, enc, content, var, rt.resout, rt.logout, &rt.contextdump);
+	rt.calldump = g_call_dump;
+	return rt;
+}
+
+/// \brief Execute a request streaming, compare it with the request executed sequentially if the automaton is streamable, expect it to be rejected otherwise
+static void compareStreamingExecution( const papuga_RequestAutomaton* atm, papuga_ContentType doctype, papuga_StringEncoding enc, const std::string& content, const RequestVariable* var, const RequestOutput& expected)
+{
+	RequestOutput result = executeRequestStreaming( atm, doctype, enc, content, var);
+	if (papuga_RequestAutomaton_is_streamable( atm))
+	{
+		compareRequestOutput( "streaming", expected, result);
+	}
+	else if (result.success || result.resout != papuga_ErrorCode_tostring( papuga_NotAllowed))
+	{
+		throw std::runtime_error( std::string("request with automaton not streamable executed streaming, expected error '") + papuga_ErrorCode_tostring( papuga_NotAllowed) + "', got " + (result.success ? std::string("success") : "'" + result.resout + "'"));
+	}
+}
+
+static void executeTest( const TestData& test, const papuga_RequestAutomaton* atm)
 {
-	std::cerr << "Executing test (" << tidx << ") '" << test.description << "'..." << std::endl;
-	LOG_TEST_CONTENT( "TXT", test.doc->totext());
 	int ei = 0, ee = -1;
 	for (; ei != ee && testsets[ei].doctype != papuga_ContentType_Unknown; ++ei)
 	{
-		g_call_dump.clear();
-		std::string resout;
-		std::string logout;
 		papuga_StringEncoding enc = testsets[ ei].encoding;
 		papuga_ContentType doctype = testsets[ ei].doctype;
 
@@ -849,7 +1243,27 @@ static void executeTest( int tidx, const TestData& test)
 		std::string content = mapDocument( *test.doc, enc, doctype, false/*no indent*/);
 		LOG_TEST_CONTENT( "DUMP", papuga::test::dumpRequest( doctype, enc, content));
 
-		if (!papuga_execute_request( test.atm->impl(), doctype, enc, content, test.var, resout, logout))
+		RequestOutput output = executeRequest( atm, doctype, enc, content, test.var, NULL/*sequential*/);
+		compareRequestOutput( "in parallel", output, executeRequest( atm, doctype, enc, content, test.var, g_threadpool));
+		compareStreamingExecution( atm, doctype, enc, content, test.var, output);
+		bool success = output.success;
+		const std::string& resout = output.resout;
+		const std::string& logout = output.logout;
+		const std::string& calldump = output.calldump;
+		if (test.error)
+		{
+			if (success)
+			{
+				throw std::runtime_error( std::string("test request succeeded, expected error: ") + test.error);
+			}
+			else if (resout != test.error)
+			{
+				std::cout << "Error:\n" << resout << std::endl;
+				std::cout << "Expected:\n" << test.error << std::endl;
+				throw std::runtime_error( "test error differs");
+			}
+		}
+		else if (!success)
 		{
 			LOG_TEST_CONTENT( "ERROR", resout);
 			std::string errmsg( std::string("executing test request: ") + resout);
@@ -858,7 +1272,7 @@ static void executeTest( int tidx, const TestData& test)
 		else
 		{
 			std::string expected = mapCallList( test.calls) + "---\n" + mapDocument( *test.expected, enc, doctype, true/*with indent*/);
-			std::string result = g_call_dump + logout + "---\n" + resout;
+			std::string result = calldump + logout + "---\n" + resout;
 			if (expected != result)
 			{
 				std::cout << "Result [" << result.size() << "]:\n" << result << std::endl;
@@ -872,6 +1286,734 @@ static void executeTest( int tidx, const TestData& test)
 		}
 	}
 }
+
+/// \brief Create a streamable automaton assigning the content of elements to variables, sequences of elements assigned to the same variable are bound to an array
+/// \note Assignments defined with papuga::RequestAutomaton are prioritized and therefore not streamable, the automaton is built with the C interface
+static papuga_RequestAutomaton* createStreamingAssignmentAutomaton()
+{
+	static const papuga_RequestMethodId assignment = {0,0};
+	papuga_RequestAutomaton* rt = papuga_create_RequestAutomaton( g_classdefs, g_structdefs, true/*strict*/, false/*exclusive*/);
+	if (!rt) throw std::bad_alloc();
+	if (!papuga_RequestAutomaton_add_value( rt, "/doc/name", "()", PersonName)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/city", "()", CityName)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/town", "()", TownName)
+	||  !papuga_RequestAutomaton_open_group( rt, 1)
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/name", &assignment, NULL/*self*/, "names", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, PersonName, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/city", &assignment, NULL/*self*/, "city", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, CityName, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/town", &assignment, NULL/*self*/, "towns", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, TownName, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_close_group( rt)
+	||  !papuga_RequestAutomaton_done( rt))
+	{
+		papuga_ErrorCode errcode = papuga_RequestAutomaton_last_error( rt);
+		papuga_destroy_RequestAutomaton( rt);
+		throw std::runtime_error( std::string("creating streaming automaton: ") + papuga_ErrorCode_tostring( errcode));
+	}
+	return rt;
+}
+
+/// \brief Feed a request element by element executing the calls ready after each element and compare it with the request executed at once
+/// \note The document ends with a sequence of assignments to the same variable, that has to be bound to an array
+static void executeStreamingTest()
+{
+	std::cerr << "Executing streaming test 'assignments bound to arrays'..." << std::endl;
+	papuga::test::Document doc(
+		"doc", {
+			{"name", {{"Hugo"}}},
+			{"name", {{"Anna"}}},
+			{"city", {{"Bern"}}},
+			{"town", {{"Biel"}}},
+			{"town", {{"Thun"}}},
+			{"town", {{"Olten"}}}
+			}
+		);
+	papuga_RequestAutomaton* atm = createStreamingAssignmentAutomaton();
+	try
+	{
+		if (!papuga_RequestAutomaton_is_streamable( atm)) throw std::runtime_error( "automaton of streaming test is not streamable");
+		int ei = 0;
+		for (; testsets[ei].doctype != papuga_ContentType_Unknown; ++ei)
+		{
+			papuga_StringEncoding enc = testsets[ ei].encoding;
+			papuga_ContentType doctype = testsets[ ei].doctype;
+			std::cerr << ei << ". doctype=" << papuga_ContentType_name( doctype) << ", encoding=" << papuga_StringEncoding_name( enc) << std::endl;
+
+			std::string content = mapDocument( doc, enc, doctype, false/*no indent*/);
+			RequestOutput output = executeRequest( atm, doctype, enc, content, NULL/*variables*/, NULL/*sequential*/);
+			if (!output.success) throw std::runtime_error( "executing streaming test request: " + output.resout);
+			compareStreamingExecution( atm, doctype, enc, content, NULL/*variables*/, output);
+			static const char* expected_context =
+				"names #1={\"Hugo\", \"Anna\"}\n"
+				"city #1=\tBern\n"
+				"towns #1={\"Biel\", \"Thun\", \"Olten\"}\n";
+			if (output.contextdump != expected_context)
+			{
+				std::cout << "Result [" << output.contextdump.size() << "]:\n" << output.contextdump << std::endl;
+				std::cout << "Expected [" << std::strlen( expected_context) << "]:\n" << expected_context << std::endl;
+				throw std::runtime_error( "variables assigned in streaming test differ");
+			}
+		}
+		papuga_destroy_RequestAutomaton( atm);
+	}
+	catch (...)
+	{
+		papuga_destroy_RequestAutomaton( atm);
+		throw;
+	}
+}
+
+/// \brief Document of a batch
+struct BatchDocument
+{
+	std::string text;		//< content of the document as split from the batch
+	bool valid;			//< true if the document is expected to be parsed without error
+
+	BatchDocument( const std::string& text_, bool valid_=true)
+		:text(text_),valid(valid_){}
+};
+
+/// \brief Remove the content events from the log of a request
+static std::string removeContentEvents( const std::string& logout)
+{
+	std::string rt;
+	std::istringstream logstream( logout);
+	std::string line;
+	while (std::getline( logstream, line))
+	{
+		if (0==std::strncmp( line.c_str(), "EV ", 3)) continue;
+		rt.append( line);
+		rt.push_back( '\n');
+	}
+	return rt;
+}
+
+/// \brief Parse a batch of documents, compare the split with the documents expected and the requests with the documents executed one by one in input order
+static void executeBatch( const papuga_RequestAutomaton* atm, papuga_ContentType doctype, const std::string& content, const std::vector<BatchDocument>& docs, int nofThreads)
+{
+	papuga_ErrorCode errcode = papuga_Ok;
+	papuga_RequestBatch* batch = papuga_create_RequestBatch( atm, NULL/*logger*/, doctype, papuga_UTF8, content.c_str(), content.size(), NULL/*limits*/, nofThreads, &errcode);
+	if (!batch) throw std::runtime_error( std::string("parsing batch: ") + papuga_ErrorCode_tostring( errcode));
+	try
+	{
+		if (papuga_RequestBatch_size( batch) != (int)docs.size())
+		{
+			throw papuga::runtime_error( "batch split into %d documents, expected %d", papuga_RequestBatch_size( batch), (int)docs.size());
+		}
+		int di = 0, de = docs.size();
+		for (; di != de; ++di)
+		{
+			const papuga_RequestBatchItem* item = papuga_RequestBatch_get( batch, di);
+			std::string text( content.c_str() + item->docpos, item->docsize);
+			if (text != docs[ di].text)
+			{
+				throw papuga::runtime_error( "document %d of batch is '%s', expected '%s'", di, text.c_str(), docs[ di].text.c_str());
+			}
+			if (!docs[ di].valid)
+			{
+				if (item->errcode == papuga_Ok || item->request) throw papuga::runtime_error( "no error reported for invalid document %d of batch", di);
+				continue;
+			}
+			if (item->errcode != papuga_Ok || !item->request)
+			{
+				throw papuga::runtime_error( "error parsing document %d of batch: %s", di, papuga_ErrorCode_tostring( item->errcode));
+			}
+			RequestOutput expected = executeRequest( atm, doctype, papuga_UTF8, text, NULL/*variables*/, NULL/*sequential*/);
+			// ... the content events are logged while feeding the request, the batch is parsed without logger
+			expected.logout = removeContentEvents( expected.logout);
+			papuga_Request* request = papuga_RequestBatch_release_request( batch, di);
+			RequestOutput result;
+			g_call_dump.clear();
+			result.success = papuga_execute_parsed_request( request, doctype, papuga_UTF8, text, NULL/*variables*/, result.resout, result.logout, &result.contextdump);
+			result.calldump = g_call_dump;
+			papuga_destroy_Request( request);
+			compareRequestOutput( "from batch", expected, result);
+		}
+		if (papuga_RequestBatch_get( batch, docs.size())) throw std::runtime_error( "item beyond the end of the batch returned");
+		papuga_destroy_RequestBatch( batch);
+	}
+	catch (...)
+	{
+		papuga_destroy_RequestBatch( batch);
+		throw;
+	}
+}
+
+/// \brief Concatenate the documents of a batch with separators cycled through between them
+static std::string batchContent( const std::vector<BatchDocument>& docs, const char** separators)
+{
+	std::string rt;
+	int si = 0;
+	std::vector<BatchDocument>::const_iterator di = docs.begin(), de = docs.end();
+	for (; di != de; ++di)
+	{
+		if (di != docs.begin())
+		{
+			rt.append( separators[ si++]);
+			if (!separators[ si]) si = 0;
+		}
+		rt.append( di->text);
+	}
+	return rt;
+}
+
+/// \brief Split batches of JSON and XML documents and parse them in parallel
+static void executeBatchTest()
+{
+	std::cerr << "Executing batch test..." << std::endl;
+	papuga_RequestAutomaton* atm = createStreamingAssignmentAutomaton();
+	try
+	{
+		enum {NofDocuments=64, NofThreads=4};
+		std::vector<BatchDocument> jsondocs;
+		std::vector<BatchDocument> xmldocs;
+		int di = 0;
+		for (; di < NofDocuments; ++di)
+		{
+			char buf[ 512];
+			// ... strings with brackets and escaped quotes must not end a JSON document
+			std::snprintf( buf, sizeof(buf), "{\"doc\":{\"name\":\"N%d}\",\"city\":\"{]\\\"}\",\"town\":[\"T%d\",\"<x>\"]}}", di, di);
+			jsondocs.push_back( BatchDocument( buf));
+			// ... comments and CDATA sections with tags must not end an XML document
+			std::snprintf( buf, sizeof(buf), "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n<doc><name>N%d</name><!-- </doc> <doc> --><city><![CDATA[</doc><]]></city><town>T%d</town></doc>", di, di);
+			xmldocs.push_back( BatchDocument( buf));
+		}
+		static const char* jsonseparators[] = {"\n", "", " \r\n", "\n\n", 0};
+		static const char* xmlseparators[] = {"\n", "", "\n<!-- <doc> < -->\n", 0};
+		executeBatch( atm, papuga_ContentType_JSON, batchContent( jsondocs, jsonseparators), jsondocs, NofThreads);
+		executeBatch( atm, papuga_ContentType_XML, batchContent( xmldocs, xmlseparators), xmldocs, NofThreads);
+
+		// ... empty batches
+		std::vector<BatchDocument> nodocs;
+		executeBatch( atm, papuga_ContentType_JSON, "", nodocs, NofThreads);
+		executeBatch( atm, papuga_ContentType_JSON, " \n\r\n ", nodocs, NofThreads);
+		executeBatch( atm, papuga_ContentType_XML, "", nodocs, NofThreads);
+		executeBatch( atm, papuga_ContentType_XML, "\n<!-- no document -->\n", nodocs, NofThreads);
+
+		// ... documents not well formed, a document not starting with a bracket ends at the end of its line, a document truncated at the end of the batch
+		std::vector<BatchDocument> baddocs;
+		baddocs.push_back( BatchDocument( jsondocs[0].text));
+		baddocs.push_back( BatchDocument( "{\"doc\":{\"name\":\"x\"]}", false));
+		baddocs.push_back( BatchDocument( "doc {\"name\":\"x\"}", false));
+		baddocs.push_back( BatchDocument( jsondocs[1].text));
+		baddocs.push_back( BatchDocument( "{\"doc\":{\"name\":\"x}\"", false));
+		static const char* eolnseparators[] = {"\n", 0};
+		executeBatch( atm, papuga_ContentType_JSON, batchContent( baddocs, eolnseparators), baddocs, NofThreads);
+
+		std::vector<BatchDocument> truncateddocs;
+		truncateddocs.push_back( BatchDocument( xmldocs[0].text));
+		truncateddocs.push_back( BatchDocument( "<doc><name>x</name><!-- </doc> -->", false));
+		executeBatch( atm, papuga_ContentType_XML, batchContent( truncateddocs, eolnseparators), truncateddocs, NofThreads);
+		papuga_destroy_RequestAutomaton( atm);
+	}
+	catch (...)
+	{
+		papuga_destroy_RequestAutomaton( atm);
+		throw;
+	}
+}
+
+/// \brief Create an automaton assigning the identifier inherited from the innermost element covering a call element 'c', searched up to a maximum number of tag levels
+/// \note Elements 'e' define an identifier, elements 'f' define an identifier and a structure with equal scopes, making a reference to them ambiguous, elements 'n' define nothing
+/// \note The identifier is the last child of an element, so that the identifiers of the elements inside are already collected when it is defined
+static papuga_RequestAutomaton* createInheritedIdAutomaton( int maxtagdiff)
+{
+	static const papuga_RequestMethodId assignment = {0,0};
+	papuga_RequestAutomaton* rt = papuga_create_RequestAutomaton( g_classdefs, g_structdefs, false/*strict*/, false/*exclusive*/);
+	if (!rt) throw std::bad_alloc();
+	if (!papuga_RequestAutomaton_add_value( rt, "//e", "id()", ElementId)
+	||  !papuga_RequestAutomaton_add_value( rt, "//f", "id()", ElementId)
+	||  !papuga_RequestAutomaton_add_structure( rt, "//f", ElementId, 0/*nofmembers*/)
+	||  !papuga_RequestAutomaton_open_group( rt, 1)
+	||  !papuga_RequestAutomaton_add_call( rt, "//c", &assignment, NULL/*self*/, "ids", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, ElementId, papuga_ResolveTypeInherited, maxtagdiff)
+	||  !papuga_RequestAutomaton_close_group( rt)
+	||  !papuga_RequestAutomaton_done( rt))
+	{
+		papuga_ErrorCode errcode = papuga_RequestAutomaton_last_error( rt);
+		papuga_destroy_RequestAutomaton( rt);
+		throw std::runtime_error( std::string("creating inherited identifier automaton: ") + papuga_ErrorCode_tostring( errcode));
+	}
+	return rt;
+}
+
+/// \brief Pseudo random number generator with the same sequence on every platform
+class TestRandom
+{
+public:
+	explicit TestRandom( unsigned int seed_) :m_value(seed_){}
+	int get( int range)
+	{
+		m_value = m_value * 1103515245 + 12345;
+		return (int)((m_value >> 16) % (unsigned int)range);
+	}
+private:
+	unsigned int m_value;
+};
+
+/// \brief Element with identifiers on the path from the root to the element visited while building a random document
+struct InheritedIdCandidate
+{
+	int taglevel;
+	int nofids;
+	std::string id;
+
+	InheritedIdCandidate( int taglevel_, int nofids_, const std::string& id_)
+		:taglevel(taglevel_),nofids(nofids_),id(id_){}
+};
+
+/// \brief Result expected for a call element, resolved by a linear scan of the candidates from the innermost to the outermost
+struct InheritedIdExpected
+{
+	papuga_ErrorCode errcode;
+	std::string id;
+
+	InheritedIdExpected( papuga_ErrorCode errcode_, const std::string& id_)
+		:errcode(errcode_),id(id_){}
+};
+
+static InheritedIdExpected resolveInheritedIdLinear( const std::vector<InheritedIdCandidate>& candidates, int taglevel, int maxtagdiff)
+{
+	std::vector<InheritedIdCandidate>::const_reverse_iterator ci = candidates.rbegin(), ce = candidates.rend();
+	for (; ci != ce; ++ci)
+	{
+		if (ci->taglevel < taglevel - maxtagdiff) break;
+		if (ci->nofids > 1) return InheritedIdExpected( papuga_AmbiguousReference, "");
+		return InheritedIdExpected( papuga_Ok, ci->id);
+	}
+	return InheritedIdExpected( papuga_ValueUndefined, "");
+}
+
+/// \brief Build a random document of nested elements 'n' without identifier, 'e' with one identifier, 'f' with two items of equal scope and call elements 'c'
+static void buildInheritedIdDocument( std::string& content, std::vector<InheritedIdCandidate>& candidates, std::vector<InheritedIdExpected>& expected, TestRandom& rnd, int taglevel, int maxtagdiff)
+{
+	int ci = 0, ce = 1 + rnd.get( 3);
+	for (; ci < ce; ++ci)
+	{
+		if (taglevel < 6 && rnd.get( 3) != 0)
+		{
+			int nofids = rnd.get( 16);
+			nofids = nofids < 5 ? 0 : (nofids < 15 ? 1 : 2);
+			static const char* tagnames[] = {"n","e","f"};
+			const char* tagname = tagnames[ nofids];
+			char idbuf[ 64];
+			std::snprintf( idbuf, sizeof(idbuf), "I%d", (int)content.size());
+			content.append( std::string("<") + tagname + ">");
+			if (nofids) candidates.push_back( InheritedIdCandidate( taglevel+1, nofids, idbuf));
+			buildInheritedIdDocument( content, candidates, expected, rnd, taglevel+1, maxtagdiff);
+			if (nofids)
+			{
+				candidates.pop_back();
+				content.append( std::string("<id>") + idbuf + "</id>");
+			}
+			content.append( std::string("</") + tagname + ">");
+		}
+		else
+		{
+			content.append( "<c/>");
+			expected.push_back( resolveInheritedIdLinear( candidates, taglevel+1, maxtagdiff));
+		}
+	}
+}
+
+/// \brief Resolve inherited items in random documents with nested and equal scopes and compare the result with the one of a linear scan
+static void executeInheritedResolveTest()
+{
+	std::cerr << "Executing inherited item resolve test..." << std::endl;
+	static const int maxtagdiffs[] = {0, 1, 2, 3, 8};
+	enum {NofDocuments=200};
+	TestRandom rnd( 7);
+	int nofSucceeded = 0;
+	int nofFailed = 0;
+	for (std::size_t mi = 0; mi < sizeof(maxtagdiffs)/sizeof(maxtagdiffs[0]); ++mi)
+	{
+		papuga_RequestAutomaton* atm = createInheritedIdAutomaton( maxtagdiffs[ mi]);
+		try
+		{
+			for (int di = 0; di < NofDocuments; ++di)
+			{
+				// ... every other document has a root element with an identifier covering all calls
+				bool withRootId = (di % 2 == 0);
+				std::string content( withRootId ? "<doc><e>" : "<doc>");
+				std::vector<InheritedIdCandidate> candidates;
+				std::vector<InheritedIdExpected> expected;
+				if (withRootId) candidates.push_back( InheritedIdCandidate( 2/*taglevel*/, 1/*nofids*/, "R"));
+				buildInheritedIdDocument( content, candidates, expected, rnd, withRootId ? 2 : 1/*taglevel*/, maxtagdiffs[ mi]);
+				content.append( withRootId ? "<id>R</id></e></doc>" : "</doc>");
+
+				// ... the request fails with the error of the first call failing or assigns the identifiers resolved in document order
+				papuga_ErrorCode expected_errcode = papuga_Ok;
+				std::string expected_context;
+				std::vector<InheritedIdExpected>::const_iterator ei = expected.begin(), ee = expected.end();
+				for (; ei != ee && ei->errcode == papuga_Ok; ++ei)
+				{
+					if (!expected_context.empty()) expected_context.append( ", ");
+					expected_context.append( "\"" + ei->id + "\"");
+				}
+				if (ei != ee)
+				{
+					expected_errcode = ei->errcode;
+				}
+				else if (expected.size() == 1)
+				{
+					expected_context = "ids #1=\t" + expected[0].id + "\n";
+				}
+				else
+				{
+					expected_context = "ids #1={" + expected_context + "}\n";
+				}
+				RequestOutput output = executeRequest( atm, papuga_ContentType_XML, papuga_UTF8, content, NULL/*variables*/, NULL/*sequential*/);
+				if (expected_errcode != papuga_Ok)
+				{
+					if (output.success || output.resout.find( papuga_ErrorCode_tostring( expected_errcode)) == std::string::npos)
+					{
+						throw std::runtime_error( std::string("resolving inherited items of document ") + content + ": expected error '" + papuga_ErrorCode_tostring( expected_errcode) + "', got " + (output.success ? std::string("success") : "'" + output.resout + "'"));
+					}
+					++nofFailed;
+				}
+				else if (!output.success)
+				{
+					throw std::runtime_error( std::string("resolving inherited items of document ") + content + ": expected success, got '" + output.resout + "'");
+				}
+				else if (output.contextdump != expected_context)
+				{
+					std::cout << "Result:\n" << output.contextdump << std::endl;
+					std::cout << "Expected:\n" << expected_context << std::endl;
+					throw std::runtime_error( std::string("identifiers resolved differ for document ") + content);
+				}
+				else
+				{
+					++nofSucceeded;
+				}
+			}
+			papuga_destroy_RequestAutomaton( atm);
+		}
+		catch (...)
+		{
+			papuga_destroy_RequestAutomaton( atm);
+			throw;
+		}
+	}
+	std::cerr << "resolved inherited items of " << nofSucceeded << " documents, " << nofFailed << " documents failed as expected" << std::endl;
+}
+
+static papuga_RequestAutomaton* reloadAutomaton( const papuga_RequestAutomaton* atm)
+{
+	papuga_ErrorCode errcode = papuga_Ok;
+	size_t imagesize = 0;
+	const void* image = papuga_RequestAutomaton_save( atm, &imagesize, &errcode);
+	if (!image) throw std::runtime_error( std::string("saving automaton image: ") + papuga_ErrorCode_tostring( errcode));
+	std::string imagecopy( (const char*)image, imagesize);
+	papuga_RequestAutomaton* rt = papuga_load_RequestAutomaton( g_classdefs, g_structdefs, imagecopy.c_str(), imagecopy.size(), &errcode);
+	if (!rt) throw std::runtime_error( std::string("loading automaton image: ") + papuga_ErrorCode_tostring( errcode));
+	return rt;
+}
+
+static void executeTest( int tidx, const TestData& test)
+{
+	std::cerr << "Executing test (" << tidx << ") '" << test.description << "'..." << std::endl;
+	LOG_TEST_CONTENT( "TXT", test.doc->totext());
+	papuga_RequestAutomaton* loadedAtm = reloadAutomaton( test.atm->impl());
+	try
+	{
+		executeTest( test, test.atm->impl());
+		executeTest( test, loadedAtm);
+		papuga_destroy_RequestAutomaton( loadedAtm);
+	}
+	catch (...)
+	{
+		papuga_destroy_RequestAutomaton( loadedAtm);
+		throw;
+	}
+}
+static papuga_RequestAutomaton* createCallGraphAutomaton()
+{
+	static const papuga_RequestMethodId assignment = {0,0};
+	static const papuga_RequestMethodId method_C1M1 = {1,1};
+	static const papuga_RequestMethodId method_C1M2 = {1,2};
+	papuga_RequestResultDescription* descr = papuga_create_RequestResultDescription( "out", NULL/*schema*/, NULL/*requestmethod*/, NULL/*addressvar*/, NULL/*path*/);
+	if (!descr) throw std::bad_alloc();
+	if (!papuga_RequestResultDescription_push_callresult( descr, "/doc/f", "out", "_out", papuga_ResolveTypeRequired)
+	||  !papuga_RequestResultDescription_push_content_variable( descr, "_content"))
+	{
+		papuga_destroy_RequestResultDescription( descr);
+		throw std::bad_alloc();
+	}
+	papuga_RequestAutomaton* rt = papuga_create_RequestAutomaton( g_classdefs, g_structdefs, false/*strict*/, false/*exclusive*/);
+	if (!rt)
+	{
+		papuga_destroy_RequestResultDescription( descr);
+		throw std::bad_alloc();
+	}
+	if (!papuga_RequestAutomation_add_result( rt, descr)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/a", "()", PersonName)
+	||  !papuga_RequestAutomaton_add_structure( rt, "/doc/e", CityList, 1/*nofmembers*/)
+	||  !papuga_RequestAutomaton_set_structure_element_var( rt, 0, "sv", "_sv")
+	// [0] ... ungrouped calls are executed before the groups
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/a", &assignment, NULL/*self*/, "x", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, PersonName, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_open_group( rt, 1)
+	// [1] ... method call reading its object 'x'
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/b", &method_C1M1, "x", "y", 0)
+	// [2] ... dead call, its local result is not read by anybody, 'z' is assigned in a group executed later
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/b", &assignment, NULL/*self*/, "_tmp", 2)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "y")
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 1, "z")
+	// [3] ... local result read by a call of a later group
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/b", &assignment, NULL/*self*/, "_used", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "x")
+	||  !papuga_RequestAutomaton_close_group( rt)
+	||  !papuga_RequestAutomaton_open_group( rt, 2)
+	// [4] ... depends on the producers of its object and of its argument
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/c", &method_C1M2, "x", "z", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "_used")
+	// [5] ... reads its own result, neither an edge nor dead
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/c", &assignment, NULL/*self*/, "_self", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "_self")
+	||  !papuga_RequestAutomaton_close_group( rt)
+	// [6] ... ungrouped call after the group assigning 'z'
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/d", &assignment, NULL/*self*/, "_late", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "z")
+	// [7] ... assigns a variable of a structure, read by every later call with an item argument
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/d", &assignment, NULL/*self*/, "_sv", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "x")
+	// [8] ... dead call with an item argument
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/e", &assignment, NULL/*self*/, "_st", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, CityList, papuga_ResolveTypeRequired, 1)
+	// [9] ... result not read by any call but not local
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/e", &assignment, NULL/*self*/, "w", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, CityList, papuga_ResolveTypeRequired, 1)
+	// [10] ... local result printed in the result
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/f", &assignment, NULL/*self*/, "_out", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "x")
+	// [11] ... local result added to the content of the result
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/f", &assignment, NULL/*self*/, "_content", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_var( rt, 0, "x")
+	||  !papuga_RequestAutomaton_done( rt))
+	{
+		papuga_ErrorCode errcode = papuga_RequestAutomaton_last_error( rt);
+		papuga_destroy_RequestAutomaton( rt);
+		throw std::runtime_error( std::string("creating call graph automaton: ") + papuga_ErrorCode_tostring( errcode));
+	}
+	return rt;
+}
+
+/// \brief Expected node of the call dependency graph, producers and consumers are lists of call indices terminated by -1
+struct CallGraphNodeDef
+{
+	int groupid;
+	int producers[ 4];
+	int consumers[ 8];
+	bool resultunused;
+};
+
+static std::string callIndexListString( int size, const int* ar)
+{
+	std::ostringstream out;
+	out << "{";
+	for (int ai=0; ai < size; ++ai) out << (ai ? "," : "") << ar[ ai];
+	out << "}";
+	return out.str();
+}
+
+static void checkCallIndexList( int callidx, const char* listname, int size, const int* ar, const int* expected)
+{
+	int esize = 0;
+	while (expected[ esize] >= 0) ++esize;
+	if (size != esize || (size && !ar) || !std::equal( ar, ar + size, expected))
+	{
+		std::ostringstream msg;
+		msg << "call [" << callidx << "] has " << listname << " " << callIndexListString( size, ar) << ", expected " << callIndexListString( esize, expected);
+		throw std::runtime_error( msg.str());
+	}
+}
+
+/// \brief Check the dependency graph of the calls compiled for an automaton
+static void checkCallGraph( const char* title, const papuga_RequestAutomaton* atm)
+{
+	// ... the group of a call is the index of the first call of its group, the index of the call if it is not in a group
+	static const CallGraphNodeDef expected[] = {
+		{0, {-1},         {1,3,4,7,10,11,-1}, false},
+		{1, {0,-1},       {2,-1},       false},
+		{1, {1,-1},       {-1},         true},
+		{1, {0,-1},       {4,-1},       false},
+		{4, {0,3,-1},     {6,-1},       false},
+		{4, {-1},         {-1},         false},
+		{6, {4,-1},       {-1},         true},
+		{7, {0,-1},       {8,9,-1},     false},
+		{8, {7,-1},       {-1},         true},
+		{9, {7,-1},       {-1},         false},
+		{10,{0,-1},       {-1},         false},
+		{11,{0,-1},       {-1},         false}
+	};
+	enum {NofCalls = sizeof(expected)/sizeof(expected[0])};
+	std::cerr << "Checking call graph of " << title << " automaton..." << std::endl;
+	if (papuga_RequestAutomaton_nof_calls( atm) != NofCalls)
+	{
+		throw std::runtime_error( std::string("unexpected number of calls in call graph of ") + title + " automaton");
+	}
+	if (papuga_RequestAutomaton_get_call_node( atm, -1) || papuga_RequestAutomaton_get_call_node( atm, NofCalls))
+	{
+		throw std::runtime_error( "call graph node returned for call index out of range");
+	}
+	for (int ci=0; ci < NofCalls; ++ci)
+	{
+		const papuga_RequestCallNode* node = papuga_RequestAutomaton_get_call_node( atm, ci);
+		if (!node) throw std::runtime_error( "call graph node not found");
+		if (node->groupid != expected[ ci].groupid)
+		{
+			std::ostringstream msg;
+			msg << "call [" << ci << "] has group " << node->groupid << ", expected " << expected[ ci].groupid;
+			throw std::runtime_error( msg.str());
+		}
+		checkCallIndexList( ci, "producers", node->nofproducers, node->producers, expected[ ci].producers);
+		checkCallIndexList( ci, "consumers", node->nofconsumers, node->consumers, expected[ ci].consumers);
+		if (node->resultunused != expected[ ci].resultunused)
+		{
+			std::ostringstream msg;
+			msg << "call [" << ci << "] assigning '" << (node->resultvarname ? node->resultvarname : "") << "' is " << (node->resultunused ? "" : "not ") << "flagged as result unused";
+			throw std::runtime_error( msg.str());
+		}
+	}
+}
+
+/// \brief Check producers, consumers, group order and dead calls in the call graph of an automaton, also after reloading its image
+static void executeCallGraphTest()
+{
+	std::cerr << "Executing call graph test..." << std::endl;
+	papuga_RequestAutomaton* atm = createCallGraphAutomaton();
+	papuga_RequestAutomaton* loadedAtm = NULL;
+	try
+	{
+		checkCallGraph( "created", atm);
+		loadedAtm = reloadAutomaton( atm);
+		checkCallGraph( "loaded", loadedAtm);
+		papuga_destroy_RequestAutomaton( loadedAtm);
+		papuga_destroy_RequestAutomaton( atm);
+	}
+	catch (...)
+	{
+		if (loadedAtm) papuga_destroy_RequestAutomaton( loadedAtm);
+		papuga_destroy_RequestAutomaton( atm);
+		throw;
+	}
+}
+
+static papuga_RequestAutomaton* createBatchedMethodAutomaton()
+{
+	static const papuga_RequestMethodId constructor_C3 = C3::constructor();
+	static const papuga_RequestMethodId method_C3M1 = C3::m1();
+	static const papuga_RequestMethodId method_C3M2 = C3::m2();
+	papuga_RequestAutomaton* rt = papuga_create_RequestAutomaton( g_classdefs, g_structdefs, false/*strict*/, false/*exclusive*/);
+	if (!rt) throw std::bad_alloc();
+	if (!papuga_RequestAutomaton_add_value( rt, "/doc/put", "@k", BatchKey)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/put", "()", BatchValue)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/get", "()", BatchValue)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/last", "@k", BatchKey)
+	||  !papuga_RequestAutomaton_add_value( rt, "/doc/last", "()", BatchValue)
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc", &constructor_C3, NULL/*self*/, "obj", 0)
+	||  !papuga_RequestAutomaton_open_group( rt, 1)
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/put", &method_C3M1, "obj", "res", 2)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, BatchKey, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 1, BatchValue, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/get", &method_C3M2, "obj", "res", 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, BatchValue, papuga_ResolveTypeRequired, 1)
+	// ... call of the batched method assigning its result to the variable of its object
+	||  !papuga_RequestAutomaton_add_call( rt, "/doc/last", &method_C3M1, "obj", "obj", 2)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 0, BatchKey, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_set_call_arg_item( rt, 1, BatchValue, papuga_ResolveTypeRequired, 1)
+	||  !papuga_RequestAutomaton_close_group( rt)
+	||  !papuga_RequestAutomaton_done( rt))
+	{
+		papuga_ErrorCode errcode = papuga_RequestAutomaton_last_error( rt);
+		papuga_destroy_RequestAutomaton( rt);
+		throw std::runtime_error( std::string("creating batched method automaton: ") + papuga_ErrorCode_tostring( errcode));
+	}
+	return rt;
+}
+
+/// \brief Request with the calls of a batched method expected to be executed and applied
+struct BatchedMethodTestDef
+{
+	const char* content;
+	const char* calls;		//< methods executed, batches of calls logged as one line before the calls
+	const char* logout;		//< calls applied in the order of the request
+	const char* contextdump;	//< context after the request or NULL if it fails
+	const char* error;		//< error expected or NULL
+};
+
+static void executeBatchedMethodTest()
+{
+	static const BatchedMethodTestDef tests[] = {
+		// ... consecutive calls are batched with their arguments, a call of another method flushes the batch, results are assigned in request order
+		{"<doc><put k='a'>x</put><put k='b'>y</put><get>z</get><put k='c'>w</put><put k='d'>v</put></doc>",
+			"executing method C3::new();\n"
+			"executing batch C3::m1 of 2 calls;\n"
+			"executing method C3::m1( 'a', 'x');\n"
+			"executing method C3::m1( 'b', 'y');\n"
+			"executing method C3::m2( 'z');\n"
+			"executing batch C3::m1 of 2 calls;\n"
+			"executing method C3::m1( 'c', 'w');\n"
+			"executing method C3::m1( 'd', 'v');\n"
+			"executing method C3::delete();\n",
+			"C3 0  obj <HostObject>\n"
+			"C3 M1 2 a x res <Serialization>\n"
+			"C3 M1 2 b y res <Serialization>\n"
+			"C3 M2 1 z res z\n"
+			"C3 M1 2 c w res <Serialization>\n"
+			"C3 M1 2 d v res <Serialization>\n",
+			"obj #1=\t<HostObject>\n\nres #1={{\"D\", \"V\"}}\n", NULL},
+		// ... the failure of a call in a batch is reported after applying the calls before it
+		{"<doc><put k='a'>x</put><put k='b'>fail</put><put k='c'>y</put></doc>",
+			"executing method C3::new();\n"
+			"executing batch C3::m1 of 3 calls;\n"
+			"executing method C3::m1( 'a', 'x');\n"
+			"executing method C3::m1( 'b', 'fail');\n"
+			"executing method C3::delete();\n",
+			"C3 0  obj <HostObject>\n"
+			"C3 M1 2 a x res <Serialization>\n",
+			NULL, "error executing host object method in method C3::M1 argument 0 accessing variable 'obj' message: error in method C3::m1: failed"},
+		// ... a call assigning the variable of the object called is not batched, the batch before is flushed,
+		// ... the call fails as for methods without batched version, because the result variable replaces the object before the call
+		{"<doc><put k='a'>x</put><put k='b'>y</put><last k='c'>w</last></doc>",
+			"executing method C3::new();\n"
+			"executing batch C3::m1 of 2 calls;\n"
+			"executing method C3::m1( 'a', 'x');\n"
+			"executing method C3::m1( 'b', 'y');\n"
+			"executing method C3::delete();\n",
+			"C3 0  obj <HostObject>\n"
+			"C3 M1 2 a x res <Serialization>\n"
+			"C3 M1 2 b y res <Serialization>\n",
+			NULL, "type mismatch in method C3::M1 argument 0 accessing variable 'obj'"},
+		{NULL,NULL,NULL,NULL,NULL}
+	};
+	std::cerr << "Executing batched method test..." << std::endl;
+	papuga_RequestAutomaton* atm = createBatchedMethodAutomaton();
+	try
+	{
+		for (int ti = 0; tests[ ti].content; ++ti)
+		{
+			const BatchedMethodTestDef& test = tests[ ti];
+			RequestOutput output = executeRequest( atm, papuga_ContentType_XML, papuga_UTF8, test.content, NULL/*variables*/, NULL/*sequential*/);
+			std::string result = output.calldump + "---\n" + removeContentEvents( output.logout) + "---\n" + (output.success ? output.contextdump : output.resout);
+			std::string expected = std::string( test.calls) + "---\n" + test.logout + "---\n" + (test.error ? test.error : test.contextdump);
+			if (output.success != !test.error || result != expected)
+			{
+				std::cout << "Result [" << result.size() << "]:\n" << result << std::endl;
+				std::cout << "Expected [" << expected.size() << "]:\n" << expected << std::endl;
+				throw std::runtime_error( std::string("output of request with batched method calls differs for document ") + test.content);
+			}
+		}
+		papuga_destroy_RequestAutomaton( atm);
+	}
+	catch (...)
+	{
+		papuga_destroy_RequestAutomaton( atm);
+		throw;
+	}
+}
+
 #endif
 
 
@@ -901,9 +2043,16 @@ int main( int argc, const char* argv[])
 			}
 		}
 	}
+	struct ThreadPoolScope
+	{
+		ThreadPoolScope()	{g_threadpool = papuga_create_RequestThreadPool( 4);}
+		~ThreadPoolScope()	{if (g_threadpool) papuga_destroy_RequestThreadPool( g_threadpool);}
+	};
 	try
 	{
 #if __cplusplus >= 201103L
+		ThreadPoolScope threadpool;
+		if (!g_threadpool) throw std::bad_alloc();
 		if (testno >= 1)
 		{
 			createTestDataFunction createTestData = g_tests[ testno-1];
@@ -911,12 +2060,20 @@ int main( int argc, const char* argv[])
 			executeTest( testno, *test);
 			delete test;
 		}
-		else for (int testidx = 1; testidx <= testcnt; ++testidx)
+		else
 		{
-			createTestDataFunction createTestData = g_tests[ testidx-1];
-			TestData* test = createTestData();
-			executeTest( testidx, *test);
-			delete test;
+			for (int testidx = 1; testidx <= testcnt; ++testidx)
+			{
+				createTestDataFunction createTestData = g_tests[ testidx-1];
+				TestData* test = createTestData();
+				executeTest( testidx, *test);
+				delete test;
+			}
+			executeStreamingTest();
+			executeBatchTest();
+			executeInheritedResolveTest();
+			executeCallGraphTest();
+			executeBatchedMethodTest();
 		}
 #else
 		std::cerr << "This test needs C++11 as it uses std initializer_list" << std::endl;
@@ -0,0 +1,1087 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/// \brief Tests of the contexts stored in a request handler
+#include "papuga.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/// \brief Host object with a state written to a snapshot of contexts
+struct Counter
+{
+	std::string name;
+	int value;
+
+	Counter( const std::string& name_, int value_) :name(name_),value(value_){}
+};
+
+static void destroyCounter( void* self)
+{
+	delete (Counter*)self;
+}
+
+static bool serializeCounter( const void* self, papuga_Serialization* dest, papuga_ErrorCode* errcode)
+{
+	const Counter* counter = (const Counter*)self;
+	if (!papuga_Serialization_pushValue_string( dest, counter->name.c_str(), counter->name.size())
+	||  !papuga_Serialization_pushValue_int( dest, counter->value))
+	{
+		*errcode = papuga_NoMemError;
+		return false;
+	}
+	return true;
+}
+
+static void* deserializeCounter( papuga_ErrorBuffer* errbuf, const papuga_Serialization* src)
+{
+	try
+	{
+		papuga_SerializationIter itr;
+		papuga_init_SerializationIter( &itr, src);
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (papuga_SerializationIter_eof( &itr) || papuga_SerializationIter_tag( &itr) != papuga_TagValue) throw std::runtime_error( "name expected");
+		std::string name = papuga::ValueVariant_tostring( *papuga_SerializationIter_value( &itr), errcode);
+		papuga_SerializationIter_skip( &itr);
+		if (papuga_SerializationIter_eof( &itr) || papuga_SerializationIter_tag( &itr) != papuga_TagValue) throw std::runtime_error( "value expected");
+		int value = papuga_ValueVariant_toint( papuga_SerializationIter_value( &itr), &errcode);
+		if (errcode != papuga_Ok) throw std::runtime_error( papuga_ErrorCode_tostring( errcode));
+		return new Counter( name, value);
+	}
+	catch (const std::exception& err)
+	{
+		papuga_ErrorBuffer_reportError( errbuf, "error deserializing counter: %s", err.what());
+		return NULL;
+	}
+}
+
+enum {CounterClassId=1};
+static papuga_ClassDef g_classdefs[] = {
+	{"Counter", NULL/*constructor*/, &destroyCounter, NULL/*methodtable*/, NULL/*methodnames*/, 0/*methodtablesize*/, NULL/*batchmethodtable*/, &serializeCounter, &deserializeCounter},
+	papuga_ClassDef_NULL
+};
+
+struct RequestHandlerScope
+{
+	papuga_RequestHandler* handler;
+
+	explicit RequestHandlerScope( int nofshards=1)
+		:handler(papuga_create_RequestHandler_sharded( g_classdefs, nofshards))
+	{
+		if (!handler) throw std::bad_alloc();
+	}
+	~RequestHandlerScope()
+	{
+		papuga_destroy_RequestHandler( handler);
+	}
+};
+
+struct RequestContextScope
+{
+	papuga_RequestContext* context;
+
+	RequestContextScope()
+		:context(papuga_create_RequestContext())
+	{
+		if (!context) throw std::bad_alloc();
+	}
+	~RequestContextScope()
+	{
+		if (context) papuga_destroy_RequestContext( context);
+	}
+	papuga_RequestContext* release()
+	{
+		papuga_RequestContext* rt = context;
+		context = 0;
+		return rt;
+	}
+};
+
+static void defineVariable( papuga_RequestContext* context, const char* name, const char* value)
+{
+	papuga_ValueVariant val;
+	papuga_init_ValueVariant_charp( &val, value);
+	if (!papuga_RequestContext_define_variable( context, name, &val))
+	{
+		throw papuga::runtime_error( "failed to define variable '%s': %s", name, papuga_ErrorCode_tostring( papuga_RequestContext_last_error( context, true)));
+	}
+}
+
+static std::string variableValue( const papuga_RequestContext* context, const char* name)
+{
+	const papuga_ValueVariant* value = papuga_RequestContext_get_variable( context, name);
+	if (!value) return std::string();
+	papuga_ErrorCode errcode = papuga_Ok;
+	return papuga::ValueVariant_tostring( *value, errcode);
+}
+
+static void transferContext( papuga_RequestHandler* handler, const char* type, const char* name, const char* varname, const char* value)
+{
+	RequestContextScope ctx;
+	defineVariable( ctx.context, varname, value);
+	papuga_ErrorCode errcode = papuga_Ok;
+	if (!papuga_RequestHandler_transfer_context( handler, type, name, ctx.context, &errcode))
+	{
+		throw papuga::runtime_error( "failed to transfer context %s/%s: %s", type, name, papuga_ErrorCode_tostring( errcode));
+	}
+	ctx.release();
+}
+
+/// \brief Get the value of a variable of a context of the handler, an empty string if the variable is not defined
+/// \note Throws if the context does not exist
+static std::string inheritedValue( const papuga_RequestHandler* handler, const char* type, const char* name, const char* varname)
+{
+	RequestContextScope ctx;
+	if (!papuga_RequestContext_inherit( ctx.context, handler, type, name))
+	{
+		throw papuga::runtime_error( "failed to inherit context %s/%s: %s", type, name, papuga_ErrorCode_tostring( papuga_RequestContext_last_error( ctx.context, true)));
+	}
+	return variableValue( ctx.context, varname);
+}
+
+static void checkEqual( const std::string& result, const std::string& expected, const char* what)
+{
+	if (result != expected)
+	{
+		throw papuga::runtime_error( "%s: got '%s', expected '%s'", what, result.c_str(), expected.c_str());
+	}
+}
+
+/// \brief Replace a context with another one with the same type and name, the key of the map must not refer to the context replaced
+static void testReplaceContext()
+{
+	RequestHandlerScope hnd;
+	// ... key longer than the small string buffer, so that it is allocated and freed with the entry replaced
+	const char* type = "collection_with_a_long_type_name";
+	const char* name = "context_with_a_long_name";
+
+	transferContext( hnd.handler, type, name, "var", "first");
+	transferContext( hnd.handler, type, name, "var", "second");
+	// ... the snapshot with the first context is dropped, allocate memory to overwrite its key
+	char othername[ 64];
+	int ni = 0;
+	for (; ni < 16; ++ni)
+	{
+		std::snprintf( othername, sizeof(othername), "overwrite_key_memory_of_a_context_%d", ni);
+		transferContext( hnd.handler, type, othername, "var", "other");
+	}
+	checkEqual( inheritedValue( hnd.handler, type, name, "var"), "second", "value of context replaced");
+
+	transferContext( hnd.handler, type, name, "var", "third");
+	checkEqual( inheritedValue( hnd.handler, type, name, "var"), "third", "value of context replaced twice");
+	papuga_ErrorCode errcode = papuga_Ok;
+	if (!papuga_RequestHandler_remove_context( hnd.handler, type, name, &errcode))
+	{
+		throw std::runtime_error( "failed to remove context replaced");
+	}
+	RequestContextScope ctx;
+	if (papuga_RequestContext_inherit( ctx.context, hnd.handler, type, name))
+	{
+		throw std::runtime_error( "context removed still found");
+	}
+}
+
+static void inheritContext( papuga_RequestContext* context, const papuga_RequestHandler* handler, const char* type, const char* name)
+{
+	if (!papuga_RequestContext_inherit( context, handler, type, name))
+	{
+		throw papuga::runtime_error( "failed to inherit context %s/%s: %s", type, name, papuga_ErrorCode_tostring( papuga_RequestContext_last_error( context, true)));
+	}
+}
+
+/// \brief Get the names of the variables visible in a context with at most max_inheritcnt inheritance steps, separated by spaces
+static std::string variableNames( const papuga_RequestContext* context, int max_inheritcnt)
+{
+	char const* buf[ 64];
+	const char** names = papuga_RequestContext_list_variables( context, max_inheritcnt, buf, sizeof(buf)/sizeof(*buf));
+	if (!names) throw std::runtime_error( "too many variables listed");
+	std::string rt;
+	for (; *names; ++names)
+	{
+		if (!rt.empty()) rt.push_back( ' ');
+		rt.append( *names);
+	}
+	return rt;
+}
+
+/// \brief Duplicate definitions of variables inherited are resolved at lookup, own variables hide inherited ones, different inherited ones are ambiguous
+static void testInheritDuplicates()
+{
+	RequestHandlerScope hnd;
+	{
+		RequestContextScope ctx;
+		defineVariable( ctx.context, "x", "A");
+		defineVariable( ctx.context, "y", "Y");
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (!papuga_RequestHandler_transfer_context( hnd.handler, "t", "a", ctx.context, &errcode)) throw std::runtime_error( "failed to transfer context a");
+		ctx.release();
+	}
+	transferContext( hnd.handler, "t", "b", "x", "B");
+	{
+		// ... context c inherits a, stored flattened
+		RequestContextScope ctx;
+		inheritContext( ctx.context, hnd.handler, "t", "a");
+		defineVariable( ctx.context, "z", "Z");
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (!papuga_RequestHandler_transfer_context( hnd.handler, "t", "c", ctx.context, &errcode)) throw std::runtime_error( "failed to transfer context c");
+		ctx.release();
+	}
+	{
+		// ... the same variable inherited twice is not a duplicate
+		RequestContextScope ctx;
+		inheritContext( ctx.context, hnd.handler, "t", "c");
+		inheritContext( ctx.context, hnd.handler, "t", "a");
+		checkEqual( variableValue( ctx.context, "x"), "A", "value of variable inherited twice");
+		checkEqual( variableNames( ctx.context, -1), "z x y", "variables inherited twice");
+		checkEqual( variableNames( ctx.context, 1), "z", "variables inherited directly");
+	}
+	{
+		RequestContextScope ctx;
+		inheritContext( ctx.context, hnd.handler, "t", "c");
+		inheritContext( ctx.context, hnd.handler, "t", "b");
+		checkEqual( variableValue( ctx.context, "y"), "Y", "value of variable defined once");
+		if (papuga_RequestContext_get_variable( ctx.context, "x")) throw std::runtime_error( "variable defined ambiguously found");
+		if (papuga_RequestContext_last_error( ctx.context, true) != papuga_DuplicateDefinition) throw std::runtime_error( "lookup of variable defined ambiguously does not report duplicate definition");
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (papuga_RequestHandler_transfer_context( hnd.handler, "t", "d", ctx.context, &errcode) || errcode != papuga_DuplicateDefinition)
+		{
+			throw std::runtime_error( "context with variable defined ambiguously transferred");
+		}
+		// ... a variable defined in the context itself hides the ones inherited
+		defineVariable( ctx.context, "x", "X");
+		checkEqual( variableValue( ctx.context, "x"), "X", "value of variable hiding the ones inherited");
+		checkEqual( variableNames( ctx.context, -1), "x z y", "variables visible");
+		checkEqual( variableNames( ctx.context, 0), "x", "variables defined in the context itself");
+		if (!papuga_RequestHandler_transfer_context( hnd.handler, "t", "d", ctx.context, &errcode)) throw std::runtime_error( "failed to transfer context d");
+		ctx.release();
+	}
+	checkEqual( inheritedValue( hnd.handler, "t", "d", "x"), "X", "value of variable of context stored");
+	checkEqual( inheritedValue( hnd.handler, "t", "d", "y"), "Y", "value of variable inherited of context stored");
+}
+
+/// \brief Define a variable with a host object of the class Counter
+static void defineCounter( papuga_RequestContext* context, const char* name, const char* countername, int value)
+{
+	papuga_Allocator allocator;
+	int allocatormem[ 256];
+	papuga_init_Allocator( &allocator, allocatormem, sizeof(allocatormem));
+	papuga_HostObject* hobj = papuga_Allocator_alloc_HostObject( &allocator, CounterClassId, new Counter( countername, value), &destroyCounter);
+	papuga_ValueVariant val;
+	papuga_init_ValueVariant_hostobj( &val, hobj);
+	bool success = papuga_RequestContext_define_variable( context, name, &val);
+	papuga_destroy_Allocator( &allocator);
+	if (!success) throw papuga::runtime_error( "failed to define variable '%s': %s", name, papuga_ErrorCode_tostring( papuga_RequestContext_last_error( context, true)));
+}
+
+/// \brief Define a variable with a structure containing a host object of the class Counter
+static void defineStructure( papuga_RequestContext* context, const char* name, const char* countername, int value)
+{
+	papuga_Allocator allocator;
+	int allocatormem[ 1024];
+	papuga_init_Allocator( &allocator, allocatormem, sizeof(allocatormem));
+	papuga_Serialization* ser = papuga_Allocator_alloc_Serialization( &allocator);
+	papuga_HostObject* hobj = papuga_Allocator_alloc_HostObject( &allocator, CounterClassId, new Counter( countername, value), &destroyCounter);
+	bool success = ser && hobj
+		&& papuga_Serialization_pushName_charp( ser, "title")
+		&& papuga_Serialization_pushValue_charp( ser, "structure")
+		&& papuga_Serialization_pushName_charp( ser, "list")
+		&& papuga_Serialization_pushOpen( ser)
+		&& papuga_Serialization_pushValue_int( ser, value)
+		&& papuga_Serialization_pushValue_double( ser, 0.5)
+		&& papuga_Serialization_pushValue_bool( ser, true)
+		&& papuga_Serialization_pushValue_void( ser)
+		&& papuga_Serialization_pushClose( ser)
+		&& papuga_Serialization_pushName_charp( ser, "counter")
+		&& papuga_Serialization_pushValue_hostobject( ser, hobj);
+	if (success)
+	{
+		papuga_ValueVariant val;
+		papuga_init_ValueVariant_serialization( &val, ser);
+		success = papuga_RequestContext_define_variable( context, name, &val);
+	}
+	papuga_destroy_Allocator( &allocator);
+	if (!success) throw papuga::runtime_error( "failed to define variable '%s'", name);
+}
+
+/// \brief Get the counter of a variable of a context of the handler
+static const Counter* inheritedCounter( papuga_RequestContext* context, const papuga_RequestHandler* handler, const char* type, const char* name, const char* varname)
+{
+	inheritContext( context, handler, type, name);
+	const papuga_ValueVariant* value = papuga_RequestContext_get_variable( context, varname);
+	if (!value || value->valuetype != papuga_TypeHostObject || value->value.hostObject->classid != CounterClassId)
+	{
+		throw papuga::runtime_error( "variable '%s' of context %s/%s is not a counter", varname, type, name);
+	}
+	return (const Counter*)value->value.hostObject->data;
+}
+
+static std::string contextMapDump( const papuga_RequestHandler* handler)
+{
+	const char* dump = papuga_RequestHandler_debug_contextmap_tostring( handler, NULL/*allocator*/, NULL/*structdefs*/);
+	if (!dump) throw std::bad_alloc();
+	std::string rt( dump);
+	std::free( (void*)dump);
+	return rt;
+}
+
+static std::string readFile( const char* filename)
+{
+	std::ifstream file( filename, std::ios::in | std::ios::binary);
+	if (!file) throw papuga::runtime_error( "failed to read file '%s'", filename);
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+static void writeFile( const char* filename, const std::string& content)
+{
+	std::ofstream file( filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file || !file.write( content.c_str(), content.size())) throw papuga::runtime_error( "failed to write file '%s'", filename);
+}
+
+/// \brief Save the contexts of a handler with shared variables, structures and host objects and load them into another handler
+/// \note The file is written to the current directory
+static void testSaveLoadContexts()
+{
+	static const char* filename = "testRequestHandler.snapshot";
+	RequestHandlerScope hnd( 3);
+	{
+		RequestContextScope ctx;
+		defineVariable( ctx.context, "str", "shared string");
+		defineCounter( ctx.context, "obj", "shared counter", 7);
+		defineStructure( ctx.context, "ser", "structure counter", 11);
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (!papuga_RequestHandler_transfer_context( hnd.handler, "t", "a", ctx.context, &errcode)) throw std::runtime_error( "failed to transfer context a");
+		ctx.release();
+	}
+	{
+		// ... context b shares the variables of context a
+		RequestContextScope ctx;
+		inheritContext( ctx.context, hnd.handler, "t", "a");
+		defineVariable( ctx.context, "own", "own string");
+		defineCounter( ctx.context, "ownobj", "own counter", 3);
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (!papuga_RequestHandler_transfer_context( hnd.handler, "u", "b", ctx.context, &errcode)) throw std::runtime_error( "failed to transfer context b");
+		ctx.release();
+	}
+	transferContext( hnd.handler, "t", "c", "str", "other string");
+	std::string expected = contextMapDump( hnd.handler);
+
+	papuga_ErrorCode errcode = papuga_Ok;
+	if (!papuga_RequestHandler_save_contexts( hnd.handler, filename, &errcode))
+	{
+		throw papuga::runtime_error( "failed to save contexts: %s", papuga_ErrorCode_tostring( errcode));
+	}
+	RequestHandlerScope loaded( 5);
+	if (!papuga_RequestHandler_load_contexts( loaded.handler, filename, &errcode))
+	{
+		throw papuga::runtime_error( "failed to load contexts: %s", papuga_ErrorCode_tostring( errcode));
+	}
+	std::string result = contextMapDump( loaded.handler);
+	if (result != expected)
+	{
+		std::cerr << "Result:\n" << result << "\nExpected:\n" << expected << std::endl;
+		throw std::runtime_error( "contexts loaded differ from the ones saved");
+	}
+	RequestContextScope ctx_a;
+	RequestContextScope ctx_b;
+	const Counter* counter_a = inheritedCounter( ctx_a.context, loaded.handler, "t", "a", "obj");
+	const Counter* counter_b = inheritedCounter( ctx_b.context, loaded.handler, "u", "b", "obj");
+	if (counter_a != counter_b) throw std::runtime_error( "host object shared by contexts saved is not shared by the contexts loaded");
+	if (counter_a->name != "shared counter" || counter_a->value != 7) throw std::runtime_error( "state of host object loaded differs from the one saved");
+	const papuga_ValueVariant* ser = papuga_RequestContext_get_variable( ctx_a.context, "ser");
+	if (!ser || ser->valuetype != papuga_TypeSerialization) throw std::runtime_error( "structure loaded is not a serialization");
+	papuga_SerializationIter itr;
+	papuga_init_SerializationIter_last( &itr, ser->value.serialization);
+	const papuga_ValueVariant* last = papuga_SerializationIter_value( &itr);
+	if (!last || last->valuetype != papuga_TypeHostObject || ((const Counter*)last->value.hostObject->data)->value != 11)
+	{
+		throw std::runtime_error( "host object in structure loaded differs from the one saved");
+	}
+	std::remove( filename);
+}
+
+/// \brief Loading a snapshot file truncated or corrupt fails with a syntax error and leaves the contexts of the handler untouched
+/// \note The file is written to the current directory
+static void testLoadCorruptContexts()
+{
+	static const char* filename = "testRequestHandler.corrupt.snapshot";
+	RequestHandlerScope hnd;
+	{
+		RequestContextScope ctx;
+		defineVariable( ctx.context, "str", "string");
+		defineCounter( ctx.context, "obj", "counter", 1);
+		defineStructure( ctx.context, "ser", "structure counter", 2);
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (!papuga_RequestHandler_transfer_context( hnd.handler, "t", "a", ctx.context, &errcode)) throw std::runtime_error( "failed to transfer context");
+		ctx.release();
+	}
+	papuga_ErrorCode errcode = papuga_Ok;
+	if (!papuga_RequestHandler_save_contexts( hnd.handler, filename, &errcode))
+	{
+		throw papuga::runtime_error( "failed to save contexts: %s", papuga_ErrorCode_tostring( errcode));
+	}
+	std::string content = readFile( filename);
+	std::vector<std::string> corrupted;
+	std::size_t ci = 0, ce = content.size();
+	for (; ci < ce; ++ci) corrupted.push_back( content.substr( 0, ci));
+	corrupted.push_back( content + '\0');
+	corrupted.push_back( "X" + content.substr( 1));
+	corrupted.push_back( content.substr( 0, 8) + '\x7F' + content.substr( 9));	//... version
+
+	RequestHandlerScope loaded;
+	transferContext( loaded.handler, "t", "a", "str", "kept");
+	std::string expected = contextMapDump( loaded.handler);
+	std::vector<std::string>::const_iterator fi = corrupted.begin(), fe = corrupted.end();
+	for (; fi != fe; ++fi)
+	{
+		writeFile( filename, *fi);
+		errcode = papuga_Ok;
+		if (papuga_RequestHandler_load_contexts( loaded.handler, filename, &errcode) || errcode != papuga_SyntaxError)
+		{
+			throw papuga::runtime_error( "loading snapshot corrupted at %d of %d bytes: got '%s', expected '%s'", (int)(fi - corrupted.begin()), (int)content.size(), papuga_ErrorCode_tostring( errcode), papuga_ErrorCode_tostring( papuga_SyntaxError));
+		}
+	}
+	checkEqual( contextMapDump( loaded.handler), expected, "contexts after loading corrupt snapshots");
+	std::remove( filename);
+}
+
+static bool hasContext( const papuga_RequestHandler* handler, const char* type, const char* name)
+{
+	std::size_t memsize;
+	return papuga_RequestHandler_context_memsize( handler, type, name, &memsize);
+}
+
+static std::size_t contextMemsize( const papuga_RequestHandler* handler, const char* type, const char* name)
+{
+	std::size_t memsize;
+	if (!papuga_RequestHandler_context_memsize( handler, type, name, &memsize))
+	{
+		throw papuga::runtime_error( "context %s/%s not found", type, name);
+	}
+	return memsize;
+}
+
+static std::string contextName( int idx)
+{
+	char buf[ 64];
+	std::snprintf( buf, sizeof(buf), "context%d", idx);
+	return std::string( buf);
+}
+
+/// \brief Log of the calls of the evict handler
+struct EvictLog
+{
+	std::vector<std::string> names;
+	std::size_t memsize;
+
+	EvictLog() :names(),memsize(0){}
+
+	static void evict( void* userdata, const char* type, const char* name, size_t memsize)
+	{
+		EvictLog* log = (EvictLog*)userdata;
+		log->names.push_back( std::string(type) + "/" + name);
+		log->memsize += memsize;
+	}
+	std::string tostring() const
+	{
+		std::string rt;
+		std::vector<std::string>::const_iterator ni = names.begin(), ne = names.end();
+		for (; ni != ne; ++ni)
+		{
+			if (!rt.empty()) rt.push_back( ' ');
+			rt.append( *ni);
+		}
+		return rt;
+	}
+};
+
+/// \brief Evict the contexts inherited least recently when the number of contexts exceeds the limit
+static void testEvictLeastRecentlyUsed()
+{
+	RequestHandlerScope hnd( 3);
+	EvictLog evictlog;
+	papuga_RequestHandler_set_context_limits( hnd.handler, 3/*maxnofcontexts*/, 0/*maxmemsize*/, &EvictLog::evict, &evictlog);
+
+	transferContext( hnd.handler, "t", "a", "var", "A");
+	transferContext( hnd.handler, "t", "b", "var", "B");
+	transferContext( hnd.handler, "t", "c", "var", "C");
+	checkEqual( evictlog.tostring(), "", "contexts evicted within limits");
+	// ... access order is now b, c, a
+	checkEqual( inheritedValue( hnd.handler, "t", "a", "var"), "A", "value of context a");
+	std::size_t memsize_b = contextMemsize( hnd.handler, "t", "b");
+
+	transferContext( hnd.handler, "t", "d", "var", "D");
+	checkEqual( evictlog.tostring(), "t/b", "contexts evicted after the 4th transfer");
+	if (evictlog.memsize != memsize_b) throw std::runtime_error( "memory passed to evict handler differs from the one counted");
+	if (hasContext( hnd.handler, "t", "b")) throw std::runtime_error( "context evicted still found");
+
+	// ... replacing a context does not change the number of contexts
+	transferContext( hnd.handler, "t", "c", "var", "C2");
+	checkEqual( evictlog.tostring(), "t/b", "contexts evicted after replacing a context");
+	// ... access order is now a, d, c
+	transferContext( hnd.handler, "t", "e", "var", "E");
+	transferContext( hnd.handler, "t", "f", "var", "F");
+	checkEqual( evictlog.tostring(), "t/b t/a t/d", "contexts evicted after the 6th transfer");
+	checkEqual( inheritedValue( hnd.handler, "t", "c", "var"), "C2", "value of context c replaced");
+
+	// ... a context removed is not evicted anymore
+	papuga_ErrorCode errcode = papuga_Ok;
+	if (!papuga_RequestHandler_remove_context( hnd.handler, "t", "e", &errcode)) throw std::runtime_error( "failed to remove context");
+	transferContext( hnd.handler, "t", "g", "var", "G");
+	transferContext( hnd.handler, "t", "h", "var", "H");
+	checkEqual( evictlog.tostring(), "t/b t/a t/d t/f", "contexts evicted after a context removed");
+	std::size_t expected_memsize = contextMemsize( hnd.handler, "t", "c") + contextMemsize( hnd.handler, "t", "g") + contextMemsize( hnd.handler, "t", "h");
+	if (papuga_RequestHandler_total_context_memsize( hnd.handler) != expected_memsize)
+	{
+		throw std::runtime_error( "total memory of contexts differs from the sum of the contexts left");
+	}
+}
+
+/// \brief Evict the contexts inherited least recently when the memory used by contexts exceeds the limit, many contexts
+static void testEvictMemoryLimit()
+{
+	RequestHandlerScope hnd( 4);
+	transferContext( hnd.handler, "t", "probe", "var", "value");
+	std::size_t ctxmemsize = contextMemsize( hnd.handler, "t", "probe");
+	papuga_ErrorCode errcode = papuga_Ok;
+	if (!papuga_RequestHandler_remove_context( hnd.handler, "t", "probe", &errcode)) throw std::runtime_error( "failed to remove context");
+	if (papuga_RequestHandler_total_context_memsize( hnd.handler) != 0) throw std::runtime_error( "memory of contexts left after removing all");
+
+	enum {NofContexts=2000,MaxNofContextsKept=100};
+	EvictLog evictlog;
+	papuga_RequestHandler_set_context_limits( hnd.handler, 0/*maxnofcontexts*/, MaxNofContextsKept * ctxmemsize, &EvictLog::evict, &evictlog);
+	int ci = 0;
+	for (; ci < NofContexts; ++ci)
+	{
+		transferContext( hnd.handler, "t", contextName( ci).c_str(), "var", "value");
+		// ... keep the first context alive by inheriting it
+		inheritedValue( hnd.handler, "t", contextName( 0).c_str(), "var");
+	}
+	if (papuga_RequestHandler_total_context_memsize( hnd.handler) > MaxNofContextsKept * ctxmemsize)
+	{
+		throw std::runtime_error( "memory limit of contexts exceeded");
+	}
+	if (evictlog.names.size() != NofContexts - MaxNofContextsKept)
+	{
+		throw papuga::runtime_error( "number of contexts evicted %d, expected %d", (int)evictlog.names.size(), (int)(NofContexts - MaxNofContextsKept));
+	}
+	// ... contexts are evicted in the order of their transfer, except the first one inherited after every transfer
+	for (ci = 1; ci <= NofContexts - MaxNofContextsKept; ++ci)
+	{
+		checkEqual( evictlog.names[ ci-1], "t/" + contextName( ci), "context evicted");
+	}
+	if (!hasContext( hnd.handler, "t", contextName( 0).c_str())) throw std::runtime_error( "context inherited recently has been evicted");
+}
+
+/// \brief Names of schemas colliding with the type "t" and of methods colliding with the class 1 in the hash values of the index of the request handler
+static const char* g_collidingSchemaNames[2][2] = {{"n85889","n130082"},{"n85888","n130083"}};
+static const char* g_collidingMethodNames[2][2] = {{"n918208","n1302244"},{"n918209","n1302245"}};
+
+/// \brief Look up schemas in the hash index of the request handler, with colliding hash values, names replaced and names not defined, compared with a map
+static void testSchemaIndex()
+{
+	RequestHandlerScope hnd;
+	typedef std::pair<std::string,std::string> SchemaKey;
+	std::map<SchemaKey,const papuga_RequestAutomaton*> expected;
+	// ... the automata are used as tags only, the handler does not access them
+	std::vector<char> tags( 1024);
+	int tagidx = 0;
+	std::vector<SchemaKey> schemas;
+	enum {NofSchemas=600};
+	for (int si = 0; si < NofSchemas; ++si) schemas.push_back( SchemaKey( "t", contextName( si)));
+	schemas.push_back( SchemaKey( "t", g_collidingSchemaNames[0][0]));
+	schemas.push_back( SchemaKey( "t", g_collidingSchemaNames[0][1]));
+	schemas.push_back( SchemaKey( "t", g_collidingSchemaNames[1][0]));
+	// ... the separator of type and name in the hash value
+	schemas.push_back( SchemaKey( "ab", "c"));
+	schemas.push_back( SchemaKey( "a", "bc"));
+	schemas.push_back( SchemaKey( "", contextName( 1)));
+	// ... replacing schemas defined before
+	schemas.push_back( SchemaKey( "t", g_collidingSchemaNames[0][1]));
+	schemas.push_back( SchemaKey( "t", contextName( 7)));
+
+	std::vector<SchemaKey>::const_iterator si = schemas.begin(), se = schemas.end();
+	for (; si != se; ++si)
+	{
+		const papuga_RequestAutomaton* tag = reinterpret_cast<const papuga_RequestAutomaton*>( &tags[ tagidx++]);
+		if (!papuga_RequestHandler_add_schema( hnd.handler, si->first.c_str(), si->second.c_str(), tag, NULL/*description*/)) throw std::bad_alloc();
+		expected[ *si] = tag;
+	}
+	std::vector<SchemaKey> queries( schemas);
+	for (int qi = NofSchemas; qi < 2*NofSchemas; ++qi) queries.push_back( SchemaKey( "t", contextName( qi)));
+	queries.push_back( SchemaKey( "t", g_collidingSchemaNames[1][1]));
+	queries.push_back( SchemaKey( "a", "b"));
+	queries.push_back( SchemaKey( "abc", ""));
+	queries.push_back( SchemaKey( "", contextName( 2)));
+	std::vector<SchemaKey>::const_iterator qi = queries.begin(), qe = queries.end();
+	for (; qi != qe; ++qi)
+	{
+		std::map<SchemaKey,const papuga_RequestAutomaton*>::const_iterator ei = expected.find( *qi);
+		const papuga_RequestAutomaton* expected_atm = ei == expected.end() ? NULL : ei->second;
+		if (papuga_RequestHandler_get_automaton( hnd.handler, qi->first.c_str(), qi->second.c_str()) != expected_atm)
+		{
+			throw papuga::runtime_error( "schema %s/%s %s", qi->first.c_str(), qi->second.c_str(), expected_atm ? "not found or not the one defined last" : "found but not defined");
+		}
+	}
+	if (papuga_RequestHandler_get_automaton( hnd.handler, NULL, contextName( 1).c_str()) != expected[ SchemaKey( "", contextName( 1))])
+	{
+		throw std::runtime_error( "schema without type not found");
+	}
+}
+
+/// \brief Look up methods in the hash index of the request handler, with colliding hash values, names replaced and names not defined, compared with a map
+static void testMethodIndex()
+{
+	RequestHandlerScope hnd;
+	typedef std::pair<std::string,bool> MethodKey;
+	std::map<MethodKey,int> expected;
+	static int noparams[] = {0};
+	std::vector<MethodKey> methods;
+	enum {NofMethods=300};
+	for (int mi = 0; mi < NofMethods; ++mi)
+	{
+		// ... a method with and without content have the same hash value
+		methods.push_back( MethodKey( contextName( mi), true));
+		methods.push_back( MethodKey( contextName( mi), false));
+	}
+	methods.push_back( MethodKey( g_collidingMethodNames[0][0], true));
+	methods.push_back( MethodKey( g_collidingMethodNames[0][1], true));
+	methods.push_back( MethodKey( g_collidingMethodNames[1][0], true));
+	// ... replacing methods defined before
+	methods.push_back( MethodKey( g_collidingMethodNames[0][0], true));
+	methods.push_back( MethodKey( contextName( 5), false));
+
+	int functionid = 0;
+	std::vector<MethodKey>::const_iterator mi = methods.begin(), me = methods.end();
+	for (; mi != me; ++mi)
+	{
+		papuga_RequestMethodDescription descr;
+		std::memset( &descr, 0, sizeof(descr));
+		descr.id.classid = CounterClassId;
+		descr.id.functionid = ++functionid;
+		descr.paramtypes = noparams;
+		descr.has_content = mi->second;
+		if (!papuga_RequestHandler_add_method( hnd.handler, mi->first.c_str(), &descr)) throw std::bad_alloc();
+		expected[ *mi] = functionid;
+	}
+	std::vector<MethodKey> queries( methods);
+	for (int qi = NofMethods; qi < 2*NofMethods; ++qi) queries.push_back( MethodKey( contextName( qi), qi % 2 == 0));
+	queries.push_back( MethodKey( g_collidingMethodNames[0][0], false));
+	queries.push_back( MethodKey( g_collidingMethodNames[1][1], true));
+	std::vector<MethodKey>::const_iterator qi = queries.begin(), qe = queries.end();
+	for (; qi != qe; ++qi)
+	{
+		std::map<MethodKey,int>::const_iterator ei = expected.find( *qi);
+		int expected_functionid = ei == expected.end() ? 0 : ei->second;
+		const papuga_RequestMethodDescription* descr = papuga_RequestHandler_get_method( hnd.handler, CounterClassId, qi->first.c_str(), qi->second);
+		if ((descr ? descr->id.functionid : 0) != expected_functionid)
+		{
+			throw papuga::runtime_error( "method %s %s content %s", qi->first.c_str(), qi->second ? "with" : "without", expected_functionid ? "not found or not the one defined last" : "found but not defined");
+		}
+	}
+	if (papuga_RequestHandler_get_method( hnd.handler, CounterClassId+1, contextName( 0).c_str(), true))
+	{
+		throw std::runtime_error( "method of a class not defined found");
+	}
+}
+
+static std::string variableName( const char* prefix, int idx)
+{
+	char buf[ 64];
+	std::snprintf( buf, sizeof(buf), "%s%d", prefix, idx);
+	return std::string( buf);
+}
+
+static void checkVariables( const papuga_RequestContext* context, const std::map<std::string,std::string>& expected, const std::vector<std::string>& undefined, const char* what)
+{
+	std::map<std::string,std::string>::const_iterator ei = expected.begin(), ee = expected.end();
+	for (; ei != ee; ++ei)
+	{
+		if (!papuga_RequestContext_get_variable( context, ei->first.c_str()))
+		{
+			throw papuga::runtime_error( "%s: variable %s not found", what, ei->first.c_str());
+		}
+		checkEqual( variableValue( context, ei->first.c_str()), ei->second, what);
+	}
+	std::vector<std::string>::const_iterator ui = undefined.begin(), ue = undefined.end();
+	for (; ui != ue; ++ui)
+	{
+		if (papuga_RequestContext_get_variable( context, ui->c_str()))
+		{
+			throw papuga::runtime_error( "%s: variable %s found but not defined", what, ui->c_str());
+		}
+	}
+}
+
+/// \brief Define and redefine variables of a context one by one, the lookup switches from a linear search to a hash index when the context gets bigger
+static void testVariableIndexGrowth()
+{
+	enum {MaxNofVariables=80};
+	RequestContextScope ctx;
+	std::map<std::string,std::string> expected;
+	for (int vi = 1; vi <= MaxNofVariables; ++vi)
+	{
+		std::string name = variableName( "v", vi);
+		defineVariable( ctx.context, name.c_str(), name.c_str());
+		expected[ name] = name;
+		// ... redefine a variable defined before
+		std::string redefined = variableName( "v", (vi+1)/2);
+		std::string value = variableName( "r", vi);
+		defineVariable( ctx.context, redefined.c_str(), value.c_str());
+		expected[ redefined] = value;
+
+		std::vector<std::string> undefined;
+		for (int ui = vi+1; ui <= vi+8; ++ui) undefined.push_back( variableName( "v", ui));
+		undefined.push_back( "v");
+		undefined.push_back( variableName( "v", 0));
+		checkVariables( ctx.context, expected, undefined, "variables of context growing");
+
+		char const* buf[ MaxNofVariables+1];
+		const char** names = papuga_RequestContext_list_variables( ctx.context, -1/*max_inheritcnt*/, buf, MaxNofVariables+1);
+		int nofnames = 0;
+		if (names) while (names[ nofnames]) ++nofnames;
+		if (nofnames != vi) throw papuga::runtime_error( "%d variables listed in a context with %d variables", nofnames, vi);
+	}
+}
+
+/// \brief Transfer contexts with local variables removed on transfer, the number of variables left is below or above the size for a hash index
+static void testVariableIndexShrink()
+{
+	RequestHandlerScope hnd;
+	static const int nofglobals[] = {3, 7, 8, 12};
+	for (std::size_t gi = 0; gi < sizeof(nofglobals)/sizeof(nofglobals[0]); ++gi)
+	{
+		for (int noflocals = 0; noflocals <= 12; ++noflocals)
+		{
+			RequestContextScope ctx;
+			std::map<std::string,std::string> expected;
+			std::vector<std::string> undefined;
+			// ... local and global variables interleaved, so that the variables left are moved when the local ones are removed
+			for (int vi = 0; vi < nofglobals[ gi] || vi < noflocals; ++vi)
+			{
+				if (vi < noflocals)
+				{
+					std::string localname = variableName( "_l", vi);
+					defineVariable( ctx.context, localname.c_str(), "local");
+					undefined.push_back( localname);
+				}
+				if (vi < nofglobals[ gi])
+				{
+					std::string name = variableName( "g", vi);
+					defineVariable( ctx.context, name.c_str(), name.c_str());
+					expected[ name] = name;
+				}
+			}
+			undefined.push_back( variableName( "g", nofglobals[ gi]));
+			std::string ctxname = variableName( "c", gi * 100 + noflocals);
+			papuga_ErrorCode errcode = papuga_Ok;
+			if (!papuga_RequestHandler_transfer_context( hnd.handler, "t", ctxname.c_str(), ctx.context, &errcode))
+			{
+				throw papuga::runtime_error( "failed to transfer context: %s", papuga_ErrorCode_tostring( errcode));
+			}
+			ctx.release();
+
+			RequestContextScope inherited;
+			inheritContext( inherited.context, hnd.handler, "t", ctxname.c_str());
+			checkVariables( inherited.context, expected, undefined, "variables of context inherited after removing local variables");
+		}
+	}
+}
+
+struct RequestContextPoolScope
+{
+	papuga_RequestContextPool* pool;
+
+	explicit RequestContextPoolScope( int maxsize)
+		:pool(papuga_create_RequestContextPool( maxsize))
+	{
+		if (!pool) throw std::bad_alloc();
+	}
+	~RequestContextPoolScope()
+	{
+		papuga_destroy_RequestContextPool( pool);
+	}
+};
+
+static papuga_RequestContext* acquireContext( papuga_RequestContextPool* pool)
+{
+	papuga_RequestContext* rt = papuga_RequestContextPool_acquire( pool);
+	if (!rt) throw std::bad_alloc();
+	return rt;
+}
+
+/// \brief Reuse contexts released to a pool, a context acquired again must be in the state of a context created, the contexts it inherited must not be affected
+static void testContextPoolReuse()
+{
+	RequestHandlerScope hnd;
+	transferContext( hnd.handler, "t", "parent", "pvar", "parent");
+	RequestContextPoolScope pl( 2);
+	std::map<std::string,std::string> expected;
+	std::vector<std::string> undefined;
+	undefined.push_back( "pvar");
+
+	papuga_RequestContext* context = acquireContext( pl.pool);
+	for (int round = 0; round < 4; ++round)
+	{
+		// ... define more variables than in the round before, so that the variables recycled are reused and new ones are created
+		expected.clear();
+		for (int vi = 0; vi < 6 + round * 4; ++vi)
+		{
+			std::string name = variableName( "v", vi);
+			std::string value = variableName( "r", round * 100 + vi);
+			defineVariable( context, name.c_str(), value.c_str());
+			expected[ name] = value;
+		}
+		inheritContext( context, hnd.handler, "t", "parent");
+		expected[ "pvar"] = "parent";
+		checkVariables( context, expected, std::vector<std::string>(), "variables of context acquired from pool");
+		// ... set the last error of the context, it has to be cleared on release
+		if (papuga_RequestContext_inherit( context, hnd.handler, "t", "undefined")) throw std::runtime_error( "undefined context inherited");
+
+		papuga_RequestContextPool_release( pl.pool, context);
+		papuga_RequestContext* reused = acquireContext( pl.pool);
+		if (reused != context) throw std::runtime_error( "context released not reused");
+		if (papuga_RequestContext_last_error( reused, false) != papuga_Ok) throw std::runtime_error( "error of context released not cleared");
+		std::map<std::string,std::string>::const_iterator ei = expected.begin(), ee = expected.end();
+		for (; ei != ee; ++ei) undefined.push_back( ei->first);
+		checkVariables( reused, std::map<std::string,std::string>(), undefined, "variables of context reused");
+		char const* buf[ 2];
+		const char** names = papuga_RequestContext_list_variables( reused, -1/*max_inheritcnt*/, buf, 2);
+		if (!names || names[0]) throw std::runtime_error( "variables listed in context reused");
+	}
+	// ... the context inherited is not affected by the contexts released
+	checkEqual( inheritedValue( hnd.handler, "t", "parent", "pvar"), "parent", "value of context inherited by contexts released");
+
+	// ... contexts released to a full pool are destroyed
+	papuga_RequestContext* other1 = acquireContext( pl.pool);
+	papuga_RequestContext* other2 = acquireContext( pl.pool);
+	papuga_RequestContextPool_release( pl.pool, context);
+	papuga_RequestContextPool_release( pl.pool, other1);
+	papuga_RequestContextPool_release( pl.pool, other2);
+	if (acquireContext( pl.pool) != other1 || acquireContext( pl.pool) != context)
+	{
+		throw std::runtime_error( "contexts not reused in the order of release");
+	}
+	papuga_destroy_RequestContext( other1);
+	papuga_destroy_RequestContext( context);
+}
+
+/// \brief Errors reported by the threads of a test, the first error is rethrown after joining the threads
+class ThreadErrors
+{
+public:
+	ThreadErrors() :m_mutex(),m_errors(){}
+
+	void report( const std::string& msg)
+	{
+		std::lock_guard<std::mutex> lock( m_mutex);
+		m_errors.push_back( msg);
+	}
+	void check() const
+	{
+		if (!m_errors.empty()) throw std::runtime_error( m_errors[0]);
+	}
+
+private:
+	std::mutex m_mutex;
+	std::vector<std::string> m_errors;
+};
+
+enum {ConcurrentNofWriters=2,ConcurrentNofReaders=4,ConcurrentNofNames=8,ConcurrentNofUpdates=2000};
+
+static std::string concurrentContextName( int writer, int ni)
+{
+	char buf[ 64];
+	std::snprintf( buf, sizeof(buf), "w%d_%d", writer, ni);
+	return std::string( buf);
+}
+
+/// \brief Value of a context written by a writer thread, the name of the context and a version incremented with every update
+static std::string concurrentContextValue( const std::string& name, int version)
+{
+	char buf[ 64];
+	std::snprintf( buf, sizeof(buf), "%s:%d", name.c_str(), version);
+	return std::string( buf);
+}
+
+/// \brief Writer thread transferring and removing the contexts it owns
+/// \note The state of the contexts after the writer has finished is returned in 'lastversion', -1 for a context removed
+static void concurrentWriter( papuga_RequestHandler* handler, int writer, std::vector<int>* lastversion, ThreadErrors* errors)
+{
+	try
+	{
+		for (int ui = 0; ui < ConcurrentNofUpdates; ++ui)
+		{
+			int ni = (ui * 7 + writer) % ConcurrentNofNames;
+			std::string name = concurrentContextName( writer, ni);
+			if (ui % 5 == 4)
+			{
+				papuga_ErrorCode errcode = papuga_Ok;
+				(void)papuga_RequestHandler_remove_context( handler, "t", name.c_str(), &errcode);
+				(*lastversion)[ ni] = -1;
+			}
+			else
+			{
+				transferContext( handler, "t", name.c_str(), "var", concurrentContextValue( name, ui).c_str());
+				(*lastversion)[ ni] = ui;
+			}
+		}
+	}
+	catch (const std::exception& err)
+	{
+		errors->report( err.what());
+	}
+}
+
+/// \brief Reader thread inheriting the contexts of all writers, the contexts are updated or removed while they are read
+/// \note A context inherited must be complete and never older than the one inherited before
+static void concurrentReader( const papuga_RequestHandler* handler, const std::atomic<bool>* stop, ThreadErrors* errors)
+{
+	try
+	{
+		std::vector<int> seenversion( ConcurrentNofWriters * ConcurrentNofNames, -1);
+		int ri = 0;
+		while (!stop->load())
+		{
+			int writer = ri % ConcurrentNofWriters;
+			int ni = (ri / ConcurrentNofWriters) % ConcurrentNofNames;
+			++ri;
+			std::string name = concurrentContextName( writer, ni);
+			RequestContextScope ctx;
+			if (!papuga_RequestContext_inherit( ctx.context, handler, "t", name.c_str())) continue;
+			std::string value = variableValue( ctx.context, "var");
+			int version = -1;
+			std::size_t sep = value.find( ':');
+			if (sep == std::string::npos || value.substr( 0, sep) != name || std::sscanf( value.c_str() + sep + 1, "%d", &version) != 1)
+			{
+				throw papuga::runtime_error( "inherited context %s with value '%s'", name.c_str(), value.c_str());
+			}
+			int& seen = seenversion[ writer * ConcurrentNofNames + ni];
+			if (version < seen)
+			{
+				throw papuga::runtime_error( "inherited context %s with version %d older than the one seen before (%d)", name.c_str(), version, seen);
+			}
+			seen = version;
+		}
+	}
+	catch (const std::exception& err)
+	{
+		errors->report( err.what());
+	}
+}
+
+/// \brief Transfer and remove contexts in several threads while other threads inherit them
+static void testConcurrentTransferRemove()
+{
+	RequestHandlerScope hnd( 3);
+	ThreadErrors errors;
+	std::atomic<bool> stop( false);
+	std::vector<std::vector<int> > lastversion( ConcurrentNofWriters, std::vector<int>( ConcurrentNofNames, -1));
+	std::vector<std::thread> readers;
+	std::vector<std::thread> writers;
+	try
+	{
+		for (int ri = 0; ri < ConcurrentNofReaders; ++ri)
+		{
+			readers.push_back( std::thread( &concurrentReader, hnd.handler, &stop, &errors));
+		}
+		for (int wi = 0; wi < ConcurrentNofWriters; ++wi)
+		{
+			writers.push_back( std::thread( &concurrentWriter, hnd.handler, wi, &lastversion[ wi], &errors));
+		}
+	}
+	catch (...)
+	{
+		errors.report( "failed to start threads");
+	}
+	std::vector<std::thread>::iterator ti = writers.begin(), te = writers.end();
+	for (; ti != te; ++ti) ti->join();
+	stop.store( true);
+	for (ti = readers.begin(), te = readers.end(); ti != te; ++ti) ti->join();
+	errors.check();
+
+	// ... the contexts left are the ones of the last update of each writer
+	for (int wi = 0; wi < ConcurrentNofWriters; ++wi)
+	{
+		for (int ni = 0; ni < ConcurrentNofNames; ++ni)
+		{
+			std::string name = concurrentContextName( wi, ni);
+			if (lastversion[ wi][ ni] < 0)
+			{
+				if (hasContext( hnd.handler, "t", name.c_str())) throw papuga::runtime_error( "context %s removed still found", name.c_str());
+			}
+			else
+			{
+				checkEqual( inheritedValue( hnd.handler, "t", name.c_str(), "var"), concurrentContextValue( name, lastversion[ wi][ ni]), "value of context after concurrent updates");
+			}
+		}
+	}
+}
+
+struct TestDef
+{
+	const char* title;
+	void (*run)();
+};
+
+static const TestDef g_tests[] = {
+	{"replace context", &testReplaceContext},
+	{"inherit duplicates", &testInheritDuplicates},
+	{"save and load contexts", &testSaveLoadContexts},
+	{"load corrupt contexts", &testLoadCorruptContexts},
+	{"evict least recently used", &testEvictLeastRecentlyUsed},
+	{"evict by memory limit", &testEvictMemoryLimit},
+	{"concurrent transfer and remove", &testConcurrentTransferRemove},
+	{"schema index", &testSchemaIndex},
+	{"method index", &testMethodIndex},
+	{"variable index growth", &testVariableIndexGrowth},
+	{"variable index shrink", &testVariableIndexShrink},
+	{"context pool reuse", &testContextPoolReuse},
+	{0,0}
+};
+
+int main( int argc, const char* argv[])
+{
+	if (argc > 1 && (std::strcmp( argv[1], "-h") == 0 || std::strcmp( argv[1], "--help") == 0))
+	{
+		std::cerr << "testRequestHandler" << std::endl;
+		return 0;
+	}
+	try
+	{
+		int ti = 0;
+		for (; g_tests[ ti].title; ++ti)
+		{
+			g_tests[ ti].run();
+			std::cerr << (ti+1) << ") " << g_tests[ ti].title << std::endl;
+		}
+		std::cerr << "OK" << std::endl;
+		return 0;
+	}
+	catch (const std::runtime_error& err)
+	{
+		std::cerr << "ERROR " << err.what() << std::endl;
+		return -1;
+	}
+	catch (const std::bad_alloc& )
+	{
+		std::cerr << "ERROR out of memory" << std::endl;
+		return -2;
+	}
+}
+
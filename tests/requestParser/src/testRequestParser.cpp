@@ -68,6 +68,17 @@ int main( int argc, const char* argv[])
 		{
 			throw papuga::runtime_error( "%s root element not as expected: parsed '%s' expected '%s'", doctype.c_str(), root, expected_root.c_str());
 		}
+		papuga_ContentHeader hdr;
+		papuga_guess_ContentHeader( &hdr, input.c_str(), input.size());
+		if (hdr.doctype != papuga_guess_ContentType( input.c_str(), input.size())
+		||  hdr.encoding != papuga_guess_StringEncoding( input.c_str(), input.size()))
+		{
+			throw papuga::runtime_error( "%s content header guessed differs from content type and encoding guessed", doctype.c_str());
+		}
+		if (!hdr.root || expected_root != hdr.root)
+		{
+			throw papuga::runtime_error( "%s content header root element not as expected: parsed '%s' expected '%s'", doctype.c_str(), hdr.root ? hdr.root : "", expected_root.c_str());
+		}
 		std::cerr << "OK" << std::endl;
 		return 0;
 	}
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2019 Patrick P. Frey
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/// \brief Tests of the request parsers on documents defined in the test
+#include "papuga/requestParser.h"
+#include "papuga/request.h"
+#include "papuga/allocator.h"
+#include "papuga/encoding.h"
+#include "papuga/errors.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <new>
+
+/// \brief Result of parsing a document to the end
+struct ParseResult
+{
+	papuga_ErrorCode errcode;
+	int nofevents;
+
+	ParseResult() :errcode(papuga_Ok),nofevents(0){}
+};
+
+static ParseResult parseDocument( papuga_ContentType doctype, const std::string& content, const papuga_ContentLimits* limits)
+{
+	ParseResult rt;
+	papuga_Allocator allocator;
+	int allocatormem[ 1024];
+	papuga_init_Allocator( &allocator, allocatormem, sizeof(allocatormem));
+	papuga_RequestParser* parser = papuga_create_RequestParser_limits( &allocator, doctype, papuga_UTF8, content.c_str(), content.size(), limits, &rt.errcode);
+	if (!parser)
+	{
+		papuga_destroy_Allocator( &allocator);
+		throw papuga::runtime_error( "failed to create %s parser: %s", papuga_ContentType_name( doctype), papuga_ErrorCode_tostring( rt.errcode));
+	}
+	papuga_RequestParserEvent events[ 16];
+	int nofevents;
+	while (0 < (nofevents = papuga_RequestParser_next_events( parser, events, 16)))
+	{
+		rt.nofevents += nofevents;
+	}
+	rt.errcode = papuga_RequestParser_last_error( parser);
+	papuga_destroy_RequestParser( parser);
+	papuga_destroy_Allocator( &allocator);
+	return rt;
+}
+
+static void checkParseResult( papuga_ContentType doctype, const std::string& content, int maxdepth, int maxnofelements, size_t maxmemsize, papuga_ErrorCode expected)
+{
+	papuga_ContentLimits limits;
+	papuga_init_ContentLimits( &limits, maxdepth, maxnofelements, maxmemsize);
+	ParseResult result = parseDocument( doctype, content, &limits);
+	if (result.errcode != expected)
+	{
+		throw papuga::runtime_error( "%s document '%.64s' with limits depth %d, elements %d, memory %d: got '%s', expected '%s'",
+						papuga_ContentType_name( doctype), content.c_str(), maxdepth, maxnofelements, (int)maxmemsize,
+						papuga_ErrorCode_tostring( result.errcode), papuga_ErrorCode_tostring( expected));
+	}
+}
+
+/// \brief Document with the same structure in XML and JSON
+struct DocumentDef
+{
+	const char* xml;
+	const char* json;
+	int depth;		//< nesting depth of the elements, the root element at depth 1
+};
+
+static const DocumentDef g_documents[] = {
+	{"<doc>x</doc>", "{\"doc\":\"x\"}", 1},
+	{"<doc><a><b>x</b></a></doc>", "{\"doc\":{\"a\":{\"b\":\"x\"}}}", 3},
+	{"<doc><a>x</a><a>y</a></doc>", "{\"doc\":{\"a\":[\"x\",\"y\"]}}", 2},
+	{"<doc id=\"1\"><a>x</a></doc>", "{\"doc\":{\"-id\":\"1\",\"a\":\"x\"}}", 2},
+	{"<doc><a><b/></a><c>x</c></doc>", "{\"doc\":{\"a\":{\"b\":null},\"c\":\"x\"}}", 3},
+	{0,0,0}
+};
+
+static std::string deepDocument( papuga_ContentType doctype, int depth)
+{
+	std::string rt;
+	int di = 0;
+	for (; di < depth; ++di) rt.append( doctype == papuga_ContentType_XML ? "<e>" : "{\"e\":");
+	rt.append( doctype == papuga_ContentType_XML ? "x" : "\"x\"");
+	for (di = 0; di < depth; ++di) rt.append( doctype == papuga_ContentType_XML ? "</e>" : "}");
+	return rt;
+}
+
+static const papuga_ContentType g_doctypes[] = {papuga_ContentType_XML, papuga_ContentType_JSON, papuga_ContentType_Unknown};
+
+/// \brief The depth of a document is the nesting depth of its elements, with the root element at depth 1, in XML and JSON
+static void testMaxDepth()
+{
+	DocumentDef const* di = g_documents;
+	for (; di->xml; ++di)
+	{
+		papuga_ContentType const* ti = g_doctypes;
+		for (; *ti != papuga_ContentType_Unknown; ++ti)
+		{
+			std::string content = (*ti == papuga_ContentType_XML) ? di->xml : di->json;
+			checkParseResult( *ti, content, di->depth, 0, 0, papuga_Ok);
+			if (di->depth > 1) checkParseResult( *ti, content, di->depth-1, 0, 0, papuga_MaxRecursionDepthReached);
+			checkParseResult( *ti, content, 0/*unlimited*/, 0, 0, papuga_Ok);
+		}
+	}
+	enum {DeepDocumentDepth = 300};
+	papuga_ContentType const* ti = g_doctypes;
+	for (; *ti != papuga_ContentType_Unknown; ++ti)
+	{
+		std::string content = deepDocument( *ti, DeepDocumentDepth);
+		checkParseResult( *ti, content, 0/*unlimited*/, 0, 0, papuga_Ok);
+		checkParseResult( *ti, content, DeepDocumentDepth, 0, 0, papuga_Ok);
+		checkParseResult( *ti, content, DeepDocumentDepth-1, 0, 0, papuga_MaxRecursionDepthReached);
+		ParseResult result = parseDocument( *ti, content, NULL/*default limits*/);
+		if (result.errcode != papuga_MaxRecursionDepthReached)
+		{
+			throw papuga::runtime_error( "%s document deeper than the default limit: got '%s'", papuga_ContentType_name( *ti), papuga_ErrorCode_tostring( result.errcode));
+		}
+	}
+}
+
+/// \brief Every element (tag, attribute and value) is counted
+static void testMaxNofElements()
+{
+	DocumentDef const* di = g_documents;
+	for (; di->xml; ++di)
+	{
+		papuga_ContentType const* ti = g_doctypes;
+		for (; *ti != papuga_ContentType_Unknown; ++ti)
+		{
+			std::string content = (*ti == papuga_ContentType_XML) ? di->xml : di->json;
+			ParseResult result = parseDocument( *ti, content, NULL/*default limits*/);
+			if (result.errcode != papuga_Ok) throw papuga::runtime_error( "failed to parse %s document '%s': %s", papuga_ContentType_name( *ti), content.c_str(), papuga_ErrorCode_tostring( result.errcode));
+			checkParseResult( *ti, content, 0, result.nofevents, 0, papuga_Ok);
+			checkParseResult( *ti, content, 0, result.nofevents-1, 0, papuga_ComplexityOfProblem);
+		}
+	}
+}
+
+/// \brief The memory accounted includes the content, a content exceeding the limit is refused
+static void testMaxMemSize()
+{
+	DocumentDef const* di = g_documents;
+	for (; di->xml; ++di)
+	{
+		papuga_ContentType const* ti = g_doctypes;
+		for (; *ti != papuga_ContentType_Unknown; ++ti)
+		{
+			std::string content = (*ti == papuga_ContentType_XML) ? di->xml : di->json;
+			checkParseResult( *ti, content, 0, 0, 1<<20, papuga_Ok);
+			checkParseResult( *ti, content, 0, 0, content.size()-1, papuga_ComplexityOfProblem);
+		}
+	}
+}
+
+/// \brief Content with the properties expected to be guessed from it
+struct ContentHeaderDef
+{
+	const char* content;
+	size_t contentsize;
+	papuga_ContentType doctype;
+	papuga_StringEncoding encoding;
+	size_t bomsize;
+	const char* root;
+};
+
+#define CONTENT(STR)	STR, sizeof(STR)-1
+static const ContentHeaderDef g_contentHeaders[] = {
+	{CONTENT("<doc>x</doc>"), papuga_ContentType_XML, papuga_UTF8, 0, "doc"},
+	{CONTENT("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<doc>x</doc>"), papuga_ContentType_XML, papuga_UTF8, 0, "doc"},
+	{CONTENT("<?xml version=\"1.0\" encoding=\"UTF-16LE\"?><doc>x</doc>"), papuga_ContentType_XML, papuga_UTF16LE, 0, "doc"},
+	{CONTENT("<?xml version=\"1.0\"?>\n<doc a=\"1\">x</doc>"), papuga_ContentType_XML, papuga_UTF8, 0, "doc a=\"1\""},
+	{CONTENT("\xEF\xBB\xBF<?xml version=\"1.0\"?><doc>x</doc>"), papuga_ContentType_XML, papuga_UTF8, 3, "doc"},
+	{CONTENT("\xFF\xFE<\0d\0o\0c\0>\0x\0<\0/\0d\0o\0c\0>\0"), papuga_ContentType_XML, papuga_UTF16LE, 2, "doc"},
+	{CONTENT("<\0?\0x\0m\0l\0?\0>\0<\0d\0o\0c\0>\0x\0<\0/\0d\0o\0c\0>\0"), papuga_ContentType_XML, papuga_UTF16LE, 0, "doc"},
+	{CONTENT("\0<\0d\0o\0c\0>\0x\0<\0/\0d\0o\0c\0>"), papuga_ContentType_XML, papuga_UTF16BE, 0, "doc"},
+	{CONTENT("{\"doc\":\"x\"}"), papuga_ContentType_JSON, papuga_UTF8, 0, "doc"},
+	{CONTENT("\xEF\xBB\xBF \n{\"doc\":{\"a\":1}}"), papuga_ContentType_JSON, papuga_UTF8, 3, "doc"},
+	{CONTENT("{\0\"\0d\0o\0c\0\"\0:\0\"\0x\0\"\0}\0"), papuga_ContentType_JSON, papuga_UTF16LE, 0, "doc"},
+	{CONTENT("doc x"), papuga_ContentType_Unknown, papuga_UTF8, 0, NULL},
+	{0,0,papuga_ContentType_Unknown,papuga_Binary,0,0}
+};
+
+/// \brief The properties of a content guessed at once are the expected ones and agree with the ones guessed separately
+static void testContentHeader()
+{
+	ContentHeaderDef const* di = g_contentHeaders;
+	for (int didx=0; di->content; ++di,++didx)
+	{
+		papuga_ContentHeader hdr;
+		papuga_guess_ContentHeader( &hdr, di->content, di->contentsize);
+		if (hdr.doctype != di->doctype || hdr.encoding != di->encoding || hdr.bomsize != di->bomsize)
+		{
+			throw papuga::runtime_error( "content header %d: got %s %s BOM %d, expected %s %s BOM %d", didx,
+							papuga_ContentType_name( hdr.doctype), papuga_stringEncodingName( hdr.encoding), (int)hdr.bomsize,
+							papuga_ContentType_name( di->doctype), papuga_stringEncodingName( di->encoding), (int)di->bomsize);
+		}
+		if ((hdr.root == NULL) != (di->root == NULL) || (hdr.root && 0!=std::strcmp( hdr.root, di->root)))
+		{
+			throw papuga::runtime_error( "content header %d: got root '%s', expected '%s'", didx, hdr.root ? hdr.root : "", di->root ? di->root : "");
+		}
+		if (hdr.doctype != papuga_guess_ContentType( di->content, di->contentsize)
+		||  hdr.encoding != papuga_guess_StringEncoding( di->content, di->contentsize))
+		{
+			throw papuga::runtime_error( "content header %d guessed differs from content type and encoding guessed", didx);
+		}
+	}
+}
+
+/// \brief Document with many items, one of them with two names, rejected by a request accepting only one name per item
+static std::string documentWithDuplicateName( papuga_ContentType doctype, int nofitems, int badidx)
+{
+	std::ostringstream out;
+	out << (doctype == papuga_ContentType_XML ? "<doc>" : "{\"doc\":{\"item\":[");
+	for (int ii=0; ii<nofitems; ++ii)
+	{
+		if (doctype == papuga_ContentType_XML)
+		{
+			if (ii == badidx)
+			{
+				out << "<item><name>bad1</name><name>bad2</name></item>";
+			}
+			else
+			{
+				out << "<item><name>n" << ii << "</name></item>";
+			}
+		}
+		else
+		{
+			if (ii) out << ",";
+			if (ii == badidx)
+			{
+				out << "{\"name\":[\"bad1\",\"bad2\"]}";
+			}
+			else
+			{
+				out << "{\"name\":\"n" << ii << "\"}";
+			}
+		}
+	}
+	out << (doctype == papuga_ContentType_XML ? "</doc>" : "]}}");
+	return out.str();
+}
+
+/// \brief The position of an error reported by the request is the one of the element rejected, not the end of the batch it was fetched with
+static void testRequestErrorPosition()
+{
+	enum {ItemName=1, NofItems=40, BadItem=5};
+	static const papuga_ClassDef classdefs[] = {papuga_ClassDef_NULL};
+	static const papuga_StructInterfaceDescription structdefs[] = {{NULL/*name*/,NULL/*doc*/,NULL/*members*/}};
+	papuga_RequestAutomaton* atm = papuga_create_RequestAutomaton( classdefs, structdefs, true/*strict*/, false/*exclusive*/);
+	if (!atm) throw std::bad_alloc();
+	if (!papuga_RequestAutomaton_add_value( atm, "/doc/item", "name()", ItemName)
+	||  !papuga_RequestAutomaton_done( atm))
+	{
+		papuga_ErrorCode errcode = papuga_RequestAutomaton_last_error( atm);
+		papuga_destroy_RequestAutomaton( atm);
+		throw papuga::runtime_error( "failed to create request automaton: %s", papuga_ErrorCode_tostring( errcode));
+	}
+	papuga_ContentType const* ti = g_doctypes;
+	for (; *ti != papuga_ContentType_Unknown; ++ti)
+	{
+		std::string content = documentWithDuplicateName( *ti, NofItems, BadItem);
+		papuga_Allocator allocator;
+		int allocatormem[ 1024];
+		papuga_init_Allocator( &allocator, allocatormem, sizeof(allocatormem));
+		papuga_ErrorCode errcode = papuga_Ok;
+		papuga_RequestParser* parser = papuga_create_RequestParser( &allocator, *ti, papuga_UTF8, content.c_str(), content.size(), &errcode);
+		papuga_Request* request = parser ? papuga_create_Request( atm, NULL/*logger*/) : NULL;
+		if (!request)
+		{
+			if (parser) papuga_destroy_RequestParser( parser);
+			papuga_destroy_Allocator( &allocator);
+			papuga_destroy_RequestAutomaton( atm);
+			throw std::bad_alloc();
+		}
+		bool success = papuga_RequestParser_feed_request( parser, request, &errcode);
+		char locbuf[ 256];
+		locbuf[ 0] = 0;
+		int pos = papuga_RequestParser_get_position( parser, locbuf, sizeof(locbuf));
+		std::string location( locbuf);
+		papuga_destroy_Request( request);
+		papuga_destroy_RequestParser( parser);
+		papuga_destroy_Allocator( &allocator);
+
+		if (success || errcode != papuga_DuplicateDefinition)
+		{
+			papuga_destroy_RequestAutomaton( atm);
+			throw papuga::runtime_error( "%s request with duplicate name: got '%s', expected '%s'", papuga_ContentType_name( *ti), success ? "success" : papuga_ErrorCode_tostring( errcode), papuga_ErrorCode_tostring( papuga_DuplicateDefinition));
+		}
+		bool posCorrect;
+		if (*ti == papuga_ContentType_XML)
+		{
+			// ... the position is within the item rejected
+			int badstart = content.find( "<item><name>bad1");
+			int badend = content.find( "</item>", badstart) + std::strlen( "</item>");
+			posCorrect = pos >= badstart && pos <= badend && location.find( "!$!") != std::string::npos;
+		}
+		else
+		{
+			// ... the location marks the item rejected, it is rendered from the items around it
+			std::size_t markerpos = location.find( "<!>");
+			posCorrect = markerpos != std::string::npos && location.find( "bad2") < markerpos;
+		}
+		if (!posCorrect)
+		{
+			papuga_destroy_RequestAutomaton( atm);
+			throw papuga::runtime_error( "%s request error position %d does not refer to the element rejected: %s", papuga_ContentType_name( *ti), pos, location.c_str());
+		}
+	}
+	papuga_destroy_RequestAutomaton( atm);
+}
+
+struct TestDef
+{
+	const char* title;
+	void (*run)();
+};
+
+static const TestDef g_tests[] = {
+	{"maximum depth", &testMaxDepth},
+	{"maximum number of elements", &testMaxNofElements},
+	{"maximum memory size", &testMaxMemSize},
+	{"content header", &testContentHeader},
+	{"request error position", &testRequestErrorPosition},
+	{0,0}
+};
+
+int main( int argc, const char* argv[])
+{
+	if (argc > 1 && (std::strcmp( argv[1], "-h") == 0 || std::strcmp( argv[1], "--help") == 0))
+	{
+		std::cerr << "testRequestParserContent" << std::endl;
+		return 0;
+	}
+	try
+	{
+		int ti = 0;
+		for (; g_tests[ ti].title; ++ti)
+		{
+			g_tests[ ti].run();
+			std::cerr << (ti+1) << ") " << g_tests[ ti].title << std::endl;
+		}
+		std::cerr << "OK" << std::endl;
+		return 0;
+	}
+	catch (const std::runtime_error& err)
+	{
+		std::cerr << "ERROR " << err.what() << std::endl;
+		return -1;
+	}
+	catch (const std::bad_alloc& )
+	{
+		std::cerr << "ERROR out of memory" << std::endl;
+		return -2;
+	}
+}
+
@@ -11,6 +11,7 @@
 #include "papuga/serialization.h"
 #include "papuga/serialization.hpp"
 #include "papuga/requestParser.h"
+#include "papuga/fileContent.h"
 #include <iostream>
 #include <stdexcept>
 #include <iostream>
@@ -36,6 +37,33 @@ static std::string readFile( const std::string& path)
 	return rt;
 }
 
+/// \brief Input file mapped into memory (or read if not mappable), parsed without copying
+class FileContent
+{
+public:
+	explicit FileContent( const std::string& path)
+	{
+		papuga_ErrorCode errcode = papuga_Ok;
+		if (!papuga_init_FileContent( &m_content, path.c_str(), &errcode))
+		{
+			throw std::runtime_error( std::string("failed to read file '") + path + "': " + papuga_ErrorCode_tostring( errcode));
+		}
+	}
+	~FileContent()
+	{
+		papuga_destroy_FileContent( &m_content);
+	}
+	const char* ptr() const		{return m_content.ptr;}
+	size_t size() const		{return m_content.size;}
+
+private:
+	FileContent( const FileContent&);	//... non copyable
+	void operator=( const FileContent&);	//... non copyable
+
+private:
+	papuga_FileContent m_content;
+};
+
 class SchemaException
 	:public std::runtime_error
 {
@@ -132,7 +160,7 @@ public:
 		return rt;
 	}
 
-	std::string process( const std::string& schemaName, const std::string& src)
+	std::string process( const std::string& schemaName, const char* src, size_t srcsize)
 	{
 		std::string rt;
 		papuga_Schema const* schema = papuga_SchemaMap_get( m_map, schemaName.c_str());
@@ -145,10 +173,10 @@ public:
 		papuga_Serialization dest;
 		papuga_init_Serialization( &dest, &allocator);
 
-		papuga_ContentType doctype = papuga_guess_ContentType( src.c_str(), src.size());
-		papuga_StringEncoding encoding = papuga_guess_StringEncoding( src.c_str(), src.size());
+		papuga_ContentType doctype = papuga_guess_ContentType( src, srcsize);
+		papuga_StringEncoding encoding = papuga_guess_StringEncoding( src, srcsize);
 
-		if (!papuga_schema_parse( &dest, schema, doctype, encoding, src.c_str(), src.size(),  &err))
+		if (!papuga_schema_parse_borrowed( &dest, schema, doctype, encoding, src, srcsize, &err))
 		{
 			papuga_destroy_Allocator( &allocator);
 			throw SchemaException( err);
@@ -256,7 +284,7 @@ int main( int argc, const char* argv[])
 		std::string inputFile( argv[ argi+2]);
 		std::string expectFile( argv[ argi+3]);
 		std::string schemaSrc = readFile( schemaFile);
-		std::string inputSrc = readFile( inputFile);
+		FileContent inputSrc( inputFile);
 		std::string expectSrc = readFile( expectFile);
 		SchemaMap schemaMap( schemaSrc);
 		std::string dump = schemaMap.source( schemaName) + schemaMap.dump( schemaSrc, schemaName);
@@ -264,7 +292,7 @@ int main( int argc, const char* argv[])
 		{
 			std::cerr << "DUMP:\n" << dump << "\n--\n" << std::endl;
 		}
-		std::string output = schemaMap.process( schemaName, inputSrc);
+		std::string output = schemaMap.process( schemaName, inputSrc.ptr(), inputSrc.size());
 		if (normalizeOutput( output) != normalizeOutput( expectSrc))
 		{
 			if (g_verbose)